@@ -142,6 +142,10 @@ void define_enums(py::module &m) {
         .value("EmbedBitcode", Target::Feature::EmbedBitcode)
         .value("DisableLLVMLoopVectorize", Target::Feature::DisableLLVMLoopVectorize)
         .value("DisableLLVMLoopUnroll", Target::Feature::DisableLLVMLoopUnroll)
+        .value("ArenaAlloc", Target::Feature::ArenaAlloc)
+        .value("ProfileCounters", Target::Feature::ProfileCounters)
+        .value("ProfileTimeline", Target::Feature::ProfileTimeline)
+        .value("SlabAlloc", Target::Feature::SlabAlloc)
         .value("FeatureEnd", Target::Feature::FeatureEnd);
 
     py::enum_<halide_type_code_t>(m, "TypeCode")
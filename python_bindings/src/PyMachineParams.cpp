@@ -11,7 +11,10 @@ void define_machine_params(py::module &m) {
         .def_readwrite("parallelism", &MachineParams::parallelism)
         .def_readwrite("last_level_cache_size", &MachineParams::last_level_cache_size)
         .def_readwrite("balance", &MachineParams::balance)
+        .def_readwrite("l1_cache_size", &MachineParams::l1_cache_size)
+        .def_readwrite("l2_cache_size", &MachineParams::l2_cache_size)
         .def_static("generic", &MachineParams::generic)
+        .def_static("host", &MachineParams::host)
         .def("__str__", &MachineParams::to_string)
         .def("__repr__", [](const MachineParams &mp) -> std::string {
             std::ostringstream o;
@@ -0,0 +1,104 @@
+#include "ArenaAllocations.h"
+#include "CodeGen_Internal.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+class InjectArenaAllocations : public IRMutator {
+    using IRMutator::visit;
+
+    bool in_device_loop = false;
+
+    Stmt visit(const For *op) override {
+        // Allocations in device code can't call back into the host runtime.
+        ScopedValue<bool> old_in_device_loop(in_device_loop,
+                                             in_device_loop ||
+                                             (op->device_api != DeviceAPI::None &&
+                                              op->device_api != DeviceAPI::Host));
+        return IRMutator::visit(op);
+    }
+
+    bool should_use_arena(const Allocate *op) const {
+        if (in_device_loop ||
+            op->new_expr.defined() ||
+            !op->free_function.empty() ||
+            op->extents.empty()) {
+            return false;
+        }
+        if (op->memory_type == MemoryType::Heap) {
+            return true;
+        }
+        if (op->memory_type != MemoryType::Auto) {
+            // Stack allocations with a dynamic size already reuse
+            // their pseudostack slot.
+            return false;
+        }
+        // Small constant-sized allocations will be placed on the
+        // stack by codegen, so leave those alone.
+        int64_t constant_bytes = Allocate::constant_allocation_size(op->extents, op->name);
+        return !(constant_bytes > 0 &&
+                 can_allocation_fit_on_stack(constant_bytes * op->type.bytes()));
+    }
+
+    Stmt visit(const Allocate *op) override {
+        Stmt body = mutate(op->body);
+        if (!should_use_arena(op)) {
+            if (body.same_as(op->body)) {
+                return op;
+            }
+            return Allocate::make(op->name, op->type, op->memory_type, op->extents,
+                                  op->condition, body, op->new_expr, op->free_function);
+        }
+
+        injected = true;
+
+        // Match the size codegen would pass to halide_malloc,
+        // including the padding for reading one scalar past the
+        // end. Codegen has already checked the size for overflow by
+        // the time the new expression is evaluated.
+        Expr size = make_const(UInt(64), op->type.bytes());
+        for (const Expr &e : op->extents) {
+            size *= cast(UInt(64), e);
+        }
+        size += op->type.bytes();
+        if (!is_one(op->condition)) {
+            size = select(op->condition, size, make_zero(UInt(64)));
+        }
+
+        Expr arena = Variable::make(Handle(), "pipeline_arena");
+        Expr new_expr = Call::make(Handle(), "halide_arena_malloc", {arena, size}, Call::Extern);
+        return Allocate::make(op->name, op->type, op->memory_type, op->extents,
+                              op->condition, body, new_expr, "halide_arena_free");
+    }
+
+public:
+    bool injected = false;
+};
+
+}  // namespace
+
+Stmt inject_arena_allocations(const Stmt &s) {
+    InjectArenaAllocations injector;
+    Stmt stmt = injector.mutate(s);
+    if (!injector.injected) {
+        return s;
+    }
+
+    // The arena is created even if the pipeline turns out to be a
+    // bounds query. The destructor runs after those of all the
+    // allocations above, as destructors run in reverse order.
+    Expr arena = Variable::make(Handle(), "pipeline_arena");
+    Stmt destroy_arena =
+        Evaluate::make(Call::make(Int(32), Call::register_destructor,
+                                  {Expr("halide_arena_destroy"), arena}, Call::Intrinsic));
+    stmt = Block::make(destroy_arena, stmt);
+    Expr create_arena = Call::make(Handle(), "halide_arena_create", {}, Call::Extern);
+    return LetStmt::make("pipeline_arena", create_arena, stmt);
+}
+
+}  // namespace Internal
+}  // namespace Halide
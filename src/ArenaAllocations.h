@@ -0,0 +1,27 @@
+#ifndef HALIDE_ARENA_ALLOCATIONS_H
+#define HALIDE_ARENA_ALLOCATIONS_H
+
+/** \file
+ * Defines the lowering pass that serves scratch heap allocations from
+ * a per-call arena.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Create an arena on entry to the pipeline, destroyed when it exits,
+ * and rewrite every host heap allocation to be allocated from and
+ * returned to it, so that allocations made in a loop recycle the same
+ * few blocks instead of going through halide_malloc each iteration.
+ * Must run after inject_early_frees and bound_small_allocations, so
+ * that every allocation has its Free, and so allocations that will
+ * end up on the stack can be left alone. Used when the target has
+ * Target::ArenaAlloc. */
+Stmt inject_arena_allocations(const Stmt &s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -1,7 +1,19 @@
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
 #include <regex>
+#include <thread>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#endif
 
 #include "AutoSchedule.h"
+#include "AssociativeOpsTable.h"
+#include "Associativity.h"
 #include "AutoScheduleUtils.h"
 #include "ExprUsesVar.h"
 #include "FindCalls.h"
@@ -722,6 +734,22 @@ map<string, Box> get_pipeline_bounds(DependenceAnalysis &analysis,
     return pipeline_bounds;
 }
 
+// An update definition that was rfactored by the auto-scheduler, which
+// needs to be reproduced before the intermediate Func can be scheduled.
+struct RFactorDirective {
+    // The Func that was rfactored
+    string func;
+    // The update stage (> 0) that was rfactored
+    int stage;
+    // Index of the RVar that was split within the stage's RVars
+    int rvar_index;
+    // The rest of the directive, after the RVar being split, e.g.
+    // ", r_rfo, r_rfi, 1024).rfactor(r_rfo, r_u)"
+    string rest;
+    // The Vars and RVars introduced by the directive
+    vector<VarOrRVar> vars;
+};
+
 struct AutoSchedule {
     struct Stage {
         string function;
@@ -755,10 +783,20 @@ struct AutoSchedule {
     // function stages.
     map<string, map<int, set<string>>> used_vars;
 
-    AutoSchedule(const map<string, Function> &env, const vector<string> &order) : env(env) {
+    // The intermediate Funcs created by rfactor, and how they were created.
+    map<string, RFactorDirective> rfactors;
+
+    AutoSchedule(const map<string, Function> &env, const vector<string> &order,
+                 const map<string, RFactorDirective> &rfactors)
+        : env(env), rfactors(rfactors) {
         for (size_t i = 0; i < order.size(); ++i) {
             topological_order.emplace(order[i], i);
         }
+        for (const auto &iter : rfactors) {
+            for (const VarOrRVar &v : iter.second.vars) {
+                internal_vars.emplace(v.name(), v);
+            }
+        }
         // Allocate a slot in 'used_vars' for each function stages in the pipeline
         for (const auto &iter : env) {
             for (size_t i = 0; i < iter.second.updates().size() + 1; ++i) {
@@ -792,9 +830,33 @@ struct AutoSchedule {
         std::ostringstream func_ss;
         std::ostringstream schedule_ss;
 
+        // Get the handles of all the Funcs in the pipeline before any of the
+        // rfactor directives add new ones, since that changes the topological
+        // order.
+        set<string> declared_funcs;
+        for (const auto &f : sched.func_schedules) {
+            if (!sched.rfactors.count(f.first)) {
+                declared_funcs.insert(f.first);
+            }
+        }
+        for (const auto &iter : sched.rfactors) {
+            declared_funcs.insert(iter.second.func);
+        }
+        for (const string &name : declared_funcs) {
+            func_ss << "Func " << get_sanitized_name(name) << " = "
+                    << sched.get_func_handle(name) << ";\n";
+        }
+        for (const auto &iter : sched.rfactors) {
+            const RFactorDirective &r = iter.second;
+            const string &fname = get_sanitized_name(r.func);
+            const string update = fname + ".update(" + std::to_string(r.stage - 1) + ")";
+            func_ss << "Func " << get_sanitized_name(iter.first) << " = " << update
+                    << ".split(RVar(" << update << ".get_schedule().rvars()["
+                    << r.rvar_index << "].var)" << r.rest << ";\n";
+        }
+
         for (const auto &f : sched.func_schedules) {
             const string &fname = get_sanitized_name(f.first);
-            func_ss << "Func " << fname << " = " << sched.get_func_handle(f.first) << ";\n";
 
             schedule_ss << "{\n";
 
@@ -863,6 +925,34 @@ struct AutoSchedule {
     }
 };
 
+// Return the cost of a load, relative to the cost of an arithmetic
+// operation, from a memory footprint of 'footprint' bytes. When the sizes
+// of the L1 and L2 caches are known, the cost is 1 up to the L1 size, then
+// rises linearly to sqrt(balance) at the L2 size and on to 'balance' at the
+// last-level cache size. Otherwise, it rises linearly from 1 to 'balance'
+// over the size of the last-level cache.
+Expr load_cost_factor(const Expr &footprint, const MachineParams &arch_params) {
+    const float balance = arch_params.balance;
+    const uint64_t llc = arch_params.last_level_cache_size;
+    const uint64_t l1 = arch_params.l1_cache_size;
+    const uint64_t l2 = arch_params.l2_cache_size;
+    if (l1 == 0 || l2 <= l1 || llc <= l2 || balance <= 1) {
+        float load_slope = balance / llc;
+        return cast<int64_t>(min(1 + footprint * load_slope, balance));
+    }
+
+    // Sum of ramps, each of which is clamped to the range of cache sizes
+    // it covers. Beyond the last-level cache, the cost stays at 'balance'.
+    const float l2_cost = std::sqrt(balance);
+    Expr f = cast<int64_t>(footprint);
+    Expr zero = make_zero(Int(64));
+    Expr l2_ramp = clamp(f - Expr((int64_t)l1), zero, Expr((int64_t)(l2 - l1)));
+    Expr llc_ramp = clamp(f - Expr((int64_t)l2), zero, Expr((int64_t)(llc - l2)));
+    return cast<int64_t>(1 +
+                         l2_ramp * ((l2_cost - 1) / (l2 - l1)) +
+                         llc_ramp * ((balance - l2_cost) / (llc - l2)));
+}
+
 // Implement the grouping algorithm and the cost model for making the grouping
 // choices.
 struct Partitioner {
@@ -1117,6 +1207,36 @@ struct Partitioner {
     // Return the estimated size of the bounds.
     map<string, Expr> bounds_to_estimates(const DimBounds &bounds);
 
+    // Return the dimension of the output stage of group 'g' that the members
+    // of the group can slide along, or an empty string if there is none. This
+    // is the outermost dimension within a tile, if it is a pure Var and there
+    // is another dimension within the tile inside it. A member computed at
+    // that dimension but stored at the tile only computes the values not
+    // already computed by the previous iteration (see SlidingWindow.cpp), and
+    // its storage can be folded down to the region required by one iteration
+    // (see StorageFolding.cpp).
+    string get_sliding_dim(const Group &g);
+
+    // Return the regions of the members of group 'g' required by a single
+    // iteration over 'sliding_dim' within a tile of the group output.
+    map<string, Box> get_sliding_regions(const Group &g, const string &sliding_dim);
+
+    // Return true if it is worth computing the group member 'f' at the
+    // sliding dimension of its group, given the region of 'f' required by a
+    // tile of the group and by one iteration over the sliding dimension.
+    bool should_slide(const Function &f, const Box &tile_region, const Box &sliding_region);
+
+    // Return the members of group 'g' that will be computed in a sliding
+    // window, given the regions of the members required by a tile of the
+    // group and by one iteration over the sliding dimension. A member only
+    // slides if it should, and all of its consumers within the group also
+    // slide or are the group output. Otherwise, a consumer computed once
+    // per tile would need values of the member that are only computed
+    // later on in the tile. Used by both the cost model and the schedule
+    // generation, so that they agree.
+    set<string> get_sliding_members(const Group &g, const map<string, Box> &tile_regions,
+                                    const map<string, Box> &sliding_regions);
+
     // Given a function stage, return a vector of possible tile configurations for
     // that function stage.
     vector<map<string, Expr>> generate_tile_configs(const FStage &stg);
@@ -1182,6 +1302,8 @@ struct Partitioner {
     void generate_group_cpu_schedule(const Group &g, const Target &t,
                                      const map<FStage, DimBounds> &group_loop_bounds,
                                      const map<string, Box> &group_storage_bounds,
+                                     const string &sliding_dim,
+                                     const map<string, Box> &group_sliding_bounds,
                                      const set<string> &inlines,
                                      AutoSchedule &sched);
 
@@ -1496,11 +1618,25 @@ vector<map<string, Expr>> Partitioner::generate_tile_configs(const FStage &stg)
 
     const vector<Dim> &dims = get_stage_dims(stg.func, stg.stage_num);
 
-    // Get the dimensions that are going to be tiled in this stage.
-    // Skipping rvars for now.
+    // Get the dimensions that are going to be tiled in this stage. RVars are
+    // skipped, except for the outermost one if it can be parallelized without
+    // races: tiling it moves its outer loop outwards, but never reorders it
+    // with respect to the other RVars.
+    int outermost_rvar = -1;
+    for (int d = 0; d < (int)dims.size() - 1; d++) {
+        if (dims[d].is_rvar()) {
+            outermost_rvar = d;
+        }
+    }
+    bool tile_outermost_rvar = false;
+    if (outermost_rvar >= 0) {
+        Definition def = get_stage_definition(stg.func, stg.stage_num);
+        tile_outermost_rvar =
+            can_parallelize_rvar(dims[outermost_rvar].var, stg.func.name(), def);
+    }
     vector<string> tile_vars;
     for (int d = 0; d < (int)dims.size() - 1; d++) {
-        if (!dims[d].is_rvar()) {
+        if (!dims[d].is_rvar() || (tile_outermost_rvar && d == outermost_rvar)) {
             tile_vars.push_back(dims[d].var);
         }
     }
@@ -1857,6 +1993,14 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
     map<string, Box> alloc_regions = dep_analysis.regions_required(
         g.output.func, g.output.stage_num, tile_bounds, group_members, false, &costs.input_estimates);
 
+    map<string, Box> sliding_regions;
+    set<string> sliding_members;
+    string sliding_dim = get_sliding_dim(g);
+    if (!sliding_dim.empty()) {
+        sliding_regions = get_sliding_regions(g, sliding_dim);
+        sliding_members = get_sliding_members(g, alloc_regions, sliding_regions);
+    }
+
     map<string, Box> compute_regions = dep_analysis.regions_required(
         g.output.func, g.output.stage_num, tile_bounds, group_members, true, &costs.input_estimates);
 
@@ -1943,21 +2087,18 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
                                      tile_cost.second);
     }*/
 
-    // TODO: Use smooth step curve from Jon to better model cache behavior,
-    // where each step corresponds to different cache level.
-    //
-    // The current cost model drops off linearly. Larger memory footprint is
-    // penalized more than smaller memory footprint (since smaller one can fit
-    // more in the cache). The cost is clamped at 'balance', which is roughly at
-    // memory footprint equal to or larger than the last level cache size.
+    // The cost of a load rises with the memory footprint, with a linear
+    // segment between each pair of cache levels (see load_cost_factor).
+    // Larger memory footprint is penalized more than smaller memory footprint
+    // (since smaller one can fit more in the cache). The cost is clamped at
+    // 'balance', which is roughly at memory footprint equal to or larger than
+    // the last level cache size.
 
     // If 'model_reuse' is set, the cost model should take into account memory
     // reuse within the tile, e.g. matrix multiply reuses inputs multiple times.
     // TODO: Implement a better reuse model.
     bool model_reuse = false;
 
-    // Linear dropoff
-    float load_slope = arch_params.balance / arch_params.last_level_cache_size;
     for (const auto &f_load : group_load_costs) {
         internal_assert(g.inlined.find(f_load.first) == g.inlined.end())
             << "Intermediates of inlined pure fuction \"" << f_load.first
@@ -1974,6 +2115,13 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
 
         if (!is_output && is_group_member) {
             footprint = costs.region_size(f_load.first, alloc_reg);
+            // A member that slides only needs storage for the region required
+            // by one iteration over the sliding dimension, rounded up to a
+            // power of two by storage folding.
+            if (sliding_members.count(f_load.first)) {
+                footprint = 2 * costs.region_size(f_load.first,
+                                                  get_element(sliding_regions, f_load.first));
+            }
         } else {
             Expr initial_footprint;
             const auto &f_load_pipeline_bounds = get_element(pipeline_bounds, f_load.first);
@@ -1999,8 +2147,7 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
             }
 
             if (model_reuse) {
-                Expr initial_factor =
-                    cast<int64_t>(min(1 + initial_footprint * load_slope, arch_params.balance));
+                Expr initial_factor = load_cost_factor(initial_footprint, arch_params);
                 per_tile_cost.memory += initial_factor * footprint;
             } else {
                 footprint = initial_footprint;
@@ -2011,7 +2158,7 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
             }
         }
 
-        Expr cost_factor = cast<int64_t>(min(1 + footprint * load_slope, arch_params.balance));
+        Expr cost_factor = load_cost_factor(footprint, arch_params);
         per_tile_cost.memory += cost_factor * f_load.second;
     }
 
@@ -2260,6 +2407,103 @@ map<FStage, map<string, Box>> Partitioner::group_storage_bounds() {
     return group_storage_bounds;
 }
 
+string Partitioner::get_sliding_dim(const Group &g) {
+    if (g.output.func.has_extern_definition()) {
+        return "";
+    }
+
+    const vector<Dim> &dims = get_stage_dims(g.output.func, g.output.stage_num);
+    DimBounds stg_bounds = get_bounds(g.output);
+
+    // Find the dimensions within a tile, in the same way as
+    // generate_group_cpu_schedule: a dimension is split if its extent is
+    // larger than its tile size, and only the outer part remains if the tile
+    // size is 1.
+    bool tiled = false;
+    vector<int> inner_dims;
+    for (int d = 0; d < (int)dims.size() - 1; d++) {
+        const string &var = dims[d].var;
+        const auto &iter = g.tile_sizes.find(var);
+        Expr extent = get_extent(get_element(stg_bounds, var));
+        if ((iter != g.tile_sizes.end()) && extent.defined() &&
+            can_prove(extent > iter->second)) {
+            tiled = true;
+            if (can_prove(iter->second == 1)) {
+                continue;
+            }
+        }
+        inner_dims.push_back(d);
+    }
+
+    if (!tiled || (inner_dims.size() < 2) || dims[inner_dims.back()].is_rvar()) {
+        return "";
+    }
+    return dims[inner_dims.back()].var;
+}
+
+map<string, Box> Partitioner::get_sliding_regions(const Group &g, const string &sliding_dim) {
+    DimBounds bounds = get_bounds_from_tile_sizes(g.output, g.tile_sizes);
+    const Interval &interval = get_element(bounds, sliding_dim);
+    bounds[sliding_dim] = Interval(interval.min, interval.min);
+
+    set<string> prods;
+    for (const FStage &s : g.members) {
+        prods.insert(s.func.name());
+    }
+
+    return dep_analysis.regions_required(g.output.func, g.output.stage_num,
+                                         bounds, prods, false, &costs.input_estimates);
+}
+
+bool Partitioner::should_slide(const Function &f, const Box &tile_region,
+                               const Box &sliding_region) {
+    // Sliding window only applies to Funcs without update definitions.
+    if (f.has_extern_definition() || !f.updates().empty()) {
+        return false;
+    }
+    // The storage of a sliding Func is folded to a power of two at least as
+    // large as the region required by one iteration, so only slide if that
+    // is smaller than the storage required by the tile.
+    Expr tile_size = costs.region_size(f.name(), tile_region);
+    Expr sliding_size = costs.region_size(f.name(), sliding_region);
+    if (!tile_size.defined() || !sliding_size.defined()) {
+        return false;
+    }
+    return can_prove(2 * sliding_size < tile_size);
+}
+
+set<string> Partitioner::get_sliding_members(const Group &g,
+                                             const map<string, Box> &tile_regions,
+                                             const map<string, Box> &sliding_regions) {
+    set<string> sliding;
+    for (const FStage &mem : g.members) {
+        const string &name = mem.func.name();
+        const auto &tile_iter = tile_regions.find(name);
+        const auto &sliding_iter = sliding_regions.find(name);
+        if ((name != g.output.func.name()) && !g.inlined.count(name) &&
+            (tile_iter != tile_regions.end()) &&
+            (sliding_iter != sliding_regions.end()) &&
+            should_slide(mem.func, tile_iter->second, sliding_iter->second)) {
+            sliding.insert(name);
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const FStage &mem : g.members) {
+            if ((mem.func.name() == g.output.func.name()) || sliding.count(mem.func.name())) {
+                continue;
+            }
+            for (const string &prod : get_parents(mem.func, mem.stage_num)) {
+                if (sliding.erase(prod)) {
+                    changed = true;
+                }
+            }
+        }
+    }
+    return sliding;
+}
+
 map<FStage, map<FStage, DimBounds>> Partitioner::group_loop_bounds() {
     map<FStage, map<FStage, DimBounds>> group_bounds;
     for (const pair<const FStage, Group> &gpair : groups) {
@@ -2633,6 +2877,8 @@ void Partitioner::generate_group_cpu_schedule(
         const Group &g, const Target &t,
         const map<FStage, DimBounds> &group_loop_bounds,
         const map<string, Box> &group_storage_bounds,
+        const string &sliding_dim,
+        const map<string, Box> &group_sliding_bounds,
         const set<string> &inlines,
         AutoSchedule &sched) {
     string out_f_name = g.output.func.name();
@@ -2700,10 +2946,14 @@ void Partitioner::generate_group_cpu_schedule(
         dim_vars[d] = get_base_name(dims[d].var);
     }
 
+    // The name of the sliding dimension within the tile, once it is tiled
+    string sliding_var;
+
     // Apply tiling to output of the group
     for (const auto &var : dim_vars) {
         bool is_rvar = (rvars.find(var) != rvars.end());
         VarOrRVar v(var, is_rvar);
+        bool is_sliding_dim = (var == get_base_name(sliding_dim));
 
         const auto &iter = g.tile_sizes.find(var);
         if ((iter != g.tile_sizes.end()) &&
@@ -2719,6 +2969,9 @@ void Partitioner::generate_group_cpu_schedule(
 
                 inner_dims.push_back(tile_vars.first);
                 outer_dims.push_back(tile_vars.second);
+                if (is_sliding_dim) {
+                    sliding_var = tile_vars.first.name();
+                }
 
                 if (is_rvar) {
                     rvars.erase(var);
@@ -2728,6 +2981,26 @@ void Partitioner::generate_group_cpu_schedule(
             }
         } else {
             inner_dims.push_back(v);
+            if (is_sliding_dim) {
+                sliding_var = v.name();
+            }
+        }
+    }
+
+    // Find the members that slide. They are computed at the sliding
+    // dimension, so it must be the outermost dimension within the tile.
+    set<string> sliding;
+    if (!sliding_var.empty() && !outer_dims.empty()) {
+        sliding = get_sliding_members(g, group_storage_bounds, group_sliding_bounds);
+        if (!sliding.empty() && (inner_dims.back().name() != sliding_var)) {
+            for (size_t i = 0; i < inner_dims.size(); i++) {
+                if (inner_dims[i].name() == sliding_var) {
+                    VarOrRVar v = inner_dims[i];
+                    inner_dims.erase(inner_dims.begin() + i);
+                    inner_dims.push_back(v);
+                    break;
+                }
+            }
         }
     }
 
@@ -2759,6 +3032,17 @@ void Partitioner::generate_group_cpu_schedule(
     vectorize_stage(g, f_handle, g.output.stage_num, def, g_out, true, t,
                     rvars, stg_estimates, sched);
 
+    // The members can only slide along a serial loop.
+    if (!sliding.empty()) {
+        for (int d = 0; d < (int)dims.size() - 1; d++) {
+            if ((get_base_name(dims[d].var) == sliding_var) &&
+                (dims[d].for_type != ForType::Serial)) {
+                sliding.clear();
+                break;
+            }
+        }
+    }
+
     // Parallelize definition
     Expr def_par = 1;
     // TODO: Investigate if it is better to pull one large dimension and
@@ -2778,6 +3062,12 @@ void Partitioner::generate_group_cpu_schedule(
             }
 
             string var = get_base_name(dims[d].var);
+            if (!sliding.empty() && (var == sliding_var)) {
+                // Keep the sliding dimension serial. If the tiles don't
+                // provide enough parallelism, the sliding members are
+                // made async below instead.
+                break;
+            }
             bool is_rvar = (rvars.find(var) != rvars.end());
             internal_assert(is_rvar == dims[d].is_rvar());
             VarOrRVar v(var, is_rvar);
@@ -2855,7 +3145,31 @@ void Partitioner::generate_group_cpu_schedule(
         if (mem.stage_num > 0) {
             mem_handle = Func(mem.func).update(mem.stage_num - 1);
         } else {
-            if (!outer_dims.empty()) {
+            if (sliding.count(mem.func.name())) {
+                // Store the member at the tile, but compute it at each
+                // iteration over the sliding dimension, so that it is
+                // computed in a sliding window with folded storage.
+                string sanitized_g_out = get_sanitized_name(g_out.name());
+                if (tile_inner_var.is_rvar) {
+                    Func(mem.func).store_at(Func(g_out), tile_inner_var.rvar);
+                } else {
+                    Func(mem.func).store_at(Func(g_out), tile_inner_var.var);
+                }
+                Func(mem.func).compute_at(Func(g_out), Var(sliding_var));
+                sched.push_schedule(mem_handle.name(), mem.stage_num,
+                                    "store_at(" + sanitized_g_out + ", " + tile_inner_var.name() + ")",
+                                    {sanitized_g_out, tile_inner_var.name()});
+                sched.push_schedule(mem_handle.name(), mem.stage_num,
+                                    "compute_at(" + sanitized_g_out + ", " + sliding_var + ")",
+                                    {sanitized_g_out, sliding_var});
+
+                // If the group can't use all the cores by itself, run the
+                // member in its own thread, so it runs ahead of its consumers.
+                if (can_prove(def_par < arch_params.parallelism)) {
+                    Func(mem.func).async();
+                    sched.push_schedule(mem_handle.name(), mem.stage_num, "async()", {});
+                }
+            } else if (!outer_dims.empty()) {
                 if (tile_inner_var.is_rvar) {
                     Func(mem.func).compute_at(Func(g_out), tile_inner_var.rvar);
                 } else {
@@ -2893,6 +3207,15 @@ void Partitioner::generate_cpu_schedule(const Target &t, AutoSchedule &sched) {
     // outputs which will be altered by modifying schedules.
     map<FStage, map<FStage, DimBounds>> loop_bounds = group_loop_bounds();
     map<FStage, map<string, Box>> storage_bounds = group_storage_bounds();
+    map<FStage, string> sliding_dims;
+    map<FStage, map<string, Box>> sliding_bounds;
+    for (const auto &g : groups) {
+        string dim = get_sliding_dim(g.second);
+        sliding_dims[g.first] = dim;
+        if (!dim.empty()) {
+            sliding_bounds[g.first] = get_sliding_regions(g.second, dim);
+        }
+    }
 
     set<string> inlines;
     // Mark all functions that are inlined.
@@ -2913,7 +3236,9 @@ void Partitioner::generate_cpu_schedule(const Target &t, AutoSchedule &sched) {
     // Realize schedule for each group in the pipeline.
     for (const auto &g : groups) {
         generate_group_cpu_schedule(g.second, t, get_element(loop_bounds, g.first),
-                                    get_element(storage_bounds, g.first), inlines, sched);
+                                    get_element(storage_bounds, g.first),
+                                    get_element(sliding_dims, g.first),
+                                    sliding_bounds[g.first], inlines, sched);
     }
 }
 
@@ -3321,6 +3646,207 @@ bool inline_unbounded(const vector<Function> &outputs,
     return inlined;
 }
 
+// Return the value of 'e' if it's a constant after simplification, or -1
+// otherwise.
+int64_t get_const_extent(const Expr &e) {
+    if (!e.defined()) {
+        return -1;
+    }
+    const int64_t *value = as_const_int(simplify(e));
+    return value ? *value : -1;
+}
+
+// Try to rfactor update stage 'stage' of 'f', if it's an associative
+// reduction with too little parallelism otherwise, and rfactoring it is
+// cheaper according to the cost model. The outermost RVar is split, and the
+// outer part is turned into a pure Var of the intermediate Func, so the
+// intermediate can be computed in parallel. If the operator is also
+// commutative, and the update doesn't scatter, the innermost vector-width
+// slice of the inner part is also turned into a pure Var, so the
+// intermediate can be vectorized. Return true and fill in 'directive' and
+// 'intm' (the intermediate Func) if the stage was rfactored.
+bool rfactor_stage(Function f, int stage, const Box &pure_box, RegionCosts &costs,
+                   const Target &target, const MachineParams &arch_params,
+                   RFactorDirective &directive, Func &intm) {
+    const Definition &def = f.update(stage - 1);
+    const vector<Dim> &dims = def.schedule().dims();
+    const vector<ReductionVariable> &rvars = def.schedule().rvars();
+    if (rvars.empty() || !def.specializations().empty()) {
+        return false;
+    }
+
+    DimBounds pure_bounds;
+    for (size_t d = 0; d < f.args().size(); d++) {
+        pure_bounds[f.args()[d]] = pure_box[d];
+    }
+    DimBounds bounds = get_stage_bounds(f, stage, pure_bounds);
+
+    // The parallelism available without rfactor: the pure dimensions, and
+    // the RVars that can be parallelized without races. If that's enough,
+    // the stage will be parallelized as is.
+    int64_t parallelism = 1;
+    for (int d = 0; d < (int)dims.size() - 1; d++) {
+        if (!dims[d].is_rvar() || can_parallelize_rvar(dims[d].var, f.name(), def)) {
+            int64_t extent = get_const_extent(get_extent(get_element(bounds, dims[d].var)));
+            if (extent <= 0) {
+                return false;
+            }
+            parallelism *= extent;
+        }
+    }
+    if (parallelism >= arch_params.parallelism) {
+        return false;
+    }
+
+    AssociativeOp prover_result = prove_associativity(f.name(), def.args(), def.values());
+    if (!prover_result.associative()) {
+        return false;
+    }
+
+    // The stage scatters if its LHS isn't just the pure Vars.
+    bool scatters = false;
+    for (size_t i = 0; i < def.args().size(); i++) {
+        const Variable *v = def.args()[i].as<Variable>();
+        if (!v || v->name != f.args()[i]) {
+            scatters = true;
+        }
+    }
+
+    // The outermost RVar is split: it's the one that can be rfactored even
+    // if the operator isn't commutative.
+    const int rvar_index = rvars.size() - 1;
+    const ReductionVariable &rv = rvars[rvar_index];
+    int64_t extent = get_const_extent(get_extent(get_element(bounds, rv.var)));
+    if (extent <= 0) {
+        return false;
+    }
+
+    int vec_len = 1;
+    if (prover_result.commutative() && !scatters) {
+        for (const auto &type : f.output_types()) {
+            vec_len = std::max(vec_len, target.natural_vector_size(type));
+        }
+    }
+
+    // Give each core a slice of the RVar, with at least a few vectors of
+    // work in each slice.
+    const int64_t min_slice = 4 * vec_len;
+    int64_t slices = std::min<int64_t>((arch_params.parallelism + parallelism - 1) / parallelism,
+                                       extent / min_slice);
+    if (slices < 2) {
+        return false;
+    }
+    int64_t slice = (extent + slices - 1) / slices;
+    slice = ((slice + vec_len - 1) / vec_len) * vec_len;
+    slices = (extent + slice - 1) / slice;
+
+    // Compare the cost of the stage as is with the cost of computing the
+    // intermediate in parallel, plus the cost of initializing the
+    // intermediate and merging it into the original Func. Those are
+    // parallelized over the pure dimensions of the original Func.
+    Cost cost = costs.stage_region_cost(f.name(), stage, bounds);
+    if (!cost.defined()) {
+        return false;
+    }
+    int64_t arith = get_const_extent(cost.arith);
+    int64_t memory = get_const_extent(cost.memory);
+    if (arith < 0 || memory < 0) {
+        return false;
+    }
+    int64_t points = 1;
+    for (const auto &b : pure_box.bounds) {
+        int64_t e = get_const_extent(get_extent(b));
+        if (e <= 0) {
+            return false;
+        }
+        points *= e;
+    }
+    double serial_cost = (double)(arith + memory) / parallelism;
+    double rfactor_cost =
+        (double)(arith + memory) / std::min<int64_t>(parallelism * slices, arch_params.parallelism) +
+        2.0 * points * slices * vec_len * f.outputs() /
+        std::min<int64_t>(points, arch_params.parallelism);
+    debug(2) << "Rfactoring " << f.name() << ".update(" << stage - 1 << ") over "
+             << rv.var << " into " << slices << " slices would cost "
+             << rfactor_cost << " instead of " << serial_cost << "\n";
+    if (rfactor_cost >= serial_cost) {
+        return false;
+    }
+
+    const string base = get_base_name(rv.var);
+    RVar outer(base + "_rfo"), inner(base + "_rfi");
+    Var u(base + "_u");
+    directive.func = f.name();
+    directive.stage = stage;
+    directive.rvar_index = rvar_index;
+    directive.vars = {outer, inner, u};
+
+    Halide::Stage handle = Func(f).update(stage - 1);
+    handle.split(RVar(rv.var), outer, inner, (int)slice);
+    std::ostringstream rest;
+    rest << ", " << outer.name() << ", " << inner.name() << ", " << slice << ")";
+
+    vector<pair<RVar, Var>> preserved = {{outer, u}};
+    if (vec_len > 1) {
+        RVar inner_outer(base + "_rfio"), lanes(base + "_rfv");
+        Var v(base + "_v");
+        handle.split(inner, inner_outer, lanes, vec_len);
+        rest << ".split(" << inner.name() << ", " << inner_outer.name() << ", "
+             << lanes.name() << ", " << vec_len << ")";
+        preserved.push_back({lanes, v});
+        directive.vars.push_back(inner_outer);
+        directive.vars.push_back(lanes);
+        directive.vars.push_back(v);
+    }
+
+    intm = handle.rfactor(preserved);
+    rest << ".rfactor({";
+    for (size_t i = 0; i < preserved.size(); i++) {
+        rest << (i > 0 ? ", " : "") << "{" << preserved[i].first.name()
+             << ", " << preserved[i].second.name() << "}";
+    }
+    rest << "})";
+    directive.rest = rest.str();
+    return true;
+}
+
+// Run a pre-pass that rfactors the update definitions that would otherwise
+// be left serial (see rfactor_stage). At most one stage of each Func is
+// rfactored, since the intermediate Func is named after the Func. Return
+// the directives applied, keyed by the name of the intermediate Func
+// returned by rfactor.
+map<string, RFactorDirective> rfactor_serial_reductions(const vector<Function> &outputs,
+                                                        const vector<string> &order,
+                                                        const map<string, Function> &env,
+                                                        const Target &target,
+                                                        const MachineParams &arch_params) {
+    // This runs before the rest of the analysis, which has to be redone
+    // for the intermediate Funcs anyway.
+    FuncValueBounds func_val_bounds = compute_function_value_bounds(order, env);
+    RegionCosts costs(env, order);
+    DependenceAnalysis dep_analysis(env, order, func_val_bounds);
+    map<string, Box> pipeline_bounds =
+        get_pipeline_bounds(dep_analysis, outputs, &costs.input_estimates);
+
+    map<string, RFactorDirective> rfactors;
+    for (const auto &iter : env) {
+        Function f = iter.second;
+        if (f.has_extern_definition() || !pipeline_bounds.count(f.name())) {
+            continue;
+        }
+        const Box &pure_box = get_element(pipeline_bounds, f.name());
+        for (int s = 1; s <= (int)f.updates().size(); s++) {
+            RFactorDirective directive;
+            Func intm;
+            if (rfactor_stage(f, s, pure_box, costs, target, arch_params, directive, intm)) {
+                rfactors.emplace(intm.name(), directive);
+                break;
+            }
+        }
+    }
+    return rfactors;
+}
+
 }  // anonymous namespace
 
 // Generate schedules for all functions in the pipeline required to compute the
@@ -3411,6 +3937,21 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
         order = realization_order(outputs, env).first;
     }
 
+    // Run a pre-pass that rfactors associative update definitions that
+    // can't otherwise be parallelized. This adds intermediate Funcs to the
+    // pipeline, so we need to recompute 'env' if it did anything.
+    debug(2) << "Rfactoring serial reductions...\n";
+    map<string, RFactorDirective> rfactors =
+        rfactor_serial_reductions(outputs, order, env, target, arch_params);
+    if (!rfactors.empty()) {
+        env.clear();
+        for (Function f : outputs) {
+            map<string, Function> more_funcs = find_transitive_calls(f);
+            env.insert(more_funcs.begin(), more_funcs.end());
+        }
+        order = realization_order(outputs, env).first;
+    }
+
     // Compute the bounds of function values which are used for dependence analysis.
     debug(2) << "Computing function value bounds...\n";
     FuncValueBounds func_val_bounds = compute_function_value_bounds(order, env);
@@ -3509,7 +4050,7 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
     }
 
     debug(2) << "Initializing AutoSchedule...\n";
-    AutoSchedule sched(env, top_order);
+    AutoSchedule sched(env, top_order, rfactors);
     debug(2) << "Generating CPU schedule...\n";
     part.generate_cpu_schedule(target, sched);
 
@@ -3530,6 +4071,268 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
     return sched_string;
 }
 
+namespace {
+
+// What we know about the caches of the host. Sizes are in bytes, and are
+// zero if unknown.
+struct HostCaches {
+    uint64_t l1 = 0, l2 = 0;
+    // The size of one last-level cache, and how many of them there are
+    // in the machine (e.g. one per socket).
+    uint64_t llc = 0;
+    int llc_count = 1;
+    int line_size = 0;
+};
+
+#ifdef __linux__
+string read_sysfs(const string &path) {
+    std::ifstream f(path);
+    string s;
+    std::getline(f, s);
+    return s;
+}
+
+// Parse a size like "32K" from sysfs.
+uint64_t parse_sysfs_size(const string &s) {
+    uint64_t size = std::strtoull(s.c_str(), nullptr, 10);
+    if (s.find('K') != string::npos) {
+        size *= 1024;
+    } else if (s.find('M') != string::npos) {
+        size *= 1024 * 1024;
+    } else if (s.find('G') != string::npos) {
+        size *= 1024 * 1024 * 1024;
+    }
+    return size;
+}
+
+// Count the CPUs in a list like "0-7,16-23".
+int count_cpu_list(const string &s) {
+    int count = 0;
+    for (const string &range : split_string(s, ",")) {
+        vector<string> v = split_string(range, "-");
+        if (v.size() == 2) {
+            count += std::atoi(v[1].c_str()) - std::atoi(v[0].c_str()) + 1;
+        } else if (!range.empty()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool read_linux_caches(int cpus, HostCaches &caches) {
+    const string dir = "/sys/devices/system/cpu/cpu0/cache/index";
+    int llc_level = 0;
+    for (int i = 0;; i++) {
+        const string index = dir + std::to_string(i) + "/";
+        string type = read_sysfs(index + "type");
+        if (type.empty()) {
+            break;
+        }
+        if (type == "Instruction") {
+            continue;
+        }
+        int level = std::atoi(read_sysfs(index + "level").c_str());
+        uint64_t size = parse_sysfs_size(read_sysfs(index + "size"));
+        int line_size = std::atoi(read_sysfs(index + "coherency_line_size").c_str());
+        if (level == 1) {
+            caches.l1 = size;
+            caches.line_size = line_size;
+        } else if (level == 2) {
+            caches.l2 = size;
+        }
+        if (level >= llc_level) {
+            llc_level = level;
+            caches.llc = size;
+            int sharing = count_cpu_list(read_sysfs(index + "shared_cpu_list"));
+            caches.llc_count = std::max(1, cpus / std::max(1, sharing));
+        }
+    }
+    return caches.llc != 0;
+}
+#endif
+
+#ifdef __APPLE__
+uint64_t read_sysctl(const char *name) {
+    uint64_t value = 0;
+    size_t size = sizeof(value);
+    if (sysctlbyname(name, &value, &size, nullptr, 0) != 0) {
+        return 0;
+    }
+    return value;
+}
+
+bool read_apple_caches(HostCaches &caches) {
+    caches.l1 = read_sysctl("hw.l1dcachesize");
+    caches.l2 = read_sysctl("hw.l2cachesize");
+    caches.llc = read_sysctl("hw.l3cachesize");
+    if (caches.llc == 0) {
+        caches.llc = caches.l2;
+    }
+    caches.line_size = (int)read_sysctl("hw.cachelinesize");
+    return caches.llc != 0;
+}
+#endif
+
+// Enumerate the caches with cpuid leaf 4 (Intel) or 0x8000001d (AMD),
+// which describe the caches in the same format.
+bool read_cpuid_cache_leaf(int leaf, int cpus, HostCaches &caches) {
+    int info[4];
+    int llc_level = 0;
+    for (int i = 0; i < 16; i++) {
+        host_cpuid(info, leaf, i);
+        int type = info[0] & 0x1f;
+        if (type == 0) {
+            break;
+        }
+        if (type == 2) {
+            // Instruction cache
+            continue;
+        }
+        int level = (info[0] >> 5) & 0x7;
+        int sharing = ((info[0] >> 14) & 0xfff) + 1;
+        uint64_t ways = ((uint32_t)info[1] >> 22) + 1;
+        uint64_t partitions = (((uint32_t)info[1] >> 12) & 0x3ff) + 1;
+        uint64_t line_size = ((uint32_t)info[1] & 0xfff) + 1;
+        uint64_t sets = (uint64_t)(uint32_t)info[2] + 1;
+        uint64_t size = ways * partitions * line_size * sets;
+        if (level == 1) {
+            caches.l1 = size;
+            caches.line_size = (int)line_size;
+        } else if (level == 2) {
+            caches.l2 = size;
+        }
+        if (level >= llc_level) {
+            llc_level = level;
+            caches.llc = size;
+            caches.llc_count = std::max(1, cpus / sharing);
+        }
+    }
+    return caches.llc != 0;
+}
+
+bool read_cpuid_caches(int cpus, HostCaches &caches) {
+    int info[4];
+    if (!host_cpuid(info, 0, 0)) {
+        return false;
+    }
+    if (info[0] >= 4 && read_cpuid_cache_leaf(4, cpus, caches)) {
+        return true;
+    }
+    caches = HostCaches();
+    host_cpuid(info, (int)0x80000000, 0);
+    return ((uint32_t)info[0] >= 0x8000001d &&
+            read_cpuid_cache_leaf((int)0x8000001d, cpus, caches));
+}
+
+// Measure how much more a load that misses in cache costs than an
+// arithmetic operation. Loads from random lines of a buffer several times
+// the size of the last-level cache are compared to a loop of independent
+// multiply-adds. Both loops have several independent chains of work in
+// flight, so this measures throughput, as the auto-scheduler's cost model
+// does, rather than latency.
+float calibrate_balance(uint64_t llc_size, int line_size) {
+    using clock = std::chrono::steady_clock;
+    const int chains = 8;
+    volatile uint32_t sink = 0;
+
+    // Arithmetic
+    double arith_time = std::numeric_limits<double>::max();
+    const int arith_iters = 1 << 22;
+    for (int trial = 0; trial < 3; trial++) {
+        uint32_t acc[chains];
+        for (int c = 0; c < chains; c++) {
+            acc[c] = sink + c;
+        }
+        auto start = clock::now();
+        for (int i = 0; i < arith_iters; i++) {
+            for (int c = 0; c < chains; c++) {
+                acc[c] = acc[c] * 1664525u + 1013904223u;
+            }
+        }
+        auto end = clock::now();
+        for (int c = 0; c < chains; c++) {
+            sink = sink + acc[c];
+        }
+        // Count the multiply and the add as two operations.
+        double t = std::chrono::duration<double>(end - start).count() / (2.0 * chains * arith_iters);
+        arith_time = std::min(arith_time, t);
+    }
+
+    // Loads. Round the buffer up to a power of two number of lines, and
+    // cap it so the calibration stays quick.
+    const uint64_t line = std::max(line_size, 16);
+    uint64_t lines = 1;
+    while (lines * line < std::min(llc_size * 4, (uint64_t)1 << 28)) {
+        lines *= 2;
+    }
+    vector<uint32_t> buf(lines * line / sizeof(uint32_t), 1);
+    const uint32_t mask = (uint32_t)(lines - 1);
+    const uint32_t words_per_line = (uint32_t)(line / sizeof(uint32_t));
+    double load_time = std::numeric_limits<double>::max();
+    const int load_iters = 1 << 17;
+    for (int trial = 0; trial < 3; trial++) {
+        uint32_t idx[chains], acc[chains];
+        for (int c = 0; c < chains; c++) {
+            idx[c] = sink + c * 7919;
+            acc[c] = 0;
+        }
+        auto start = clock::now();
+        for (int i = 0; i < load_iters; i++) {
+            for (int c = 0; c < chains; c++) {
+                idx[c] = idx[c] * 1664525u + 1013904223u;
+                acc[c] += buf[((idx[c] >> 8) & mask) * words_per_line];
+            }
+        }
+        auto end = clock::now();
+        for (int c = 0; c < chains; c++) {
+            sink = sink + acc[c];
+        }
+        double t = std::chrono::duration<double>(end - start).count() / ((double)chains * load_iters);
+        load_time = std::min(load_time, t);
+    }
+
+    return (float)std::max(1.0, load_time / arith_time);
+}
+
+MachineParams detect_host_machine_params() {
+    MachineParams generic(16, 16 * 1024 * 1024, 40);
+
+    int cpus = std::max(1, (int)std::thread::hardware_concurrency());
+
+    HostCaches caches;
+    bool found = false;
+#ifdef __linux__
+    found = read_linux_caches(cpus, caches);
+#endif
+#ifdef __APPLE__
+    found = found || read_apple_caches(caches);
+#endif
+    if (!found) {
+        caches = HostCaches();
+        found = read_cpuid_caches(cpus, caches);
+    }
+    if (!found) {
+        caches = HostCaches();
+        caches.llc = generic.last_level_cache_size;
+    }
+
+    uint64_t llc = caches.llc * caches.llc_count;
+    float balance = calibrate_balance(llc, caches.line_size);
+
+    MachineParams params(cpus, llc, balance);
+    // Only keep L1 and L2 sizes if they're distinct levels of the
+    // hierarchy below the last-level cache.
+    if (caches.l1 > 0 && caches.l1 < caches.l2 && caches.l2 < caches.llc) {
+        params.l1_cache_size = caches.l1;
+        params.l2_cache_size = caches.l2;
+    }
+
+    debug(1) << "Detected host MachineParams: " << params.to_string() << "\n";
+    return params;
+}
+
+}  // namespace
+
 }  // namespace Internal
 
 MachineParams MachineParams::generic() {
@@ -3541,18 +4344,34 @@ MachineParams MachineParams::generic() {
     }
 }
 
+MachineParams MachineParams::host() {
+    static const MachineParams params = Internal::detect_host_machine_params();
+    return params;
+}
+
 std::string MachineParams::to_string() const {
     std::ostringstream o;
     o << parallelism << "," << last_level_cache_size << "," << balance;
+    if (l1_cache_size || l2_cache_size) {
+        o << "," << l1_cache_size << "," << l2_cache_size;
+    }
     return o.str();
 }
 
 MachineParams::MachineParams(const std::string &s) {
+    if (s == "host") {
+        *this = host();
+        return;
+    }
     std::vector<std::string> v = Internal::split_string(s, ",");
-    user_assert(v.size() == 3) << "Unable to parse MachineParams: " << s;
+    user_assert(v.size() == 3 || v.size() == 5) << "Unable to parse MachineParams: " << s;
     parallelism = std::atoi(v[0].c_str());
     last_level_cache_size = std::atoll(v[1].c_str());
     balance = std::atof(v[2].c_str());
+    if (v.size() == 5) {
+        l1_cache_size = std::atoll(v[3].c_str());
+        l2_cache_size = std::atoll(v[4].c_str());
+    }
 }
 
 }  // namespace Halide
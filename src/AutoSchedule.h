@@ -21,17 +21,37 @@ struct MachineParams {
     /** Indicates how much more expensive is the cost of a load compared to
      * the cost of an arithmetic operation at last level cache. */
     float balance;
+    /** Sizes of the first and second level data caches of each core (in
+     * bytes). Zero if unknown, in which case the auto-scheduler only
+     * models the last-level cache. */
+    uint64_t l1_cache_size = 0;
+    uint64_t l2_cache_size = 0;
 
     explicit MachineParams(int parallelism, uint64_t llc, float balance)
         : parallelism(parallelism), last_level_cache_size(llc), balance(balance) {}
 
+    explicit MachineParams(int parallelism, uint64_t llc, float balance,
+                           uint64_t l1, uint64_t l2)
+        : parallelism(parallelism), last_level_cache_size(llc), balance(balance),
+          l1_cache_size(l1), l2_cache_size(l2) {}
+
     /** Default machine parameters for generic CPU architecture. */
     static MachineParams generic();
 
+    /** Machine parameters for the host. The core count and cache
+     * hierarchy are read from the OS (or cpuid), and the balance is
+     * measured by a short microbenchmark. The last-level cache size is
+     * the total over all the last-level caches in the machine, e.g. on
+     * all sockets. This is only computed the first time it's called,
+     * which takes a fraction of a second. */
+    static MachineParams host();
+
     /** Convert the MachineParams into canonical string form. */
     std::string to_string() const;
 
-    /** Reconstruct a MachineParams from canonical string form. */
+    /** Reconstruct a MachineParams from canonical string form, which is
+     * "parallelism,llc,balance" or "parallelism,llc,balance,l1,l2". The
+     * string "host" gives MachineParams::host(). */
     explicit MachineParams(const std::string &s);
 };
 
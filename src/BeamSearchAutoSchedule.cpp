@@ -0,0 +1,865 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "AutoScheduleUtils.h"
+#include "BeamSearchAutoSchedule.h"
+#include "Bounds.h"
+#include "FindCalls.h"
+#include "Func.h"
+#include "IROperator.h"
+#include "RealizationOrder.h"
+#include "RegionCosts.h"
+#include "Simplify.h"
+#include "Util.h"
+
+namespace Halide {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+class AnalyticCostModel : public AutoScheduleCostModel {
+public:
+    double evaluate(const vector<AutoScheduleStageFeatures> &stages,
+                    const MachineParams &params) override {
+        const double parallelism = std::max(params.parallelism, 1);
+        // Each core gets an equal share of the last level cache.
+        const double cache_per_core = params.last_level_cache_size / parallelism;
+        // The cost, in arithmetic operations, of allocating storage and
+        // of launching a parallel task.
+        const double allocation_cost = 100;
+        const double task_cost = 500;
+
+        double total = 0;
+        for (const AutoScheduleStageFeatures &s : stages) {
+            double lanes = std::max(1.0, s.vector_width * s.vector_utilization);
+            double compute = s.arith / lanes;
+
+            // Loads from a footprint that stays in cache cost about as
+            // much as arithmetic; anything else goes to memory.
+            double load_cost = s.footprint_bytes <= cache_per_core ? 1 : params.balance;
+            double store_cost = s.instance_bytes <= cache_per_core ? 1 : params.balance;
+            double memory = (s.bytes_loaded * load_cost + s.bytes_stored * store_cost) / lanes;
+
+            double cores = std::min(std::max(s.parallel_tasks, 1.0), parallelism);
+            total += (compute + memory) / cores;
+            total += s.instances * allocation_cost / cores;
+            if (s.parallel_tasks > 1) {
+                total += s.parallel_tasks * task_cost / cores;
+            }
+        }
+        return total;
+    }
+};
+
+}  // namespace
+
+std::shared_ptr<AutoScheduleCostModel> default_auto_schedule_cost_model() {
+    return std::make_shared<AnalyticCostModel>();
+}
+
+std::function<string(Pipeline, const Target &, const MachineParams &)>
+beam_search_auto_scheduler(const BeamSearchOptions &options) {
+    return [=](Pipeline p, const Target &target, const MachineParams &params) {
+        vector<Internal::Function> outputs;
+        for (Func f : p.outputs()) {
+            outputs.push_back(f.function());
+        }
+        return Internal::generate_beam_search_schedules(outputs, target, params, options);
+    };
+}
+
+namespace Internal {
+
+namespace {
+
+// The region of a Func computed by one instance of it, as constant
+// mins and extents of each dimension.
+struct Region {
+    bool known = false;
+    vector<int64_t> min, extent;
+
+    int64_t size() const {
+        int64_t s = 1;
+        for (int64_t e : extent) {
+            s *= e;
+        }
+        return s;
+    }
+
+    void merge(const Region &other) {
+        if (!known || !other.known) {
+            known = false;
+            return;
+        }
+        internal_assert(min.size() == other.min.size());
+        for (size_t i = 0; i < min.size(); i++) {
+            int64_t max = std::max(min[i] + extent[i], other.min[i] + other.extent[i]);
+            min[i] = std::min(min[i], other.min[i]);
+            extent[i] = max - min[i];
+        }
+    }
+
+    string key() const {
+        std::ostringstream s;
+        for (size_t i = 0; i < min.size(); i++) {
+            s << min[i] << "+" << extent[i] << ",";
+        }
+        return s.str();
+    }
+};
+
+bool const_value(const Expr &e, int64_t &value) {
+    if (!e.defined()) {
+        return false;
+    }
+    Expr s = simplify(subsitute_var_estimates(e));
+    const int64_t *v = as_const_int(s);
+    if (!v) {
+        return false;
+    }
+    value = *v;
+    return true;
+}
+
+Region box_to_region(const Box &b) {
+    Region r;
+    r.known = true;
+    for (size_t i = 0; i < b.size(); i++) {
+        int64_t min, max;
+        if (!const_value(b[i].min, min) || !const_value(b[i].max, max)) {
+            r.known = false;
+            return r;
+        }
+        r.min.push_back(min);
+        r.extent.push_back(std::max(max - min + 1, (int64_t)1));
+    }
+    return r;
+}
+
+string sanitized_name(const string &name) {
+    string s = name;
+    for (char &c : s) {
+        if (!isalnum(c)) {
+            c = '_';
+        }
+    }
+    return s;
+}
+
+int64_t ceil_div(int64_t a, int64_t b) {
+    return (a + b - 1) / b;
+}
+
+// The schedule chosen for one Func.
+struct Choice {
+    enum Kind {
+        Undecided,
+        Inline,
+        Root,
+        ComputeAt
+    } kind = Undecided;
+
+    // For Root: the innermost dimension is split by tile_x, and the
+    // next dimension by tile_y, and the tiles are parallelized. Zero
+    // means not split.
+    int64_t tile_x = 0, tile_y = 0;
+
+    // For ComputeAt: the Func whose tile loop this is computed at.
+    int at = -1;
+};
+
+struct State {
+    vector<Choice> choices;
+    double cost = 0;
+};
+
+class BeamSearch {
+    const Target &target;
+    const MachineParams &params;
+    AutoScheduleCostModel &model;
+
+    map<string, Function> env;
+    // Realization order: producers come before consumers.
+    vector<string> order;
+    vector<Function> funcs;
+    map<string, int> index;
+    vector<bool> is_output, can_inline;
+    vector<vector<int>> callers, callees;
+    vector<Region> root_region;
+    vector<int> vector_width;
+    vector<int64_t> bytes_per_point;
+
+    FuncValueBounds func_val_bounds;
+    RegionCosts costs;
+
+    map<string, map<string, Region>> required_cache;
+    map<string, Cost> cost_cache;
+
+    // The Funcs inlined into f, directly or through other inlined Funcs.
+    void inlined_into(int f, const State &s, set<string> &result) const {
+        for (int g : callees[f]) {
+            if (s.choices[g].kind == Choice::Inline && result.insert(funcs[g].name()).second) {
+                inlined_into(g, s, result);
+            }
+        }
+    }
+
+    string inline_key(const set<string> &inlines) const {
+        std::ostringstream key;
+        for (const string &n : inlines) {
+            key << n << ",";
+        }
+        return key.str();
+    }
+
+    // The regions of other Funcs and inputs loaded by one instance of f
+    // computing the given region.
+    const map<string, Region> &required(int f, const Region &region, const set<string> &inlines) {
+        string key = funcs[f].name() + ":" + region.key() + ":" + inline_key(inlines);
+        auto it = required_cache.find(key);
+        if (it != required_cache.end()) {
+            return it->second;
+        }
+
+        map<string, Region> &result = required_cache[key];
+        const Function &fn = funcs[f];
+        if (fn.has_extern_definition() || !region.known) {
+            // Extern Funcs may load anything from their inputs.
+            for (int g : callees[f]) {
+                result[funcs[g].name()] = Region();
+            }
+            return result;
+        }
+
+        DimBounds pure_bounds;
+        for (size_t d = 0; d < fn.args().size(); d++) {
+            pure_bounds.emplace(fn.args()[d],
+                                Interval(make_const(Int(32), region.min[d]),
+                                         make_const(Int(32), region.min[d] + region.extent[d] - 1)));
+        }
+
+        map<string, Box> boxes;
+        for (int s = 0; s <= (int)fn.updates().size(); s++) {
+            Definition def = get_stage_definition(fn, s);
+            Scope<Interval> scope;
+            for (const auto &b : get_stage_bounds(fn, s, pure_bounds)) {
+                scope.push(b.first, b.second);
+            }
+            vector<Expr> exprs = def.values();
+            exprs.insert(exprs.end(), def.args().begin(), def.args().end());
+            for (const Expr &e : exprs) {
+                Expr inlined = perform_inline(e, env, inlines, order);
+                for (const auto &b : boxes_required(inlined, scope, func_val_bounds)) {
+                    if (b.first == fn.name()) {
+                        continue;
+                    }
+                    auto existing = boxes.find(b.first);
+                    if (existing == boxes.end()) {
+                        boxes.emplace(b.first, b.second);
+                    } else {
+                        merge_boxes(existing->second, b.second);
+                    }
+                }
+            }
+        }
+        for (const auto &b : boxes) {
+            result[b.first] = box_to_region(b.second);
+        }
+        return result;
+    }
+
+    // The cost of computing a single value of a stage of f.
+    Cost value_cost(int f, int stage, const set<string> &inlines) {
+        string key = funcs[f].name() + "." + std::to_string(stage) + ":" + inline_key(inlines);
+        auto it = cost_cache.find(key);
+        if (it != cost_cache.end()) {
+            return it->second;
+        }
+        Cost c = costs.get_func_stage_cost(funcs[f], stage, inlines);
+        int64_t arith = 0, memory = 0;
+        if (c.defined()) {
+            const_value(c.arith, arith);
+            const_value(c.memory, memory);
+        }
+        return cost_cache[key] = Cost(arith, memory);
+    }
+
+    // The number of times a stage runs per value of the pure
+    // dimensions, which is the extent of its reduction domain.
+    int64_t rvar_points(int f, int stage) const {
+        if (stage == 0 || funcs[f].has_extern_definition()) {
+            return 1;
+        }
+        int64_t points = 1;
+        for (const ReductionVariable &rv : funcs[f].update(stage - 1).schedule().rvars()) {
+            int64_t extent;
+            if (const_value(rv.extent, extent)) {
+                points *= std::max(extent, (int64_t)1);
+            }
+        }
+        return points;
+    }
+
+    // Whether dimension d of f is a pure variable of an update stage.
+    bool pure_in_update(int f, int stage, int d) const {
+        const Definition &def = funcs[f].update(stage - 1);
+        const Variable *v = def.args()[d].as<Variable>();
+        return v && v->name == funcs[f].args()[d];
+    }
+
+    Choice effective_choice(const State &s, int f) const {
+        Choice c = s.choices[f];
+        if (c.kind == Choice::Undecided) {
+            c.kind = can_inline[f] && !root_region[f].known ? Choice::Inline : Choice::Root;
+        }
+        return c;
+    }
+
+    // The Funcs that load f: its callers, looking through inlined ones.
+    void consumers_of(int f, const State &s, set<int> &result) const {
+        for (int c : callers[f]) {
+            if (effective_choice(s, c).kind == Choice::Inline) {
+                consumers_of(c, s, result);
+            } else {
+                result.insert(c);
+            }
+        }
+    }
+
+    // The tiled root Func whose tile loop f would be computed in if it
+    // were computed with its consumer, or -1 if there isn't one.
+    int tile_owner(int f, const State &s) const {
+        Choice c = effective_choice(s, f);
+        if (c.kind == Choice::Root && c.tile_x > 0) {
+            return f;
+        } else if (c.kind == Choice::ComputeAt) {
+            return c.at;
+        }
+        return -1;
+    }
+
+    // The region of a tiled root Func computed by one iteration of its
+    // tile loop.
+    Region tile_region(int f, const Choice &c) const {
+        Region r = root_region[f];
+        for (size_t d = 0; d < r.extent.size(); d++) {
+            if (d == 0) {
+                r.extent[d] = c.tile_x;
+            } else if (d == 1 && c.tile_y > 0) {
+                r.extent[d] = c.tile_y;
+            } else {
+                r.extent[d] = 1;
+            }
+        }
+        return r;
+    }
+
+    int64_t num_tiles(int f, const Choice &c) const {
+        const Region &r = root_region[f];
+        int64_t n = 1;
+        for (size_t d = 0; d < r.extent.size(); d++) {
+            if (d == 0) {
+                n *= ceil_div(r.extent[d], c.tile_x);
+            } else if (d == 1 && c.tile_y > 0) {
+                n *= ceil_div(r.extent[d], c.tile_y);
+            } else {
+                n *= r.extent[d];
+            }
+        }
+        return n;
+    }
+
+    // The extent of the loop parallelized for a root Func, or 1.
+    int64_t root_parallel_tasks(int f, const Choice &c) const {
+        const Region &r = root_region[f];
+        size_t dims = r.extent.size();
+        if (!r.known || dims == 0) {
+            return 1;
+        }
+        if (dims >= 3 || (dims == 2 && c.tile_y == 0)) {
+            return r.extent[dims - 1];
+        } else if (dims == 2) {
+            return ceil_div(r.extent[1], c.tile_y);
+        } else if (c.tile_x > 0) {
+            return ceil_div(r.extent[0], c.tile_x);
+        }
+        return 1;
+    }
+
+    double region_bytes(const string &name, const Region &r) const {
+        if (!r.known) {
+            return 0;
+        }
+        auto it = index.find(name);
+        if (it != index.end()) {
+            return (double)r.size() * bytes_per_point[it->second];
+        }
+        auto input = costs.inputs.find(name);
+        if (input != costs.inputs.end()) {
+            return (double)r.size() * input->second.bytes();
+        }
+        return 0;
+    }
+
+    vector<AutoScheduleStageFeatures> features(const State &s) {
+        size_t n = funcs.size();
+        vector<Region> region(n);
+        vector<double> instances(n, 1), tasks(n, 1);
+        vector<AutoScheduleStageFeatures> result;
+
+        // Visit consumers before producers.
+        for (int f = (int)n - 1; f >= 0; f--) {
+            Choice c = effective_choice(s, f);
+            if (c.kind == Choice::Inline) {
+                continue;
+            }
+
+            if (c.kind == Choice::Root) {
+                region[f] = root_region[f];
+                tasks[f] = root_parallel_tasks(f, c);
+            } else {
+                // The union of the regions each consumer loads per tile.
+                set<int> consumers;
+                consumers_of(f, s, consumers);
+                bool first = true;
+                for (int g : consumers) {
+                    Choice gc = effective_choice(s, g);
+                    Region per_tile = gc.kind == Choice::Root ? tile_region(g, gc) : region[g];
+                    set<string> inlines;
+                    inlined_into(g, s, inlines);
+                    const map<string, Region> &req = required(g, per_tile, inlines);
+                    auto it = req.find(funcs[f].name());
+                    Region r = it == req.end() ? Region() : it->second;
+                    if (first) {
+                        region[f] = r;
+                        first = false;
+                    } else {
+                        region[f].merge(r);
+                    }
+                }
+                instances[f] = num_tiles(c.at, effective_choice(s, c.at));
+                tasks[f] = tasks[c.at];
+            }
+
+            set<string> inlines;
+            inlined_into(f, s, inlines);
+            const Region &r = region[f];
+            if (!r.known) {
+                continue;
+            }
+
+            // The footprint of the innermost tile.
+            Region inner = (c.kind == Choice::Root && c.tile_x > 0) ? tile_region(f, c) : r;
+            double footprint = region_bytes(funcs[f].name(), inner);
+            for (const auto &i : required(f, inner, inlines)) {
+                footprint += region_bytes(i.first, i.second);
+            }
+
+            int64_t inner_extent = inner.extent.empty() ? 1 : inner.extent[0];
+            for (int stage = 0; stage <= (int)funcs[f].updates().size(); stage++) {
+                AutoScheduleStageFeatures ft;
+                ft.func = funcs[f].name();
+                ft.stage = stage;
+                ft.compute_root = c.kind == Choice::Root;
+                ft.instances = instances[f];
+                ft.points = instances[f] * (double)r.size() * rvar_points(f, stage);
+                Cost vc = value_cost(f, stage, inlines);
+                ft.arith = ft.points * *as_const_int(vc.arith);
+                ft.bytes_loaded = ft.points * *as_const_int(vc.memory);
+                ft.bytes_stored = ft.points * bytes_per_point[f];
+                ft.instance_bytes = region_bytes(ft.func, r);
+                ft.footprint_bytes = footprint;
+
+                bool vectorized = inner_extent >= vector_width[f];
+                bool parallel = tasks[f] > 1;
+                if (stage > 0) {
+                    const Definition &def = funcs[f].update(stage - 1);
+                    size_t dims = def.args().size();
+                    vectorized = (vectorized && dims > 0 && def.schedule().rvars().empty() &&
+                                  pure_in_update(f, stage, 0));
+                    parallel = parallel && dims > 1 && pure_in_update(f, stage, dims - 1);
+                }
+                if (vectorized) {
+                    ft.vector_width = vector_width[f];
+                    ft.vector_utilization =
+                        (double)inner_extent / (ceil_div(inner_extent, vector_width[f]) * vector_width[f]);
+                }
+                ft.parallel_tasks = parallel ? tasks[f] : 1;
+                result.push_back(ft);
+            }
+        }
+        return result;
+    }
+
+    vector<Choice> options(int f, const State &s) const {
+        vector<Choice> result;
+        const Function &fn = funcs[f];
+
+        if (can_inline[f]) {
+            Choice c;
+            c.kind = Choice::Inline;
+            result.push_back(c);
+            if (!root_region[f].known) {
+                // Funcs we can't bound can only be inlined.
+                return result;
+            }
+        }
+
+        Choice root;
+        root.kind = Choice::Root;
+        result.push_back(root);
+
+        const Region &r = root_region[f];
+        if (!r.known || fn.has_extern_definition() || r.extent.empty()) {
+            return result;
+        }
+
+        // Tilings of the innermost two dimensions.
+        int vw = vector_width[f];
+        for (int64_t tx : {2 * vw, 8 * vw, 32 * vw}) {
+            if (tx > r.extent[0]) {
+                continue;
+            }
+            for (int64_t ty : {0, 4, 16, 64}) {
+                if (ty > 0 && (r.extent.size() < 2 || ty > r.extent[1])) {
+                    continue;
+                }
+                Choice c = root;
+                c.tile_x = tx;
+                c.tile_y = ty;
+                result.push_back(c);
+            }
+        }
+
+        // Computing at the tiles of the consumers, if they all share them.
+        if (!is_output[f]) {
+            set<int> consumers;
+            consumers_of(f, s, consumers);
+            int owner = -1;
+            bool shared = !consumers.empty();
+            for (int g : consumers) {
+                int o = funcs[g].has_extern_definition() ? -1 : tile_owner(g, s);
+                if (o < 0 || (owner >= 0 && o != owner)) {
+                    shared = false;
+                    break;
+                }
+                owner = o;
+            }
+            if (shared) {
+                Choice c;
+                c.kind = Choice::ComputeAt;
+                c.at = owner;
+                result.push_back(c);
+            }
+        }
+
+        return result;
+    }
+
+public:
+    BeamSearch(const vector<Function> &outputs,
+               const map<string, Function> &env_in,
+               const vector<string> &order_in,
+               const Target &target,
+               const MachineParams &params,
+               AutoScheduleCostModel &model)
+        : target(target), params(params), model(model),
+          env(env_in), order(order_in), costs(env_in, order_in) {
+        for (const string &name : order) {
+            index[name] = (int)funcs.size();
+            funcs.push_back(env.at(name));
+        }
+        size_t n = funcs.size();
+        is_output.resize(n, false);
+        for (const Function &f : outputs) {
+            is_output[index.at(f.name())] = true;
+        }
+
+        callers.resize(n);
+        callees.resize(n);
+        can_inline.resize(n);
+        vector_width.resize(n);
+        bytes_per_point.resize(n);
+        for (size_t f = 0; f < n; f++) {
+            for (const auto &i : find_direct_calls(funcs[f])) {
+                auto it = index.find(i.first);
+                if (it != index.end() && it->second != (int)f) {
+                    callees[f].push_back(it->second);
+                    callers[it->second].push_back(f);
+                }
+            }
+            const Function &fn = funcs[f];
+            can_inline[f] = (!is_output[f] && !fn.has_extern_definition() &&
+                             fn.updates().empty() && fn.can_be_inlined());
+            vector_width[f] = target.natural_vector_size(fn.output_types()[0]);
+            int64_t bytes = 0;
+            for (const Type &t : fn.output_types()) {
+                bytes += t.bytes();
+            }
+            bytes_per_point[f] = bytes;
+        }
+        // Extern consumers may load anything.
+        for (size_t f = 0; f < n; f++) {
+            if (funcs[f].has_extern_definition()) {
+                for (int g : callees[f]) {
+                    can_inline[g] = false;
+                }
+            }
+        }
+
+        func_val_bounds = compute_function_value_bounds(order, env);
+
+        // The bounds of each Func when computed at root, given the
+        // estimates on the outputs.
+        root_region.resize(n);
+        for (const Function &out : outputs) {
+            Region &r = root_region[index.at(out.name())];
+            r.known = true;
+            for (const string &arg : out.args()) {
+                int64_t min = 0, extent = 0;
+                for (const Bound &b : out.schedule().estimates()) {
+                    if (b.var == arg && b.min.defined() && b.extent.defined()) {
+                        const_value(b.min, min);
+                        const_value(b.extent, extent);
+                    }
+                }
+                r.min.push_back(min);
+                r.extent.push_back(std::max(extent, (int64_t)1));
+            }
+        }
+        vector<bool> seen(n, false);
+        for (int f = (int)n - 1; f >= 0; f--) {
+            if (is_output[f]) {
+                seen[f] = true;
+            }
+            const map<string, Region> &req = required(f, root_region[f], set<string>());
+            for (int g : callees[f]) {
+                if (is_output[g]) {
+                    continue;
+                }
+                auto it = req.find(funcs[g].name());
+                Region r = it == req.end() ? Region() : it->second;
+                if (!seen[g]) {
+                    root_region[g] = r;
+                    seen[g] = true;
+                } else {
+                    root_region[g].merge(r);
+                }
+            }
+        }
+    }
+
+    State search(int beam_size) {
+        State initial;
+        initial.choices.resize(funcs.size());
+        vector<State> beam = {initial};
+
+        for (int f = (int)funcs.size() - 1; f >= 0; f--) {
+            vector<State> next;
+            for (const State &s : beam) {
+                for (const Choice &c : options(f, s)) {
+                    State candidate = s;
+                    candidate.choices[f] = c;
+                    candidate.cost = model.evaluate(features(candidate), params);
+                    next.push_back(candidate);
+                }
+            }
+            std::stable_sort(next.begin(), next.end(),
+                             [](const State &a, const State &b) { return a.cost < b.cost; });
+            if ((int)next.size() > beam_size) {
+                next.resize(beam_size);
+            }
+            beam.swap(next);
+            debug(2) << "Beam search: scheduled " << funcs[f].name()
+                     << ", best cost so far " << beam[0].cost << "\n";
+        }
+        return beam[0];
+    }
+
+    // Apply a schedule, and return the equivalent source code.
+    string apply(const State &s, const vector<string> &top_order) {
+        std::ostringstream funcs_ss, schedule_ss;
+
+        for (size_t f = 0; f < funcs.size(); f++) {
+            const Choice &c = s.choices[f];
+            if (c.kind == Choice::Inline) {
+                continue;
+            }
+            const Function &fn = funcs[f];
+            Func handle(fn);
+            string name = sanitized_name(fn.name());
+            size_t position = std::find(top_order.begin(), top_order.end(), fn.name()) - top_order.begin();
+            funcs_ss << "Func " << name << " = pipeline.get_func(" << position << ");\n";
+
+            const vector<string> &args = fn.args();
+            size_t dims = args.size();
+            const Region &r = root_region[f];
+            int vw = vector_width[f];
+            vector<string> stage0;
+            set<string> new_vars;
+
+            auto var = [&](const string &n) { return Var(n); };
+            string x = dims > 0 ? args[0] : "";
+            string y = dims > 1 ? args[1] : "";
+
+            if (c.kind == Choice::Root) {
+                handle.compute_root();
+                stage0.push_back("compute_root()");
+                if (c.tile_x > 0 && (dims == 1 || c.tile_y == 0)) {
+                    handle.split(var(x), var(x + "_o"), var(x + "_i"), (int)c.tile_x);
+                    stage0.push_back("split(" + x + ", " + x + "_o, " + x + "_i, " + std::to_string(c.tile_x) + ")");
+                    new_vars.insert({x + "_o", x + "_i"});
+                } else if (c.tile_x > 0) {
+                    handle.tile(var(x), var(y), var(x + "_o"), var(y + "_o"), var(x + "_i"), var(y + "_i"),
+                                (int)c.tile_x, (int)c.tile_y);
+                    stage0.push_back("tile(" + x + ", " + y + ", " + x + "_o, " + y + "_o, " + x + "_i, " + y + "_i, " +
+                                     std::to_string(c.tile_x) + ", " + std::to_string(c.tile_y) + ")");
+                    new_vars.insert({x + "_o", y + "_o", x + "_i", y + "_i"});
+                }
+
+                if (c.tile_x > 0) {
+                    handle.vectorize(var(x + "_i"), vw);
+                    stage0.push_back("vectorize(" + x + "_i, " + std::to_string(vw) + ")");
+                } else if (r.known && dims > 0 && r.extent[0] >= vw) {
+                    handle.vectorize(var(x), vw);
+                    stage0.push_back("vectorize(" + x + ", " + std::to_string(vw) + ")");
+                }
+
+                if (r.known && root_parallel_tasks(f, c) > 1) {
+                    string p;
+                    if (dims >= 3 || (dims == 2 && c.tile_y == 0)) {
+                        p = args[dims - 1];
+                    } else if (dims == 2) {
+                        p = y + "_o";
+                    } else {
+                        p = x + "_o";
+                    }
+                    handle.parallel(var(p));
+                    stage0.push_back("parallel(" + p + ")");
+                }
+            } else {
+                const Function &at = funcs[c.at];
+                string at_var = at.args()[0] + "_o";
+                handle.compute_at(Func(at), var(at_var));
+                stage0.push_back("compute_at(" + sanitized_name(at.name()) + ", " + at_var + ")");
+                new_vars.insert(at_var);
+                if (dims > 0 && r.known && r.extent[0] >= vw) {
+                    handle.vectorize(var(x), vw);
+                    stage0.push_back("vectorize(" + x + ", " + std::to_string(vw) + ")");
+                }
+            }
+
+            // Updates of root Funcs are vectorized and parallelized over
+            // their pure dimensions.
+            vector<vector<string>> updates(fn.updates().size());
+            if (c.kind == Choice::Root && r.known && !fn.has_extern_definition()) {
+                for (size_t u = 0; u < fn.updates().size(); u++) {
+                    int stage = (int)u + 1;
+                    if (dims > 0 && r.extent[0] >= vw && fn.update(u).schedule().rvars().empty() &&
+                        pure_in_update(f, stage, 0)) {
+                        handle.update(u).vectorize(var(x), vw);
+                        updates[u].push_back("vectorize(" + x + ", " + std::to_string(vw) + ")");
+                    }
+                    if (dims > 1 && r.extent[dims - 1] > 1 && pure_in_update(f, stage, dims - 1)) {
+                        handle.update(u).parallel(var(args[dims - 1]));
+                        updates[u].push_back("parallel(" + args[dims - 1] + ")");
+                    }
+                }
+            }
+
+            schedule_ss << "{\n";
+            for (size_t d = 0; d < dims; d++) {
+                schedule_ss << "    Var " << args[d] << " = " << name << ".args()[" << d << "];\n";
+            }
+            for (const string &v : new_vars) {
+                schedule_ss << "    Var " << v << "(\"" << v << "\");\n";
+            }
+            schedule_ss << "    " << name;
+            for (const string &d : stage0) {
+                schedule_ss << "\n        ." << d;
+            }
+            schedule_ss << ";\n";
+            for (size_t u = 0; u < updates.size(); u++) {
+                if (updates[u].empty()) {
+                    continue;
+                }
+                schedule_ss << "    " << name << ".update(" << u << ")";
+                for (const string &d : updates[u]) {
+                    schedule_ss << "\n        ." << d;
+                }
+                schedule_ss << ";\n";
+            }
+            schedule_ss << "}\n";
+        }
+
+        std::ostringstream oss;
+        oss << "// Delete this line if not using Generator\n";
+        oss << "Pipeline pipeline = get_pipeline();\n\n";
+        oss << funcs_ss.str() << "\n" << schedule_ss.str();
+        return oss.str();
+    }
+};
+
+}  // namespace
+
+string generate_beam_search_schedules(const vector<Function> &outputs,
+                                      const Target &target,
+                                      const MachineParams &params,
+                                      const BeamSearchOptions &options) {
+    user_assert(options.beam_size > 0) << "The beam size must be positive\n";
+
+    map<string, Function> env;
+    for (const Function &f : outputs) {
+        map<string, Function> more_funcs = find_transitive_calls(f);
+        env.insert(more_funcs.begin(), more_funcs.end());
+    }
+    for (auto &iter : env) {
+        iter.second.lock_loop_levels();
+    }
+
+    for (const Function &out : outputs) {
+        for (const string &arg : out.args()) {
+            bool found = false;
+            for (const Bound &b : out.schedule().estimates()) {
+                found |= (b.var == arg && b.min.defined() && b.extent.defined() &&
+                          b.min.type().is_int() && b.extent.type().is_int());
+            }
+            user_assert(found)
+                << "Please provide a valid estimate for dimension "
+                << arg << " of output \"" << out.name() << "\"\n";
+        }
+    }
+
+    vector<string> top_order = topological_order(outputs, env);
+    vector<string> order = realization_order(outputs, env).first;
+
+    std::shared_ptr<AutoScheduleCostModel> model = options.cost_model;
+    if (!model) {
+        model = default_auto_schedule_cost_model();
+    }
+
+    BeamSearch search(outputs, env, order, target, params, *model);
+    State best = search.search(options.beam_size);
+
+    std::ostringstream oss;
+    oss << "// Target: " << target.to_string() << "\n";
+    oss << "// MachineParams: " << params.to_string() << "\n";
+    oss << "// Beam size: " << options.beam_size << "\n";
+    oss << "// Estimated cost: " << best.cost << "\n";
+    oss << "\n";
+    oss << search.apply(best, top_order);
+    string sched_string = oss.str();
+
+    debug(3) << "\n\n*******************************\nSchedule:\n"
+             << "*******************************\n" << sched_string << "\n\n";
+
+    return sched_string;
+}
+
+}  // namespace Internal
+}  // namespace Halide
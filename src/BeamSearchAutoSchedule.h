@@ -0,0 +1,134 @@
+#ifndef HALIDE_BEAM_SEARCH_AUTO_SCHEDULE_H
+#define HALIDE_BEAM_SEARCH_AUTO_SCHEDULE_H
+
+/** \file
+ *
+ * Defines an auto-scheduler that runs a beam search over schedules,
+ * scored by a replaceable cost model. Use it in place of the default
+ * auto-scheduler with:
+ *
+ \code
+ Pipeline::set_custom_auto_scheduler(beam_search_auto_scheduler());
+ \endcode
+ */
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Function.h"
+#include "Pipeline.h"
+#include "Target.h"
+
+namespace Halide {
+
+/** What the beam search auto-scheduler knows about one stage of a
+ * Func under a candidate schedule. Inlined Funcs have no stages of
+ * their own; their cost is included in the stages that call them. All
+ * quantities are totals for one run of the pipeline, and are
+ * estimates derived from the estimates on the outputs and inputs. */
+struct AutoScheduleStageFeatures {
+    /** The Func and the stage (0 for the pure definition, 1 + i for
+     * update i). */
+    std::string func;
+    int stage = 0;
+
+    /** Whether the Func is computed at root, rather than within a tile
+     * of one of its consumers. */
+    bool compute_root = true;
+
+    /** The number of values computed, including those computed more
+     * than once because the tiles of a consumer overlap. */
+    double points = 0;
+
+    /** Arithmetic operations and bytes loaded to compute them. */
+    double arith = 0;
+    double bytes_loaded = 0;
+
+    /** Bytes written to the Func's storage. */
+    double bytes_stored = 0;
+
+    /** The number of times the Func's storage is allocated and
+     * computed: once if computed at root, or once per tile of the
+     * consumer it's computed at. */
+    double instances = 1;
+
+    /** The size in bytes of one instance of the Func's storage. */
+    double instance_bytes = 0;
+
+    /** The bytes touched by the innermost tile of the stage: the
+     * regions of its inputs that it loads, and its own output. This
+     * determines whether its loads hit in cache. */
+    double footprint_bytes = 0;
+
+    /** The number of tasks the stage runs in parallel, or 1 if it's
+     * serial. */
+    double parallel_tasks = 1;
+
+    /** The width the stage is vectorized by (1 if it isn't), and the
+     * fraction of vector lanes that compute a useful value. */
+    double vector_width = 1;
+    double vector_utilization = 1;
+};
+
+/** A model of how long a pipeline takes to run given the features of
+ * each of its stages. Lower is better; the units don't matter, as long
+ * as costs of two schedules for the same pipeline can be compared.
+ * Implement this to drive the beam search with, e.g., a learned model. */
+class AutoScheduleCostModel {
+public:
+    virtual ~AutoScheduleCostModel() = default;
+
+    virtual double evaluate(const std::vector<AutoScheduleStageFeatures> &stages,
+                            const MachineParams &params) = 0;
+};
+
+/** Get the default analytic cost model. It charges each stage for its
+ * arithmetic, divided by the vector lanes used, and for its memory
+ * traffic, weighted by MachineParams::balance when its footprint
+ * doesn't fit in each core's share of the last level cache. The result
+ * is divided by the parallelism available to the stage, and overheads
+ * are added for each allocation and parallel task. */
+std::shared_ptr<AutoScheduleCostModel> default_auto_schedule_cost_model();
+
+/** Options for the beam search auto-scheduler. */
+struct BeamSearchOptions {
+    /** How many partial schedules to keep at each step of the search. A
+     * beam size of 1 is a greedy search. */
+    int beam_size = 16;
+
+    /** The cost model used to score schedules. If null, the default
+     * analytic cost model is used. */
+    std::shared_ptr<AutoScheduleCostModel> cost_model;
+};
+
+/** Get an auto-scheduler, to pass to Pipeline::set_custom_auto_scheduler,
+ * that runs a beam search over the schedules of the Funcs in the
+ * pipeline.
+ *
+ * Funcs are scheduled one at a time, from the outputs back to the
+ * inputs. Each Func is inlined, computed at root (optionally tiled,
+ * with the tiles parallelized and vectorized), or computed within the
+ * tiles of the consumer they all share. After each Func, only the
+ * beam_size best partial schedules are kept, with any Funcs not yet
+ * scheduled assumed to be computed at root. Like the default
+ * auto-scheduler, this requires estimates on the outputs, and ignores
+ * any schedules the Funcs already have. */
+std::function<std::string(Pipeline, const Target &, const MachineParams &)>
+beam_search_auto_scheduler(const BeamSearchOptions &options = BeamSearchOptions());
+
+namespace Internal {
+
+/** Run the beam search auto-scheduler on the pipeline with the given
+ * outputs. This applies the best schedule found and returns a string
+ * representation of it. */
+std::string generate_beam_search_schedules(const std::vector<Function> &outputs,
+                                           const Target &target,
+                                           const MachineParams &params,
+                                           const BeamSearchOptions &options);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
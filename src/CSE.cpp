@@ -1,4 +1,5 @@
 #include <map>
+#include <unordered_map>
 
 #include "CSE.h"
 #include "IREquality.h"
@@ -80,35 +81,39 @@ bool should_extract(const Expr &e, bool lift_all) {
 
 // A global-value-numbering of expressions. Returns canonical form of
 // the Expr and writes out a global value numbering as a side-effect.
+//
+// Each Expr is rebuilt from the canonical forms of its children
+// before it's numbered, so two Exprs are equal exactly when their
+// fields are equal and their children have the same numbers. This
+// makes finding an Expr in the numbering take constant time, rather
+// than a number of deep comparisons that grows with the size of the
+// Expr, which is what makes this pass scale to large unrolled and
+// vectorized bodies.
 class GVN : public IRMutator {
 public:
     struct Entry {
         Expr expr;
         int use_count;
+        // A hash of the structure of the expr, consistent with equal().
+        uint64_t hash;
     };
     vector<Entry> entries;
 
-    typedef map<ExprWithCompareCache, int> CacheType;
-    CacheType numbering;
+    // Maps the hash of an entry to its number.
+    std::unordered_multimap<uint64_t, int> numbering;
 
     map<Expr, int, ExprCompare> shallow_numbering;
 
     Scope<int> let_substitutions;
     int number;
 
-    IRCompareCache cache;
-
-    GVN() : number(0), cache(8) {}
+    GVN() : number(0) {}
 
     Stmt mutate(const Stmt &s) override {
         internal_error << "Can't call GVN on a Stmt: " << s << "\n";
         return Stmt();
     }
 
-    ExprWithCompareCache with_cache(Expr e) {
-        return ExprWithCompareCache(e, &cache);
-    }
-
     Expr mutate(const Expr &e) override {
         // Early out if we've already seen this exact Expr.
         {
@@ -129,40 +134,257 @@ public:
             }
         }
 
-        // If e already has an entry, return that.
-        CacheType::iterator iter = numbering.find(with_cache(e));
-        if (iter != numbering.end()) {
-            number = iter->second;
-            shallow_numbering[e] = number;
-            internal_assert(entries[number].expr.type() == e.type());
-            return entries[number].expr;
-        }
-
         // Rebuild using things already in the numbering.
         Expr old_e = e;
         Expr new_e = IRMutator::mutate(e);
 
-        // See if it's there in another form after being rebuilt
+        // See if it's there already, possibly in another form
         // (e.g. because it was a let variable).
-        iter = numbering.find(with_cache(new_e));
-        if (iter != numbering.end()) {
-            number = iter->second;
-            shallow_numbering[old_e] = number;
-            internal_assert(entries[number].expr.type() == old_e.type());
-            return entries[number].expr;
+        uint64_t h = hash(new_e);
+        auto range = numbering.equal_range(h);
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            if (shallow_equal(entries[iter->second].expr, new_e)) {
+                number = iter->second;
+                shallow_numbering[old_e] = number;
+                internal_assert(entries[number].expr.type() == old_e.type());
+                return entries[number].expr;
+            }
         }
 
         // Add it to the numbering.
-        Entry entry = {new_e, 0};
+        Entry entry = {new_e, 0, h};
         number = (int)entries.size();
-        numbering[with_cache(new_e)] = number;
+        numbering.emplace(h, number);
         shallow_numbering[new_e] = number;
         entries.push_back(entry);
         internal_assert(new_e.type() == old_e.type());
         return new_e;
     }
 
+private:
+    static uint64_t mix(uint64_t h, uint64_t x) {
+        return h ^ (x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+    }
+
+    static uint64_t hash_string(const string &s) {
+        return std::hash<string>()(s);
+    }
+
+    // The number of a child, or -1 if it isn't in the numbering (as
+    // for the unvisited predicates of loads).
+    int number_of(const Expr &e) const {
+        map<Expr, int, ExprCompare>::const_iterator iter = shallow_numbering.find(e);
+        return iter == shallow_numbering.end() ? -1 : iter->second;
+    }
+
+    uint64_t hash_child(const Expr &e) const {
+        if (!e.defined()) {
+            return 0;
+        }
+        int n = number_of(e);
+        return n >= 0 ? entries[n].hash : hash(e);
+    }
+
+    uint64_t hash_children(const vector<Expr> &v) const {
+        uint64_t h = v.size();
+        for (const Expr &e : v) {
+            h = mix(h, hash_child(e));
+        }
+        return h;
+    }
+
+    // Hash an Expr using the cached hashes of its children. Only
+    // fields that equal() compares are included.
+    uint64_t hash(const Expr &e) const {
+        Type t = e.type();
+        uint64_t h = mix((uint64_t)e->node_type,
+                         ((uint64_t)t.code() << 32) | ((uint64_t)t.bits() << 16) | (uint64_t)t.lanes());
+        switch (e->node_type) {
+        case IRNodeType::IntImm:
+            return mix(h, (uint64_t)e.as<IntImm>()->value);
+        case IRNodeType::UIntImm:
+            return mix(h, e.as<UIntImm>()->value);
+        case IRNodeType::FloatImm: {
+            double value = e.as<FloatImm>()->value;
+            if (value != value) {
+                // equal() doesn't order NaNs.
+                return h;
+            }
+            // 0.0 and -0.0 are equal.
+            return mix(h, std::hash<double>()(value == 0 ? 0.0 : value));
+        }
+        case IRNodeType::StringImm:
+            return mix(h, hash_string(e.as<StringImm>()->value));
+        case IRNodeType::Cast:
+            return mix(h, hash_child(e.as<Cast>()->value));
+        case IRNodeType::Variable:
+            return mix(h, hash_string(e.as<Variable>()->name));
+        case IRNodeType::Not:
+            return mix(h, hash_child(e.as<Not>()->a));
+        case IRNodeType::Select: {
+            const Select *op = e.as<Select>();
+            h = mix(h, hash_child(op->condition));
+            h = mix(h, hash_child(op->true_value));
+            return mix(h, hash_child(op->false_value));
+        }
+        case IRNodeType::Load: {
+            const Load *op = e.as<Load>();
+            h = mix(h, hash_string(op->name));
+            h = mix(h, hash_child(op->predicate));
+            return mix(h, hash_child(op->index));
+        }
+        case IRNodeType::Ramp: {
+            const Ramp *op = e.as<Ramp>();
+            h = mix(h, hash_child(op->base));
+            return mix(h, hash_child(op->stride));
+        }
+        case IRNodeType::Broadcast:
+            return mix(h, hash_child(e.as<Broadcast>()->value));
+        case IRNodeType::Call: {
+            const Call *op = e.as<Call>();
+            h = mix(h, hash_string(op->name));
+            h = mix(h, ((uint64_t)op->call_type << 32) | (uint64_t)op->value_index);
+            return mix(h, hash_children(op->args));
+        }
+        case IRNodeType::Let: {
+            const Let *op = e.as<Let>();
+            h = mix(h, hash_string(op->name));
+            h = mix(h, hash_child(op->value));
+            return mix(h, hash_child(op->body));
+        }
+        case IRNodeType::Shuffle: {
+            const Shuffle *op = e.as<Shuffle>();
+            h = mix(h, hash_children(op->vectors));
+            for (int i : op->indices) {
+                h = mix(h, (uint64_t)i);
+            }
+            return h;
+        }
+        default: {
+            // The remaining Expr nodes are binary operators.
+            std::pair<Expr, Expr> ab = binary_operands(e);
+            h = mix(h, hash_child(ab.first));
+            return mix(h, hash_child(ab.second));
+        }
+        }
+    }
 
+    static std::pair<Expr, Expr> binary_operands(const Expr &e) {
+        switch (e->node_type) {
+#define HALIDE_GVN_BINARY_OPERANDS(T) \
+        case IRNodeType::T:           \
+            return {e.as<T>()->a, e.as<T>()->b};
+        HALIDE_GVN_BINARY_OPERANDS(Add)
+        HALIDE_GVN_BINARY_OPERANDS(Sub)
+        HALIDE_GVN_BINARY_OPERANDS(Mul)
+        HALIDE_GVN_BINARY_OPERANDS(Div)
+        HALIDE_GVN_BINARY_OPERANDS(Mod)
+        HALIDE_GVN_BINARY_OPERANDS(Min)
+        HALIDE_GVN_BINARY_OPERANDS(Max)
+        HALIDE_GVN_BINARY_OPERANDS(EQ)
+        HALIDE_GVN_BINARY_OPERANDS(NE)
+        HALIDE_GVN_BINARY_OPERANDS(LT)
+        HALIDE_GVN_BINARY_OPERANDS(LE)
+        HALIDE_GVN_BINARY_OPERANDS(GT)
+        HALIDE_GVN_BINARY_OPERANDS(GE)
+        HALIDE_GVN_BINARY_OPERANDS(And)
+        HALIDE_GVN_BINARY_OPERANDS(Or)
+#undef HALIDE_GVN_BINARY_OPERANDS
+        default:
+            internal_error << "Unexpected IR node in GVN: " << e << "\n";
+            return {Expr(), Expr()};
+        }
+    }
+
+    // Children that are both in the numbering are equal only if
+    // they're the same entry. Anything else needs a deep comparison.
+    bool child_equal(const Expr &a, const Expr &b) const {
+        if (a.same_as(b)) {
+            return true;
+        }
+        if (!a.defined() || !b.defined()) {
+            return false;
+        }
+        int na = number_of(a), nb = number_of(b);
+        if (na >= 0 && nb >= 0) {
+            return na == nb;
+        }
+        return equal(a, b);
+    }
+
+    bool children_equal(const vector<Expr> &a, const vector<Expr> &b) const {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (!child_equal(a[i], b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Compare two Exprs with the same hash, looking only one level
+    // deep. Equivalent to equal() when their children are numbered.
+    bool shallow_equal(const Expr &a, const Expr &b) const {
+        if (a.same_as(b)) {
+            return true;
+        }
+        if (a->node_type != b->node_type || a.type() != b.type()) {
+            return false;
+        }
+        switch (a->node_type) {
+        case IRNodeType::IntImm:
+        case IRNodeType::UIntImm:
+        case IRNodeType::FloatImm:
+        case IRNodeType::StringImm:
+        case IRNodeType::Variable:
+            return equal(a, b);
+        case IRNodeType::Cast:
+            return child_equal(a.as<Cast>()->value, b.as<Cast>()->value);
+        case IRNodeType::Not:
+            return child_equal(a.as<Not>()->a, b.as<Not>()->a);
+        case IRNodeType::Select: {
+            const Select *x = a.as<Select>(), *y = b.as<Select>();
+            return (child_equal(x->condition, y->condition) &&
+                    child_equal(x->true_value, y->true_value) &&
+                    child_equal(x->false_value, y->false_value));
+        }
+        case IRNodeType::Load: {
+            const Load *x = a.as<Load>(), *y = b.as<Load>();
+            return (x->name == y->name &&
+                    child_equal(x->predicate, y->predicate) &&
+                    child_equal(x->index, y->index) &&
+                    x->alignment.modulus == y->alignment.modulus &&
+                    x->alignment.remainder == y->alignment.remainder);
+        }
+        case IRNodeType::Ramp: {
+            const Ramp *x = a.as<Ramp>(), *y = b.as<Ramp>();
+            return child_equal(x->base, y->base) && child_equal(x->stride, y->stride);
+        }
+        case IRNodeType::Broadcast:
+            return child_equal(a.as<Broadcast>()->value, b.as<Broadcast>()->value);
+        case IRNodeType::Call: {
+            const Call *x = a.as<Call>(), *y = b.as<Call>();
+            return (x->name == y->name &&
+                    x->call_type == y->call_type &&
+                    x->value_index == y->value_index &&
+                    children_equal(x->args, y->args));
+        }
+        case IRNodeType::Let:
+            return equal(a, b);
+        case IRNodeType::Shuffle: {
+            const Shuffle *x = a.as<Shuffle>(), *y = b.as<Shuffle>();
+            return children_equal(x->vectors, y->vectors) && x->indices == y->indices;
+        }
+        default: {
+            std::pair<Expr, Expr> x = binary_operands(a), y = binary_operands(b);
+            return child_equal(x.first, y.first) && child_equal(x.second, y.second);
+        }
+        }
+    }
+
+public:
     using IRMutator::visit;
 
     Expr visit(const Let *let) override {
@@ -1604,6 +1604,22 @@ void CodeGen_C::compile(const LoweredFunc &f) {
         stream << "const struct halide_filter_metadata_t *" << simple_name << "_metadata() HALIDE_FUNCTION_ATTRS;\n";
     }
 
+    if (f.linkage == LinkageType::ExternalPlusMetadata &&
+        target.has_feature(Target::SlabAlloc)) {
+        // The slab sizes the caller needs to provide.
+        if (is_header()) {
+            stream << "int64_t " << simple_name << "_slab_bytes() HALIDE_FUNCTION_ATTRS;\n";
+            stream << "int64_t " << simple_name << "_task_slab_bytes() HALIDE_FUNCTION_ATTRS;\n";
+        } else {
+            stream << "int64_t " << simple_name << "_slab_bytes() {\n"
+                   << " return " << f.slab_bytes << ";\n"
+                   << "}\n";
+            stream << "int64_t " << simple_name << "_task_slab_bytes() {\n"
+                   << " return " << f.task_slab_bytes << ";\n"
+                   << "}\n";
+        }
+    }
+
     if (!namespaces.empty()) {
         stream << "\n";
         for (size_t i = namespaces.size(); i > 0; i--) {
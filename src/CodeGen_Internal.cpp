@@ -139,6 +139,8 @@ llvm::Type *llvm_type_of(LLVMContext *c, Halide::Type t) {
 // functions that takes a user_context pointer as its first parameter.
 bool function_takes_user_context(const std::string &name) {
     static const char *user_context_runtime_funcs[] = {
+        "halide_arena_create",
+        "halide_arena_malloc",
         "halide_buffer_copy",
         "halide_copy_to_host",
         "halide_copy_to_device",
@@ -165,6 +167,8 @@ bool function_takes_user_context(const std::string &name) {
         "halide_profiler_pipeline_start",
         "halide_profiler_pipeline_end",
         "halide_profiler_stack_peak_update",
+        "halide_profiler_start_counters",
+        "halide_profiler_start_timeline",
         "halide_spawn_thread",
         "halide_device_release",
         "halide_start_clock",
@@ -172,6 +176,7 @@ bool function_takes_user_context(const std::string &name) {
         "halide_trace_helper",
         "halide_memoization_cache_lookup",
         "halide_memoization_cache_store",
+        "halide_memoization_cache_store_with_cost",
         "halide_memoization_cache_release",
         "halide_cuda_run",
         "halide_opencl_run",
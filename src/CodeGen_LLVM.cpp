@@ -14,6 +14,7 @@
 #include "CodeGen_RISCV.h"
 #include "CodeGen_PowerPC.h"
 #include "CodeGen_X86.h"
+#include "CompileTimeReport.h"
 #include "Debug.h"
 #include "Deinterleave.h"
 #include "ExprUsesVar.h"
@@ -475,6 +476,8 @@ struct MangledNames {
     string extern_name;
     string argv_name;
     string metadata_name;
+    string slab_bytes_name;
+    string task_slab_bytes_name;
 };
 
 MangledNames get_mangled_names(const std::string &name,
@@ -488,6 +491,8 @@ MangledNames get_mangled_names(const std::string &name,
     names.extern_name = names.simple_name;
     names.argv_name = names.simple_name + "_argv";
     names.metadata_name = names.simple_name + "_metadata";
+    names.slab_bytes_name = names.simple_name + "_slab_bytes";
+    names.task_slab_bytes_name = names.simple_name + "_task_slab_bytes";
 
     if (linkage != LinkageType::Internal &&
         ((mangling == NameMangling::Default &&
@@ -508,6 +513,8 @@ MangledNames get_mangled_names(const std::string &name,
         Type void_star_star(Handle(1, &inner_type));
         names.argv_name = cplusplus_function_mangled_name(names.argv_name, namespaces, type_of<int>(), { ExternFuncArgument(make_zero(void_star_star)) }, target);
         names.metadata_name = cplusplus_function_mangled_name(names.metadata_name, namespaces, type_of<const struct halide_filter_metadata_t *>(), {}, target);
+        names.slab_bytes_name = cplusplus_function_mangled_name(names.slab_bytes_name, namespaces, type_of<int64_t>(), {}, target);
+        names.task_slab_bytes_name = cplusplus_function_mangled_name(names.task_slab_bytes_name, namespaces, type_of<int64_t>(), {}, target);
     }
     return names;
 }
@@ -521,7 +528,10 @@ MangledNames get_mangled_names(const LoweredFunc &f, const Target &target) {
 std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
     input_module = &input;
 
+    CompileTimeReport report("llvm", input.name());
+
     init_module();
+    report.pass("init_module", *module);
 
     debug(1) << "Target triple of initial module: " << module->getTargetTriple() << "\n";
 
@@ -588,6 +598,10 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
             llvm::Function *wrapper = add_argv_wrapper(names.argv_name);
             llvm::Function *metadata_getter = embed_metadata_getter(names.metadata_name,
                 names.simple_name, f.args, input.get_metadata_name_map());
+            if (get_target().has_feature(Target::SlabAlloc)) {
+                embed_constant_getter(names.slab_bytes_name, f.slab_bytes);
+                embed_constant_getter(names.task_slab_bytes_name, f.task_slab_bytes);
+            }
 
             if (target.has_feature(Target::Matlab)) {
                 define_matlab_wrapper(module.get(), wrapper, metadata_getter);
@@ -595,14 +609,17 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
         }
     }
 
+    report.pass("generate_llvm_ir", *module);
     debug(2) << module.get() << "\n";
 
     // Verify the module is ok
     internal_assert(!verifyModule(*module, &llvm::errs()));
     debug(2) << "Done generating llvm bitcode\n";
+    report.pass("verify_module", *module);
 
     // Optimize
     CodeGen_LLVM::optimize_module();
+    report.pass("optimize_module", *module);
 
     if (target.has_feature(Target::EmbedBitcode)) {
         std::string halide_command = "halide target=" + target.to_string();
@@ -1105,6 +1122,17 @@ llvm::Function *CodeGen_LLVM::embed_metadata_getter(const std::string &metadata_
     return metadata_getter;
 }
 
+llvm::Function *CodeGen_LLVM::embed_constant_getter(const std::string &getter_name, int64_t value) {
+    llvm::FunctionType *func_t = llvm::FunctionType::get(i64_t, false);
+    llvm::Function *getter = llvm::Function::Create(func_t, llvm::GlobalValue::ExternalLinkage, getter_name, module.get());
+    llvm::BasicBlock *block = llvm::BasicBlock::Create(module.get()->getContext(), "entry", getter);
+    builder->SetInsertPoint(block);
+    builder->CreateRet(ConstantInt::get(i64_t, value));
+    internal_assert(!verifyFunction(*getter, &llvm::errs()));
+
+    return getter;
+}
+
 llvm::Type *CodeGen_LLVM::llvm_type_of(Type t) {
     return Internal::llvm_type_of(context, t);
 }
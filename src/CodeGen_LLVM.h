@@ -495,6 +495,11 @@ private:
         const std::string &function_name, const std::vector<LoweredArgument> &args,
         const std::map<std::string, std::string> &metadata_name_map);
 
+    /** Embed a function with the given name that takes no arguments
+     * and returns the given constant, such as the slab sizes of a
+     * function compiled with the slab_alloc target feature. */
+    llvm::Function *embed_constant_getter(const std::string &getter_name, int64_t value);
+
     /** Embed a constant expression as a global variable. */
     llvm::Constant *embed_constant_expr(Expr e, llvm::Type *t);
     llvm::Constant *embed_constant_scalar_value_t(Expr e);
@@ -0,0 +1,225 @@
+#include "CompileTimeReport.h"
+#include "Debug.h"
+#include "IR.h"
+#include "IRVisitor.h"
+#include "LLVM_Headers.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+std::mutex report_mutex;
+
+// The total time spent in each kind of pass by the process so far.
+struct Total {
+    std::string phase, pass;
+    int count = 0;
+    double seconds = 0;
+};
+std::map<std::pair<std::string, std::string>, Total> totals;
+
+// The most memory the process has used so far, or -1 if we don't know.
+int64_t process_peak_rss_bytes() {
+#ifdef _WIN32
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#ifdef __APPLE__
+    return (int64_t)usage.ru_maxrss;
+#else
+    // Linux reports kilobytes.
+    return (int64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Count the distinct IR nodes in a Stmt. Common subexpressions are
+// only counted once, so this is the amount of memory the IR uses
+// rather than the size of its printed form.
+class IRNodeCounter : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+
+    void include(const Expr &e) override {
+        if (visited.insert(e.get()).second) {
+            count++;
+            e.accept(this);
+        }
+    }
+
+    void include(const Stmt &s) override {
+        if (visited.insert(s.get()).second) {
+            count++;
+            s.accept(this);
+        }
+    }
+
+    std::set<const IRNode *> visited;
+
+public:
+    int64_t count = 0;
+
+    void count_nodes(const Stmt &s) {
+        include(s);
+    }
+};
+
+std::string json_string(const std::string &s) {
+    std::string result = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        } else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+std::string json_size(int64_t size) {
+    return size < 0 ? "null" : std::to_string(size);
+}
+
+// Must be called with report_mutex held.
+void append_to_report(const std::string &text) {
+    std::string filename = get_env_variable("HL_COMPILE_TIME_REPORT");
+    std::ofstream f(filename, std::ios::app);
+    f << text;
+    if (!f.good()) {
+        debug(1) << "Failed to write compile time report to " << filename << "\n";
+    }
+}
+
+// Appends the totals for each kind of pass to the report when the
+// process exits, slowest first.
+struct TotalsWriter {
+    ~TotalsWriter() {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        if (totals.empty()) {
+            return;
+        }
+        std::vector<Total> sorted;
+        for (const auto &i : totals) {
+            sorted.push_back(i.second);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const Total &a, const Total &b) { return a.seconds > b.seconds; });
+
+        std::ostringstream text;
+        text << "{\"totals\": [";
+        const char *sep = "";
+        for (const Total &t : sorted) {
+            text << sep << "{\"phase\": " << json_string(t.phase)
+                 << ", \"pass\": " << json_string(t.pass)
+                 << ", \"count\": " << t.count
+                 << ", \"seconds\": " << t.seconds << "}";
+            sep = ", ";
+        }
+        text << "]}\n";
+        append_to_report(text.str());
+    }
+} totals_writer;
+
+}  // namespace
+
+bool CompileTimeReport::enabled() {
+    return !get_env_variable("HL_COMPILE_TIME_REPORT").empty();
+}
+
+CompileTimeReport::CompileTimeReport(const std::string &phase, const std::string &pipeline)
+    : active(enabled()), phase(phase), pipeline(pipeline),
+      start(std::chrono::high_resolution_clock::now()) {
+}
+
+CompileTimeReport::~CompileTimeReport() {
+    if (!active || records.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(report_mutex);
+    append_to_report(records);
+}
+
+void CompileTimeReport::record(const std::string &name, double seconds,
+                               int64_t before, int64_t after) {
+    std::ostringstream r;
+    r << "{\"phase\": " << json_string(phase)
+      << ", \"pipeline\": " << json_string(pipeline)
+      << ", \"pass\": " << json_string(name)
+      << ", \"seconds\": " << seconds
+      << ", \"ir_size_before\": " << json_size(before)
+      << ", \"ir_size_after\": " << json_size(after)
+      << ", \"process_peak_rss_bytes\": " << json_size(process_peak_rss_bytes()) << "}\n";
+    records += r.str();
+    {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        Total &t = totals[{phase, name}];
+        t.phase = phase;
+        t.pass = name;
+        t.count++;
+        t.seconds += seconds;
+    }
+    // Don't count the time taken to measure the IR or record the pass.
+    start = std::chrono::high_resolution_clock::now();
+}
+
+void CompileTimeReport::pass(const std::string &name) {
+    if (!active) {
+        return;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    // Passes that don't produce IR leave the size unknown.
+    record(name, std::chrono::duration<double>(end - start).count(), -1, -1);
+}
+
+void CompileTimeReport::pass(const std::string &name, const Stmt &s) {
+    if (!active) {
+        return;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    IRNodeCounter counter;
+    if (s.defined()) {
+        counter.count_nodes(s);
+    }
+    record(name, std::chrono::duration<double>(end - start).count(), size_before, counter.count);
+    size_before = counter.count;
+}
+
+void CompileTimeReport::pass(const std::string &name, const llvm::Module &m) {
+    if (!active) {
+        return;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    int64_t count = 0;
+    for (const llvm::Function &f : m) {
+        for (const llvm::BasicBlock &b : f) {
+            count += b.size();
+        }
+    }
+    record(name, std::chrono::duration<double>(end - start).count(), size_before, count);
+    size_before = count;
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,70 @@
+#ifndef HALIDE_COMPILE_TIME_REPORT_H
+#define HALIDE_COMPILE_TIME_REPORT_H
+
+/** \file
+ * Defines a report of where the compiler spends its time, appended as
+ * JSON lines to the file named by the HL_COMPILE_TIME_REPORT
+ * environment variable.
+ */
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+
+#include "Expr.h"
+
+namespace llvm {
+class Module;
+}
+
+namespace Halide {
+namespace Internal {
+
+/** Times a sequence of compiler passes for the compile time report.
+ * Each call to pass() records the wall time since the previous call
+ * (or since construction), the size of the IR before and after the
+ * pass, and the peak memory use of the whole process so far (not of
+ * the pass). Measuring the size of the IR is not counted as part of
+ * any pass.
+ *
+ * When the timer is destroyed, its passes are appended to the report,
+ * one JSON object per line. When the process exits, the totals for
+ * each kind of pass are appended as a final line. If
+ * HL_COMPILE_TIME_REPORT is not set, this does nothing. */
+class CompileTimeReport {
+public:
+    /** Start timing the passes of a phase of compilation (e.g. "lower"
+     * or "llvm") of the named pipeline. */
+    CompileTimeReport(const std::string &phase, const std::string &pipeline);
+    ~CompileTimeReport();
+
+    /** Record a pass that doesn't produce a Stmt, e.g. one that
+     * transforms the Functions of the pipeline. */
+    void pass(const std::string &name);
+
+    /** Record a pass that produced the given Stmt. Its size is the
+     * number of distinct IR nodes in it. */
+    void pass(const std::string &name, const Stmt &s);
+
+    /** Record a pass over the given LLVM module. Its size is the
+     * number of LLVM instructions in it. */
+    void pass(const std::string &name, const llvm::Module &m);
+
+    /** Whether HL_COMPILE_TIME_REPORT is set. */
+    static bool enabled();
+
+private:
+    bool active;
+    std::string phase, pipeline;
+    std::chrono::high_resolution_clock::time_point start;
+    int64_t size_before = -1;
+    // The JSON lines for the passes recorded so far.
+    std::string records;
+
+    void record(const std::string &name, double seconds, int64_t before, int64_t after);
+};
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -105,8 +105,10 @@ struct IRNode {
 template<>
 inline RefCount &ref_count<IRNode>(const IRNode *t) {return t->ref_count;}
 
+/** Deletes the node, first removing it from the intern table if it's
+ * an interned Expr. */
 template<>
-inline void destroy<IRNode>(const IRNode *t) {delete t;}
+void destroy<IRNode>(const IRNode *t);
 
 /** IR nodes are split into expressions and statements. These are
    similar to expressions and statements in C - expressions
@@ -127,8 +129,20 @@ struct BaseExprNode : public IRNode {
     BaseExprNode(IRNodeType t) : IRNode(t) {}
     virtual Expr mutate_expr(IRMutator *v) const = 0;
     Type type;
+
+    /** When IR interning is enabled (see IRInterning.h), a hash of
+     * the structure of the Expr rooted at this node, and whether it
+     * has been computed. */
+    // @{
+    uint32_t hash = 0;
+    bool interned = false;
+    // @}
 };
 
+/** Called by the make() method of each constant node type. Computes
+ * the hash of the constant if IR interning is enabled. */
+void intern_constant(BaseExprNode *node);
+
 /** We use the "curiously recurring template pattern" to avoid
    duplicated code in the IR Nodes. These classes live between the
    abstract base classes and the actual IR Nodes in the
@@ -210,6 +224,7 @@ struct IntImm : public ExprNode<IntImm> {
         IntImm *node = new IntImm;
         node->type = t;
         node->value = value;
+        intern_constant(node);
         return node;
     }
 
@@ -233,6 +248,7 @@ struct UIntImm : public ExprNode<UIntImm> {
         UIntImm *node = new UIntImm;
         node->type = t;
         node->value = value;
+        intern_constant(node);
         return node;
     }
 
@@ -261,6 +277,7 @@ struct FloatImm : public ExprNode<FloatImm> {
         default:
             internal_error << "FloatImm must be 16, 32, or 64-bit\n";
         }
+        intern_constant(node);
 
         return node;
     }
@@ -276,6 +293,7 @@ struct StringImm : public ExprNode<StringImm> {
         StringImm *node = new StringImm;
         node->type = type_of<const char *>();
         node->value = val;
+        intern_constant(node);
         return node;
     }
 
@@ -2504,6 +2504,37 @@ Func &Func::add_trace_tag(const std::string &trace_tag) {
     return *this;
 }
 
+Func &Func::trace_region(Var var, Expr min, Expr extent) {
+    invalidate_cache();
+    const auto &arg_names = func.args();
+    int dim = -1;
+    for (size_t i = 0; i < arg_names.size(); ++i) {
+        if (arg_names[i] == var.name()) {
+            dim = i;
+            break;
+        }
+    }
+    user_assert(dim >= 0)
+        << "Can't trace a region of variable " << var.name()
+        << " of function " << name()
+        << " because " << var.name()
+        << " is not one of the pure variables of " << name() << ".\n";
+    func.trace_region(dim, cast<int>(min), cast<int>(extent));
+    return *this;
+}
+
+Func &Func::trace_every(Expr n) {
+    invalidate_cache();
+    func.trace_every(cast<int>(n));
+    return *this;
+}
+
+Func &Func::trace_first(Expr n) {
+    invalidate_cache();
+    func.trace_first(cast<int>(n));
+    return *this;
+}
+
 void Func::debug_to_file(const string &filename) {
     invalidate_cache();
     func.debug_file() = filename;
@@ -2260,6 +2260,29 @@ public:
      */
     Func &add_trace_tag(const std::string &trace_tag);
 
+    /** Only trace loads from and stores to this Func where the given
+     * pure variable is in the range [min, min + extent). Call once per
+     * dimension to trace a box. A vector of loads or stores is traced
+     * if any part of it is inside the box. The range may depend on
+     * Params, so the box can be moved without recompiling. */
+    Func &trace_region(Var var, Expr min, Expr extent);
+
+    /** Only trace every nth load from and every nth store to this
+     * Func, starting with the first, in each run of the pipeline. */
+    Func &trace_every(Expr n);
+
+    /** Only trace the first n loads from and the first n stores to
+     * this Func in each run of the pipeline.
+     *
+     * These filters are checked in the generated code, so a load or
+     * store that is filtered out costs a branch (and for trace_every
+     * and trace_first, an atomic increment until the first n are
+     * done), but no call to halide_trace. Loads and stores outside of
+     * a trace_region don't count towards trace_every or
+     * trace_first. Events other than loads and stores are always
+     * traced. */
+    Func &trace_first(Expr n);
+
     /** Get a handle on the internal halide function that this Func
      * represents. Useful if you want to do introspection on Halide
      * functions */
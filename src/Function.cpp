@@ -89,6 +89,10 @@ struct FunctionContents {
     bool trace_loads = false, trace_stores = false, trace_realizations = false;
     std::vector<string> trace_tags;
 
+    // Filters on the loads and stores traced.
+    Region trace_region;
+    Expr trace_every, trace_first;
+
     bool frozen = false;
 
     void accept(IRVisitor *visitor) const {
@@ -116,6 +120,19 @@ struct FunctionContents {
             }
         }
 
+        for (const Range &r : trace_region) {
+            if (r.min.defined()) {
+                r.min.accept(visitor);
+                r.extent.accept(visitor);
+            }
+        }
+        if (trace_every.defined()) {
+            trace_every.accept(visitor);
+        }
+        if (trace_first.defined()) {
+            trace_first.accept(visitor);
+        }
+
         for (Parameter i : output_buffers) {
             for (size_t j = 0; j < args.size(); j++) {
                 if (i.min_constraint(j).defined()) {
@@ -150,6 +167,19 @@ struct FunctionContents {
             }
             extern_proxy_expr = mutator->mutate(extern_proxy_expr);
         }
+
+        for (Range &r : trace_region) {
+            if (r.min.defined()) {
+                r.min = mutator->mutate(r.min);
+                r.extent = mutator->mutate(r.extent);
+            }
+        }
+        if (trace_every.defined()) {
+            trace_every = mutator->mutate(trace_every);
+        }
+        if (trace_first.defined()) {
+            trace_first = mutator->mutate(trace_first);
+        }
     }
 };
 
@@ -340,6 +370,9 @@ void Function::deep_copy(FunctionPtr copy, DeepCopyMap &copied_map) const {
     copy->trace_stores = contents->trace_stores;
     copy->trace_realizations = contents->trace_realizations;
     copy->trace_tags = contents->trace_tags;
+    copy->trace_region = contents->trace_region;
+    copy->trace_every = contents->trace_every;
+    copy->trace_first = contents->trace_first;
     copy->frozen = contents->frozen;
     copy->output_buffers = contents->output_buffers;
     copy->func_schedule = contents->func_schedule.deep_copy(copied_map);
@@ -900,6 +933,19 @@ void Function::trace_realizations() {
 void Function::add_trace_tag(const std::string &trace_tag) {
     contents->trace_tags.push_back(trace_tag);
 }
+void Function::trace_region(int dim, Expr min, Expr extent) {
+    Region &box = contents->trace_region;
+    if ((int)box.size() <= dim) {
+        box.resize(dim + 1);
+    }
+    box[dim] = Range(min, extent);
+}
+void Function::trace_every(Expr n) {
+    contents->trace_every = n;
+}
+void Function::trace_first(Expr n) {
+    contents->trace_first = n;
+}
 
 bool Function::is_tracing_loads() const {
     return contents->trace_loads;
@@ -913,6 +959,20 @@ bool Function::is_tracing_realizations() const {
 const std::vector<std::string> &Function::get_trace_tags() const {
     return contents->trace_tags;
 }
+const Region &Function::get_trace_region() const {
+    return contents->trace_region;
+}
+Expr Function::get_trace_every() const {
+    return contents->trace_every;
+}
+Expr Function::get_trace_first() const {
+    return contents->trace_first;
+}
+bool Function::has_trace_filters() const {
+    return (!contents->trace_region.empty() ||
+            contents->trace_every.defined() ||
+            contents->trace_first.defined());
+}
 
 void Function::freeze() {
     contents->frozen = true;
@@ -60,6 +60,7 @@ enum class NameMangling {
 namespace Internal {
 
 struct Call;
+struct Range;
 
 /** A reference-counted handle to Halide's internal representation of
  * a function. Similar to a front-end Func object, but with no
@@ -273,10 +274,17 @@ public:
     void trace_stores();
     void trace_realizations();
     void add_trace_tag(const std::string &trace_tag);
+    void trace_region(int dim, Expr min, Expr extent);
+    void trace_every(Expr n);
+    void trace_first(Expr n);
     bool is_tracing_loads() const;
     bool is_tracing_stores() const;
     bool is_tracing_realizations() const;
     const std::vector<std::string> &get_trace_tags() const;
+    const std::vector<Range> &get_trace_region() const;
+    Expr get_trace_every() const;
+    Expr get_trace_first() const;
+    bool has_trace_filters() const;
     // @}
 
     /** Replace this Function's LoopLevels with locked copies that
@@ -192,7 +192,8 @@
  *  - 'machine_params' is only used if auto_schedule is true; it is ignored
  *    if auto_schedule is false. It provides details about the machine architecture
  *    being targeted which may be used to enhance the automatically-generated
- *    schedule.
+ *    schedule. Pass machine_params=host to use the parameters detected for the
+ *    machine running the Generator (see MachineParams::host()).
  *
  * Generators are added to a global registry to simplify AOT build mechanics; this
  * is done by simply using the HALIDE_REGISTER_GENERATOR macro at global scope:
@@ -1984,6 +1985,9 @@ public:
     HALIDE_FORWARD_METHOD(Func, store_at)
     HALIDE_FORWARD_METHOD(Func, store_root)
     HALIDE_FORWARD_METHOD(Func, tile)
+    HALIDE_FORWARD_METHOD(Func, trace_every)
+    HALIDE_FORWARD_METHOD(Func, trace_first)
+    HALIDE_FORWARD_METHOD(Func, trace_region)
     HALIDE_FORWARD_METHOD(Func, trace_stores)
     HALIDE_FORWARD_METHOD(Func, unroll)
     HALIDE_FORWARD_METHOD(Func, update)
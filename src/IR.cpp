@@ -1,4 +1,5 @@
 #include "IR.h"
+#include "IRInterning.h"
 #include "IRMutator.h"
 #include "IRPrinter.h"
 #include "IRVisitor.h"
@@ -13,7 +14,7 @@ Expr Cast::make(Type t, Expr v) {
     Cast *node = new Cast;
     node->type = t;
     node->value = std::move(v);
-    return node;
+    return intern(node);
 }
 
 Expr Add::make(Expr a, Expr b) {
@@ -25,7 +26,7 @@ Expr Add::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr Sub::make(Expr a, Expr b) {
@@ -37,7 +38,7 @@ Expr Sub::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr Mul::make(Expr a, Expr b) {
@@ -49,7 +50,7 @@ Expr Mul::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr Div::make(Expr a, Expr b) {
@@ -61,7 +62,7 @@ Expr Div::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr Mod::make(Expr a, Expr b) {
@@ -73,7 +74,7 @@ Expr Mod::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr Min::make(Expr a, Expr b) {
@@ -85,7 +86,7 @@ Expr Min::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr Max::make(Expr a, Expr b) {
@@ -97,7 +98,7 @@ Expr Max::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr EQ::make(Expr a, Expr b) {
@@ -109,7 +110,7 @@ Expr EQ::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr NE::make(Expr a, Expr b) {
@@ -121,7 +122,7 @@ Expr NE::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr LT::make(Expr a, Expr b) {
@@ -133,7 +134,7 @@ Expr LT::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 
@@ -146,7 +147,7 @@ Expr LE::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr GT::make(Expr a, Expr b) {
@@ -158,7 +159,7 @@ Expr GT::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 
@@ -171,7 +172,7 @@ Expr GE::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr And::make(Expr a, Expr b) {
@@ -185,7 +186,7 @@ Expr And::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr Or::make(Expr a, Expr b) {
@@ -199,7 +200,7 @@ Expr Or::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern(node);
 }
 
 Expr Not::make(Expr a) {
@@ -209,7 +210,7 @@ Expr Not::make(Expr a) {
     Not *node = new Not;
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
-    return node;
+    return intern(node);
 }
 
 Expr Select::make(Expr condition, Expr true_value, Expr false_value) {
@@ -227,7 +228,7 @@ Expr Select::make(Expr condition, Expr true_value, Expr false_value) {
     node->condition = std::move(condition);
     node->true_value = std::move(true_value);
     node->false_value = std::move(false_value);
-    return node;
+    return intern(node);
 }
 
 Expr Load::make(Type type, const std::string &name, Expr index, Buffer<> image, Parameter param, Expr predicate, ModulusRemainder alignment) {
@@ -245,7 +246,7 @@ Expr Load::make(Type type, const std::string &name, Expr index, Buffer<> image,
     node->image = std::move(image);
     node->param = std::move(param);
     node->alignment = alignment;
-    return node;
+    return intern(node);
 }
 
 Expr Ramp::make(Expr base, Expr stride, int lanes) {
@@ -261,7 +262,7 @@ Expr Ramp::make(Expr base, Expr stride, int lanes) {
     node->base = std::move(base);
     node->stride = std::move(stride);
     node->lanes = std::move(lanes);
-    return node;
+    return intern(node);
 }
 
 Expr Broadcast::make(Expr value, int lanes) {
@@ -273,7 +274,7 @@ Expr Broadcast::make(Expr value, int lanes) {
     node->type = value.type().with_lanes(lanes);
     node->value = std::move(value);
     node->lanes = lanes;
-    return node;
+    return intern(node);
 }
 
 Expr Let::make(const std::string &name, Expr value, Expr body) {
@@ -285,7 +286,7 @@ Expr Let::make(const std::string &name, Expr value, Expr body) {
     node->name = name;
     node->value = std::move(value);
     node->body = std::move(body);
-    return node;
+    return intern(node);
 }
 
 Stmt LetStmt::make(const std::string &name, Expr value, Stmt body) {
@@ -611,7 +612,7 @@ Expr Call::make(Type type, const std::string &name, const std::vector<Expr> &arg
     node->value_index = value_index;
     node->image = std::move(image);
     node->param = std::move(param);
-    return node;
+    return intern(node);
 }
 
 Expr Variable::make(Type type, const std::string &name, Buffer<> image, Parameter param, ReductionDomain reduction_domain) {
@@ -622,7 +623,7 @@ Expr Variable::make(Type type, const std::string &name, Buffer<> image, Paramete
     node->image = std::move(image);
     node->param = std::move(param);
     node->reduction_domain = std::move(reduction_domain);
-    return node;
+    return intern(node);
 }
 
 Expr Shuffle::make(const std::vector<Expr> &vectors,
@@ -643,7 +644,7 @@ Expr Shuffle::make(const std::vector<Expr> &vectors,
     node->type = element_ty.with_lanes((int)indices.size());
     node->vectors = vectors;
     node->indices = indices;
-    return node;
+    return intern(node);
 }
 
 Expr Shuffle::make_interleave(const std::vector<Expr> &vectors) {
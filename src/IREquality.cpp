@@ -132,11 +132,14 @@ IRComparer::CmpResult IRComparer::compare_expr(const Expr &a, const Expr &b) {
         return result;
     }
 
-    // If in the future we have hashes for Exprs, this is a good place
-    // to compare the hashes:
-    // if (compare_scalar(a.hash(), b.hash()) != Equal) {
-    //   return result;
-    // }
+    // Interned Exprs carry a hash that is consistent with this
+    // comparison, so unequal ones can usually be told apart without
+    // walking them. This orders Exprs by hash first, which is only
+    // consistent if either all Exprs are interned or none are.
+    if (a.get()->interned && b.get()->interned &&
+        compare_scalar(a.get()->hash, b.get()->hash) != Equal) {
+        return result;
+    }
 
     if (compare_scalar(a->node_type, b->node_type) != Equal) {
         return result;
@@ -0,0 +1,484 @@
+#include "IRInterning.h"
+#include "IR.h"
+#include "Util.h"
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+// The table is split into independently locked shards, so that
+// threads lowering different pipelines rarely contend.
+const int num_shards = 64;
+
+struct InternShard {
+    std::mutex mutex;
+    std::unordered_multimap<uint32_t, const BaseExprNode *> nodes;
+};
+
+InternShard *shards() {
+    // Never freed, because nodes in static storage can be destroyed
+    // after any static table would be.
+    static InternShard *s = new InternShard[num_shards];
+    return s;
+}
+
+uint32_t mix(uint32_t h, uint32_t x) {
+    return h ^ (x + 0x9e3779b9 + (h << 6) + (h >> 2));
+}
+
+uint32_t hash_bits(uint64_t bits) {
+    return mix((uint32_t)bits, (uint32_t)(bits >> 32));
+}
+
+uint32_t hash_string(const std::string &s) {
+    // FNV-1a, so that the hash, and so the order of Exprs in maps
+    // keyed on IRDeepCompare, is the same on every platform.
+    uint32_t h = 2166136261u;
+    for (char c : s) {
+        h = (h ^ (uint8_t)c) * 16777619u;
+    }
+    return h;
+}
+
+uint32_t hash_type(Type t) {
+    return ((uint32_t)t.code() << 24) ^ ((uint32_t)t.bits() << 16) ^ (uint32_t)t.lanes();
+}
+
+bool is_constant(IRNodeType t) {
+    return (t == IRNodeType::IntImm ||
+            t == IRNodeType::UIntImm ||
+            t == IRNodeType::FloatImm ||
+            t == IRNodeType::StringImm);
+}
+
+// Computes the hash of a node from its own fields and the hashes of
+// its children. Only the fields that equal() and the IR matcher both
+// compare are included, so that Exprs either of them considers equal
+// have equal hashes. Returns false if a child isn't interned, in
+// which case the node can't be either.
+class NodeHasher {
+    uint32_t h;
+    bool ok = true;
+
+public:
+    NodeHasher(const BaseExprNode *node)
+        : h(mix((uint32_t)node->node_type, hash_type(node->type))) {
+    }
+
+    void add(uint32_t x) {
+        h = mix(h, x);
+    }
+
+    void add(const Expr &e) {
+        if (!e.defined()) {
+            add(0);
+        } else if (e.get()->interned) {
+            add(e.get()->hash);
+        } else {
+            ok = false;
+        }
+    }
+
+    void add(const std::vector<Expr> &v) {
+        add((uint32_t)v.size());
+        for (const Expr &e : v) {
+            add(e);
+        }
+    }
+
+    bool result(uint32_t &hash) const {
+        hash = h;
+        return ok;
+    }
+};
+
+template<typename Op>
+bool hash_binop(const BaseExprNode *node, NodeHasher &hasher) {
+    const Op *op = (const Op *)node;
+    hasher.add(op->a);
+    hasher.add(op->b);
+    return true;
+}
+
+bool hash_node(const BaseExprNode *node, uint32_t &hash) {
+    NodeHasher hasher(node);
+    switch (node->node_type) {
+    case IRNodeType::Cast:
+        hasher.add(((const Cast *)node)->value);
+        break;
+    case IRNodeType::Variable:
+        hasher.add(hash_string(((const Variable *)node)->name));
+        break;
+    case IRNodeType::Add:
+        hash_binop<Add>(node, hasher);
+        break;
+    case IRNodeType::Sub:
+        hash_binop<Sub>(node, hasher);
+        break;
+    case IRNodeType::Mul:
+        hash_binop<Mul>(node, hasher);
+        break;
+    case IRNodeType::Div:
+        hash_binop<Div>(node, hasher);
+        break;
+    case IRNodeType::Mod:
+        hash_binop<Mod>(node, hasher);
+        break;
+    case IRNodeType::Min:
+        hash_binop<Min>(node, hasher);
+        break;
+    case IRNodeType::Max:
+        hash_binop<Max>(node, hasher);
+        break;
+    case IRNodeType::EQ:
+        hash_binop<EQ>(node, hasher);
+        break;
+    case IRNodeType::NE:
+        hash_binop<NE>(node, hasher);
+        break;
+    case IRNodeType::LT:
+        hash_binop<LT>(node, hasher);
+        break;
+    case IRNodeType::LE:
+        hash_binop<LE>(node, hasher);
+        break;
+    case IRNodeType::GT:
+        hash_binop<GT>(node, hasher);
+        break;
+    case IRNodeType::GE:
+        hash_binop<GE>(node, hasher);
+        break;
+    case IRNodeType::And:
+        hash_binop<And>(node, hasher);
+        break;
+    case IRNodeType::Or:
+        hash_binop<Or>(node, hasher);
+        break;
+    case IRNodeType::Not:
+        hasher.add(((const Not *)node)->a);
+        break;
+    case IRNodeType::Select: {
+        const Select *op = (const Select *)node;
+        hasher.add(op->condition);
+        hasher.add(op->true_value);
+        hasher.add(op->false_value);
+        break;
+    }
+    case IRNodeType::Load: {
+        // The IR matcher ignores the predicate and alignment.
+        const Load *op = (const Load *)node;
+        hasher.add(hash_string(op->name));
+        hasher.add(op->index);
+        break;
+    }
+    case IRNodeType::Ramp: {
+        const Ramp *op = (const Ramp *)node;
+        hasher.add(op->base);
+        hasher.add(op->stride);
+        break;
+    }
+    case IRNodeType::Broadcast:
+        hasher.add(((const Broadcast *)node)->value);
+        break;
+    case IRNodeType::Call: {
+        const Call *op = (const Call *)node;
+        hasher.add(hash_string(op->name));
+        hasher.add((uint32_t)op->call_type);
+        hasher.add((uint32_t)op->value_index);
+        hasher.add(op->args);
+        break;
+    }
+    case IRNodeType::Let: {
+        const Let *op = (const Let *)node;
+        hasher.add(hash_string(op->name));
+        hasher.add(op->value);
+        hasher.add(op->body);
+        break;
+    }
+    case IRNodeType::Shuffle: {
+        const Shuffle *op = (const Shuffle *)node;
+        hasher.add(op->vectors);
+        for (int i : op->indices) {
+            hasher.add((uint32_t)i);
+        }
+        break;
+    }
+    default:
+        internal_error << "Can't intern IR node of type " << (int)node->node_type << "\n";
+    }
+    return hasher.result(hash);
+}
+
+// Children of interned nodes are interned, so two children are equal
+// if they're the same node, or if they're constants with the same
+// value. Floating point constants are compared bitwise, so that 0.0
+// and -0.0 are kept apart.
+bool same_child(const Expr &a, const Expr &b) {
+    if (a.same_as(b)) {
+        return true;
+    }
+    if (!a.defined() || !b.defined() ||
+        a->node_type != b->node_type ||
+        !is_constant(a->node_type) ||
+        a.type() != b.type()) {
+        return false;
+    }
+    if (const IntImm *i = a.as<IntImm>()) {
+        return i->value == b.as<IntImm>()->value;
+    } else if (const UIntImm *u = a.as<UIntImm>()) {
+        return u->value == b.as<UIntImm>()->value;
+    } else if (const FloatImm *f = a.as<FloatImm>()) {
+        return std::memcmp(&f->value, &b.as<FloatImm>()->value, sizeof(double)) == 0;
+    } else {
+        return a.as<StringImm>()->value == b.as<StringImm>()->value;
+    }
+}
+
+bool same_children(const std::vector<Expr> &a, const std::vector<Expr> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!same_child(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool same_buffer(Buffer<> a, const Buffer<> &b) {
+    return a.same_as(b);
+}
+
+template<typename Op>
+bool same_binop(const BaseExprNode *a, const BaseExprNode *b) {
+    return (same_child(((const Op *)a)->a, ((const Op *)b)->a) &&
+            same_child(((const Op *)a)->b, ((const Op *)b)->b));
+}
+
+// Whether two nodes of the same type and hash are interchangeable:
+// every field is equal, including the Functions, Parameters and
+// Buffers they refer to, which equal() ignores.
+bool same_node(const BaseExprNode *a, const BaseExprNode *b) {
+    if (a->node_type != b->node_type || a->type != b->type) {
+        return false;
+    }
+    switch (a->node_type) {
+    case IRNodeType::Cast:
+        return same_child(((const Cast *)a)->value, ((const Cast *)b)->value);
+    case IRNodeType::Variable: {
+        const Variable *x = (const Variable *)a, *y = (const Variable *)b;
+        return (x->name == y->name &&
+                x->param.same_as(y->param) &&
+                same_buffer(x->image, y->image) &&
+                x->reduction_domain.same_as(y->reduction_domain));
+    }
+    case IRNodeType::Add:
+        return same_binop<Add>(a, b);
+    case IRNodeType::Sub:
+        return same_binop<Sub>(a, b);
+    case IRNodeType::Mul:
+        return same_binop<Mul>(a, b);
+    case IRNodeType::Div:
+        return same_binop<Div>(a, b);
+    case IRNodeType::Mod:
+        return same_binop<Mod>(a, b);
+    case IRNodeType::Min:
+        return same_binop<Min>(a, b);
+    case IRNodeType::Max:
+        return same_binop<Max>(a, b);
+    case IRNodeType::EQ:
+        return same_binop<EQ>(a, b);
+    case IRNodeType::NE:
+        return same_binop<NE>(a, b);
+    case IRNodeType::LT:
+        return same_binop<LT>(a, b);
+    case IRNodeType::LE:
+        return same_binop<LE>(a, b);
+    case IRNodeType::GT:
+        return same_binop<GT>(a, b);
+    case IRNodeType::GE:
+        return same_binop<GE>(a, b);
+    case IRNodeType::And:
+        return same_binop<And>(a, b);
+    case IRNodeType::Or:
+        return same_binop<Or>(a, b);
+    case IRNodeType::Not:
+        return same_child(((const Not *)a)->a, ((const Not *)b)->a);
+    case IRNodeType::Select: {
+        const Select *x = (const Select *)a, *y = (const Select *)b;
+        return (same_child(x->condition, y->condition) &&
+                same_child(x->true_value, y->true_value) &&
+                same_child(x->false_value, y->false_value));
+    }
+    case IRNodeType::Load: {
+        const Load *x = (const Load *)a, *y = (const Load *)b;
+        return (x->name == y->name &&
+                same_child(x->index, y->index) &&
+                same_child(x->predicate, y->predicate) &&
+                same_buffer(x->image, y->image) &&
+                x->param.same_as(y->param) &&
+                x->alignment == y->alignment);
+    }
+    case IRNodeType::Ramp: {
+        const Ramp *x = (const Ramp *)a, *y = (const Ramp *)b;
+        return same_child(x->base, y->base) && same_child(x->stride, y->stride);
+    }
+    case IRNodeType::Broadcast:
+        return same_child(((const Broadcast *)a)->value, ((const Broadcast *)b)->value);
+    case IRNodeType::Call: {
+        const Call *x = (const Call *)a, *y = (const Call *)b;
+        return (x->name == y->name &&
+                x->call_type == y->call_type &&
+                x->value_index == y->value_index &&
+                same_children(x->args, y->args) &&
+                // A strong and a weak reference to the same Function
+                // are not interchangeable.
+                x->func.same_as(y->func) &&
+                x->func.strong.defined() == y->func.strong.defined() &&
+                same_buffer(x->image, y->image) &&
+                x->param.same_as(y->param));
+    }
+    case IRNodeType::Let: {
+        const Let *x = (const Let *)a, *y = (const Let *)b;
+        return (x->name == y->name &&
+                same_child(x->value, y->value) &&
+                same_child(x->body, y->body));
+    }
+    case IRNodeType::Shuffle: {
+        const Shuffle *x = (const Shuffle *)a, *y = (const Shuffle *)b;
+        return same_children(x->vectors, y->vectors) && x->indices == y->indices;
+    }
+    default:
+        return false;
+    }
+}
+
+bool shareable(const BaseExprNode *node) {
+    if (is_constant(node->node_type)) {
+        return false;
+    }
+    // Impure calls are kept distinct, so that passes that work on
+    // the graph of IR nodes never see two of them as one.
+    if (node->node_type == IRNodeType::Call) {
+        return ((const Call *)node)->is_pure();
+    }
+    return true;
+}
+
+}  // namespace
+
+bool ir_interning_enabled() {
+    static bool enabled = get_env_variable("HL_INTERN_IR") == "1";
+    return enabled;
+}
+
+void intern_constant(BaseExprNode *node) {
+    if (!ir_interning_enabled()) {
+        return;
+    }
+    uint32_t h = mix((uint32_t)node->node_type, hash_type(node->type));
+    switch (node->node_type) {
+    case IRNodeType::IntImm:
+        h = mix(h, hash_bits((uint64_t)((const IntImm *)node)->value));
+        break;
+    case IRNodeType::UIntImm:
+        h = mix(h, hash_bits(((const UIntImm *)node)->value));
+        break;
+    case IRNodeType::FloatImm: {
+        // 0.0 and -0.0 compare equal, so must hash equal.
+        double value = ((const FloatImm *)node)->value;
+        if (value == 0) {
+            value = 0;
+        }
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        h = mix(h, hash_bits(bits));
+        break;
+    }
+    case IRNodeType::StringImm:
+        h = mix(h, hash_string(((const StringImm *)node)->value));
+        break;
+    default:
+        internal_error << "intern_constant called on a non-constant\n";
+    }
+    node->hash = h;
+    node->interned = true;
+}
+
+Expr intern(BaseExprNode *node) {
+    uint32_t h;
+    if (!ir_interning_enabled() || !hash_node(node, h)) {
+        return Expr(node);
+    }
+    node->hash = h;
+    node->interned = true;
+    if (!shareable(node)) {
+        return Expr(node);
+    }
+
+    const BaseExprNode *existing = nullptr;
+    InternShard &shard = shards()[h % num_shards];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto range = shard.nodes.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it) {
+            // A node whose count is zero is being destroyed by
+            // another thread, which will remove it from the table as
+            // soon as it can take the lock.
+            if (same_node(it->second, node) &&
+                it->second->ref_count.increment_if_nonzero()) {
+                existing = it->second;
+                break;
+            }
+        }
+        if (!existing) {
+            shard.nodes.emplace(h, node);
+        }
+    }
+
+    if (!existing) {
+        return Expr(node);
+    }
+    delete node;
+    Expr result(existing);
+    // Drop the reference taken while holding the lock.
+    existing->ref_count.decrement();
+    return result;
+}
+
+size_t interned_node_count() {
+    size_t count = 0;
+    for (int i = 0; i < num_shards; i++) {
+        std::lock_guard<std::mutex> lock(shards()[i].mutex);
+        count += shards()[i].nodes.size();
+    }
+    return count;
+}
+
+template<>
+void destroy<IRNode>(const IRNode *t) {
+    if (t->node_type < IRNodeType::LetStmt) {
+        const BaseExprNode *e = (const BaseExprNode *)t;
+        if (e->interned && shareable(e)) {
+            InternShard &shard = shards()[e->hash % num_shards];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto range = shard.nodes.equal_range(e->hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second == e) {
+                    shard.nodes.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+    delete t;
+}
+
+}  // namespace Internal
+}  // namespace Halide
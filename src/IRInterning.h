@@ -0,0 +1,39 @@
+#ifndef HALIDE_IR_INTERNING_H
+#define HALIDE_IR_INTERNING_H
+
+/** \file
+ * Defines an optional mode in which Expr nodes are hash-consed: each
+ * node carries a hash of its structure, and making a node equal to
+ * one that already exists returns the existing node instead.
+ */
+
+#include "Expr.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Whether Expr nodes are being interned. This is set by the
+ * HL_INTERN_IR environment variable, and is fixed for the life of the
+ * process the first time it's queried (which is when the first Expr
+ * is made), so that either all Expr nodes are interned or none are.
+ *
+ * When on, each Expr node records a hash of its structure that is
+ * consistent with equal() and with the IR matcher's notion of
+ * equality, so comparisons of unequal Exprs usually stop at the hash,
+ * and equal Exprs are usually the same node, so comparisons of equal
+ * Exprs usually stop at the pointer comparison. Constants and impure
+ * calls are hashed but never shared. */
+bool ir_interning_enabled();
+
+/** Called by the make() method of each Expr node type with the new
+ * node. Returns the node, or an existing equal node if interning is
+ * enabled and there is one, in which case the new node is deleted. */
+Expr intern(BaseExprNode *node);
+
+/** Get the number of distinct Expr nodes in the intern table. */
+size_t interned_node_count();
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
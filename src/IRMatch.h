@@ -189,7 +189,8 @@ HALIDE_ALWAYS_INLINE
 bool equal(const BaseExprNode &a, const BaseExprNode &b) noexcept {
     // Early out
     return (&a == &b) ||
-        ((a.type == b.type) &&
+        ((a.hash == b.hash || !(a.interned && b.interned)) &&
+         (a.type == b.type) &&
          (a.node_type == b.node_type) &&
          equal_helper(a, b));
 }
@@ -0,0 +1,391 @@
+#include "JITCache.h"
+#include "FindCalls.h"
+#include "Function.h"
+#include "IR.h"
+#include "IRPrinter.h"
+#include "InferArguments.h"
+#include "Target.h"
+#include "Util.h"
+
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+namespace Halide {
+
+namespace {
+
+std::mutex jit_cache_mutex;
+bool jit_cache_directory_initialized = false;
+std::string jit_cache_directory;
+JITCacheStats jit_cache_stats;
+
+// Must be called with jit_cache_mutex held.
+std::string &directory_already_locked() {
+    if (!jit_cache_directory_initialized) {
+        jit_cache_directory = Internal::get_env_variable("HL_JIT_CACHE_DIR");
+        jit_cache_directory_initialized = true;
+    }
+    return jit_cache_directory;
+}
+
+}  // namespace
+
+void set_jit_cache_directory(const std::string &dir) {
+    std::lock_guard<std::mutex> lock(jit_cache_mutex);
+    directory_already_locked() = dir;
+}
+
+std::string get_jit_cache_directory() {
+    std::lock_guard<std::mutex> lock(jit_cache_mutex);
+    return directory_already_locked();
+}
+
+JITCacheStats get_jit_cache_stats() {
+    std::lock_guard<std::mutex> lock(jit_cache_mutex);
+    return jit_cache_stats;
+}
+
+void reset_jit_cache_stats() {
+    std::lock_guard<std::mutex> lock(jit_cache_mutex);
+    jit_cache_stats = JITCacheStats();
+}
+
+namespace Internal {
+
+namespace {
+
+// Bump this whenever the layout of a cache entry changes.
+const char *jit_cache_format = "halide-jit-cache-1";
+
+// Identify the build of the Halide library, so that entries are never
+// shared between two different builds. There's no version number to
+// use, so use the file the library was loaded from (the program
+// itself, if it's linked statically), its size and modification
+// time. This file's build time is the fallback.
+std::string library_version() {
+    std::ostringstream version;
+    version << jit_cache_format << " " << __DATE__ << " " << __TIME__;
+#ifndef _WIN32
+    Dl_info info;
+    if (dladdr((void *)&library_version, &info) && info.dli_fname &&
+        file_exists(info.dli_fname)) {
+        FileStat stat = file_stat(info.dli_fname);
+        version << " " << info.dli_fname << " " << stat.file_size << " " << stat.mod_time;
+    }
+#endif
+    return version.str();
+}
+
+const std::string &jit_cache_version() {
+    static std::string version = library_version();
+    return version;
+}
+
+// An IRPrinter that doesn't drop anything that could change the
+// generated code. Plain IR printing omits the types of variables,
+// and which value of a Tuple a call refers to.
+class KeyPrinter : public IRPrinter {
+    using IRPrinter::visit;
+
+    void visit(const Variable *op) override {
+        stream << op->name << ":" << op->type;
+    }
+
+    void visit(const Call *op) override {
+        IRPrinter::visit(op);
+        stream << "[" << (int)op->call_type << "," << op->value_index << "]";
+    }
+
+public:
+    KeyPrinter(std::ostream &s) : IRPrinter(s) {
+        // Print floating point constants exactly.
+        s << std::setprecision(17);
+    }
+
+    void print_expr(const Expr &e) {
+        if (e.defined()) {
+            print(e);
+        } else {
+            stream << "undef";
+        }
+        stream << ",";
+    }
+
+    void print_loop_level(LoopLevel level) {
+        // LoopLevels can only be inspected once locked, and locking
+        // the user's own LoopLevels would stop them from being set
+        // again, so lock a copy.
+        LoopLevel copy;
+        copy.set(level);
+        copy.lock();
+        if (copy.is_inlined()) {
+            stream << "inlined";
+        } else if (copy.is_root()) {
+            stream << "root";
+        } else {
+            stream << copy.to_string();
+        }
+        stream << ",";
+    }
+
+    void print_parameter(const Parameter &p) {
+        if (!p.defined()) {
+            return;
+        }
+        stream << p.name() << ":" << p.type() << ":" << p.dimensions() << "{";
+        if (p.is_buffer()) {
+            for (int i = 0; i < p.dimensions(); i++) {
+                print_expr(p.min_constraint(i));
+                print_expr(p.extent_constraint(i));
+                print_expr(p.stride_constraint(i));
+            }
+            stream << p.host_alignment();
+        } else {
+            print_expr(p.min_value());
+            print_expr(p.max_value());
+        }
+        stream << "}";
+    }
+
+    void print_stage_schedule(const StageSchedule &s) {
+        stream << "splits:";
+        for (const Split &split : s.splits()) {
+            stream << split.old_var << "," << split.outer << "," << split.inner << ",";
+            print_expr(split.factor);
+            stream << split.exact << "," << split.tail << "," << (int)split.split_type << ";";
+        }
+        stream << "dims:";
+        for (const Dim &d : s.dims()) {
+            stream << d.var << "," << d.for_type << "," << d.device_api << "," << (int)d.dim_type << ";";
+        }
+        stream << "rvars:";
+        for (const ReductionVariable &rv : s.rvars()) {
+            stream << rv.var << ",";
+            print_expr(rv.min);
+            print_expr(rv.extent);
+        }
+        stream << "prefetches:";
+        for (const PrefetchDirective &p : s.prefetches()) {
+            stream << p.name << "," << p.var << ",";
+            print_expr(p.offset);
+            stream << (int)p.strategy << ";";
+        }
+        stream << "fuse:";
+        print_loop_level(s.fuse_level().level);
+        for (const auto &i : s.fuse_level().align) {
+            stream << i.first << "=" << (int)i.second << ",";
+        }
+        for (const FusedPair &p : s.fused_pairs()) {
+            stream << p.func_1 << "." << p.stage_1 << "," << p.func_2 << "." << p.stage_2
+                   << "," << p.var_name << ";";
+        }
+        stream << "race:" << s.allow_race_conditions() << ";";
+    }
+
+    void print_definition(const Definition &d) {
+        stream << "[";
+        for (const Expr &e : d.args()) {
+            print_expr(e);
+        }
+        stream << "]=";
+        for (const Expr &e : d.values()) {
+            print_expr(e);
+        }
+        stream << "if ";
+        print_expr(d.predicate());
+        print_stage_schedule(d.schedule());
+        for (const Specialization &s : d.specializations()) {
+            stream << "specialize ";
+            print_expr(s.condition);
+            stream << s.failure_message << "{";
+            print_definition(s.definition);
+            stream << "}";
+        }
+        stream << ";\n";
+    }
+
+    void print_function(const Function &f) {
+        stream << f.name() << "(";
+        for (const std::string &arg : f.args()) {
+            stream << arg << ",";
+        }
+        stream << ")";
+        for (Type t : f.output_types()) {
+            stream << t << ",";
+        }
+        stream << "\n";
+
+        if (f.has_extern_definition()) {
+            stream << "extern " << f.extern_function_name() << ":"
+                   << f.extern_definition_name_mangling() << ":"
+                   << f.extern_function_device_api() << "(";
+            for (const ExternFuncArgument &arg : f.extern_arguments()) {
+                if (arg.is_func()) {
+                    stream << Function(arg.func).name();
+                } else if (arg.is_expr()) {
+                    print_expr(arg.expr);
+                } else if (arg.is_buffer()) {
+                    stream << arg.buffer.name();
+                } else if (arg.is_image_param()) {
+                    stream << arg.image_param.name();
+                }
+                stream << ",";
+            }
+            stream << ")\n";
+        }
+        if (f.has_pure_definition()) {
+            print_definition(f.definition());
+        }
+        for (const Definition &u : f.updates()) {
+            print_definition(u);
+        }
+
+        const FuncSchedule &s = f.schedule();
+        stream << "store:";
+        print_loop_level(s.store_level());
+        stream << "compute:";
+        print_loop_level(s.compute_level());
+        stream << "memoized:" << s.memoized()
+               << ",async:" << s.async()
+               << ",memory:" << s.memory_type() << ";";
+        for (const StorageDim &d : s.storage_dims()) {
+            stream << d.var << ",";
+            print_expr(d.alignment);
+            print_expr(d.fold_factor);
+            stream << d.fold_forward << ";";
+        }
+        stream << "bounds:";
+        for (const Bound &b : s.bounds()) {
+            stream << b.var << ",";
+            print_expr(b.min);
+            print_expr(b.extent);
+            print_expr(b.modulus);
+            print_expr(b.remainder);
+        }
+        stream << "wrappers:";
+        for (const auto &i : s.wrappers()) {
+            stream << i.first << "=" << Function(i.second).name() << ",";
+        }
+        stream << "\n";
+
+        stream << "trace:" << f.is_tracing_loads()
+               << f.is_tracing_stores()
+               << f.is_tracing_realizations() << ",";
+        for (const std::string &tag : f.get_trace_tags()) {
+            stream << tag << ",";
+        }
+        for (const Range &r : f.get_trace_region()) {
+            print_expr(r.min);
+            print_expr(r.extent);
+        }
+        print_expr(f.get_trace_every());
+        print_expr(f.get_trace_first());
+        stream << "debug_file:" << f.debug_file() << "\n";
+
+        for (const Parameter &p : f.output_buffers()) {
+            print_parameter(p);
+        }
+        stream << "\n";
+    }
+};
+
+uint64_t fnv1a(const std::string &s) {
+    // FNV-1a, which unlike std::hash is the same in every process.
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : s) {
+        h = (h ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    return h;
+}
+
+}  // namespace
+
+std::string jit_cache_key(const std::vector<Function> &outputs,
+                          const std::vector<InferredArgument> &args,
+                          const std::string &fn_name,
+                          const Target &target) {
+    if (get_jit_cache_directory().empty()) {
+        return "";
+    }
+
+    std::ostringstream key;
+    KeyPrinter printer(key);
+
+    key << jit_cache_version() << "\n"
+        << "llvm " << LLVM_VERSION << "\n"
+        << target.to_string() << "\n"
+        << fn_name << "\n";
+
+    for (const InferredArgument &arg : args) {
+        key << arg.arg.name << ":" << (int)arg.arg.kind << ":"
+            << arg.arg.type << ":" << (int)arg.arg.dimensions << ":";
+        printer.print_parameter(arg.param);
+        if (arg.buffer.defined()) {
+            key << "buffer " << arg.buffer.name();
+        }
+        key << "\n";
+    }
+
+    std::map<std::string, Function> env;
+    for (const Function &f : outputs) {
+        key << "output " << f.name() << "\n";
+        populate_environment(f, env);
+    }
+    for (const auto &i : env) {
+        printer.print_function(i.second);
+    }
+
+    return key.str();
+}
+
+std::string jit_cache_runtime_key(const std::string &module_name,
+                                  const Target &target,
+                                  const std::string &target_options) {
+    if (get_jit_cache_directory().empty()) {
+        return "";
+    }
+
+    std::ostringstream key;
+    key << jit_cache_version() << "\n"
+        << "llvm " << LLVM_VERSION << "\n"
+        << "runtime " << module_name << "\n"
+        << target.to_string() << "\n"
+        << target_options << "\n";
+    return key.str();
+}
+
+std::string jit_cache_entry_path(const std::string &key) {
+    std::ostringstream path;
+    path << get_jit_cache_directory() << "/"
+         << std::hex << std::setw(16) << std::setfill('0') << fnv1a(key);
+    return path.str();
+}
+
+void jit_cache_record(JITCacheEvent event) {
+    std::lock_guard<std::mutex> lock(jit_cache_mutex);
+    switch (event) {
+    case JITCacheEvent::Hit:
+        jit_cache_stats.hits++;
+        break;
+    case JITCacheEvent::Miss:
+        jit_cache_stats.misses++;
+        break;
+    case JITCacheEvent::Uncacheable:
+        jit_cache_stats.uncacheable++;
+        break;
+    case JITCacheEvent::RuntimeHit:
+        jit_cache_stats.runtime_hits++;
+        break;
+    case JITCacheEvent::RuntimeMiss:
+        jit_cache_stats.runtime_misses++;
+        break;
+    }
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,102 @@
+#ifndef HALIDE_JIT_CACHE_H
+#define HALIDE_JIT_CACHE_H
+
+/** \file
+ * Defines an opt-in cache of JIT compiled pipelines on disk, so that
+ * a program that JIT compiles the same pipeline every time it runs
+ * only pays for lowering and LLVM code generation once.
+ */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Halide {
+
+struct Target;
+
+/** Counts of JIT compilations since the program started or since
+ * the last call to reset_jit_cache_stats. */
+struct JITCacheStats {
+    /** Compilations that were loaded from the cache. These skip
+     * lowering and code generation entirely. */
+    uint64_t hits = 0;
+
+    /** Compilations that were not in the cache, and were added to it. */
+    uint64_t misses = 0;
+
+    /** Compilations that can't be cached, because the cache is
+     * disabled or because the pipeline has custom lowering passes. */
+    uint64_t uncacheable = 0;
+
+    /** Shared runtime modules that were loaded from the cache, or
+     * that were compiled and added to it. Each process needs these
+     * once per Target, before its first JIT compilation. */
+    uint64_t runtime_hits = 0;
+    uint64_t runtime_misses = 0;
+};
+
+/** Set the directory in which JIT compiled pipelines, and the shared
+ * runtime they depend on, are cached. It is created if it doesn't
+ * exist. An empty string, the default, disables the cache. The
+ * initial value is taken from the HL_JIT_CACHE_DIR environment
+ * variable.
+ *
+ * Entries are keyed on the algorithm and schedule of every Func in
+ * the pipeline, the constraints on its inputs, the Target, and the
+ * versions of LLVM and of the Halide library, so a stale entry is
+ * never used. Nothing is ever removed from the directory; deleting
+ * it, or any file in it, is always safe. */
+void set_jit_cache_directory(const std::string &dir);
+
+/** Get the directory set by set_jit_cache_directory. */
+std::string get_jit_cache_directory();
+
+/** Get the statistics on JIT compilations in this process. With
+ * HL_DEBUG_CODEGEN=1 each hit or miss is also reported as it
+ * happens. */
+JITCacheStats get_jit_cache_stats();
+
+/** Reset the statistics returned by get_jit_cache_stats to zero. */
+void reset_jit_cache_stats();
+
+namespace Internal {
+
+class Function;
+struct InferredArgument;
+
+/** Compute the text that identifies the code JIT compiling a
+ * pipeline would produce. Returns an empty string if the pipeline
+ * can't be cached. */
+std::string jit_cache_key(const std::vector<Function> &outputs,
+                          const std::vector<InferredArgument> &args,
+                          const std::string &fn_name,
+                          const Target &target);
+
+/** Compute the text that identifies one of the shared runtime
+ * modules used by JIT compiled code. target_options describes the
+ * LLVM target options the module is compiled with. Returns an empty
+ * string if the cache is disabled. */
+std::string jit_cache_runtime_key(const std::string &module_name,
+                                  const Target &target,
+                                  const std::string &target_options);
+
+/** The path, without an extension, of the cache entry for a key. */
+std::string jit_cache_entry_path(const std::string &key);
+
+/** The outcomes of a lookup in the JIT cache counted by JITCacheStats. */
+enum class JITCacheEvent {
+    Hit,
+    Miss,
+    Uncacheable,
+    RuntimeHit,
+    RuntimeMiss
+};
+
+/** Record the outcome of a lookup in the statistics. */
+void jit_cache_record(JITCacheEvent event);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -8,6 +8,8 @@
 #endif
 
 #include "CodeGen_Internal.h"
+#include "CompileTimeReport.h"
+#include "JITCache.h"
 #include "JITModule.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Runtime_Linker.h"
@@ -136,6 +138,7 @@ public:
     std::map<std::string, JITModule::Symbol> exports;
     llvm::LLVMContext context;
     ExecutionEngine *execution_engine;
+    std::unique_ptr<llvm::ObjectCache> object_cache;
     std::vector<JITModule> dependencies;
     JITModule::Symbol entrypoint;
     JITModule::Symbol argv_entrypoint;
@@ -151,10 +154,13 @@ void destroy<JITModuleContents>(const JITModuleContents *f) { delete f; }
 
 namespace {
 
-// Retrieve a function pointer from an llvm module, possibly by compiling it.
-JITModule::Symbol compile_and_get_function(ExecutionEngine &ee, const string &name) {
+// Retrieve a function pointer from an llvm module, possibly by
+// compiling it. The module only declares the function if its code
+// was loaded from the JIT cache.
+JITModule::Symbol compile_and_get_function(ExecutionEngine &ee, const llvm::Module &module, const string &name) {
     debug(2) << "JIT Compiling " << name << "\n";
-    llvm::Function *fn = ee.FindFunctionNamed(name.c_str());
+    llvm::Function *fn = module.getFunction(name);
+    internal_assert(fn) << "No function " << name << " in module\n";
     void *f = (void *)ee.getFunctionAddress(name);
     if (!f) {
         internal_error << "Compiling " << name << " returned nullptr\n";
@@ -238,6 +244,152 @@ public:
 
 };
 
+// Write a file into the JIT cache directory, via a temporary file so
+// that other processes never see it partially written.
+bool write_cache_file(const std::string &path, StringRef contents) {
+    SmallString<256> dir(path);
+    llvm::sys::path::remove_filename(dir);
+    if (llvm::sys::fs::create_directories(dir)) {
+        return false;
+    }
+    int fd;
+    SmallString<256> tmp_path;
+    if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, tmp_path)) {
+        return false;
+    }
+    raw_fd_ostream out(fd, /* shouldClose */ true);
+    out << contents;
+    out.close();
+    if (out.has_error()) {
+        out.clear_error();
+        llvm::sys::fs::remove(tmp_path);
+        return false;
+    }
+    return !llvm::sys::fs::rename(tmp_path, path);
+}
+
+// Saves the object MCJIT compiles for a module into the JIT cache, or
+// hands it a previously saved object instead of compiling anything.
+class HalideJITObjectCache : public llvm::ObjectCache {
+    std::string path;
+    std::unique_ptr<MemoryBuffer> object;
+
+public:
+    HalideJITObjectCache(const std::string &path) : path(path) {}
+    HalideJITObjectCache(std::unique_ptr<MemoryBuffer> object) : object(std::move(object)) {}
+
+    void notifyObjectCompiled(const llvm::Module *, MemoryBufferRef obj) override {
+        if (!path.empty() && !write_cache_file(path, obj.getBuffer())) {
+            debug(1) << "Could not write JIT cache entry " << path << "\n";
+        }
+    }
+
+    std::unique_ptr<MemoryBuffer> getObject(const llvm::Module *) override {
+        return std::move(object);
+    }
+};
+
+// The module MCJIT is given in place of a module's code when loading
+// it from the JIT cache. It has the target options, the declarations
+// of the exported functions and the static destructors of the
+// original module, and the full cache key, so a collision of the
+// key's hash can't load the wrong code.
+std::unique_ptr<llvm::Module> make_cache_stub(const llvm::Module &m, const std::vector<string> &exports,
+                                              const string &cache_key) {
+    llvm::LLVMContext &context = m.getContext();
+    std::unique_ptr<llvm::Module> stub(new llvm::Module(m.getModuleIdentifier(), context));
+    stub->setTargetTriple(m.getTargetTriple());
+    stub->setDataLayout(m.getDataLayout());
+
+    SmallVector<llvm::Module::ModuleFlagEntry, 8> flags;
+    m.getModuleFlagsMetadata(flags);
+    for (const auto &flag : flags) {
+        stub->addModuleFlag(flag.Behavior, flag.Key->getString(), flag.Val);
+    }
+
+    ValueToValueMapTy declarations;
+    auto declare = [&](const llvm::Function *fn) {
+        if (!declarations.count(fn)) {
+            declarations[fn] = llvm::Function::Create(fn->getFunctionType(), llvm::GlobalValue::ExternalLinkage,
+                                                      fn->getName(), stub.get());
+        }
+    };
+    for (const string &name : exports) {
+        llvm::Function *fn = m.getFunction(name);
+        internal_assert(fn) << "No function " << name << " in module\n";
+        declare(fn);
+    }
+
+    // The runtime's destructors are all exported, so they can be
+    // found by name in the cached object.
+    for (const char *name : {"llvm.global_ctors", "llvm.global_dtors"}) {
+        const llvm::GlobalVariable *list = m.getNamedGlobal(name);
+        if (!list || !list->hasInitializer()) {
+            continue;
+        }
+        if (const auto *entries = dyn_cast<ConstantArray>(list->getInitializer())) {
+            for (const llvm::Use &entry : entries->operands()) {
+                const llvm::Value *target = cast<Constant>(entry)->getOperand(1)->stripPointerCasts();
+                const llvm::Function *fn = dyn_cast<llvm::Function>(target);
+                internal_assert(fn && !fn->hasLocalLinkage())
+                    << "Static constructors and destructors must be exported\n";
+                declare(fn);
+            }
+        }
+        new llvm::GlobalVariable(*stub, list->getValueType(), false, llvm::GlobalValue::AppendingLinkage,
+                                 MapValue(list->getInitializer(), declarations), name);
+    }
+
+    stub->getOrInsertNamedMetadata("halide_jit_cache_key")
+        ->addOperand(MDNode::get(context, MDString::get(context, cache_key)));
+    return stub;
+}
+
+void save_cache_stub(const llvm::Module &stub, const string &cache_path) {
+    SmallVector<char, 1024> bitcode;
+    raw_svector_ostream bitcode_stream(bitcode);
+#if LLVM_VERSION >= 70
+    WriteBitcodeToFile(stub, bitcode_stream);
+#else
+    WriteBitcodeToFile(&stub, bitcode_stream);
+#endif
+    if (!write_cache_file(cache_path + ".bc", StringRef(bitcode.data(), bitcode.size()))) {
+        debug(1) << "Could not write JIT cache entry " << cache_path << "\n";
+    }
+}
+
+// Read the stub and the object of a cache entry. Returns nullptr if
+// there is no complete entry for the key.
+std::unique_ptr<llvm::Module> load_cache_stub(const string &cache_key, const string &cache_path,
+                                              llvm::LLVMContext &context,
+                                              std::unique_ptr<MemoryBuffer> &object) {
+    auto stub_bitcode = MemoryBuffer::getFile(cache_path + ".bc");
+    // Objects can be large, so let them be mapped rather than read.
+    auto object_or_error = MemoryBuffer::getFile(cache_path + ".o", /* FileSize */ -1,
+                                                 /* RequiresNullTerminator */ false);
+    if (!stub_bitcode || !object_or_error) {
+        return nullptr;
+    }
+
+    auto stub = llvm::expectedToErrorOr(
+        llvm::parseBitcodeFile((*stub_bitcode)->getMemBufferRef(), context));
+    if (!stub) {
+        debug(1) << "Could not parse JIT cache entry " << cache_path << "\n";
+        return nullptr;
+    }
+    std::unique_ptr<llvm::Module> module(std::move(*stub));
+
+    llvm::NamedMDNode *stored_key = module->getNamedMetadata("halide_jit_cache_key");
+    if (!stored_key || stored_key->getNumOperands() != 1 ||
+        cast<MDString>(stored_key->getOperand(0)->getOperand(0))->getString() != cache_key) {
+        debug(1) << "JIT cache entry " << cache_path << " is for a different module\n";
+        return nullptr;
+    }
+
+    object = std::move(*object_or_error);
+    return module;
+}
+
 }
 
 JITModule::JITModule() {
@@ -245,22 +397,62 @@ JITModule::JITModule() {
 }
 
 JITModule::JITModule(const Module &m, const LoweredFunc &fn,
-                     const std::vector<JITModule> &dependencies) {
+                     const std::vector<JITModule> &dependencies,
+                     const std::string &cache_key) {
     jit_module = new JITModuleContents();
     std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(m, jit_module->context));
+
+    string cache_path;
+    std::unique_ptr<llvm::Module> cache_stub;
+    HalideJITObjectCache *object_cache = nullptr;
+    if (!cache_key.empty()) {
+        cache_path = jit_cache_entry_path(cache_key);
+        cache_stub = make_cache_stub(*llvm_module, {fn.name, fn.name + "_argv"}, cache_key);
+        object_cache = new HalideJITObjectCache(cache_path + ".o");
+    }
+
     std::vector<JITModule> deps_with_runtime = dependencies;
     std::vector<JITModule> shared_runtime = JITSharedRuntime::get(llvm_module.get(), m.target());
     deps_with_runtime.insert(deps_with_runtime.end(), shared_runtime.begin(), shared_runtime.end());
-    compile_module(std::move(llvm_module), fn.name, m.target(), deps_with_runtime);
+    compile_module(std::move(llvm_module), fn.name, m.target(), deps_with_runtime,
+                   std::vector<std::string>(), object_cache);
     // If -time-passes is in HL_LLVM_ARGS, this will print llvm passes time statstics otherwise its no-op.
 #if LLVM_VERSION >= 80
     llvm::reportAndResetTimings();
 #endif
+
+    if (cache_stub) {
+        // Lookups look for the stub, so write it after the object, so
+        // that an entry is never found half written.
+        save_cache_stub(*cache_stub, cache_path);
+    }
+}
+
+JITModule JITModule::load_from_cache(const std::string &cache_key,
+                                     const std::string &function_name,
+                                     const Target &target,
+                                     const std::vector<JITModule> &dependencies) {
+    JITModule result;
+    std::unique_ptr<MemoryBuffer> object;
+    std::unique_ptr<llvm::Module> module =
+        load_cache_stub(cache_key, jit_cache_entry_path(cache_key), result.jit_module->context, object);
+    if (!module) {
+        return JITModule();
+    }
+
+    std::vector<JITModule> deps_with_runtime = dependencies;
+    std::vector<JITModule> shared_runtime = JITSharedRuntime::get(module.get(), target);
+    deps_with_runtime.insert(deps_with_runtime.end(), shared_runtime.begin(), shared_runtime.end());
+    result.compile_module(std::move(module), function_name, target, deps_with_runtime,
+                          std::vector<std::string>(), new HalideJITObjectCache(std::move(object)));
+    return result;
 }
 
 void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &function_name, const Target &target,
                                const std::vector<JITModule> &dependencies,
-                               const std::vector<std::string> &requested_exports) {
+                               const std::vector<std::string> &requested_exports,
+                               llvm::ObjectCache *object_cache) {
+    jit_module->object_cache.reset(object_cache);
 
     // Ensure that LLVM is initialized
     CodeGen_LLVM::initialize_llvm();
@@ -277,6 +469,10 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
 
     DataLayout initial_module_data_layout = m->getDataLayout();
     string module_name = m->getModuleIdentifier();
+    // Owned by the execution engine from here on.
+    const llvm::Module &module = *m;
+
+    CompileTimeReport report("jit", module_name);
 
     llvm::EngineBuilder engine_builder((std::move(m)));
     engine_builder.setTargetOptions(options);
@@ -305,6 +501,7 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
 
     if (!ee) std::cerr << error_string << "\n";
     internal_assert(ee) << "Couldn't create execution engine\n";
+    report.pass("create_execution_engine");
 
     // Do any target-specific initialization
     std::vector<llvm::JITEventListener *> listeners;
@@ -319,6 +516,13 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
         ee->RegisterJITEventListener(listeners[i]);
     }
 
+    if (object_cache) {
+        ee->setObjectCache(object_cache);
+        // A module loaded from the cache has no code for MCJIT to
+        // find its functions in, so load the object up front.
+        ee->finalizeObject();
+    }
+
     // Retrieve function pointers from the compiled module (which also
     // triggers compilation)
     debug(1) << "JIT compiling " << module_name
@@ -329,18 +533,19 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     Symbol entrypoint;
     Symbol argv_entrypoint;
     if (!function_name.empty()) {
-        entrypoint = compile_and_get_function(*ee, function_name);
+        entrypoint = compile_and_get_function(*ee, module, function_name);
         exports[function_name] = entrypoint;
-        argv_entrypoint = compile_and_get_function(*ee, function_name + "_argv");
+        argv_entrypoint = compile_and_get_function(*ee, module, function_name + "_argv");
         exports[function_name + "_argv"] = argv_entrypoint;
     }
 
     for (size_t i = 0; i < requested_exports.size(); i++) {
-        exports[requested_exports[i]] = compile_and_get_function(*ee, requested_exports[i]);
+        exports[requested_exports[i]] = compile_and_get_function(*ee, module, requested_exports[i]);
     }
 
     debug(2) << "Finalizing object\n";
     ee->finalizeObject();
+    report.pass("mcjit_codegen", module);
 #if LLVM_VERSION >= 80
     // nothing
 #else
@@ -466,6 +671,14 @@ void JITModule::memoization_cache_set_size(int64_t size) const {
     }
 }
 
+void JITModule::memoization_cache_set_eviction_policy(int policy) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_set_eviction_policy");
+    if (f != exports().end()) {
+        (reinterpret_bits<int (*)(int)>(f->second.address))(policy);
+    }
+}
+
 bool JITModule::compiled() const {
   return jit_module->execution_engine != nullptr;
 }
@@ -476,6 +689,7 @@ JITHandlers runtime_internal_handlers;
 JITHandlers default_handlers;
 JITHandlers active_handlers;
 int64_t default_cache_size;
+int default_cache_eviction_policy;
 
 void merge_handlers(JITHandlers &base, const JITHandlers &addins) {
     if (addins.custom_print) {
@@ -651,6 +865,24 @@ JITModule &shared_runtimes(RuntimeKind k) {
     return m[k];
 }
 
+// Describe the target options clone_target_options copies from a
+// module, for the JIT cache key of a runtime module.
+string target_options_key(const llvm::Module *m) {
+    if (!m) {
+        return "";
+    }
+    string result;
+    raw_string_ostream stream(result);
+    stream << m->getTargetTriple();
+    for (const char *flag : {"halide_use_soft_float_abi", "halide_mcpu", "halide_mattrs"}) {
+        stream << " " << flag << "=";
+        if (llvm::Metadata *md = m->getModuleFlag(flag)) {
+            md->print(stream);
+        }
+    }
+    return stream.str();
+}
+
 JITModule &make_module(llvm::Module *for_module, Target target,
                        RuntimeKind runtime_kind, const std::vector<JITModule> &deps,
                        bool create) {
@@ -752,27 +984,62 @@ JITModule &make_module(llvm::Module *for_module, Target target,
             break;
         }
 
-        // This function is protected by a mutex so this is thread safe.
-        std::unique_ptr<llvm::Module> module(get_initial_module_for_target(one_gpu,
-            &runtime.jit_module->context, true, runtime_kind != MainShared));
-        if (for_module) {
-            clone_target_options(*for_module, *module);
+        // Building and compiling the runtime is most of the cost of
+        // the first JIT compilation in a process, so try the JIT
+        // cache first.
+        string cache_key = jit_cache_runtime_key(module_name, one_gpu, target_options_key(for_module));
+        string cache_path;
+        std::unique_ptr<MemoryBuffer> cached_object;
+        std::unique_ptr<llvm::Module> module;
+        if (!cache_key.empty()) {
+            cache_path = jit_cache_entry_path(cache_key);
+            module = load_cache_stub(cache_key, cache_path, runtime.jit_module->context, cached_object);
         }
-        module->setModuleIdentifier(module_name);
 
-        std::set<std::string> halide_exports_unique;
+        std::vector<std::string> halide_exports;
+        std::unique_ptr<llvm::Module> cache_stub;
+        HalideJITObjectCache *object_cache = nullptr;
+        if (module) {
+            debug(1) << "Loaded " << module_name << " from the JIT cache\n";
+            jit_cache_record(JITCacheEvent::RuntimeHit);
+            // The stub declares exactly the exported functions.
+            for (auto &f : *module) {
+                halide_exports.push_back(f.getName().str());
+            }
+            object_cache = new HalideJITObjectCache(std::move(cached_object));
+        } else {
+            // This function is protected by a mutex so this is thread safe.
+            module = get_initial_module_for_target(one_gpu,
+                &runtime.jit_module->context, true, runtime_kind != MainShared);
+            if (for_module) {
+                clone_target_options(*for_module, *module);
+            }
+            module->setModuleIdentifier(module_name);
+
+            std::set<std::string> halide_exports_unique;
 
-        // Enumerate the functions.
-        for (auto &f : *module) {
-            // LLVM_Runtime_Linker has marked everything that should be exported as weak
-            if (f.hasWeakLinkage()) {
-                halide_exports_unique.insert(f.getName());
+            // Enumerate the functions.
+            for (auto &f : *module) {
+                // LLVM_Runtime_Linker has marked everything that should be exported as weak
+                if (f.hasWeakLinkage()) {
+                    halide_exports_unique.insert(f.getName());
+                }
+            }
+
+            halide_exports.assign(halide_exports_unique.begin(), halide_exports_unique.end());
+
+            if (!cache_key.empty()) {
+                jit_cache_record(JITCacheEvent::RuntimeMiss);
+                cache_stub = make_cache_stub(*module, halide_exports, cache_key);
+                object_cache = new HalideJITObjectCache(cache_path + ".o");
             }
         }
 
-        std::vector<std::string> halide_exports(halide_exports_unique.begin(), halide_exports_unique.end());
+        runtime.compile_module(std::move(module), "", target, deps, halide_exports, object_cache);
 
-        runtime.compile_module(std::move(module), "", target, deps, halide_exports);
+        if (cache_stub) {
+            save_cache_stub(*cache_stub, cache_path);
+        }
 
         if (runtime_kind == MainShared) {
             runtime_internal_handlers.custom_print =
@@ -811,6 +1078,9 @@ JITModule &make_module(llvm::Module *for_module, Target target,
             if (default_cache_size != 0) {
                 runtime.memoization_cache_set_size(default_cache_size);
             }
+            if (default_cache_eviction_policy != 0) {
+                runtime.memoization_cache_set_eviction_policy(default_cache_eviction_policy);
+            }
 
             runtime.jit_module->name = "MainShared";
         } else {
@@ -942,5 +1212,14 @@ void JITSharedRuntime::memoization_cache_set_size(int64_t size) {
     }
 }
 
+void JITSharedRuntime::memoization_cache_set_eviction_policy(int policy) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    if (policy != default_cache_eviction_policy) {
+        default_cache_eviction_policy = policy;
+        shared_runtimes(MainShared).memoization_cache_set_eviction_policy(policy);
+    }
+}
+
 }  // namespace Internal
 }  // namespace Halide
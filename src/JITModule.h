@@ -15,6 +15,7 @@
 
 namespace llvm {
 class Module;
+class ObjectCache;
 class Type;
 }
 
@@ -41,8 +42,21 @@ struct JITModule {
     };
 
     JITModule();
+    /** Compile a Module. If cache_key is not empty, the compiled
+     * object is also saved in the JIT cache directory under that key
+     * (see set_jit_cache_directory). */
     JITModule(const Module &m, const LoweredFunc &fn,
-                     const std::vector<JITModule> &dependencies = std::vector<JITModule>());
+              const std::vector<JITModule> &dependencies = std::vector<JITModule>(),
+              const std::string &cache_key = "");
+
+    /** Load the function saved in the JIT cache directory under the
+     * given key, without lowering or compiling anything. Returns a
+     * JITModule that has not been compiled() if there is no usable
+     * entry for the key. */
+    static JITModule load_from_cache(const std::string &cache_key,
+                                     const std::string &function_name,
+                                     const Target &target,
+                                     const std::vector<JITModule> &dependencies = std::vector<JITModule>());
     /** The exports map of a JITModule contains all symbols which are
      * available to other JITModules which depend on this one. For
      * runtime modules, this is all of the symbols exported from the
@@ -107,14 +121,18 @@ struct JITModule {
     Symbol find_symbol_by_name(const std::string &) const;
 
     /** Take an llvm module and compile it. The requested exports will
-        be available via the exports method. */
+        be available via the exports method. If an object cache is
+        given, the JITModule takes ownership of it, and it is used to
+        save or load the compiled object. */
     void compile_module(std::unique_ptr<llvm::Module> mod,
                         const std::string &function_name, const Target &target,
                         const std::vector<JITModule> &dependencies = std::vector<JITModule>(),
-                        const std::vector<std::string> &requested_exports = std::vector<std::string>());
+                        const std::vector<std::string> &requested_exports = std::vector<std::string>(),
+                        llvm::ObjectCache *object_cache = nullptr);
 
     /** Encapsulate device (GPU) and buffer interactions. */
     void memoization_cache_set_size(int64_t size) const;
+    void memoization_cache_set_eviction_policy(int policy) const;
 
     /** Return true if compile_module has been called on this module. */
     bool compiled() const;
@@ -153,6 +171,13 @@ public:
      */
     static void memoization_cache_set_size(int64_t size);
 
+    /** Select the memoization cache's eviction policy, one of the
+     * values of halide_memoization_cache_eviction_policy_t. If you
+     * are compiling statically, call
+     * halide_memoization_cache_set_eviction_policy() instead.
+     */
+    static void memoization_cache_set_eviction_policy(int policy);
+
     static void release_all();
 };
 
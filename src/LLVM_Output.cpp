@@ -2,8 +2,10 @@
 #include "CodeGen_C.h"
 #include "CodeGen_Internal.h"
 #include "CodeGen_LLVM.h"
+#include "CompileTimeReport.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Runtime_Linker.h"
+#include "ThreadPool.h"
 
 #include <fstream>
 #include <iostream>
@@ -335,8 +337,11 @@ void emit_file(const llvm::Module &module_in, Internal::LLVMOStream& out, llvm::
     Internal::debug(1) << "emit_file.Compiling to native code...\n";
     Internal::debug(2) << "Target triple: " << module_in.getTargetTriple() << "\n";
 
+    Internal::CompileTimeReport report("llvm", module_in.getModuleIdentifier());
+
     // Work on a copy of the module to avoid modifying the original.
     std::unique_ptr<llvm::Module> module = clone_module(module_in);
+    report.pass("clone_module", *module);
 
     // Get the target specific parser.
     auto target_machine = Internal::make_target_machine(*module);
@@ -377,6 +382,7 @@ void emit_file(const llvm::Module &module_in, Internal::LLVMOStream& out, llvm::
 #endif
 
     pass_manager.run(*module);
+    report.pass(file_type == llvm::TargetMachine::CGFT_ObjectFile ? "emit_object" : "emit_assembly", *module);
     // If -time-passes is in HL_LLVM_ARGS, this will print llvm passes time statstics otherwise its no-op.
 #if LLVM_VERSION >= 80
     llvm::reportAndResetTimings();
@@ -395,6 +401,55 @@ void compile_llvm_module_to_assembly(llvm::Module &module, Internal::LLVMOStream
     emit_file(module, out, llvm::TargetMachine::CGFT_AssemblyFile);
 }
 
+void compile_llvm_module_to_objects(const llvm::Module &module, const std::vector<Internal::LLVMOStream *> &outs) {
+    internal_assert(!outs.empty());
+    if (outs.size() == 1) {
+        emit_file(module, *outs[0], llvm::TargetMachine::CGFT_ObjectFile);
+        return;
+    }
+
+    // The optimizer has already seen the whole module, so the
+    // partitions lose nothing but the chance to share code between
+    // them. SplitModule assigns globals to partitions by a hash of
+    // their names. Locals must stay local, or two libraries compiled
+    // this way would define the same externalized symbols (e.g. the
+    // unnamed constants) and couldn't be linked into one program, so
+    // every user of a local is kept in the same partition as it.
+    Internal::debug(1) << "Splitting " << module.getModuleIdentifier()
+                       << " into " << outs.size() << " partitions\n";
+    std::unique_ptr<llvm::Module> whole = clone_module(module);
+    std::vector<llvm::SmallVector<char, 0>> partitions;
+    auto add_partition = [&](std::unique_ptr<llvm::Module> part) {
+        // An LLVMContext can only be used by one thread at a time,
+        // so each partition is moved to a context of its own as bitcode.
+        partitions.emplace_back();
+        llvm::raw_svector_ostream os(partitions.back());
+#if LLVM_VERSION >= 70
+        WriteBitcodeToFile(*part, os);
+#else
+        WriteBitcodeToFile(part.get(), os);
+#endif
+    };
+#if LLVM_VERSION >= 120
+    llvm::SplitModule(*whole, outs.size(), add_partition, /* PreserveLocals */ true);
+#else
+    llvm::SplitModule(std::move(whole), outs.size(), add_partition, /* PreserveLocals */ true);
+#endif
+    internal_assert(partitions.size() == outs.size());
+
+    std::vector<std::function<void()>> jobs;
+    for (size_t i = 0; i < partitions.size(); i++) {
+        jobs.push_back([&partitions, &outs, i]() {
+            llvm::LLVMContext context;
+            llvm::MemoryBufferRef buffer(llvm::StringRef(partitions[i].data(), partitions[i].size()), "partition");
+            auto part = llvm::parseBitcodeFile(buffer, context);
+            internal_assert(part);
+            emit_file(*part.get(), *outs[i], llvm::TargetMachine::CGFT_ObjectFile);
+        });
+    }
+    Internal::run_jobs_concurrently(jobs, outs.size());
+}
+
 void compile_llvm_module_to_llvm_bitcode(llvm::Module &module, Internal::LLVMOStream& out) {
 #if LLVM_VERSION >= 70
     WriteBitcodeToFile(module, out);
@@ -39,6 +39,13 @@ void compile_llvm_module_to_object(llvm::Module &module, Internal::LLVMOStream&
 void compile_llvm_module_to_assembly(llvm::Module &module, Internal::LLVMOStream& out);
 // @}
 
+/** Compile an LLVM module to one native object per output stream. The
+ * module is split into that many partitions, which are emitted
+ * concurrently. A symbol defined in one partition may be used by
+ * another, so the objects must all be linked together, e.g. by
+ * putting them in the same static library. */
+void compile_llvm_module_to_objects(const llvm::Module &module, const std::vector<Internal::LLVMOStream *> &outs);
+
 /** Compile an LLVM module to LLVM targets (bitcode, LLVM assembly). */
 // @{
 void compile_llvm_module_to_llvm_bitcode(llvm::Module &module, Internal::LLVMOStream& out);
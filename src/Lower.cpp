@@ -9,11 +9,13 @@
 #include "AddParameterChecks.h"
 #include "AllocationBoundsInference.h"
 #include "AsyncProducers.h"
+#include "ArenaAllocations.h"
 #include "BoundSmallAllocations.h"
 #include "Bounds.h"
 #include "BoundsInference.h"
 #include "CSE.h"
 #include "CanonicalizeGPUVars.h"
+#include "CompileTimeReport.h"
 #include "Debug.h"
 #include "DebugArguments.h"
 #include "DebugToFile.h"
@@ -51,6 +53,7 @@
 #include "Simplify.h"
 #include "SimplifySpecializations.h"
 #include "SkipStages.h"
+#include "SlabAllocations.h"
 #include "SlidingWindow.h"
 #include "SplitTuples.h"
 #include "StorageFlattening.h"
@@ -86,6 +89,8 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
 
     Module result_module(simple_pipeline_name, t);
 
+    CompileTimeReport report("lower", pipeline_name);
+
     // Compute an environment
     map<string, Function> env;
     for (Function f : output_funcs) {
@@ -95,9 +100,11 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // Create a deep-copy of the entire graph of Funcs.
     vector<Function> outputs;
     std::tie(outputs, env) = deep_copy(output_funcs, env);
+    report.pass("deep_copy");
 
     bool any_strict_float = strictify_float(env, t);
     result_module.set_any_strict_float(any_strict_float);
+    report.pass("strictify_float");
 
     // Output functions should all be computed and stored at root.
     for (Function f: outputs) {
@@ -108,28 +115,34 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     for (auto &iter : env) {
         iter.second.lock_loop_levels();
     }
+    report.pass("lock_loop_levels");
 
     // Substitute in wrapper Funcs
     env = wrap_func_calls(env);
+    report.pass("wrap_func_calls");
 
     // Compute a realization order and determine group of functions which loops
     // are to be fused together
     vector<string> order;
     vector<vector<string>> fused_groups;
     std::tie(order, fused_groups) = realization_order(outputs, env);
+    report.pass("realization_order");
 
     // Try to simplify the RHS/LHS of a function definition by propagating its
     // specializations' conditions
     simplify_specializations(env);
+    report.pass("simplify_specializations");
 
     debug(1) << "Creating initial loop nests...\n";
     bool any_memoized = false;
     Stmt s = schedule_functions(outputs, fused_groups, env, t, any_memoized);
+    report.pass("schedule_functions", s);
     debug(2) << "Lowering after creating initial loop nests:\n" << s << '\n';
 
     if (any_memoized) {
         debug(1) << "Injecting memoization...\n";
         s = inject_memoization(s, env, pipeline_name, outputs);
+        report.pass("inject_memoization", s);
         debug(2) << "Lowering after injecting memoization:\n" << s << '\n';
     } else {
         debug(1) << "Skipping injecting memoization...\n";
@@ -137,21 +150,25 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
 
     debug(1) << "Injecting tracing...\n";
     s = inject_tracing(s, pipeline_name, env, outputs, t);
+    report.pass("inject_tracing", s);
     debug(2) << "Lowering after injecting tracing:\n" << s << '\n';
 
     debug(1) << "Adding checks for parameters\n";
     s = add_parameter_checks(s, t);
+    report.pass("add_parameter_checks", s);
     debug(2) << "Lowering after injecting parameter checks:\n" << s << '\n';
 
     // Compute the maximum and minimum possible value of each
     // function. Used in later bounds inference passes.
     debug(1) << "Computing bounds of each function's value\n";
     FuncValueBounds func_bounds = compute_function_value_bounds(order, env);
+    report.pass("compute_function_value_bounds");
 
     // The checks will be in terms of the symbols defined by bounds
     // inference.
     debug(1) << "Adding checks for images\n";
     s = add_image_checks(s, outputs, t, order, env, func_bounds);
+    report.pass("add_image_checks", s);
     debug(2) << "Lowering after injecting image checks:\n" << s << '\n';
 
     // This pass injects nested definitions of variable names, so we
@@ -159,22 +176,27 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // can still simplify Exprs).
     debug(1) << "Performing computation bounds inference...\n";
     s = bounds_inference(s, outputs, order, fused_groups, env, func_bounds, t);
+    report.pass("bounds_inference", s);
     debug(2) << "Lowering after computation bounds inference:\n" << s << '\n';
 
     debug(1) << "Removing extern loops...\n";
     s = remove_extern_loops(s);
+    report.pass("remove_extern_loops", s);
     debug(2) << "Lowering after removing extern loops:\n" << s << '\n';
 
     debug(1) << "Performing sliding window optimization...\n";
     s = sliding_window(s, env);
+    report.pass("sliding_window", s);
     debug(2) << "Lowering after sliding window:\n" << s << '\n';
 
     debug(1) << "Performing allocation bounds inference...\n";
     s = allocation_bounds_inference(s, env, func_bounds);
+    report.pass("allocation_bounds_inference", s);
     debug(2) << "Lowering after allocation bounds inference:\n" << s << '\n';
 
     debug(1) << "Removing code that depends on undef values...\n";
     s = remove_undef(s);
+    report.pass("remove_undef", s);
     debug(2) << "Lowering after removing code that depends on undef values:\n" << s << "\n\n";
 
     // This uniquifies the variable names, so we're good to simplify
@@ -182,53 +204,65 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // equivalence means semantic equivalence.
     debug(1) << "Uniquifying variable names...\n";
     s = uniquify_variable_names(s);
+    report.pass("uniquify_variable_names", s);
     debug(2) << "Lowering after uniquifying variable names:\n" << s << "\n\n";
 
     debug(1) << "Simplifying...\n";
     s = simplify(s, false); // Storage folding needs .loop_max symbols
+    report.pass("simplify", s);
     debug(2) << "Lowering after first simplification:\n" << s << "\n\n";
 
     debug(1) << "Performing storage folding optimization...\n";
     s = storage_folding(s, env);
+    report.pass("storage_folding", s);
     debug(2) << "Lowering after storage folding:\n" << s << '\n';
 
     debug(1) << "Injecting debug_to_file calls...\n";
     s = debug_to_file(s, outputs, env);
+    report.pass("debug_to_file", s);
     debug(2) << "Lowering after injecting debug_to_file calls:\n" << s << '\n';
 
     debug(1) << "Injecting prefetches...\n";
     s = inject_prefetch(s, env);
+    report.pass("inject_prefetch", s);
     debug(2) << "Lowering after injecting prefetches:\n" << s << "\n\n";
 
     debug(1) << "Dynamically skipping stages...\n";
     s = skip_stages(s, order);
+    report.pass("skip_stages", s);
     debug(2) << "Lowering after dynamically skipping stages:\n" << s << "\n\n";
 
     debug(1) << "Forking asynchronous producers...\n";
     s = fork_async_producers(s, env);
+    report.pass("fork_async_producers", s);
     debug(2) << "Lowering after forking asynchronous producers:\n" << s << '\n';
 
     debug(1) << "Destructuring tuple-valued realizations...\n";
     s = split_tuples(s, env);
+    report.pass("split_tuples", s);
     debug(2) << "Lowering after destructuring tuple-valued realizations:\n" << s << "\n\n";
 
     // OpenGL relies on GPU var canonicalization occurring before
     // storage flattening
     debug(1) << "Canonicalizing GPU var names...\n";
     s = canonicalize_gpu_vars(s);
+    report.pass("canonicalize_gpu_vars", s);
     debug(2) << "Lowering after canonicalizing GPU var names:\n" << s << '\n';
 
     debug(1) << "Performing storage flattening...\n";
     s = storage_flattening(s, outputs, env, t);
+    report.pass("storage_flattening", s);
     debug(2) << "Lowering after storage flattening:\n" << s << "\n\n";
 
     debug(1) << "Unpacking buffer arguments...\n";
     s = unpack_buffers(s);
+    report.pass("unpack_buffers", s);
     debug(2) << "Lowering after unpacking buffer arguments...\n" << s << "\n\n";
 
     if (any_memoized) {
         debug(1) << "Rewriting memoized allocations...\n";
         s = rewrite_memoized_allocations(s, env);
+        report.pass("rewrite_memoized_allocations", s);
         debug(2) << "Lowering after rewriting memoized allocations:\n" << s << "\n\n";
     } else {
         debug(1) << "Skipping rewriting memoized allocations...\n";
@@ -241,116 +275,170 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
         (t.arch != Target::Hexagon && (t.features_any_of({Target::HVX_64, Target::HVX_128})))) {
         debug(1) << "Selecting a GPU API for GPU loops...\n";
         s = select_gpu_api(s, t);
+        report.pass("select_gpu_api", s);
         debug(2) << "Lowering after selecting a GPU API:\n" << s << "\n\n";
 
         debug(1) << "Injecting host <-> dev buffer copies...\n";
         s = inject_host_dev_buffer_copies(s, t);
+        report.pass("inject_host_dev_buffer_copies", s);
         debug(2) << "Lowering after injecting host <-> dev buffer copies:\n" << s << "\n\n";
 
         debug(1) << "Selecting a GPU API for extern stages...\n";
         s = select_gpu_api(s, t);
+        report.pass("select_gpu_api", s);
         debug(2) << "Lowering after selecting a GPU API for extern stages:\n" << s << "\n\n";
     }
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Injecting OpenGL texture intrinsics...\n";
         s = inject_opengl_intrinsics(s);
+        report.pass("inject_opengl_intrinsics", s);
         debug(2) << "Lowering after OpenGL intrinsics:\n" << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
     s = simplify(s);
+    report.pass("simplify", s);
     s = unify_duplicate_lets(s);
+    report.pass("unify_duplicate_lets", s);
     s = remove_trivial_for_loops(s);
+    report.pass("remove_trivial_for_loops", s);
     debug(2) << "Lowering after second simplifcation:\n" << s << "\n\n";
 
     debug(1) << "Reduce prefetch dimension...\n";
     s = reduce_prefetch_dimension(s, t);
+    report.pass("reduce_prefetch_dimension", s);
     debug(2) << "Lowering after reduce prefetch dimension:\n" << s << "\n";
 
     debug(1) << "Unrolling...\n";
     s = unroll_loops(s);
+    report.pass("unroll_loops", s);
     s = simplify(s);
+    report.pass("simplify", s);
     debug(2) << "Lowering after unrolling:\n" << s << "\n\n";
 
     debug(1) << "Vectorizing...\n";
     s = vectorize_loops(s, t);
+    report.pass("vectorize_loops", s);
     s = simplify(s);
+    report.pass("simplify", s);
     debug(2) << "Lowering after vectorizing:\n" << s << "\n\n";
 
+    debug(1) << "Injecting trace filters...\n";
+    s = inject_trace_filters(s, env);
+    report.pass("inject_trace_filters", s);
+    debug(2) << "Lowering after injecting trace filters:\n" << s << "\n\n";
+
     if (t.has_gpu_feature() ||
         t.has_feature(Target::OpenGLCompute)) {
         debug(1) << "Injecting per-block gpu synchronization...\n";
         s = fuse_gpu_thread_loops(s);
+        report.pass("fuse_gpu_thread_loops", s);
         debug(2) << "Lowering after injecting per-block gpu synchronization:\n" << s << "\n\n";
     }
 
     debug(1) << "Detecting vector interleavings...\n";
     s = rewrite_interleavings(s);
+    report.pass("rewrite_interleavings", s);
     s = simplify(s);
+    report.pass("simplify", s);
     debug(2) << "Lowering after rewriting vector interleavings:\n" << s << "\n\n";
 
     debug(1) << "Partitioning loops to simplify boundary conditions...\n";
     s = partition_loops(s);
+    report.pass("partition_loops", s);
     s = simplify(s);
+    report.pass("simplify", s);
     debug(2) << "Lowering after partitioning loops:\n" << s << "\n\n";
 
     debug(1) << "Trimming loops to the region over which they do something...\n";
     s = trim_no_ops(s);
+    report.pass("trim_no_ops", s);
     debug(2) << "Lowering after loop trimming:\n" << s << "\n\n";
 
     debug(1) << "Injecting early frees...\n";
     s = inject_early_frees(s);
+    report.pass("inject_early_frees", s);
     debug(2) << "Lowering after injecting early frees:\n" << s << "\n\n";
 
     if (t.has_feature(Target::Profile)) {
         debug(1) << "Injecting profiling...\n";
-        s = inject_profiling(s, pipeline_name);
+        s = inject_profiling(s, pipeline_name,
+                             t.has_feature(Target::ProfileCounters),
+                             t.has_feature(Target::ProfileTimeline));
+        report.pass("inject_profiling", s);
         debug(2) << "Lowering after injecting profiling:\n" << s << "\n\n";
     }
 
     if (t.has_feature(Target::FuzzFloatStores)) {
         debug(1) << "Fuzzing floating point stores...\n";
         s = fuzz_float_stores(s);
+        report.pass("fuzz_float_stores", s);
         debug(2) << "Lowering after fuzzing floating point stores:\n" << s << "\n\n";
     }
 
+    int64_t slab_bytes = 0, task_slab_bytes = 0;
+    if (t.has_feature(Target::SlabAlloc)) {
+        debug(1) << "Packing allocations into slabs...\n";
+        s = plan_slab_allocations(s, slab_bytes, task_slab_bytes);
+        report.pass("plan_slab_allocations", s);
+        debug(2) << "Lowering after packing allocations into slabs:\n" << s << "\n\n";
+    }
+
     debug(1) << "Bounding small allocations...\n";
     s = bound_small_allocations(s);
+    report.pass("bound_small_allocations", s);
     debug(2) << "Lowering after bounding small allocations:\n" << s << "\n\n";
 
+    if (t.has_feature(Target::ArenaAlloc)) {
+        debug(1) << "Injecting arena allocations...\n";
+        s = inject_arena_allocations(s);
+        report.pass("inject_arena_allocations", s);
+        debug(2) << "Lowering after injecting arena allocations:\n" << s << "\n\n";
+    }
+
     if (t.has_feature(Target::CUDA)) {
         debug(1) << "Injecting warp shuffles...\n";
         s = lower_warp_shuffles(s);
+        report.pass("lower_warp_shuffles", s);
         debug(2) << "Lowering after injecting warp shuffles:\n" << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
     s = common_subexpression_elimination(s);
+    report.pass("common_subexpression_elimination", s);
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Detecting varying attributes...\n";
         s = find_linear_expressions(s);
+        report.pass("find_linear_expressions", s);
         debug(2) << "Lowering after detecting varying attributes:\n" << s << "\n\n";
 
         debug(1) << "Moving varying attribute expressions out of the shader...\n";
         s = setup_gpu_vertex_buffer(s);
+        report.pass("setup_gpu_vertex_buffer", s);
         debug(2) << "Lowering after removing varying attributes:\n" << s << "\n\n";
     }
 
     debug(1) << "Lowering unsafe promises...\n";
     s = lower_unsafe_promises(s, t);
+    report.pass("lower_unsafe_promises", s);
     debug(2) << "Lowering after lowering unsafe promises:\n" << s << "\n\n";
 
     s = remove_dead_allocations(s);
+    report.pass("remove_dead_allocations", s);
     s = remove_trivial_for_loops(s);
+    report.pass("remove_trivial_for_loops", s);
     s = simplify(s);
+    report.pass("simplify", s);
     s = loop_invariant_code_motion(s);
+    report.pass("loop_invariant_code_motion", s);
     debug(1) << "Lowering after final simplification:\n" << s << "\n\n";
 
     if (t.arch != Target::Hexagon && (t.features_any_of({Target::HVX_64, Target::HVX_128}))) {
         debug(1) << "Splitting off Hexagon offload...\n";
         s = inject_hexagon_rpc(s, t, result_module);
+        report.pass("inject_hexagon_rpc", s);
         debug(2) << "Lowering after splitting off Hexagon offload:\n" << s << '\n';
     } else {
         debug(1) << "Skipping Hexagon offload...\n";
@@ -360,6 +448,7 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
         for (size_t i = 0; i < custom_passes.size(); i++) {
             debug(1) << "Running custom lowering pass " << i << "...\n";
             s = custom_passes[i]->mutate(s);
+            report.pass("custom_pass", s);
             debug(1) << "Lowering after custom pass " << i << ":\n" << s << "\n\n";
         }
     }
@@ -374,6 +463,7 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     }
 
     vector<InferredArgument> inferred_args = infer_arguments(s, outputs);
+    report.pass("infer_arguments");
     for (const InferredArgument &arg : inferred_args) {
         if (arg.param.defined() && arg.param.name() == "__user_context") {
             // The user context is always in the inferred args, but is
@@ -439,6 +529,8 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     s = StrengthenRefs().mutate(s);
 
     LoweredFunc main_func(pipeline_name, public_args, s, linkage_type);
+    main_func.slab_bytes = slab_bytes;
+    main_func.task_slab_bytes = task_slab_bytes;
 
     // If we're in debug mode, add code that prints the args.
     if (t.has_feature(Target::Debug)) {
@@ -1,5 +1,7 @@
 #include "Memoization.h"
 #include "Error.h"
+#include "FindCalls.h"
+#include "IRPrinter.h"
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "Param.h"
@@ -7,7 +9,9 @@
 #include "Util.h"
 #include "Var.h"
 
+#include <iomanip>
 #include <map>
+#include <sstream>
 
 namespace Halide {
 namespace Internal {
@@ -143,11 +147,74 @@ public:
 
 typedef std::pair<FindParameterDependencies::DependencyKey, FindParameterDependencies::DependencyInfo> DependencyKeyInfoPair;
 
+// A hash of the definitions of a Func and everything it calls, so
+// that results persisted by the memoization cache are not reused
+// after a pipeline's algorithm changes. The contents of Buffers and
+// the behavior of extern stages are not covered; only their names are.
+std::string definition_fingerprint(const Function &function) {
+    std::ostringstream defs;
+    for (const auto &i : find_transitive_calls(function)) {
+        const Function &g = i.second;
+        defs << g.name() << "(";
+        for (const std::string &arg : g.args()) {
+            defs << arg << ",";
+        }
+        defs << ")";
+        for (Type t : g.output_types()) {
+            defs << t << ",";
+        }
+        if (g.has_extern_definition()) {
+            defs << "extern " << g.extern_function_name() << "(";
+            for (const ExternFuncArgument &arg : g.extern_arguments()) {
+                if (arg.is_func()) {
+                    defs << Function(arg.func).name();
+                } else if (arg.is_expr()) {
+                    defs << arg.expr;
+                } else if (arg.is_buffer()) {
+                    defs << arg.buffer.name();
+                } else if (arg.is_image_param()) {
+                    defs << arg.image_param.name();
+                }
+                defs << ",";
+            }
+            defs << ")";
+        }
+        std::vector<const Definition *> definitions;
+        if (g.has_pure_definition()) {
+            definitions.push_back(&g.definition());
+        }
+        for (const Definition &u : g.updates()) {
+            definitions.push_back(&u);
+        }
+        for (const Definition *d : definitions) {
+            defs << "[";
+            for (const Expr &e : d->args()) {
+                defs << e << ",";
+            }
+            defs << "]=";
+            for (const Expr &e : d->values()) {
+                defs << e << ",";
+            }
+            defs << "if " << d->predicate() << ";";
+        }
+    }
+
+    // FNV-1a, which unlike std::hash is the same in every process.
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : defs.str()) {
+        h = (h ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    std::ostringstream result;
+    result << std::hex << std::setw(16) << std::setfill('0') << h;
+    return result.str();
+}
+
 class KeyInfo {
     FindParameterDependencies dependencies;
     Expr key_size_expr;
     const std::string &top_level_name;
     const std::string &function_name;
+    std::string fingerprint;
     int memoize_instance;
 
     size_t parameters_alignment() {
@@ -185,6 +252,7 @@ public:
     KeyInfo(const Function &function, const std::string &name, int memoize_instance)
         : top_level_name(name),
           function_name(function.origin_name()),
+          fingerprint(definition_fingerprint(function)),
           memoize_instance(memoize_instance)
     {
         dependencies.visit_function(function);
@@ -216,10 +284,16 @@ public:
         // Store a pointer to a string identifying the filter and
         // function. Assume this will be unique due to CSE. This can
         // break with loading and unloading of code, though the name
-        // mechanism can also break in those conditions.
+        // mechanism can also break in those conditions. The string
+        // ends with a fingerprint of the definition, and the
+        // persistent tier of the runtime's cache keys entries by the
+        // string rather than the pointer (and ignores the
+        // memoize_instance that follows), so that entries can be
+        // shared between processes.
         writes.push_back(Store::make(key_name,
                                      StringImm::make(std::to_string(top_level_name.size()) + ":" + top_level_name +
-                                                     std::to_string(function_name.size()) + ":" + function_name),
+                                                     std::to_string(function_name.size()) + ":" + function_name +
+                                                     ":" + fingerprint),
                                      (index / Handle().bytes()), Parameter(), const_true(), ModulusRemainder()));
         size_t alignment = Handle().bytes();
         index += Handle().bytes();
@@ -280,7 +354,8 @@ public:
 
     // Returns a statement which will store the result of a computation under this key
     Stmt store_computation(std::string key_allocation_name, std::string computed_bounds_name,
-                           int32_t tuple_count, std::string storage_base_name) {
+                           int32_t tuple_count, std::string storage_base_name,
+                           std::string compute_start_name) {
         std::vector<Expr> args;
         args.push_back(Variable::make(type_of<uint8_t *>(), key_allocation_name));
         args.push_back(key_size());
@@ -296,8 +371,13 @@ public:
         }
         args.push_back(Call::make(type_of<halide_buffer_t **>(), Call::make_struct, buffers, Call::Intrinsic));
 
+        // Pass along how long the computation took, so the cache can
+        // weigh the cost of recomputing an entry against its size.
+        Expr now = Call::make(Int(64), "halide_current_time_ns", {}, Call::Extern);
+        args.push_back(now - Variable::make(Int(64), compute_start_name));
+
         // This is actually a void call. How to indicate that? Look at Extern_ stuff.
-        return Evaluate::make(Call::make(Int(32), "halide_memoization_cache_store", args, Call::Extern));
+        return Evaluate::make(Call::make(Int(32), "halide_memoization_cache_store_with_cost", args, Call::Extern));
     }
 };
 
@@ -353,10 +433,16 @@ private:
             std::string cache_result_name = op->name + ".cache_result";
             std::string cache_miss_name = op->name + ".cache_miss";
             std::string computed_bounds_name = op->name + ".computed_bounds.buffer";
+            std::string compute_start_name = op->name + ".compute_start";
 
+            // Note the time just after the lookup, before the producer
+            // runs, so that the store can report the compute time.
+            Stmt compute_start = LetStmt::make(compute_start_name,
+                                               Call::make(Int(64), "halide_current_time_ns", {}, Call::Extern),
+                                               mutated_body);
             Stmt cache_miss_marker = LetStmt::make(cache_miss_name,
                                                    Cast::make(Bool(), Variable::make(Int(32), cache_result_name)),
-                                                   mutated_body);
+                                                   compute_start);
             Stmt cache_lookup_check = Block::make(AssertStmt::make(NE::make(Variable::make(Int(32), cache_result_name), -1),
                                                                    Call::make(Int(32), "halide_error_out_of_memory", { }, Call::Extern)),
                                                   cache_miss_marker);
@@ -413,9 +499,11 @@ private:
 
                 std::string cache_key_name = op->name + ".cache_key";
                 std::string computed_bounds_name = op->name + ".computed_bounds.buffer";
+                std::string compute_start_name = op->name + ".compute_start";
 
                 Stmt cache_store_back =
-                    IfThenElse::make(cache_miss, key_info.store_computation(cache_key_name, computed_bounds_name, f.outputs(), op->name));
+                    IfThenElse::make(cache_miss, key_info.store_computation(cache_key_name, computed_bounds_name,
+                                                                            f.outputs(), op->name, compute_start_name));
 
                 Stmt mutated_body = Block::make(cache_store_back, body);
                 return ProducerConsumer::make(op->name, op->is_producer, mutated_body);
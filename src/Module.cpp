@@ -15,6 +15,7 @@
 #include "Outputs.h"
 #include "PythonExtensionGen.h"
 #include "StmtToHtml.h"
+#include "ThreadPool.h"
 #include "WrapExternStages.h"
 
 using Halide::Internal::debug;
@@ -471,13 +472,28 @@ void Module::compile(const Outputs &output_files_arg) const {
             // no real-world code ever sets both object_name and static_library_name
             // at the same time, so there is no meaningful performance advantage
             // to be had.
+            //
+            // The objects in a library are linked together anyway, so
+            // split the module into partitions and emit them
+            // concurrently. There's no point in more partitions than
+            // functions (plus one for the runtime, if it's included).
             TemporaryObjectFileDir temp_dir;
             {
-                std::string object_name = temp_dir.add_temp_object_file(output_files.static_library_name, "", target());
-                debug(1) << "Module.compile(): temporary object_name " << object_name << "\n";
-                auto out = make_raw_fd_ostream(object_name);
-                compile_llvm_module_to_object(*llvm_module, *out);
-                out->flush();  // create_static_library() is happier if we do this
+                size_t partitions = functions().size() + (target().has_feature(Target::NoRuntime) ? 0 : 1);
+                partitions = std::max((size_t)1, std::min(partitions, (size_t)get_compile_thread_count()));
+                std::vector<std::unique_ptr<llvm::raw_fd_ostream>> outs;
+                std::vector<LLVMOStream *> out_ptrs;
+                for (size_t i = 0; i < partitions; i++) {
+                    std::string suffix = partitions == 1 ? "" : "_" + std::to_string(i);
+                    std::string object_name = temp_dir.add_temp_object_file(output_files.static_library_name, suffix, target());
+                    debug(1) << "Module.compile(): temporary object_name " << object_name << "\n";
+                    outs.push_back(make_raw_fd_ostream(object_name));
+                    out_ptrs.push_back(outs.back().get());
+                }
+                compile_llvm_module_to_objects(*llvm_module, out_ptrs);
+                for (auto &out : outs) {
+                    out->flush();  // create_static_library() is happier if we do this
+                }
             }
             debug(1) << "Module.compile(): static_library_name " << output_files.static_library_name << "\n";
             Target base_target(target().os, target().arch, target().bits);
@@ -608,6 +624,12 @@ void compile_multitarget(const std::string &fn_name,
     constexpr int kFeaturesWordCount = (Target::FeatureEnd + 63) / (sizeof(uint64_t) * 8);
     uint64_t runtime_features[kFeaturesWordCount] = {(uint64_t)-1LL};
 
+    // Lowering happens here, one target at a time, since module
+    // producers (e.g. Generators) aren't thread-safe. Generating code
+    // for each lowered module is independent of the others, so that's
+    // deferred and done concurrently once they've all been lowered.
+    std::vector<std::function<void()>> compile_jobs;
+
     TemporaryObjectFileDir temp_dir;
     std::vector<Expr> wrapper_args;
     std::vector<LoweredArgument> base_target_args;
@@ -662,8 +684,10 @@ void compile_multitarget(const std::string &fn_name,
         internal_assert(sub_out.object_name.empty());
         sub_out.object_name = temp_dir.add_temp_object_file(output_files.static_library_name, suffix, target);
         sub_out.registration_name.clear();
-        debug(1) << "compile_multitarget: compile_sub_target " << sub_out.object_name << "\n";
-        sub_module.compile(sub_out);
+        compile_jobs.push_back([sub_module, sub_out]() {
+            debug(1) << "compile_multitarget: compile_sub_target " << sub_out.object_name << "\n";
+            sub_module.compile(sub_out);
+        });
 
         uint64_t cur_target_features[kFeaturesWordCount] = {0};
         for (int i = 0; i < Target::FeatureEnd; ++i) {
@@ -711,8 +735,10 @@ void compile_multitarget(const std::string &fn_name,
         }
         Outputs runtime_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target));
-        debug(1) << "compile_multitarget: compile_standalone_runtime " << runtime_out.static_library_name << "\n";
-        compile_standalone_runtime(runtime_out, runtime_target);
+        compile_jobs.push_back([runtime_out, runtime_target]() {
+            debug(1) << "compile_multitarget: compile_standalone_runtime " << runtime_out.object_name << "\n";
+            compile_standalone_runtime(runtime_out, runtime_target);
+        });
     }
 
     if (needs_wrapper) {
@@ -750,10 +776,14 @@ void compile_multitarget(const std::string &fn_name,
 
         Outputs wrapper_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true));
-        debug(1) << "compile_multitarget: wrapper " << wrapper_out.object_name << "\n";
-        wrapper_module.compile(wrapper_out);
+        compile_jobs.push_back([wrapper_module, wrapper_out]() {
+            debug(1) << "compile_multitarget: wrapper " << wrapper_out.object_name << "\n";
+            wrapper_module.compile(wrapper_out);
+        });
     }
 
+    run_jobs_concurrently(compile_jobs, get_compile_thread_count());
+
     if (!output_files.c_header_name.empty()) {
         Module header_module(fn_name, base_target);
         header_module.append(LoweredFunc(fn_name, base_target_args, {}, LinkageType::ExternalPlusMetadata));
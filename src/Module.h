@@ -60,6 +60,14 @@ struct LoweredFunc {
      * the Target. */
     NameMangling name_mangling;
 
+    /** The size of the slab of scratch memory the function allocates
+     * once per call, and of the largest slab it allocates once per
+     * parallel task, with the slab_alloc target feature. AOT callers
+     * can query them with the <name>_slab_bytes() and
+     * <name>_task_slab_bytes() functions emitted alongside
+     * <name>_metadata(). See plan_slab_allocations. */
+    int64_t slab_bytes = 0, task_slab_bytes = 0;
+
     LoweredFunc(const std::string &name,
                 const std::vector<LoweredArgument> &args,
                 Stmt body,
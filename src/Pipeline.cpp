@@ -5,6 +5,7 @@
 #include "Func.h"
 #include "IRVisitor.h"
 #include "InferArguments.h"
+#include "JITCache.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Output.h"
 #include "Lower.h"
@@ -455,14 +456,35 @@ void *Pipeline::compile_jit(const Target &target_arg) {
     // Come up with a name for the generated function
     string name = generate_function_name();
 
+    std::map<std::string, JITExtern> lowered_externs = contents->jit_externs;
+    std::vector<JITModule> externs_jit_module = make_externs_jit_module(target_arg, lowered_externs);
+
+    // Custom lowering passes can do anything, so there's no way to
+    // know whether a cached pipeline was lowered with the same ones.
+    string cache_key;
+    if (contents->custom_lowering_passes.empty()) {
+        cache_key = jit_cache_key(contents->outputs, contents->inferred_args, name, target);
+    }
+    if (cache_key.empty()) {
+        jit_cache_record(JITCacheEvent::Uncacheable);
+    } else {
+        JITModule cached = JITModule::load_from_cache(cache_key, name, target, externs_jit_module);
+        if (cached.compiled()) {
+            debug(1) << "Loaded " << name << " from the JIT cache\n";
+            jit_cache_record(JITCacheEvent::Hit);
+            contents->jit_module = cached;
+            return cached.main_function();
+        }
+        debug(1) << "JIT cache miss for " << name << "\n";
+        jit_cache_record(JITCacheEvent::Miss);
+    }
+
     // Compile to a module and also compile any submodules.
     Module module = compile_to_module(args, name, target).resolve_submodules();
     auto f = module.get_function_by_name(name);
 
-    std::map<std::string, JITExtern> lowered_externs = contents->jit_externs;
-
     // Compile to jit module
-    JITModule jit_module(module, f, make_externs_jit_module(target_arg, lowered_externs));
+    JITModule jit_module(module, f, externs_jit_module, cache_key);
 
     // Dump bitcode to a file if the environment variable
     // HL_GENBITCODE is defined to a nonzero value.
@@ -27,7 +27,7 @@ public:
 
     string pipeline_name;
 
-    InjectProfiling(const string &pipeline_name) : pipeline_name(pipeline_name) {
+    InjectProfiling(const string &pipeline_name, bool timeline) : pipeline_name(pipeline_name), timeline(timeline) {
         indices["overhead"] = 0;
         stack.push_back(0);
     }
@@ -47,6 +47,10 @@ private:
 
     bool profiling_memory = true;
 
+    // Whether to record a timeline. Not supported in code offloaded to
+    // other devices.
+    bool timeline;
+
     // Strip down the tuple name, e.g. f.0 into f
     string normalize_name(const string &name) {
         vector<string> v = split_string(name, ".");
@@ -200,16 +204,71 @@ private:
             idx = stack.back();
         }
 
+        body = Block::make(set_current_func(idx), body);
+
+        return ProducerConsumer::make(op->name, op->is_producer, body);
+    }
+
+    // Record that this thread is now computing the Func with the given
+    // index, or pass -1 to record that it's waiting on other threads.
+    Stmt set_current_func(int idx) {
         Expr profiler_token = Variable::make(Int(32), "profiler_token");
         Expr profiler_state = Variable::make(Handle(), "profiler_state");
+        Expr profiler_thread = Variable::make(Handle(), "profiler_thread");
+        if (idx < 0) {
+            profiler_token = -1;
+            idx = 0;
+        }
 
-        // This call gets inlined and becomes a single store instruction.
-        Expr set_task = Call::make(Int(32), "halide_profiler_set_current_func",
-                                   {profiler_state, profiler_token, idx}, Call::Extern);
+        // This call gets inlined and becomes one or two store
+        // instructions, unless we're recording a timeline.
+        string fn = timeline ? "halide_profiler_timeline_set_current_func" : "halide_profiler_set_current_func";
+        Expr set_task = Call::make(Int(32), fn,
+                                   {profiler_state, profiler_token, idx, profiler_thread}, Call::Extern);
+        return Evaluate::make(set_task);
+    }
 
-        body = Block::make(Evaluate::make(set_task), body);
+    // Give a parallel task its own thread slot, so that the profiler
+    // can tell what each thread is doing. The slot is released when the
+    // task completes, or by the pipeline call on an error.
+    Stmt claim_thread_slot(Stmt s) {
+        Expr state = Variable::make(Handle(), "profiler_state");
+        Expr call_thread = Variable::make(Handle(), "profiler_call_thread");
+        Expr thread = Variable::make(Handle(), "profiler_thread");
+        Expr acquire = Call::make(Handle(), "halide_profiler_acquire_thread",
+                                  {state, call_thread}, Call::Extern);
+        Expr release = Call::make(Int(32), "halide_profiler_release_thread",
+                                  {thread}, Call::Extern);
+        s = Block::make(s, Evaluate::make(release));
+        return LetStmt::make("profiler_thread", acquire, s);
+    }
 
-        return ProducerConsumer::make(op->name, op->is_producer, body);
+    // Wrap a statement in which this thread waits on other threads.
+    Stmt wait_for_other_threads(Stmt s) {
+        return Block::make({decr_active_threads(), set_current_func(-1), s,
+                            set_current_func(stack.back()), incr_active_threads()});
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        Stmt stmt = IRMutator::visit(op);
+        const Call *call = op->value.as<Call>();
+        if (!timeline || !call || call->call_type != Call::Extern ||
+            (call->name != "halide_copy_to_device" &&
+             call->name != "halide_copy_to_host" &&
+             call->name != "halide_buffer_copy")) {
+            return stmt;
+        }
+        // Mark the copy on the timeline. These calls are bound to a
+        // result that is checked in the body.
+        const LetStmt *let = stmt.as<LetStmt>();
+        internal_assert(let);
+        Expr thread = Variable::make(Handle(), "profiler_thread");
+        Stmt begin = Evaluate::make(Call::make(Int(32), "halide_profiler_timeline_copy",
+                                               {thread, call->name, 0}, Call::Extern));
+        Stmt end = Evaluate::make(Call::make(Int(32), "halide_profiler_timeline_copy",
+                                             {thread, call->name, 1}, Call::Extern));
+        stmt = LetStmt::make(let->name, let->value, Block::make(end, let->body));
+        return Block::make(begin, stmt);
     }
 
     Stmt incr_active_threads() {
@@ -230,18 +289,16 @@ private:
         } else if (const Acquire *a = s.as<Acquire>()) {
             return Acquire::make(a->semaphore, a->count, visit_parallel_task(a->body));
         } else {
-            return Block::make({incr_active_threads(), mutate(s), decr_active_threads()});
+            return claim_thread_slot(Block::make({incr_active_threads(), mutate(s), decr_active_threads()}));
         }
     }
 
     Stmt visit(const Acquire *op) override {
-        Stmt s = visit_parallel_task(op);
-        return Block::make({decr_active_threads(), s, incr_active_threads()});
+        return wait_for_other_threads(visit_parallel_task(op));
     }
 
     Stmt visit(const Fork *op) override {
-        Stmt s = visit_parallel_task(op);
-        return Block::make({decr_active_threads(), s, incr_active_threads()});
+        return wait_for_other_threads(visit_parallel_task(op));
     }
 
     Stmt visit(const For *op) override {
@@ -265,9 +322,12 @@ private:
             // hexagon. We don't support per-func stats remotely,
             // which means we can't do memory accounting.
             bool old_profiling_memory = profiling_memory;
+            bool old_timeline = timeline;
             profiling_memory = false;
+            timeline = false;
             body = mutate(body);
             profiling_memory = old_profiling_memory;
+            timeline = old_timeline;
 
             // Get the profiler state pointer from scratch inside the
             // kernel. There will be a separate copy of the state on
@@ -275,24 +335,31 @@ private:
             Expr get_state = Call::make(Handle(), "halide_profiler_get_state", {}, Call::Extern);
             body = substitute("profiler_state", Variable::make(Handle(), "hvx_profiler_state"), body);
             body = LetStmt::make("hvx_profiler_state", get_state, body);
+            // Host thread slots don't exist on the DSP.
+            body = substitute("profiler_thread", make_zero(Handle()), body);
         } else if (op->device_api == DeviceAPI::None ||
                    op->device_api == DeviceAPI::Host) {
             body = mutate(body);
+            if (op->is_parallel()) {
+                body = claim_thread_slot(body);
+            }
         } else {
             body = op->body;
         }
 
         Stmt stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
 
-        if (update_active_threads) {
+        if (op->device_api == DeviceAPI::Hexagon) {
             stmt = Block::make({decr_active_threads(), stmt, incr_active_threads()});
+        } else if (update_active_threads) {
+            stmt = wait_for_other_threads(stmt);
         }
         return stmt;
     }
 };
 
-Stmt inject_profiling(Stmt s, string pipeline_name) {
-    InjectProfiling profiling(pipeline_name);
+Stmt inject_profiling(Stmt s, string pipeline_name, bool hardware_counters, bool timeline) {
+    InjectProfiling profiling(pipeline_name, timeline);
     s = profiling.mutate(s);
 
     int num_funcs = (int)(profiling.indices.size());
@@ -330,8 +397,31 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
                                   {profiler_state}, Call::Extern));
     s = Block::make({incr_active_threads, s, decr_active_threads});
 
+    // Claim a thread slot for the pipeline call itself. Parallel tasks
+    // claim theirs on behalf of this one, which releases any that an
+    // error left behind.
+    Expr profiler_call_thread = Variable::make(Handle(), "profiler_call_thread");
+    Expr acquire_thread = Call::make(Handle(), "halide_profiler_acquire_thread",
+                                     {profiler_state, make_zero(Handle())}, Call::Extern);
+    Expr release_thread = Call::make(Int(32), Call::register_destructor,
+                                     {Expr("halide_profiler_release_call_thread"), profiler_call_thread},
+                                     Call::Intrinsic);
+    s = LetStmt::make("profiler_thread", profiler_call_thread, s);
+    s = Block::make(Evaluate::make(release_thread), s);
+    s = LetStmt::make("profiler_call_thread", acquire_thread, s);
+
     s = LetStmt::make("profiler_pipeline_state", get_pipeline_state, s);
     s = LetStmt::make("profiler_state", get_state, s);
+    if (hardware_counters) {
+        // Start the counters before the thread pool is first used, so
+        // that its threads are counted too.
+        Expr start_counters = Call::make(Int(32), "halide_profiler_start_counters", {}, Call::Extern);
+        s = Block::make(Evaluate::make(start_counters), s);
+    }
+    if (timeline) {
+        Expr start_timeline = Call::make(Int(32), "halide_profiler_start_timeline", {}, Call::Extern);
+        s = Block::make(Evaluate::make(start_timeline), s);
+    }
     // If there was a problem starting the profiler, it will call an
     // appropriate halide error function and then return the
     // (negative) error code as the token.
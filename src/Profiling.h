@@ -33,10 +33,14 @@ namespace Internal {
  * high-resolution timing into the generated code (via spawning a
  * thread that acts as a sampling profiler); summaries of execution
  * times and counts will be logged at the end. Should be done before
- * storage flattening, but after all bounds inference.
+ * storage flattening, but after all bounds inference. If
+ * hardware_counters is true, the profiler also attributes hardware
+ * performance counters to each Func. If timeline is true, it also
+ * records when each thread starts and finishes each Func, parallel
+ * task, wait and device copy.
  *
  */
-Stmt inject_profiling(Stmt, std::string);
+Stmt inject_profiling(Stmt, std::string, bool hardware_counters = false, bool timeline = false);
 
 }  // namespace Internal
 }  // namespace Halide
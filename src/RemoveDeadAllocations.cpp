@@ -51,17 +51,24 @@ class RemoveDeadAllocations : public IRMutator {
     }
 
     Stmt visit(const Allocate *op) override {
+        // The new expression may refer to another allocation, as
+        // allocations packed into a slab do.
+        Expr new_expr;
+        if (op->new_expr.defined()) {
+            new_expr = mutate(op->new_expr);
+        }
+
         allocs.push(op->name, 1);
         Stmt body = mutate(op->body);
 
         if (allocs.contains(op->name) && op->free_function.empty()) {
             allocs.pop(op->name);
             return body;
-        } else if (body.same_as(op->body)) {
+        } else if (body.same_as(op->body) && new_expr.same_as(op->new_expr)) {
             return op;
         } else {
             return Allocate::make(op->name, op->type, op->memory_type, op->extents,
-                                  op->condition, body, op->new_expr, op->free_function);
+                                  op->condition, body, new_expr, op->free_function);
         }
     }
 
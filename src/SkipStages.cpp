@@ -288,9 +288,9 @@ private:
             // the cache, so we perform the lookup instead of allocating a new one.
             return Call::make(op->type, Call::if_then_else,
                               {alloc_predicate, op, 0}, Call::PureIntrinsic);
-        } else if ((op->name == "halide_memoization_cache_store") &&
+        } else if ((op->name == "halide_memoization_cache_store_with_cost") &&
                     memoize_call_uses_buffer(op)) {
-            // We need to wrap the halide_memoization_cache_store with the
+            // We need to wrap the halide_memoization_cache_store_with_cost with the
             // compute_predicate, since the data to be written is only valid if
             // the producer of the buffer is executed.
             return Call::make(op->type, Call::if_then_else,
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <map>
+
+#include "CodeGen_Internal.h"
+#include "ExprUsesVar.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "SlabAllocations.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Enough for the widest vectors on any target.
+const int64_t slab_alignment = 128;
+
+bool is_device_loop(const For *op) {
+    return op->device_api != DeviceAPI::None && op->device_api != DeviceAPI::Host;
+}
+
+// The number of bytes an allocation will take in a slab, or zero if
+// it should be left alone.
+int64_t slab_bytes_for(const Allocate *op) {
+    if (op->new_expr.defined() ||
+        !op->free_function.empty() ||
+        op->extents.empty() ||
+        (op->memory_type != MemoryType::Heap &&
+         op->memory_type != MemoryType::Auto)) {
+        return 0;
+    }
+    int64_t elems = Allocate::constant_allocation_size(op->extents, op->name);
+    if (elems <= 0) {
+        return 0;
+    }
+    int64_t bytes = elems * op->type.bytes();
+    if (op->memory_type == MemoryType::Auto && can_allocation_fit_on_stack(bytes)) {
+        // It will go on the stack anyway.
+        return 0;
+    }
+    // Leave room for reading one scalar past the end, as codegen
+    // would when calling halide_malloc.
+    bytes += op->type.bytes();
+    return (bytes + slab_alignment - 1) / slab_alignment * slab_alignment;
+}
+
+struct SlabEntry {
+    const Allocate *op;
+    int64_t bytes, offset;
+    int start, end;
+};
+
+// Number each Allocate and Free in a scope in execution order, to get
+// the lifetime of each allocation that could go in the slab. Parallel
+// loops are planned on their own, and device loops are left alone.
+class FindLifetimes : public IRVisitor {
+public:
+    vector<SlabEntry> entries;
+
+private:
+    using IRVisitor::visit;
+
+    int time = 0;
+    map<string, size_t> live;
+
+    void visit(const For *op) override {
+        if (op->for_type == ForType::Parallel || is_device_loop(op)) {
+            time++;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const Fork *op) override {
+        int start = time++;
+        size_t first = entries.size();
+        IRVisitor::visit(op);
+        int end = time++;
+        // Both sides of a fork run at once, so anything allocated
+        // inside it is treated as live for all of it.
+        for (size_t i = first; i < entries.size(); i++) {
+            entries[i].start = start;
+            entries[i].end = end;
+        }
+    }
+
+    void visit(const Allocate *op) override {
+        int64_t bytes = slab_bytes_for(op);
+        if (bytes == 0) {
+            IRVisitor::visit(op);
+            return;
+        }
+        size_t idx = entries.size();
+        entries.push_back({op, bytes, 0, time++, -1});
+        live[op->name] = idx;
+        IRVisitor::visit(op);
+        if (entries[idx].end < 0) {
+            entries[idx].end = time++;
+        }
+    }
+
+    void visit(const Free *op) override {
+        auto it = live.find(op->name);
+        if (it != live.end()) {
+            if (entries[it->second].end < 0) {
+                entries[it->second].end = time++;
+            }
+            live.erase(it);
+        }
+    }
+};
+
+// Assign each entry the lowest offset that doesn't collide with an
+// entry of overlapping lifetime that has already been placed, placing
+// the largest first. Returns the size of the slab.
+int64_t assign_offsets(vector<SlabEntry> &entries) {
+    vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return entries[a].bytes > entries[b].bytes;
+    });
+
+    int64_t slab_bytes = 0;
+    vector<size_t> placed;
+    for (size_t i : order) {
+        SlabEntry &e = entries[i];
+        vector<const SlabEntry *> conflicts;
+        for (size_t j : placed) {
+            const SlabEntry &p = entries[j];
+            if (p.start <= e.end && e.start <= p.end) {
+                conflicts.push_back(&p);
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end(), [](const SlabEntry *a, const SlabEntry *b) {
+            return a->offset < b->offset;
+        });
+        int64_t offset = 0;
+        for (const SlabEntry *p : conflicts) {
+            if (offset + e.bytes <= p->offset) {
+                break;
+            }
+            offset = std::max(offset, p->offset + p->bytes);
+        }
+        e.offset = offset;
+        slab_bytes = std::max(slab_bytes, offset + e.bytes);
+        placed.push_back(i);
+    }
+    return slab_bytes;
+}
+
+// Count the allocations that have been packed into a slab.
+class CountSlabEntries : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &slab_name;
+
+    void visit(const Allocate *op) override {
+        if (is_entry(op, slab_name)) {
+            count++;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    int count = 0;
+
+    CountSlabEntries(const string &slab_name) : slab_name(slab_name) {}
+
+    static bool is_entry(const Allocate *op, const string &slab_name) {
+        return op->free_function == "slab_nop_free" &&
+            expr_uses_var(op->new_expr, slab_name);
+    }
+};
+
+int count_slab_entries(const Stmt &s, const string &slab_name) {
+    CountSlabEntries counter(slab_name);
+    s.accept(&counter);
+    return counter.count;
+}
+
+// Allocate the slab around the innermost statement that contains all
+// of the allocations packed into it. This puts it below the early
+// return for bounds queries and after the checks on the inputs, so
+// that neither allocates the slab. Never descends into a loop, which
+// would allocate the slab once per iteration.
+Stmt wrap_in_slab(const Stmt &s, const string &slab_name, int64_t bytes) {
+    if (const Block *op = s.as<Block>()) {
+        if (count_slab_entries(op->first, slab_name) == 0) {
+            return Block::make(op->first, wrap_in_slab(op->rest, slab_name, bytes));
+        } else if (count_slab_entries(op->rest, slab_name) == 0) {
+            return Block::make(wrap_in_slab(op->first, slab_name, bytes), op->rest);
+        }
+    } else if (const IfThenElse *op = s.as<IfThenElse>()) {
+        if (!op->else_case.defined() || count_slab_entries(op->else_case, slab_name) == 0) {
+            return IfThenElse::make(op->condition, wrap_in_slab(op->then_case, slab_name, bytes), op->else_case);
+        } else if (count_slab_entries(op->then_case, slab_name) == 0) {
+            return IfThenElse::make(op->condition, op->then_case, wrap_in_slab(op->else_case, slab_name, bytes));
+        }
+    } else if (const LetStmt *op = s.as<LetStmt>()) {
+        return LetStmt::make(op->name, op->value, wrap_in_slab(op->body, slab_name, bytes));
+    } else if (const ProducerConsumer *op = s.as<ProducerConsumer>()) {
+        return ProducerConsumer::make(op->name, op->is_producer, wrap_in_slab(op->body, slab_name, bytes));
+    } else if (const Allocate *op = s.as<Allocate>()) {
+        if (!CountSlabEntries::is_entry(op, slab_name)) {
+            return Allocate::make(op->name, op->type, op->memory_type, op->extents,
+                                  op->condition, wrap_in_slab(op->body, slab_name, bytes),
+                                  op->new_expr, op->free_function);
+        }
+    }
+    Stmt body = Block::make(s, Free::make(slab_name));
+    return Allocate::make(slab_name, UInt(8), MemoryType::Heap, {(int32_t)bytes},
+                          const_true(), body);
+}
+
+class PlanSlabs : public IRMutator {
+    using IRMutator::visit;
+
+    map<const Allocate *, int64_t> offsets;
+    string slab_name;
+
+    Stmt visit(const Allocate *op) override {
+        auto it = offsets.find(op);
+        if (it == offsets.end()) {
+            return IRMutator::visit(op);
+        }
+        Expr slab = reinterpret(UInt(64), Variable::make(Handle(), slab_name));
+        Expr new_expr = reinterpret(Handle(), slab + make_const(UInt(64), it->second));
+        return Allocate::make(op->name, op->type, op->memory_type, op->extents,
+                              op->condition, mutate(op->body), new_expr, "slab_nop_free");
+    }
+
+    Stmt visit(const For *op) override {
+        if (is_device_loop(op)) {
+            return op;
+        } else if (op->for_type == ForType::Parallel) {
+            // Parallel loops nested in this one get slabs of their
+            // own, which may be larger.
+            int64_t bytes = 0;
+            PlanSlabs task_planner(task_slab_bytes);
+            Stmt body = task_planner.plan(op->body, bytes);
+            task_slab_bytes = std::max(task_planner.task_slab_bytes, bytes);
+            return For::make(op->name, op->min, op->extent, op->for_type,
+                             op->device_api, body);
+        } else {
+            return IRMutator::visit(op);
+        }
+    }
+
+public:
+    int64_t task_slab_bytes;
+
+    PlanSlabs(int64_t task_slab_bytes) : task_slab_bytes(task_slab_bytes) {}
+
+    // Plan the slab for the scope s, setting bytes to its size.
+    Stmt plan(const Stmt &s, int64_t &bytes) {
+        FindLifetimes lifetimes;
+        s.accept(&lifetimes);
+        bytes = 0;
+        // A slab for a single allocation wouldn't save anything.
+        if (lifetimes.entries.size() >= 2) {
+            bytes = assign_offsets(lifetimes.entries);
+            if (bytes > 0x7fffffff) {
+                bytes = 0;
+            }
+        }
+        if (bytes == 0) {
+            return mutate(s);
+        }
+
+        slab_name = unique_name("slab");
+        for (const SlabEntry &e : lifetimes.entries) {
+            offsets[e.op] = e.offset;
+            debug(3) << "Placing " << e.op->name << " at offset " << e.offset
+                     << " in " << slab_name << "\n";
+        }
+        debug(3) << slab_name << " is " << bytes << " bytes for "
+                 << lifetimes.entries.size() << " allocations\n";
+
+        return wrap_in_slab(mutate(s), slab_name, bytes);
+    }
+};
+
+}  // namespace
+
+Stmt plan_slab_allocations(const Stmt &s, int64_t &slab_bytes, int64_t &task_slab_bytes) {
+    PlanSlabs planner(0);
+    Stmt result = planner.plan(s, slab_bytes);
+    task_slab_bytes = planner.task_slab_bytes;
+    return result;
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,28 @@
+#ifndef HALIDE_SLAB_ALLOCATIONS_H
+#define HALIDE_SLAB_ALLOCATIONS_H
+
+/** \file
+ * Defines the lowering pass that packs heap allocations with
+ * non-overlapping lifetimes into a single slab.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find the heap allocations of constant size, work out when each is
+ * live from where it is allocated and freed, and assign each an
+ * offset in a single slab, so that allocations that are never live
+ * at the same time share memory. The allocations outside of any
+ * parallel loop share a slab allocated once per call. The body of
+ * each parallel loop gets its own slab, allocated once per task.
+ * Must run after inject_early_frees. Sets slab_bytes to the size of
+ * the per-call slab, and task_slab_bytes to the size of the largest
+ * per-task slab (zero if there is none). */
+Stmt plan_slab_allocations(const Stmt &s, int64_t &slab_bytes, int64_t &task_slab_bytes);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -25,27 +25,21 @@ namespace Halide {
 using std::string;
 using std::vector;
 
-namespace {
+namespace Internal {
 
+bool host_cpuid(int info[4], int infoType, int extra) {
 #ifdef _MSC_VER
-static void cpuid(int info[4], int infoType, int extra) {
     __cpuidex(info, infoType, extra);
-}
-#else
-
-#if defined(__x86_64__) || defined(__i386__)
-// CPU feature detection code taken from ispc
-// (https://github.com/ispc/ispc/blob/master/builtins/dispatch.ll)
-
+    return true;
+#elif defined(__x86_64__) || defined(__i386__)
+    // CPU feature detection code taken from ispc
+    // (https://github.com/ispc/ispc/blob/master/builtins/dispatch.ll)
 #ifdef _LP64
-static void cpuid(int info[4], int infoType, int extra) {
     __asm__ __volatile__ (
         "cpuid                 \n\t"
         : "=a" (info[0]), "=b" (info[1]), "=c" (info[2]), "=d" (info[3])
         : "0" (infoType), "2" (extra));
-}
 #else
-static void cpuid(int info[4], int infoType, int extra) {
     // We save %ebx in case it's the PIC register
     __asm__ __volatile__ (
         "mov{l}\t{%%}ebx, %1  \n\t"
@@ -53,10 +47,17 @@ static void cpuid(int info[4], int infoType, int extra) {
         "xchg{l}\t{%%}ebx, %1  \n\t"
         : "=a" (info[0]), "=r" (info[1]), "=c" (info[2]), "=d" (info[3])
         : "0" (infoType), "2" (extra));
-}
-#endif
 #endif
+    return true;
+#else
+    info[0] = info[1] = info[2] = info[3] = 0;
+    return false;
 #endif
+}
+
+}  // namespace Internal
+
+namespace {
 
 Target calculate_host_target() {
     Target::OS os = Target::OSUnknown;
@@ -102,7 +103,7 @@ Target calculate_host_target() {
     Target::Arch arch = Target::X86;
 
     int info[4];
-    cpuid(info, 1, 0);
+    Internal::host_cpuid(info, 1, 0);
     bool have_sse41  = (info[2] & (1 << 19)) != 0;
     bool have_sse2   = (info[3] & (1 << 26)) != 0;
     bool have_avx    = (info[2] & (1 << 28)) != 0;
@@ -128,7 +129,7 @@ Target calculate_host_target() {
         // So far, so good.  AVX2/512?
         // Call cpuid with eax=7, ecx=0
         int info2[4];
-        cpuid(info2, 7, 0);
+        Internal::host_cpuid(info2, 7, 0);
         const uint32_t avx2 = 1U << 5;
         const uint32_t avx512f = 1U << 16;
         const uint32_t avx512dq = 1U << 17;
@@ -313,6 +314,10 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"embed_bitcode", Target::EmbedBitcode},
     {"disable_llvm_loop_vectorize", Target::DisableLLVMLoopVectorize},
     {"disable_llvm_loop_unroll", Target::DisableLLVMLoopUnroll},
+    {"arena_alloc", Target::ArenaAlloc},
+    {"profile_counters", Target::ProfileCounters},
+    {"profile_timeline", Target::ProfileTimeline},
+    {"slab_alloc", Target::SlabAlloc},
     // NOTE: When adding features to this map, be sure to update
     // PyEnums.cpp and halide.cmake as well.
 };
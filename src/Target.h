@@ -104,6 +104,10 @@ struct Target {
         EmbedBitcode = halide_target_feature_embed_bitcode,
         DisableLLVMLoopVectorize = halide_target_feature_disable_llvm_loop_vectorize,
         DisableLLVMLoopUnroll = halide_target_feature_disable_llvm_loop_unroll,
+        ArenaAlloc = halide_target_feature_arena_alloc,
+        ProfileCounters = halide_target_feature_profile_counters,
+        ProfileTimeline = halide_target_feature_profile_timeline,
+        SlabAlloc = halide_target_feature_slab_alloc,
         FeatureEnd = halide_target_feature_end
     };
     Target() : os(OSUnknown), arch(ArchUnknown), bits(0) {}
@@ -259,6 +263,11 @@ Target::Feature target_feature_for_device_api(DeviceAPI api);
 
 namespace Internal {
 
+/** Run the cpuid instruction on the host with the given leaf
+ * (infoType) and subleaf (extra), storing eax, ebx, ecx and edx in
+ * info. Returns false, with info zeroed, if the host is not x86. */
+bool host_cpuid(int info[4], int infoType, int extra);
+
 void target_test();
 }
 
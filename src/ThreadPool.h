@@ -1,12 +1,16 @@
 #ifndef HALIDE_THREAD_POOL_H
 #define HALIDE_THREAD_POOL_H
 
+#include <algorithm>
 #include <condition_variable>
+#include <exception>
+#include <functional>
 #include <future>
 #include <mutex>
 #include <queue>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #ifdef _MSC_VER
 #else
@@ -152,6 +156,42 @@ inline void ThreadPool<void>::Job::run_unlocked(std::unique_lock<std::mutex> &un
     result.set_value();
 }
 
+/** Run a list of independent jobs on up to max_threads threads, and
+ * wait for all of them to finish. Jobs may throw (e.g. a user_error
+ * with exceptions enabled); once every job has finished, the
+ * exception from the first job that threw is rethrown here. */
+inline void run_jobs_concurrently(const std::vector<std::function<void()>> &jobs, size_t max_threads) {
+    if (max_threads <= 1 || jobs.size() <= 1) {
+        for (const auto &job : jobs) {
+            job();
+        }
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(jobs.size());
+    {
+        ThreadPool<void> pool(std::min(max_threads, jobs.size()));
+        std::vector<std::future<void>> results;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            results.push_back(pool.async([&jobs, &errors, i]() {
+                try {
+                    jobs[i]();
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }));
+        }
+        for (auto &r : results) {
+            r.wait();
+        }
+    }
+    for (const auto &e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
 
 }  // namespace Internal
 }  // namespace Halide
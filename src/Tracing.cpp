@@ -3,7 +3,9 @@
 #include "IROperator.h"
 #include "runtime/HalideRuntime.h"
 #include "Bounds.h"
+#include "Deinterleave.h"
 #include "RealizationOrder.h"
+#include "Simplify.h"
 
 namespace Halide {
 namespace Internal {
@@ -453,5 +455,144 @@ Stmt inject_tracing(Stmt s, const string &pipeline_name,
     return s;
 }
 
+namespace {
+
+class InjectTraceFilters : public IRMutator {
+    const map<string, Function> &env;
+
+    using IRMutator::visit;
+
+    // Find the Function with the filters for loads and stores traced
+    // under the given name. Loads from an ImageParam are traced under
+    // the name of the image, and its Function has an "_im" suffix.
+    bool find_function(const string &name, Function &f) {
+        auto it = env.find(name);
+        if (it == env.end()) {
+            it = env.find(name + "_im");
+        }
+        if (it == env.end() || !it->second.has_trace_filters()) {
+            return false;
+        }
+        f = it->second;
+        return true;
+    }
+
+    // The smallest and largest of the lanes of a coordinate.
+    Interval bounds_of_lanes(Expr e) {
+        if (e.type().is_scalar()) {
+            return Interval(e, e);
+        } else if (const Broadcast *b = e.as<Broadcast>()) {
+            return Interval(b->value, b->value);
+        } else if (const Ramp *r = e.as<Ramp>()) {
+            Expr last = r->base + r->stride * (r->lanes - 1);
+            return Interval(simplify(min(r->base, last)), simplify(max(r->base, last)));
+        }
+        Expr lo = extract_lane(e, 0), hi = lo;
+        for (int i = 1; i < e.type().lanes(); i++) {
+            Expr lane = extract_lane(e, i);
+            lo = min(lo, lane);
+            hi = max(hi, lane);
+        }
+        return Interval(simplify(lo), simplify(hi));
+    }
+
+    Expr visit(const Call *op) override {
+        Expr expr = IRMutator::visit(op);
+        op = expr.as<Call>();
+        if (!op || op->name != Call::trace || op->call_type != Call::Extern) {
+            return expr;
+        }
+        const int64_t *event = as_const_int(op->args[6]);
+        internal_assert(event);
+        if (*event != halide_trace_load && *event != halide_trace_store) {
+            return expr;
+        }
+        const StringImm *func = op->args[0].as<StringImm>();
+        internal_assert(func);
+        Function f;
+        if (!find_function(func->value, f)) {
+            return expr;
+        }
+
+        if (f.get_trace_every().defined() || f.get_trace_first().defined()) {
+            // Count loads and stores separately.
+            string counter = func->value + (*event == halide_trace_load ?
+                                            ".trace_load_counter" :
+                                            ".trace_store_counter");
+            if (!counters_seen.count(counter)) {
+                counters_seen.insert(counter);
+                counters.push_back(counter);
+            }
+            Expr every = f.get_trace_every();
+            if (!every.defined()) {
+                every = 1;
+            }
+            Expr first = f.get_trace_first();
+            if (!first.defined()) {
+                first = Int(32).max();
+            }
+            Expr sample = Call::make(Int(32), "halide_trace_sample",
+                                     {Variable::make(Handle(), counter), every, first},
+                                     Call::Extern);
+            expr = Call::make(op->type, Call::if_then_else,
+                              {sample != 0, expr, make_zero(op->type)},
+                              Call::PureIntrinsic);
+        }
+
+        // Check the box first, so that events outside of it don't
+        // touch the counter.
+        const Call *coords = op->args[2].as<Call>();
+        internal_assert(coords && coords->is_intrinsic(Call::make_struct));
+        const Region &box = f.get_trace_region();
+        Expr in_box = const_true();
+        for (size_t i = 0; i < box.size() && i < coords->args.size(); i++) {
+            if (!box[i].min.defined()) {
+                continue;
+            }
+            Interval lanes = bounds_of_lanes(coords->args[i]);
+            in_box = in_box && (lanes.max >= box[i].min &&
+                                lanes.min < box[i].min + box[i].extent);
+        }
+        if (!is_one(in_box)) {
+            expr = Call::make(op->type, Call::if_then_else,
+                              {in_box, expr, make_zero(op->type)},
+                              Call::PureIntrinsic);
+        }
+
+        return expr;
+    }
+
+public:
+    // The counters used for trace_every and trace_first, in the order
+    // they were first needed.
+    vector<string> counters;
+    set<string> counters_seen;
+
+    InjectTraceFilters(const map<string, Function> &e) : env(e) {}
+};
+
+}  // namespace
+
+Stmt inject_trace_filters(Stmt s, const map<string, Function> &env) {
+    bool any_filters = false;
+    for (const auto &p : env) {
+        any_filters = any_filters || p.second.has_trace_filters();
+    }
+    if (!any_filters) {
+        return s;
+    }
+
+    InjectTraceFilters filters(env);
+    s = filters.mutate(s);
+
+    // Each counter is a single int on the stack, zeroed at the start
+    // of the pipeline.
+    for (const string &counter : filters.counters) {
+        s = Block::make(Store::make(counter, 0, 0, Parameter(), const_true(), ModulusRemainder()), s);
+        s = Allocate::make(counter, Int(32), MemoryType::Stack, {1}, const_true(), s);
+    }
+    return s;
+}
+
 }  // namespace Internal
 }  // namespace Halide
@@ -22,6 +22,12 @@ Stmt inject_tracing(Stmt, const std::string &pipeline_name,
                     const std::vector<Function> &outputs,
                     const Target &Target);
 
+/** Make the tracing of loads and stores of Funcs with a trace_region,
+ * trace_every or trace_first conditional on those filters. Done after
+ * vectorization, so that a vector of loads or stores is filtered as
+ * one event. */
+Stmt inject_trace_filters(Stmt s, const std::map<std::string, Function> &env);
+
 }  // namespace Internal
 }  // namespace Halide
 
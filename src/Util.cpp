@@ -9,6 +9,7 @@
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #ifdef _MSC_VER
 #include <io.h>
@@ -71,6 +72,16 @@ std::string get_env_variable(char const *env_var_name) {
     return "";
 }
 
+int get_compile_thread_count() {
+    std::string threads = get_env_variable("HL_COMPILE_THREADS");
+    if (!threads.empty()) {
+        int n = atoi(threads.c_str());
+        user_assert(n > 0) << "HL_COMPILE_THREADS must be a positive integer, not \"" << threads << "\"\n";
+        return n;
+    }
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
 string running_program_name() {
     #ifndef CAN_GET_RUNNING_PROGRAM_NAME
         return "";
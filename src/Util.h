@@ -110,6 +110,12 @@ std::string make_entity_name(void *stack_ptr, const std::string &type, char pref
  */
 std::string get_env_variable(char const *env_var_name);
 
+/** Get the number of threads the compiler may use to generate code
+ * for independent modules or parts of a module at the same time. This
+ * is the value of the HL_COMPILE_THREADS environment variable if it
+ * is set, and the number of cores otherwise. */
+int get_compile_thread_count();
+
 /** Get the name of the currently running executable. Platform-specific.
  * If program name cannot be retrieved, function returns an empty string. */
 std::string running_program_name();
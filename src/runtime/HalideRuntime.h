@@ -305,6 +305,90 @@ extern void halide_join_thread(struct halide_thread *);
  */
 extern int halide_set_num_threads(int n);
 
+/** Turn NUMA-aware scheduling in Halide's thread pool on or off.
+ * Returns the old setting. When on, worker threads are pinned to cores
+ * one NUMA node at a time, workers in a parallel loop prefer to take
+ * iterations from other workers on the same node (so the loop's range
+ * is split by node), and large halide_malloc allocations are placed
+ * on the node of the allocating thread. The default comes from the
+ * environment variable HL_NUMA_AWARE, and is off if it is unset.
+ *
+ * Only worker threads created after the call are pinned, so call this
+ * before the first parallel pipeline runs, or after
+ * halide_shutdown_thread_pool(). Node-local allocation is only used if
+ * halide_malloc has not been replaced via halide_set_custom_malloc. Has
+ * no effect on platforms without NUMA support, which is currently all
+ * but Linux.
+ */
+extern int halide_set_numa_aware_thread_pool(int enable);
+
+/** Control how halide_malloc treats allocations of 2MB or more. If
+ * huge_pages is true, they are aligned to 2MB and advised to use
+ * transparent huge pages, which cuts the TLB misses taken by access
+ * patterns that stride across many pages, such as transposes. If
+ * prefault is true, all of their pages are faulted in when they are
+ * allocated, spread over the thread pool, rather than one at a time by
+ * the first stage to write them. The defaults come from the environment
+ * variables HL_HUGE_PAGES and HL_PREFAULT, and are off if they are
+ * unset. Returns false if the request can't be honored, either because
+ * halide_malloc has been replaced via halide_set_custom_malloc or
+ * because the platform isn't Linux.
+ */
+extern bool halide_set_huge_page_malloc(bool huge_pages, bool prefault);
+
+/** Priority classes for calls into Halide's thread pool. Work from
+ * calls in a higher class is picked up before work from calls in a
+ * lower class. Calls that have not been tagged with
+ * halide_set_thread_pool_qos run at normal priority. */
+typedef enum halide_thread_pool_priority_t {
+    halide_thread_pool_priority_low = 0,
+    halide_thread_pool_priority_normal = 1,
+    halide_thread_pool_priority_high = 2,
+    halide_thread_pool_priority_critical = 3,
+    halide_thread_pool_priority_count = 4
+} halide_thread_pool_priority_t;
+
+/** Per-priority-class counters kept by Halide's thread pool. Only
+ * calls tagged with halide_set_thread_pool_qos are counted. All
+ * times are in nanoseconds. */
+struct halide_thread_pool_qos_stats_t {
+    /** The number of parallel loops and sets of parallel tasks run. */
+    uint64_t jobs;
+
+    /** The total and largest time from a job entering the queue until
+     * a thread first started working on it. */
+    uint64_t queue_wait_time, max_queue_wait_time;
+
+    /** The total time threads spent working on jobs in this class,
+     * summed over threads. */
+    uint64_t execution_time;
+};
+
+/** Tag all calls into the thread pool made with the given user
+ * context with a priority class, and limit the number of threads that
+ * may work on their parallel loops at once to max_threads (zero means
+ * no limit). Nested parallelism inherits the tag. Jobs that have been
+ * waiting for a thread without one becoming available rise one
+ * priority class every few milliseconds, so lower classes are not
+ * starved indefinitely. Parallel tasks that may block (e.g. async
+ * producers) are exempt from the thread limit, to avoid deadlock.
+ * Returns halide_error_code_success, or
+ * halide_error_code_generic_error if too many user contexts are
+ * tagged at once. Has no effect with a custom do_par_for. */
+extern int halide_set_thread_pool_qos(void *user_context, int priority, int max_threads);
+
+/** Remove the tag set by halide_set_thread_pool_qos for the given user
+ * context. Work already in flight keeps its tag until it completes. */
+extern void halide_clear_thread_pool_qos(void *user_context);
+
+/** Get the counters for a priority class. Returns
+ * halide_error_code_success, or halide_error_code_generic_error if the
+ * priority class is out of range. */
+extern int halide_thread_pool_qos_stats(int priority, struct halide_thread_pool_qos_stats_t *stats);
+
+/** Zero the counters for all priority classes. */
+extern void halide_reset_thread_pool_qos_stats();
+
 /** Halide calls these functions to allocate and free memory. To
  * replace in AOT code, use the halide_set_custom_malloc and
  * halide_set_custom_free, or (on platforms that support weak
@@ -333,6 +417,22 @@ extern halide_malloc_t halide_set_custom_malloc(halide_malloc_t user_malloc);
 extern halide_free_t halide_set_custom_free(halide_free_t user_free);
 //@}
 
+/** Pipelines compiled with the arena_alloc target feature create an
+ * arena on entry with halide_arena_create, serve their heap
+ * allocations from it with halide_arena_malloc and halide_arena_free,
+ * and destroy it on exit. Freed blocks are recycled by later
+ * allocations in the same call, and the memory the arena holds is
+ * obtained from, and returned to, halide_malloc and halide_free. An
+ * arena may be used by several threads at once. These are not
+ * normally called directly.
+ */
+//@{
+extern void *halide_arena_create(void *user_context);
+extern void halide_arena_destroy(void *user_context, void *arena);
+extern void *halide_arena_malloc(void *user_context, void *arena, uint64_t size);
+extern void halide_arena_free(void *user_context, void *ptr);
+//@}
+
 /** Halide calls these functions to interact with the underlying
  * system runtime functions. To replace in AOT code on platforms that
  * support weak linking, define these functions yourself, or use
@@ -635,7 +735,52 @@ struct halide_trace_packet_t {
     #endif
 };
 
+/** Binary trace files are a sequence of blocks. Threads write packets
+ * into a few separate buffers, so the packets in one block are in
+ * order, but the blocks are not in order relative to each other; put
+ * packets back in order using their ids. Older traces may also contain
+ * bare packets outside of any block. These can be told apart by their
+ * first word, which is halide_trace_block_magic for a block and the
+ * packet size (always a multiple of four) for a packet. */
+// @{
+enum { halide_trace_block_magic = 0x4b4c4231 };
+
+typedef enum halide_trace_block_flags_t {
+    /** The packets are delta coded instead of laid out as in memory. */
+    halide_trace_block_delta_coded = 1,
+    /** The first block written by a process. Packet ids restart from one. */
+    halide_trace_block_stream_start = 2
+} halide_trace_block_flags_t;
+
+/** The header of a block in a binary trace. All fields are 32-bit. */
+struct halide_trace_block_t {
+    /** Always halide_trace_block_magic. */
+    uint32_t magic;
+
+    /** A combination of halide_trace_block_flags_t. */
+    uint32_t flags;
 
+    /** The number of bytes of packets following the header. The next
+     * block starts after this many bytes, rounded up to a multiple of
+     * four. */
+    uint32_t size;
+};
+
+/** In a delta-coded block, each packet is stored as:
+ * - the difference between its id and that of the previous packet in the block
+ * - the type code and bits, one byte each, then the lanes
+ * - the event
+ * - the difference between the id and the parent_id
+ * - the value_index
+ * - the number of dimensions
+ * - each coordinate, minus the corresponding coordinate of the previous
+ *   packet if it had the same number of dimensions
+ * - the value bytes, as in memory
+ * - the length of the func name plus one followed by the name, or zero
+ *   if it is the same as that of the previous packet
+ * - the length of the trace_tag followed by the tag
+ * Integers are LEB128 varints, with differences zig-zag encoded. */
+// @}
 
 /** Set the file descriptor that Halide should write binary trace
  * events to. If called with 0 as the argument, Halide outputs trace
@@ -643,7 +788,9 @@ struct halide_trace_packet_t {
  * Halide checks the for existence of an environment variable called
  * HL_TRACE_FILE and opens that file. If HL_TRACE_FILE is not defined,
  * it outputs trace information to stdout in a human-readable
- * format. */
+ * format. Binary traces are written by a background thread. Set the
+ * environment variable HL_TRACE_COMPRESS=1 to delta code them, which
+ * typically makes them less than half the size. */
 extern void halide_set_trace_file(int fd);
 
 /** Halide calls this to retrieve the file descriptor to write binary
@@ -883,6 +1030,20 @@ extern int halide_memoization_cache_store(void *user_context, const uint8_t *cac
                                           int32_t tuple_count,
                                           struct halide_buffer_t **tuple_buffers);
 
+/** Like halide_memoization_cache_store, but also given the time in
+ * nanoseconds the generated code spent computing the result, which
+ * cost-aware eviction policies use to decide what to keep. Generated
+ * code calls this. The default implementation calls
+ * halide_memoization_cache_store, so caches that only override that
+ * keep working, and passes the compute time along to the default
+ * cache.
+ */
+extern int halide_memoization_cache_store_with_cost(void *user_context, const uint8_t *cache_key, int32_t size,
+                                                    struct halide_buffer_t *realized_bounds,
+                                                    int32_t tuple_count,
+                                                    struct halide_buffer_t **tuple_buffers,
+                                                    int64_t compute_time);
+
 /** If halide_memoization_cache_lookup succeeds,
  * halide_memoization_cache_release must be called to signal the
  * storage is no longer being used by the caller. It will be passed
@@ -905,6 +1066,87 @@ extern void halide_memoization_cache_release(void *user_context, void *host);
  */
 extern void halide_memoization_cache_cleanup();
 
+/** Set the number of independently locked shards the memoization
+ * cache is split into, and the number of hash buckets each shard
+ * starts with. Each shard doubles its buckets as it fills. More
+ * shards reduce contention between threads looking up different
+ * keys. Passing zero or less for either selects the default (16
+ * shards of 16 buckets). The shard count is capped at 64 and the
+ * bucket count is rounded up to a power of two. This flushes the
+ * cache, so like halide_memoization_cache_cleanup it must be called
+ * when no other threads are accessing the cache. */
+extern int halide_memoization_cache_set_geometry(int num_shards, int initial_buckets);
+
+/** The ways the memoization cache can choose what to evict when it
+ * is full. */
+typedef enum halide_memoization_cache_eviction_policy_t {
+    /** Evict the least recently used entry. The default. */
+    halide_memoization_cache_evict_lru = 0,
+    /** GreedyDual-Size: evict the entry that saves the least compute
+     * time per byte, aging entries that go unused. This keeps small,
+     * expensive results in favor of large ones that are cheap to
+     * recompute. */
+    halide_memoization_cache_evict_greedy_dual_size = 1,
+} halide_memoization_cache_eviction_policy_t;
+
+/** Select the memoization cache's eviction policy. Returns zero on
+ * success, or halide_error_code_generic_error for an unknown
+ * policy. */
+extern int halide_memoization_cache_set_eviction_policy(halide_memoization_cache_eviction_policy_t policy);
+
+/** Back the memoization cache with a memory-mapped file of max_bytes
+ * bytes at the given path, creating it if need be. Results stored in
+ * the cache are also written to the file, and lookups that miss in
+ * memory are satisfied from it when possible, so results survive
+ * restarts and can be shared by processes that use the same file
+ * (and the same max_bytes). Concurrent readers and writers in
+ * different processes are safe. The oldest results in the file are
+ * overwritten once it is full. Results are identified by the names
+ * and a fingerprint of the definitions of the memoized Funcs, which
+ * does not cover the contents of Buffers or the behavior of extern
+ * stages; don't share a file between programs where those differ
+ * under the same names. Passing a NULL path detaches the file. Must
+ * not be called while pipelines are running. Returns zero on
+ * success, or halide_error_code_generic_error if the file can't be
+ * mapped or is in use with a different size. Not supported on
+ * Windows. */
+extern int halide_memoization_cache_set_persistent_file(void *user_context, const char *path, int64_t max_bytes);
+
+/** Counters describing the memoization cache's behavior since it was
+ * last flushed. */
+struct halide_memoization_cache_stats_t {
+    /** Lookups that found a matching entry, and lookups that did not. */
+    uint64_t hits, misses;
+
+    /** Misses in memory that were satisfied from the persistent file. */
+    uint64_t persistent_hits;
+
+    /** Entries evicted to keep the cache within its size. */
+    uint64_t evictions;
+
+    /** Bytes of cached data currently held, and the size set by
+     * halide_memoization_cache_set_size. */
+    int64_t bytes, max_bytes;
+
+    /** The number of entries currently held. */
+    uint64_t entries;
+
+    /** Total time in nanoseconds that threads have spent waiting to
+     * acquire the cache's locks. */
+    int64_t lock_wait_time;
+
+    /** Total compute time in nanoseconds that cache hits have saved,
+     * according to the time each entry took to compute. */
+    int64_t compute_time_saved;
+
+    /** The number of shards the cache is split into. */
+    int shards;
+};
+
+/** Fill in the memoization cache statistics. Returns zero on success,
+ * or halide_error_code_generic_error if stats is NULL. */
+extern int halide_memoization_cache_get_stats(void *user_context, struct halide_memoization_cache_stats_t *stats);
+
 /** Create a unique file with a name of the form prefixXXXXXsuffix in an arbitrary
  * (but writable) directory; this is typically $TMP or /tmp, but the specific
  * location is not guaranteed. (Note that the exact form of the file name
@@ -1282,7 +1524,11 @@ typedef enum halide_target_feature_t {
     halide_target_feature_embed_bitcode = 57,  ///< Emulate clang -fembed-bitcode flag.
     halide_target_feature_disable_llvm_loop_vectorize = 58,  ///< Disable loop vectorization in LLVM. (Ignored for non-LLVM targets.)
     halide_target_feature_disable_llvm_loop_unroll = 59,  ///< Disable loop unrolling in LLVM. (Ignored for non-LLVM targets.)
-    halide_target_feature_end = 60 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
+    halide_target_feature_arena_alloc = 60,  ///< Serve heap allocations made during a pipeline call from an arena that is freed when the call returns.
+    halide_target_feature_profile_counters = 61,  ///< Have the profiler also attribute hardware performance counters (cycles, instructions, cache and branch misses) to each Func, where the platform provides them. Use with profile.
+    halide_target_feature_profile_timeline = 62,  ///< Have the profiler also record a timeline of each thread's Funcs, tasks, waits and device copies, written as a Chrome trace to the file named by HL_PROFILER_TIMELINE. Use with profile.
+    halide_target_feature_slab_alloc = 63,  ///< Pack heap allocations of constant size with non-overlapping lifetimes into a single slab, allocated once per call (and once per parallel task).
+    halide_target_feature_end = 64 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
 } halide_target_feature_t;
 
 /** This function is called internally by Halide in some situations to determine
@@ -1687,6 +1933,11 @@ struct halide_profiler_func_stats {
     /** The average number of thread pool worker threads active while computing this Func. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
+    /** Hardware performance counters accumulated while computing this
+     * Func, if the pipeline was compiled with the profile_counters
+     * target feature and the platform provides them. Zero otherwise. */
+    uint64_t cycles, instructions, llc_misses, branch_misses;
+
     /** The name of this Func. A global constant string. */
     const char *name;
 
@@ -1713,6 +1964,10 @@ struct halide_profiler_pipeline_stats {
      * work while computing this pipeline. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
+    /** Hardware performance counters accumulated while computing
+     * this pipeline. See halide_profiler_func_stats. */
+    uint64_t cycles, instructions, llc_misses, branch_misses;
+
     /** The name of this pipeline. A global constant string. */
     const char *name;
 
@@ -1739,6 +1994,35 @@ struct halide_profiler_pipeline_stats {
     int num_allocs;
 };
 
+/** The number of threads of work the profiler can follow at once. */
+enum {
+    halide_profiler_max_threads = 256
+};
+
+/** A slot tracking one thread of work: the main body of a pipeline
+ * call, or a task of a parallel loop or fork. A slot is claimed when
+ * the work starts and released when it ends, so the slots in use at any
+ * moment say what every thread is computing. */
+struct halide_profiler_thread_stats {
+    /** The id of the Func this thread is currently computing, or
+     * halide_profiler_outside_of_halide if it is waiting on other
+     * threads. Set by halide_profiler_set_current_func. */
+    int current_func;
+
+    /** Nonzero while a thread holds this slot. */
+    int in_use;
+
+    /** The slot of the pipeline call that a parallel task's slot was
+     * claimed for, so that the call can release it if the task exits
+     * early on an error. Null for the slot of a pipeline call. */
+    void *owner;
+
+    /** Total time during which exactly as many threads as this slot's
+     * index plus one were computing a Func (in nanoseconds). Unlike the
+     * fields above, this is not tied to the thread holding the slot. */
+    uint64_t time;
+};
+
 /** The global state of the profiler. */
 
 struct halide_profiler_state {
@@ -1754,8 +2038,9 @@ struct halide_profiler_state {
     /** An internal id used for bookkeeping. */
     int first_free_id;
 
-    /** The id of the current running Func. Set by the pipeline, read
-     * periodically by the profiler thread. */
+    /** The id of the most recently started Func on any thread. Set by
+     * the pipeline, and read periodically by the profiler thread if
+     * no thread slot is in use. */
     int current_func;
 
     /** The number of threads currently doing work. */
@@ -1771,6 +2056,15 @@ struct halide_profiler_state {
 
     /** Sampling thread reference to be joined at shutdown. */
     struct halide_thread *sampling_thread;
+
+    /** Total time during which any slot below was computing a Func
+     * (in nanoseconds). */
+    uint64_t threads_time;
+
+    /** Per-thread slots, sampled by the profiler thread so that time is
+     * attributed correctly when several threads, or several pipelines,
+     * are computing different Funcs at once. */
+    struct halide_profiler_thread_stats threads[halide_profiler_max_threads];
 };
 
 /** Profiler func ids with special meanings. */
@@ -9,4 +9,24 @@ WEAK int halide_host_cpu_count() {
     return sysconf(97);
 }
 
+WEAK int halide_host_cpu_numa_node(int cpu) {
+    return 0;
+}
+
+WEAK int halide_host_current_numa_node() {
+    return 0;
+}
+
+WEAK bool halide_host_pin_thread_to_cpu(int cpu) {
+    return false;
+}
+
+WEAK bool halide_host_set_numa_local_malloc(bool enable) {
+    return !enable;
+}
+
+WEAK bool halide_host_set_huge_page_malloc(bool huge_pages, bool prefault) {
+    return !huge_pages && !prefault;
+}
+
 }
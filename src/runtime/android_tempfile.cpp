@@ -33,4 +33,37 @@ WEAK int halide_create_temp_file(void *user_context, const char *prefix, const c
     return 0;
 }
 
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+extern int munmap(void *addr, size_t length);
+extern int ftruncate(int fd, long length);
+extern long lseek(int fd, long offset, int whence);
+
+WEAK void *halide_map_shared_file(void *user_context, const char *path, size_t size) {
+    // "a+" creates the file if need be and opens it for reading and
+    // writing, without depending on the platform's values of O_CREAT.
+    void *f = fopen(path, "a+");
+    if (!f) {
+        return NULL;
+    }
+    int fd = fileno(f);
+    const int seek_end = 2;
+    void *addr = NULL;
+    long current_size = lseek(fd, 0, seek_end);
+    if (current_size >= 0 &&
+        ((size_t)current_size >= size || ftruncate(fd, (long)size) == 0)) {
+        const int prot_read_write = 3, map_shared = 1;
+        addr = mmap(NULL, size, prot_read_write, map_shared, fd, 0);
+        if (addr == (void *)-1) {
+            addr = NULL;
+        }
+    }
+    // The mapping outlives the file descriptor.
+    fclose(f);
+    return addr;
+}
+
+WEAK void halide_unmap_shared_file(void *user_context, void *addr, size_t size) {
+    munmap(addr, size);
+}
+
 }  // extern "C"
@@ -0,0 +1,183 @@
+#include "HalideRuntime.h"
+#include "scoped_mutex_lock.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// An arena serves the heap allocations made by a single call to a
+// pipeline compiled with Target::ArenaAlloc. Blocks are carved from
+// large chunks with a bump pointer, and blocks that are freed go on a
+// free list for their power-of-two size class, to be handed out again
+// to the next allocation of that class. Nothing is returned to
+// halide_malloc until the pipeline exits and the arena is destroyed.
+//
+// An arena is shared by every thread working on the pipeline, so it is
+// split into stripes with one lock each. There is no thread-local
+// storage in the runtime, so a thread picks its stripe by hashing the
+// address of its stack, which is different for every thread.
+
+#define ARENA_STRIPE_BITS 3
+#define ARENA_STRIPES (1 << ARENA_STRIPE_BITS)
+#define ARENA_MIN_CLASS_BITS 8
+#define ARENA_NUM_CLASSES 40
+#define ARENA_CHUNK_BYTES (1024 * 1024)
+// Blocks larger than this are allocated individually rather than from
+// a chunk, so that one large scratch buffer doesn't waste most of a
+// chunk.
+#define ARENA_MAX_CHUNKED_BLOCK_BYTES (ARENA_CHUNK_BYTES / 4)
+
+struct ArenaStripe;
+
+// Lives immediately before the memory handed out for a block, padded
+// to halide_malloc_alignment() so the payload stays aligned.
+struct ArenaBlockHeader {
+    ArenaStripe *stripe;
+    ArenaBlockHeader *next_free;
+    int size_class;
+};
+
+// Every halide_malloc made by an arena, to be freed when it's destroyed.
+struct ArenaSystemBlock {
+    ArenaSystemBlock *next;
+};
+
+struct ArenaStripe {
+    halide_mutex lock;
+    ArenaBlockHeader *free_lists[ARENA_NUM_CLASSES];
+    ArenaSystemBlock *system_blocks;
+    uint8_t *chunk_cursor;
+    uint8_t *chunk_end;
+} __attribute__((aligned(64)));
+
+struct Arena {
+    ArenaStripe stripes[ARENA_STRIPES];
+};
+
+WEAK size_t arena_header_bytes() {
+    size_t bytes = halide_malloc_alignment();
+    while (bytes < sizeof(ArenaBlockHeader)) {
+        bytes *= 2;
+    }
+    return bytes;
+}
+
+WEAK int arena_size_class(size_t bytes) {
+    int c = 0;
+    while (((size_t)1 << (c + ARENA_MIN_CLASS_BITS)) < bytes) {
+        c++;
+    }
+    return c;
+}
+
+WEAK ArenaStripe *arena_stripe_for_this_thread(Arena *arena) {
+    int on_stack;
+    uint32_t h = (uint32_t)((uintptr_t)&on_stack >> 20);
+    h *= 0x9E3779B1u;
+    return &arena->stripes[h >> (32 - ARENA_STRIPE_BITS)];
+}
+
+WEAK void *arena_system_malloc(void *user_context, ArenaStripe *stripe, size_t bytes) {
+    size_t header_bytes = halide_malloc_alignment();
+    uint8_t *mem = (uint8_t *)halide_malloc(user_context, bytes + header_bytes);
+    if (!mem) {
+        return NULL;
+    }
+    ArenaSystemBlock *block = (ArenaSystemBlock *)mem;
+    block->next = stripe->system_blocks;
+    stripe->system_blocks = block;
+    return mem + header_bytes;
+}
+
+WEAK ArenaBlockHeader *arena_carve_already_locked(void *user_context, ArenaStripe *stripe, int size_class) {
+    size_t block_bytes = (size_t)1 << (size_class + ARENA_MIN_CLASS_BITS);
+    if (block_bytes > ARENA_MAX_CHUNKED_BLOCK_BYTES) {
+        return (ArenaBlockHeader *)arena_system_malloc(user_context, stripe, block_bytes);
+    }
+    if (stripe->chunk_cursor == NULL ||
+        stripe->chunk_cursor + block_bytes > stripe->chunk_end) {
+        // The tail of the old chunk is abandoned until the arena dies.
+        uint8_t *chunk = (uint8_t *)arena_system_malloc(user_context, stripe, ARENA_CHUNK_BYTES);
+        if (!chunk) {
+            return NULL;
+        }
+        stripe->chunk_cursor = chunk;
+        stripe->chunk_end = chunk + ARENA_CHUNK_BYTES;
+    }
+    ArenaBlockHeader *block = (ArenaBlockHeader *)stripe->chunk_cursor;
+    stripe->chunk_cursor += block_bytes;
+    return block;
+}
+
+}}}  // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK void *halide_arena_create(void *user_context) {
+    Arena *arena = (Arena *)halide_malloc(user_context, sizeof(Arena));
+    if (!arena) {
+        return NULL;
+    }
+    memset(arena, 0, sizeof(Arena));
+    return arena;
+}
+
+WEAK void halide_arena_destroy(void *user_context, void *obj) {
+    Arena *arena = (Arena *)obj;
+    for (int i = 0; i < ARENA_STRIPES; i++) {
+        ArenaSystemBlock *block = arena->stripes[i].system_blocks;
+        while (block) {
+            ArenaSystemBlock *next = block->next;
+            halide_free(user_context, block);
+            block = next;
+        }
+    }
+    halide_free(user_context, arena);
+}
+
+WEAK void *halide_arena_malloc(void *user_context, void *obj, uint64_t size) {
+    Arena *arena = (Arena *)obj;
+    if (arena == NULL || size == 0) {
+        // Either creating the arena failed, in which case this is
+        // reported as this allocation failing rather than silently
+        // using another allocator, or the allocation is conditionally
+        // skipped.
+        return NULL;
+    }
+    size_t header_bytes = arena_header_bytes();
+    if (size > (uint64_t)((size_t)-1 / 2)) {
+        return NULL;
+    }
+    int size_class = arena_size_class((size_t)size + header_bytes);
+    if (size_class >= ARENA_NUM_CLASSES) {
+        return NULL;
+    }
+    ArenaStripe *stripe = arena_stripe_for_this_thread(arena);
+    ArenaBlockHeader *block;
+    {
+        ScopedMutexLock lock(&stripe->lock);
+        block = stripe->free_lists[size_class];
+        if (block) {
+            stripe->free_lists[size_class] = block->next_free;
+        } else {
+            block = arena_carve_already_locked(user_context, stripe, size_class);
+            if (!block) {
+                return NULL;
+            }
+        }
+    }
+    block->stripe = stripe;
+    block->next_free = NULL;
+    block->size_class = size_class;
+    return (uint8_t *)block + header_bytes;
+}
+
+WEAK void halide_arena_free(void *user_context, void *ptr) {
+    ArenaBlockHeader *block = (ArenaBlockHeader *)((uint8_t *)ptr - arena_header_bytes());
+    ArenaStripe *stripe = block->stripe;
+    ScopedMutexLock lock(&stripe->lock);
+    block->next_free = stripe->free_lists[block->size_class];
+    stripe->free_lists[block->size_class] = block;
+}
+
+}
@@ -65,6 +65,8 @@ WEAK bool buffer_has_shape(const halide_buffer_t *buf, const halide_dimension_t
     return true;
 }
 
+#define NOT_IN_HEAP 0xffffffffU
+
 struct CacheEntry {
     CacheEntry *next;
     CacheEntry *more_recent;
@@ -74,6 +76,16 @@ struct CacheEntry {
     uint8_t *key;
     uint32_t hash;
     uint32_t in_use_count; // 0 if none returned from halide_cache_lookup
+    // The shard's lru_clock when this entry last moved to the front.
+    uint64_t last_used;
+    // How long the cached values took to compute, as measured by the
+    // generated code, and the sum of their sizes in bytes.
+    int64_t compute_time;
+    int64_t bytes;
+    // The GreedyDual-Size priority, and the entry's position in its
+    // shard's heap of unused entries (or NOT_IN_HEAP while in use).
+    double priority;
+    uint32_t heap_index;
     uint32_t tuple_count;
     // The shape of the computed data. There may be more data allocated than this.
     int32_t dimensions;
@@ -84,7 +96,8 @@ struct CacheEntry {
     bool init(const uint8_t *cache_key, size_t cache_key_size,
               uint32_t key_hash,
               const halide_buffer_t *computed_bounds_buf,
-              int32_t tuples, halide_buffer_t **tuple_buffers);
+              int32_t tuples, halide_buffer_t **tuple_buffers,
+              int64_t compute_time_ns);
     void destroy();
     halide_buffer_t &buffer(int32_t i);
 
@@ -112,13 +125,19 @@ WEAK CacheBlockHeader *get_pointer_to_header(uint8_t * host) {
 
 WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
                            uint32_t key_hash, const halide_buffer_t *computed_bounds_buf,
-                           int32_t tuples, halide_buffer_t **tuple_buffers) {
+                           int32_t tuples, halide_buffer_t **tuple_buffers,
+                           int64_t compute_time_ns) {
     next = NULL;
     more_recent = NULL;
     less_recent = NULL;
     key_size = cache_key_size;
     hash = key_hash;
     in_use_count = 0;
+    last_used = 0;
+    compute_time = compute_time_ns > 0 ? compute_time_ns : 0;
+    bytes = 0;
+    priority = 0;
+    heap_index = NOT_IN_HEAP;
     tuple_count = tuples;
     dimensions = computed_bounds_buf->dimensions;
 
@@ -165,6 +184,7 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
         for (int j = 0; j < dimensions; j++) {
             buf[i].dim[j] = tuple_buffers[i]->dim[j];
         }
+        bytes += buf[i].size_in_bytes();
     }
     return true;
 }
@@ -177,42 +197,339 @@ WEAK void CacheEntry::destroy() {
     halide_free(NULL, metadata_storage);
 }
 
-WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size)  {
-    uint32_t h = 5381;
-    for (size_t i = 0; i < key_size; i++) {
-        h = (h << 5) + h + key[i];
+// MurmurHash64A, folded to 32 bits. Keys are mostly made of whole
+// words (pointers, coordinates and parameter values), so hashing a
+// word at a time is much faster than the byte-at-a-time hash this
+// replaced, and mixes better.
+WEAK uint32_t cache_key_hash(const uint8_t *key, size_t key_size) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ ((uint64_t)key_size * m);
+    size_t i = 0;
+    for (; i + 8 <= key_size; i += 8) {
+        uint64_t k;
+        __builtin_memcpy(&k, key + i, 8);
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (i < key_size) {
+        uint64_t k = 0;
+        for (size_t j = 0; i + j < key_size; j++) {
+            k |= (uint64_t)key[i + j] << (8 * j);
+        }
+        h ^= k;
+        h *= m;
     }
-    return h;
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+    return (uint32_t)(h ^ (h >> 32));
 }
 
+// The cache is split into shards, each with its own lock, hash table
+// and LRU list, so that threads looking up different keys rarely
+// contend. Eviction is LRU within a shard, which approximates LRU
+// over the whole cache.
+#define MAX_CACHE_SHARDS 64
+
+const int kDefaultCacheShards = 16;
+const int kDefaultInitialBuckets = 16;
+
+struct CacheShard {
+    halide_mutex lock;
+    // The number of threads holding or waiting for the lock via
+    // ScopedShardLock.
+    volatile int lock_users;
+    CacheEntry **buckets;
+    // Always a power of two.
+    uint32_t num_buckets;
+    uint32_t num_entries;
+    CacheEntry *most_recently_used;
+    CacheEntry *least_recently_used;
+    // Ticks on every move to the front of the LRU list.
+    uint64_t lru_clock;
+    // A binary min-heap of the entries not in use, ordered by
+    // GreedyDual-Size priority, with room for every entry in the shard.
+    CacheEntry **heap;
+    uint32_t heap_size, heap_capacity;
+    int64_t size;
+    uint64_t hits, misses, evictions, persistent_hits;
+    int64_t lock_wait_time, compute_time_saved;
+} __attribute__((aligned(64)));
+
+// Held while changing the cache size or geometry, and while flushing
+// it. Lookups and stores only take the lock of the shard they use.
 WEAK halide_mutex memoization_lock = { { 0 } };
 
-const size_t kHashTableSize = 256;
-
-WEAK CacheEntry *cache_entries[kHashTableSize];
-
-WEAK CacheEntry *most_recently_used = NULL;
-WEAK CacheEntry *least_recently_used = NULL;
+WEAK CacheShard cache_shards[MAX_CACHE_SHARDS];
+WEAK int num_cache_shards = kDefaultCacheShards;
+WEAK halide_memoization_cache_eviction_policy_t cache_eviction_policy = halide_memoization_cache_evict_lru;
+WEAK uint32_t initial_cache_buckets = kDefaultInitialBuckets;
 
 const uint64_t kDefaultCacheSize = 1 << 20;
 WEAK int64_t max_cache_size = kDefaultCacheSize;
+
+// The total of the shard sizes. Guarded by cache_size_lock, which is
+// only ever taken last and held briefly.
+WEAK halide_mutex cache_size_lock = { { 0 } };
 WEAK int64_t current_cache_size = 0;
 
+// The GreedyDual-Size inflation value: the highest priority evicted so
+// far. Written under cache_size_lock but read without it, as a stale
+// value only slightly perturbs the order of eviction.
+WEAK double cache_inflation = 0;
+
+WEAK __attribute((always_inline)) CacheShard *shard_for_hash(uint32_t h) {
+    // Use the high bits for the shard and the low bits for the bucket.
+    return &cache_shards[((uint64_t)h * (uint32_t)num_cache_shards) >> 32];
+}
+
+WEAK __attribute((always_inline)) uint32_t bucket_for_hash(const CacheShard *shard, uint32_t h) {
+    return h & (shard->num_buckets - 1);
+}
+
+WEAK bool cache_clock_started = false;
+
+// The generated code times memoized Funcs with halide_current_time_ns
+// after a lookup misses, so lookups make sure the clock is running.
+WEAK __attribute((always_inline)) void start_cache_clock(void *user_context) {
+    if (!cache_clock_started) {
+        halide_start_clock(user_context);
+        cache_clock_started = true;
+    }
+}
+
+// Only a lock that someone else holds or is waiting for is timed, so
+// the uncontended case doesn't pay for reading the clock.
+WEAK void lock_shard(void *user_context, CacheShard *shard) {
+    if (__sync_fetch_and_add(&shard->lock_users, 1) == 0) {
+        halide_mutex_lock(&shard->lock);
+        return;
+    }
+    start_cache_clock(user_context);
+    int64_t t0 = halide_current_time_ns(user_context);
+    halide_mutex_lock(&shard->lock);
+    int64_t t1 = halide_current_time_ns(user_context);
+    if (t1 > t0) {
+        shard->lock_wait_time += t1 - t0;
+    }
+}
+
+WEAK __attribute((always_inline)) void unlock_shard(CacheShard *shard) {
+    __sync_fetch_and_sub(&shard->lock_users, 1);
+    halide_mutex_unlock(&shard->lock);
+}
+
+struct ScopedShardLock {
+    CacheShard *shard;
+
+    ScopedShardLock(void *user_context, CacheShard *shard) __attribute__((always_inline)) : shard(shard) {
+        lock_shard(user_context, shard);
+    }
+
+    ~ScopedShardLock() __attribute__((always_inline)) {
+        unlock_shard(shard);
+    }
+};
+
+// Returns false if the shard has no table and one can't be allocated.
+WEAK bool ensure_buckets_already_locked(void *user_context, CacheShard *shard) {
+    if (shard->buckets != NULL) {
+        return true;
+    }
+    size_t bytes = sizeof(CacheEntry *) * initial_cache_buckets;
+    shard->buckets = (CacheEntry **)halide_malloc(user_context, bytes);
+    if (shard->buckets == NULL) {
+        return false;
+    }
+    memset(shard->buckets, 0, bytes);
+    shard->num_buckets = initial_cache_buckets;
+    return true;
+}
+
+// Double the table once chains get long. If the allocation fails we
+// carry on with the existing table.
+WEAK void maybe_grow_already_locked(void *user_context, CacheShard *shard) {
+    if (shard->num_entries <= shard->num_buckets * 2 ||
+        shard->num_buckets >= (1U << 30)) {
+        return;
+    }
+    uint32_t new_num_buckets = shard->num_buckets * 2;
+    size_t bytes = sizeof(CacheEntry *) * new_num_buckets;
+    CacheEntry **new_buckets = (CacheEntry **)halide_malloc(user_context, bytes);
+    if (new_buckets == NULL) {
+        return;
+    }
+    memset(new_buckets, 0, bytes);
+    for (uint32_t i = 0; i < shard->num_buckets; i++) {
+        CacheEntry *entry = shard->buckets[i];
+        while (entry != NULL) {
+            CacheEntry *next = entry->next;
+            uint32_t index = entry->hash & (new_num_buckets - 1);
+            entry->next = new_buckets[index];
+            new_buckets[index] = entry;
+            entry = next;
+        }
+    }
+    halide_free(user_context, shard->buckets);
+    shard->buckets = new_buckets;
+    shard->num_buckets = new_num_buckets;
+}
+
+WEAK void add_to_cache_size(int64_t delta) {
+    ScopedMutexLock lock(&cache_size_lock);
+    current_cache_size += delta;
+}
+
+WEAK bool cache_over_budget() {
+    ScopedMutexLock lock(&cache_size_lock);
+    return current_cache_size > max_cache_size;
+}
+
+// GreedyDual-Size values an entry by the compute time it saves per
+// byte it occupies, offset by the inflation value so that entries
+// which stop being used eventually age out.
+WEAK void update_priority_already_locked(CacheEntry *entry) {
+    entry->priority = cache_inflation +
+        (double)entry->compute_time / (double)(entry->bytes > 0 ? entry->bytes : 1);
+}
+
+// Whether a should be evicted before b under GreedyDual-Size:
+// the lower priority first, then the least recently used.
+WEAK __attribute((always_inline)) bool evict_before(const CacheEntry *a, const CacheEntry *b) {
+    return a->priority < b->priority ||
+        (a->priority == b->priority && a->last_used < b->last_used);
+}
+
+WEAK __attribute((always_inline)) void heap_set_already_locked(CacheShard *shard, uint32_t i, CacheEntry *entry) {
+    shard->heap[i] = entry;
+    entry->heap_index = i;
+}
+
+WEAK void heap_sift_up_already_locked(CacheShard *shard, uint32_t i) {
+    CacheEntry *entry = shard->heap[i];
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (!evict_before(entry, shard->heap[parent])) {
+            break;
+        }
+        heap_set_already_locked(shard, i, shard->heap[parent]);
+        i = parent;
+    }
+    heap_set_already_locked(shard, i, entry);
+}
+
+WEAK void heap_sift_down_already_locked(CacheShard *shard, uint32_t i) {
+    CacheEntry *entry = shard->heap[i];
+    while (true) {
+        uint32_t child = 2 * i + 1;
+        if (child >= shard->heap_size) {
+            break;
+        }
+        if (child + 1 < shard->heap_size &&
+            evict_before(shard->heap[child + 1], shard->heap[child])) {
+            child++;
+        }
+        if (!evict_before(shard->heap[child], entry)) {
+            break;
+        }
+        heap_set_already_locked(shard, i, shard->heap[child]);
+        i = child;
+    }
+    heap_set_already_locked(shard, i, entry);
+}
+
+// Make room in the heap for one more entry in the shard, so that
+// entries can always be added to it once they are in the shard.
+WEAK bool reserve_heap_already_locked(void *user_context, CacheShard *shard) {
+    if (shard->num_entries < shard->heap_capacity) {
+        return true;
+    }
+    uint32_t new_capacity = shard->heap_capacity ? shard->heap_capacity * 2 : initial_cache_buckets;
+    CacheEntry **new_heap = (CacheEntry **)halide_malloc(user_context, sizeof(CacheEntry *) * new_capacity);
+    if (new_heap == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < shard->heap_size; i++) {
+        new_heap[i] = shard->heap[i];
+    }
+    if (shard->heap != NULL) {
+        halide_free(user_context, shard->heap);
+    }
+    shard->heap = new_heap;
+    shard->heap_capacity = new_capacity;
+    return true;
+}
+
+// Called when an entry stops being in use.
+WEAK void heap_push_already_locked(CacheShard *shard, CacheEntry *entry) {
+    halide_assert(NULL, shard->heap_size < shard->heap_capacity);
+    heap_set_already_locked(shard, shard->heap_size++, entry);
+    heap_sift_up_already_locked(shard, entry->heap_index);
+}
+
+// Called when an entry starts being in use, or is evicted.
+WEAK void heap_remove_already_locked(CacheShard *shard, CacheEntry *entry) {
+    uint32_t i = entry->heap_index;
+    entry->heap_index = NOT_IN_HEAP;
+    shard->heap_size--;
+    if (i == shard->heap_size) {
+        return;
+    }
+    CacheEntry *moved = shard->heap[shard->heap_size];
+    heap_set_already_locked(shard, i, moved);
+    heap_sift_up_already_locked(shard, i);
+    heap_sift_down_already_locked(shard, moved->heap_index);
+}
+
+// Re-sort the heap after the priorities of its entries have changed.
+WEAK void heap_rebuild_already_locked(CacheShard *shard) {
+    for (uint32_t i = shard->heap_size / 2; i > 0; i--) {
+        heap_sift_down_already_locked(shard, i - 1);
+    }
+}
+
+WEAK void move_to_front_already_locked(CacheShard *shard, CacheEntry *entry) {
+    shard->lru_clock++;
+    entry->last_used = shard->lru_clock;
+    if (entry == shard->most_recently_used) {
+        return;
+    }
+    if (entry->less_recent != NULL) {
+        entry->less_recent->more_recent = entry->more_recent;
+    } else {
+        shard->least_recently_used = entry->more_recent;
+    }
+    entry->more_recent->less_recent = entry->less_recent;
+
+    entry->more_recent = NULL;
+    entry->less_recent = shard->most_recently_used;
+    shard->most_recently_used->more_recent = entry;
+    shard->most_recently_used = entry;
+}
+
+// Entries used recently enough to be in the most recent quarter of
+// the shard stay where they are on a hit, which avoids rewriting the
+// head of the list (and the cache lines of its neighbours) on every
+// lookup of a hot entry.
+WEAK __attribute((always_inline)) bool recently_used_already_locked(const CacheShard *shard, const CacheEntry *entry) {
+    return shard->lru_clock - entry->last_used < shard->num_entries / 4;
+}
+
 #if CACHE_DEBUGGING
-WEAK void validate_cache() {
-    print(NULL) << "validating cache, "
-                << "current size " << current_cache_size
-                << " of maximum " << max_cache_size << "\n";
+WEAK void validate_shard(CacheShard *shard) {
     int entries_in_hash_table = 0;
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
+    for (size_t i = 0; shard->buckets != NULL && i < shard->num_buckets; i++) {
+        CacheEntry *entry = shard->buckets[i];
         while (entry != NULL) {
             entries_in_hash_table++;
-            if (entry->more_recent == NULL && entry != most_recently_used) {
+            if (entry->more_recent == NULL && entry != shard->most_recently_used) {
                 halide_print(NULL, "cache invalid case 1\n");
                 __builtin_trap();
             }
-            if (entry->less_recent == NULL && entry != least_recently_used) {
+            if (entry->less_recent == NULL && entry != shard->least_recently_used) {
                 halide_print(NULL, "cache invalid case 2\n");
                 __builtin_trap();
             }
@@ -220,21 +537,23 @@ WEAK void validate_cache() {
         }
     }
     int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
+    CacheEntry *mru_chain = shard->most_recently_used;
     while (mru_chain != NULL) {
         entries_from_mru++;
         mru_chain = mru_chain->less_recent;
     }
     int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
+    CacheEntry *lru_chain = shard->least_recently_used;
     while (lru_chain != NULL) {
         entries_from_lru++;
         lru_chain = lru_chain->more_recent;
     }
-    print(NULL) << "hash entries " << entries_in_hash_table
+    print(NULL) << "shard " << (int)(shard - cache_shards)
+                << ": hash entries " << entries_in_hash_table
                 << ", mru entries " << entries_from_mru
                 << ", lru entries " << entries_from_lru << "\n";
-    if (entries_in_hash_table != entries_from_mru) {
+    if (entries_in_hash_table != entries_from_mru ||
+        entries_in_hash_table != (int)shard->num_entries) {
         halide_print(NULL, "cache invalid case 3\n");
         __builtin_trap();
     }
@@ -242,95 +561,533 @@ WEAK void validate_cache() {
         halide_print(NULL, "cache invalid case 4\n");
         __builtin_trap();
     }
-    if (current_cache_size < 0) {
-        halide_print(NULL, "cache size is negative\n");
+    if (shard->size < 0) {
+        halide_print(NULL, "cache shard size is negative\n");
         __builtin_trap();
     }
 }
 #endif
 
-WEAK void prune_cache() {
+// Unlink an entry from its shard and free it. Returns the number of
+// bytes of cached data it held.
+WEAK int64_t evict_entry_already_locked(CacheShard *shard, CacheEntry *entry) {
+    uint32_t index = bucket_for_hash(shard, entry->hash);
+
+    // Remove from hash table
+    CacheEntry *prev_hash_entry = shard->buckets[index];
+    if (prev_hash_entry == entry) {
+        shard->buckets[index] = entry->next;
+    } else {
+        while (prev_hash_entry != NULL && prev_hash_entry->next != entry) {
+            prev_hash_entry = prev_hash_entry->next;
+        }
+        halide_assert(NULL, prev_hash_entry != NULL);
+        prev_hash_entry->next = entry->next;
+    }
+
+    // Remove from the LRU list.
+    if (entry->more_recent != NULL) {
+        entry->more_recent->less_recent = entry->less_recent;
+    } else {
+        shard->most_recently_used = entry->less_recent;
+    }
+    if (entry->less_recent != NULL) {
+        entry->less_recent->more_recent = entry->more_recent;
+    } else {
+        shard->least_recently_used = entry->more_recent;
+    }
+
+    if (entry->heap_index != NOT_IN_HEAP) {
+        heap_remove_already_locked(shard, entry);
+    }
+
+    int64_t bytes = entry->bytes;
+    shard->size -= bytes;
+    shard->num_entries--;
+    shard->evictions++;
+
+    // Deallocate the entry.
+    entry->destroy();
+    halide_free(NULL, entry);
+    return bytes;
+}
+
+// Evict unused entries from one shard, least recently used first,
+// until the whole cache fits in its budget.
+WEAK void prune_shard_already_locked(CacheShard *shard) {
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_shard(shard);
 #endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != NULL) {
+    CacheEntry *prune_candidate = shard->least_recently_used;
+    while (prune_candidate != NULL && cache_over_budget()) {
         CacheEntry *more_recent = prune_candidate->more_recent;
-
         if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
-                }
-                halide_assert(NULL, prev_hash_entry != NULL);
-                prev_hash_entry->next = prune_candidate->next;
-            }
+            add_to_cache_size(-evict_entry_already_locked(shard, prune_candidate));
+        }
+        prune_candidate = more_recent;
+    }
+#if CACHE_DEBUGGING
+    validate_shard(shard);
+#endif
+}
 
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
-            }
-            if (more_recent != NULL) {
-                more_recent->less_recent = prune_candidate->less_recent;
-            }
+// The unused entry in a shard with the lowest GreedyDual-Size
+// priority, preferring the least recently used among equals.
+WEAK __attribute((always_inline)) CacheEntry *lowest_priority_already_locked(CacheShard *shard) {
+    return shard->heap_size > 0 ? shard->heap[0] : NULL;
+}
 
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
+// GreedyDual-Size compares priorities across the whole cache, so find
+// the shard holding the lowest one, then go back and evict it. Each
+// shard keeps its unused entries in a heap, so this only looks at the
+// top of each.
+WEAK void prune_cache_greedy_dual_size(void *user_context) {
+    while (cache_over_budget()) {
+        CacheShard *victim_shard = NULL;
+        double victim_priority = 0;
+        for (int s = 0; s < num_cache_shards; s++) {
+            CacheShard *shard = &cache_shards[s];
+            ScopedShardLock lock(user_context, shard);
+            CacheEntry *lowest = lowest_priority_already_locked(shard);
+            if (lowest != NULL && (victim_shard == NULL || lowest->priority < victim_priority)) {
+                victim_shard = shard;
+                victim_priority = lowest->priority;
             }
-            if (prune_candidate->less_recent != NULL) {
-                prune_candidate->less_recent = more_recent;
+        }
+        if (victim_shard == NULL) {
+            return;
+        }
+
+        // The shard may have changed since we looked, in which case
+        // this evicts whatever is now lowest there.
+        ScopedShardLock lock(user_context, victim_shard);
+        CacheEntry *victim = lowest_priority_already_locked(victim_shard);
+        if (victim != NULL) {
+            {
+                ScopedMutexLock size_lock(&cache_size_lock);
+                if (victim->priority > cache_inflation) {
+                    cache_inflation = victim->priority;
+                }
             }
+            add_to_cache_size(-evict_entry_already_locked(victim_shard, victim));
+        }
+    }
+}
+
+// Prune the shards in turn, starting from the given one. Only one
+// shard lock is held at a time, so this must be called with none held.
+WEAK void prune_cache(void *user_context, int first_shard) {
+    if (cache_eviction_policy == halide_memoization_cache_evict_greedy_dual_size) {
+        prune_cache_greedy_dual_size(user_context);
+        return;
+    }
+    for (int i = 0; i < num_cache_shards && cache_over_budget(); i++) {
+        CacheShard *shard = &cache_shards[(first_shard + i) % num_cache_shards];
+        ScopedShardLock lock(user_context, shard);
+        prune_shard_already_locked(shard);
+    }
+}
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= prune_candidate->buf[i].size_in_bytes();
+// Free every entry in every shard. Callers hold memoization_lock.
+WEAK void flush_cache() {
+    for (int s = 0; s < MAX_CACHE_SHARDS; s++) {
+        CacheShard *shard = &cache_shards[s];
+        ScopedMutexLock lock(&shard->lock);
+        for (size_t i = 0; shard->buckets != NULL && i < shard->num_buckets; i++) {
+            CacheEntry *entry = shard->buckets[i];
+            while (entry != NULL) {
+                CacheEntry *next = entry->next;
+                entry->destroy();
+                halide_free(NULL, entry);
+                entry = next;
             }
+        }
+        if (shard->buckets != NULL) {
+            halide_free(NULL, shard->buckets);
+        }
+        if (shard->heap != NULL) {
+            halide_free(NULL, shard->heap);
+        }
+        shard->heap = NULL;
+        shard->heap_size = 0;
+        shard->heap_capacity = 0;
+        shard->buckets = NULL;
+        shard->num_buckets = 0;
+        shard->num_entries = 0;
+        shard->most_recently_used = NULL;
+        shard->least_recently_used = NULL;
+        shard->lru_clock = 0;
+        shard->size = 0;
+        shard->hits = 0;
+        shard->misses = 0;
+        shard->evictions = 0;
+        shard->lock_wait_time = 0;
+        shard->compute_time_saved = 0;
+        shard->persistent_hits = 0;
+    }
+    ScopedMutexLock lock(&cache_size_lock);
+    current_cache_size = 0;
+    cache_inflation = 0;
+}
+
+// The optional persistent tier is a memory-mapped file that can be
+// shared by several processes and outlives them. Results stored in
+// the in-memory cache are written through to it, and lookups that
+// miss in memory fall back to it. The file holds a header, a table of
+// slots, and a ring buffer of records. Writers serialize on a lock
+// word in the header; readers take no locks, and instead check that
+// the slot they read (via its sequence number) and the record it
+// points to (via the ring buffer's write cursor) did not change while
+// they were copying.
+#define PERSISTENT_TIER_MAGIC 0x3145484341434c48ULL // "HLCACHE1"
+#define PERSISTENT_TIER_WAYS 8
+#define PERSISTENT_TIER_LOCK_SPINS 1000
+
+struct PersistentTierHeader {
+    uint64_t magic;
+    // 0 when the file is new, 1 while a process initializes it, then 2.
+    uint32_t init_state;
+    uint32_t writer_lock;
+    uint64_t file_bytes;
+    uint64_t data_offset, data_capacity;
+    // The logical offset at which the next record will be written. The
+    // physical offset is this modulo data_capacity.
+    uint64_t cursor;
+    uint32_t num_slots;
+    uint32_t padding;
+};
+
+struct PersistentTierSlot {
+    // Odd while the slot is being written.
+    uint32_t seq;
+    uint32_t hash;
+    // The logical offset and size of the record. A size of zero marks
+    // an empty slot.
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+// Each record is this header followed by the key, the computed
+// bounds, and then for each tuple element its type, its allocated
+// shape and its data. Each part starts on an eight byte boundary.
+struct PersistentTierRecord {
+    uint32_t key_size;
+    int32_t dimensions;
+    int32_t tuple_count;
+    int32_t padding;
+    int64_t compute_time;
+};
+
+struct PersistentTier {
+    PersistentTierHeader *header;
+    PersistentTierSlot *slots;
+    uint8_t *data;
+    size_t mapped_bytes;
+};
+
+WEAK PersistentTier persistent_tier = { NULL, NULL, NULL, 0 };
+
+WEAK __attribute((always_inline)) size_t round_up_to_8(size_t x) {
+    return (x + 7) & ~(size_t)7;
+}
+
+// 64-bit loads are not atomic on every 32-bit target.
+WEAK __attribute((always_inline)) uint64_t tier_load(uint64_t *addr) {
+    return __sync_add_and_fetch(addr, 0);
+}
+
+// Persistent entries can't be keyed by the pointer at the start of the
+// cache key, or the memoize_instance after it, as neither is the same
+// in another process. The pointer is to a string naming the Func and
+// fingerprinting its definition (see Memoization.cpp), so key by that
+// string and the rest of the key instead. Returns NULL if the key
+// doesn't have that layout or on allocation failure.
+WEAK uint8_t *make_persistent_key(void *user_context, const uint8_t *cache_key, int32_t size,
+                                  size_t *persistent_key_size) {
+    const size_t prefix = sizeof(const char *) + sizeof(int32_t);
+    if ((size_t)size < prefix) {
+        return NULL;
+    }
+    const char *name;
+    __builtin_memcpy(&name, cache_key, sizeof(name));
+    size_t name_size = strlen(name);
+    *persistent_key_size = name_size + (size - prefix);
+    uint8_t *key = (uint8_t *)halide_malloc(user_context, *persistent_key_size);
+    if (key != NULL) {
+        memcpy(key, name, name_size);
+        memcpy(key + name_size, cache_key + prefix, size - prefix);
+    }
+    return key;
+}
+
+WEAK size_t persistent_record_bytes(size_t key_size, int32_t dimensions,
+                                    int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    size_t shape_bytes = round_up_to_8(sizeof(halide_dimension_t) * dimensions);
+    size_t bytes = sizeof(PersistentTierRecord) + round_up_to_8(key_size) + shape_bytes;
+    for (int32_t i = 0; i < tuple_count; i++) {
+        bytes += 8 + shape_bytes + round_up_to_8(tuple_buffers[i]->size_in_bytes());
+    }
+    return bytes;
+}
 
-            // Deallocate the entry.
-            prune_candidate->destroy();
-            halide_free(NULL, prune_candidate);
+WEAK bool persistent_tier_try_lock(PersistentTierHeader *header) {
+    for (int i = 0; i < PERSISTENT_TIER_LOCK_SPINS; i++) {
+        if (__sync_bool_compare_and_swap(&header->writer_lock, 0, 1)) {
+            return true;
         }
+        halide_thread_yield();
+    }
+    // The holder may have died. Writes are optional, so give up rather
+    // than wait forever.
+    return false;
+}
 
-        prune_candidate = more_recent;
+WEAK void persistent_tier_unlock(PersistentTierHeader *header) {
+    __sync_synchronize();
+    header->writer_lock = 0;
+}
+
+WEAK void persistent_tier_store(void *user_context, const uint8_t *cache_key, int32_t size,
+                                const halide_buffer_t *computed_bounds,
+                                int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                                int64_t compute_time) {
+    PersistentTierHeader *header = persistent_tier.header;
+    size_t key_size = 0;
+    uint8_t *key = make_persistent_key(user_context, cache_key, size, &key_size);
+    if (key == NULL) {
+        return;
     }
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    int32_t dimensions = computed_bounds->dimensions;
+    size_t bytes = persistent_record_bytes(key_size, dimensions, tuple_count, tuple_buffers);
+    const uint64_t capacity = header->data_capacity;
+    if (bytes > capacity / 2 || !persistent_tier_try_lock(header)) {
+        halide_free(user_context, key);
+        return;
+    }
+
+    // Claim space in the ring buffer. Records never wrap around the
+    // end. Moving the cursor before writing lets readers of any record
+    // being overwritten notice.
+    uint64_t offset = header->cursor;
+    uint64_t physical = offset % capacity;
+    if (physical + bytes > capacity) {
+        offset += capacity - physical;
+        physical = 0;
+    }
+    uint64_t cursor = offset + bytes;
+    __sync_lock_test_and_set(&header->cursor, cursor);
+    __sync_synchronize();
+
+    // Use an empty or stale slot in the set, or failing that the one
+    // with the oldest record. (A slot left odd by a writer that died is
+    // as good as empty.)
+    uint32_t h = cache_key_hash(key, key_size);
+    PersistentTierSlot *set = persistent_tier.slots +
+        ((h & (header->num_slots - 1)) & ~(uint32_t)(PERSISTENT_TIER_WAYS - 1));
+    PersistentTierSlot *slot = NULL;
+    for (int i = 0; i < PERSISTENT_TIER_WAYS; i++) {
+        PersistentTierSlot *s = set + i;
+        if (s->bytes == 0 || s->offset + capacity < cursor || (s->seq & 1)) {
+            slot = s;
+            break;
+        }
+        if (slot == NULL || s->offset < slot->offset) {
+            slot = s;
+        }
+    }
+
+    slot->seq |= 1;
+    __sync_synchronize();
+
+    uint8_t *dst = persistent_tier.data + physical;
+    PersistentTierRecord record;
+    record.key_size = key_size;
+    record.dimensions = dimensions;
+    record.tuple_count = tuple_count;
+    record.padding = 0;
+    record.compute_time = compute_time;
+    memcpy(dst, &record, sizeof(record));
+    dst += sizeof(record);
+    memcpy(dst, key, key_size);
+    dst += round_up_to_8(key_size);
+    size_t shape_bytes = sizeof(halide_dimension_t) * dimensions;
+    memcpy(dst, computed_bounds->dim, shape_bytes);
+    dst += round_up_to_8(shape_bytes);
+    for (int32_t i = 0; i < tuple_count; i++) {
+        const halide_buffer_t *buf = tuple_buffers[i];
+        memcpy(dst, &buf->type, sizeof(buf->type));
+        dst += 8;
+        memcpy(dst, buf->dim, shape_bytes);
+        dst += round_up_to_8(shape_bytes);
+        memcpy(dst, buf->host, buf->size_in_bytes());
+        dst += round_up_to_8(buf->size_in_bytes());
+    }
+
+    slot->hash = h;
+    slot->offset = offset;
+    slot->bytes = bytes;
+    __sync_synchronize();
+    slot->seq++;
+
+    persistent_tier_unlock(header);
+    halide_free(user_context, key);
 }
 
-}}} // namespace Halide::Runtime::Internal
+// Fill the caller's freshly allocated buffers from the persistent
+// tier. Returns true on a hit, in which case *compute_time is set.
+WEAK bool persistent_tier_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
+                                 const halide_buffer_t *computed_bounds,
+                                 int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                                 int64_t *compute_time) {
+    PersistentTierHeader *header = persistent_tier.header;
+    size_t key_size = 0;
+    uint8_t *key = make_persistent_key(user_context, cache_key, size, &key_size);
+    if (key == NULL) {
+        return false;
+    }
+    int32_t dimensions = computed_bounds->dimensions;
+    size_t bytes = persistent_record_bytes(key_size, dimensions, tuple_count, tuple_buffers);
+    size_t shape_bytes = sizeof(halide_dimension_t) * dimensions;
+    const uint64_t capacity = header->data_capacity;
+
+    uint32_t h = cache_key_hash(key, key_size);
+    PersistentTierSlot *set = persistent_tier.slots +
+        ((h & (header->num_slots - 1)) & ~(uint32_t)(PERSISTENT_TIER_WAYS - 1));
+    bool found = false;
+    for (int i = 0; !found && i < PERSISTENT_TIER_WAYS; i++) {
+        PersistentTierSlot *slot = set + i;
+        uint32_t seq = slot->seq;
+        __sync_synchronize();
+        if ((seq & 1) || slot->hash != h || slot->bytes != bytes) {
+            continue;
+        }
+        uint64_t offset = slot->offset;
+        if (offset + capacity < tier_load(&header->cursor) ||
+            (offset % capacity) + bytes > capacity) {
+            continue;
+        }
 
-extern "C" {
+        // Everything in the record may be overwritten as we read it,
+        // so compare it all before trusting any of it.
+        const uint8_t *src = persistent_tier.data + (offset % capacity);
+        PersistentTierRecord record;
+        memcpy(&record, src, sizeof(record));
+        src += sizeof(record);
+        if (record.key_size != key_size ||
+            record.dimensions != dimensions ||
+            record.tuple_count != tuple_count ||
+            memcmp(src, key, key_size) != 0) {
+            continue;
+        }
+        src += round_up_to_8(key_size);
+        bool match = memcmp(src, computed_bounds->dim, shape_bytes) == 0;
+        src += round_up_to_8(shape_bytes);
+        for (int32_t j = 0; match && j < tuple_count; j++) {
+            halide_buffer_t *buf = tuple_buffers[j];
+            match = memcmp(src, &buf->type, sizeof(buf->type)) == 0;
+            src += 8;
+            match = match && memcmp(src, buf->dim, shape_bytes) == 0;
+            src += round_up_to_8(shape_bytes);
+            if (match) {
+                memcpy(buf->host, src, buf->size_in_bytes());
+            }
+            src += round_up_to_8(buf->size_in_bytes());
+        }
 
-WEAK void halide_memoization_cache_set_size(int64_t size) {
-    if (size == 0) {
-        size = kDefaultCacheSize;
+        __sync_synchronize();
+        if (match && slot->seq == seq &&
+            offset + capacity >= tier_load(&header->cursor)) {
+            *compute_time = record.compute_time;
+            found = true;
+        }
     }
 
-    ScopedMutexLock lock(&memoization_lock);
+    halide_free(user_context, key);
+    return found;
+}
 
-    max_cache_size = size;
-    prune_cache();
+WEAK void close_persistent_tier(void *user_context) {
+    if (persistent_tier.header != NULL) {
+        halide_unmap_shared_file(user_context, persistent_tier.header, persistent_tier.mapped_bytes);
+    }
+    persistent_tier.header = NULL;
+    persistent_tier.slots = NULL;
+    persistent_tier.data = NULL;
+    persistent_tier.mapped_bytes = 0;
 }
 
-WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
-                                         halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
-    uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
+WEAK int open_persistent_tier(void *user_context, const char *path, size_t file_bytes) {
+    // One slot per 4kB of data, but at least a few sets of them.
+    uint32_t num_slots = PERSISTENT_TIER_WAYS * 16;
+    while ((uint64_t)num_slots * 4 * 1024 < file_bytes && num_slots < (1U << 24)) {
+        num_slots *= 2;
+    }
+    size_t data_offset = round_up_to_8(sizeof(PersistentTierHeader)) +
+        sizeof(PersistentTierSlot) * num_slots;
+    data_offset = (data_offset + 4095) & ~(size_t)4095;
+    if (file_bytes <= data_offset * 2) {
+        debug(user_context) << "Persistent memoization cache size of " << (uint64_t)file_bytes
+                            << " bytes is too small.\n";
+        return halide_error_code_generic_error;
+    }
 
-    ScopedMutexLock lock(&memoization_lock);
+    void *base = halide_map_shared_file(user_context, path, file_bytes);
+    if (base == NULL) {
+        debug(user_context) << "Could not map persistent memoization cache file " << path << "\n";
+        return halide_error_code_generic_error;
+    }
+    PersistentTierHeader *header = (PersistentTierHeader *)base;
+
+    // Whichever process first finds the file empty lays it out.
+    if (__sync_bool_compare_and_swap(&header->init_state, 0, 1)) {
+        header->writer_lock = 0;
+        header->file_bytes = file_bytes;
+        header->num_slots = num_slots;
+        header->data_offset = data_offset;
+        header->data_capacity = file_bytes - data_offset;
+        header->cursor = 0;
+        header->magic = PERSISTENT_TIER_MAGIC;
+        __sync_synchronize();
+        header->init_state = 2;
+    } else {
+        for (int i = 0; i < PERSISTENT_TIER_LOCK_SPINS && header->init_state != 2; i++) {
+            halide_thread_yield();
+        }
+        __sync_synchronize();
+    }
+
+    if (header->init_state != 2 ||
+        header->magic != PERSISTENT_TIER_MAGIC ||
+        header->file_bytes != file_bytes ||
+        header->num_slots != num_slots ||
+        header->data_offset != data_offset) {
+        halide_unmap_shared_file(user_context, base, file_bytes);
+        debug(user_context) << "Persistent memoization cache file " << path
+                            << " is in use with a different size, or is not a cache file.\n";
+        return halide_error_code_generic_error;
+    }
+
+    persistent_tier.slots = (PersistentTierSlot *)((uint8_t *)base + round_up_to_8(sizeof(PersistentTierHeader)));
+    persistent_tier.data = (uint8_t *)base + data_offset;
+    persistent_tier.mapped_bytes = file_bytes;
+    __sync_synchronize();
+    persistent_tier.header = header;
+    return 0;
+}
+
+// Insert a computed result into the in-memory cache, and also into
+// the persistent tier if there is one and write_through is set.
+WEAK int store_entry(void *user_context, const uint8_t *cache_key, int32_t size,
+                     halide_buffer_t *computed_bounds,
+                     int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                     int64_t compute_time, bool write_through) {
+    debug(user_context) << "halide_memoization_cache_store\n";
+
+    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
+    CacheShard *shard = shard_for_hash(h);
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
+    debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
 
     debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
@@ -342,89 +1099,243 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            // Check all the tuple buffers have the same bounds (they should).
-            bool all_bounds_equal = true;
-            for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-            }
+    uint64_t added_size = 0;
+    {
+        for (int32_t i = 0; i < tuple_count; i++) {
+            halide_buffer_t *buf = tuple_buffers[i];
+            added_size += buf->size_in_bytes();
+        }
+    }
 
-            if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    if (entry->less_recent != NULL) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
-                    }
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    entry->more_recent->less_recent = entry->less_recent;
+    {
+        ScopedShardLock lock(user_context, shard);
 
-                    entry->more_recent = NULL;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != NULL) {
-                        most_recently_used->more_recent = entry;
+        CacheEntry *entry = shard->buckets ? shard->buckets[bucket_for_hash(shard, h)] : NULL;
+        while (entry != NULL) {
+            if (entry->hash == h && entry->key_size == (size_t)size &&
+                keys_equal(entry->key, cache_key, size) &&
+                buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+                entry->tuple_count == (uint32_t)tuple_count) {
+
+                bool all_bounds_equal = true;
+                bool no_host_pointers_equal = true;
+                {
+                    for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                        halide_buffer_t *buf = tuple_buffers[i];
+                        all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
+                        if (entry->buf[i].host == buf->host) {
+                            no_host_pointers_equal = false;
+                        }
                     }
-                    most_recently_used = entry;
                 }
-
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    *buf = entry->buf[i];
+                if (all_bounds_equal) {
+                    halide_assert(user_context, no_host_pointers_equal);
+                    // This entry is still in use by the caller. Mark it as having no cache entry
+                    // so halide_memoization_cache_release can free the buffer.
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+                    }
+                    return 0;
                 }
+            }
+            entry = entry->next;
+        }
 
-                entry->in_use_count += tuple_count;
+        CacheEntry *new_entry = NULL;
+        bool inited = false;
+        if (ensure_buckets_already_locked(user_context, shard) &&
+            reserve_heap_already_locked(user_context, shard)) {
+            new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
+        }
+        if (new_entry) {
+            inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers, compute_time);
+        }
+        if (!inited) {
+            // This entry is still in use by the caller. Mark it as having no cache entry
+            // so halide_memoization_cache_release can free the buffer.
+            for (int32_t i = 0; i < tuple_count; i++) {
+                get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+            }
 
-                return 0;
+            if (new_entry) {
+                halide_free(user_context, new_entry);
             }
+            return 0;
+        }
+
+        uint32_t index = bucket_for_hash(shard, h);
+        new_entry->next = shard->buckets[index];
+        new_entry->less_recent = shard->most_recently_used;
+        if (shard->most_recently_used != NULL) {
+            shard->most_recently_used->more_recent = new_entry;
+        }
+        shard->most_recently_used = new_entry;
+        if (shard->least_recently_used == NULL) {
+            shard->least_recently_used = new_entry;
+        }
+        shard->buckets[index] = new_entry;
+        shard->lru_clock++;
+        new_entry->last_used = shard->lru_clock;
+        update_priority_already_locked(new_entry);
+        shard->num_entries++;
+        shard->size += added_size;
+
+        new_entry->in_use_count = tuple_count;
+
+        for (int32_t i = 0; i < tuple_count; i++) {
+            get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
+        }
+
+        maybe_grow_already_locked(user_context, shard);
+
+        // The new entry is in use, so it can't be evicted here.
+        add_to_cache_size(added_size);
+        if (cache_eviction_policy == halide_memoization_cache_evict_lru) {
+            prune_shard_already_locked(shard);
         }
-        entry = entry->next;
     }
 
-    for (int32_t i = 0; i < tuple_count; i++) {
-        halide_buffer_t *buf = tuple_buffers[i];
+    // If this shard had nothing left to give up, make room elsewhere.
+    prune_cache(user_context, (int)(shard - cache_shards));
 
-        buf->host = ((uint8_t *)halide_malloc(user_context, buf->size_in_bytes() + header_bytes()));
-        if (buf->host == NULL) {
-            for (int32_t j = i; j > 0; j--) {
-                halide_free(user_context, get_pointer_to_header(tuple_buffers[j - 1]->host));
-                tuple_buffers[j - 1]->host = NULL;
-            }
-            return -1;
+    if (write_through && persistent_tier.header != NULL) {
+        persistent_tier_store(user_context, cache_key, size, computed_bounds,
+                              tuple_count, tuple_buffers, compute_time);
+    }
+
+    debug(user_context) << "Exiting halide_memoization_cache_store\n";
+
+    return 0;
+}
+
+// halide_memoization_cache_store_with_cost hands the compute time to
+// halide_memoization_cache_store through these slots, so that the
+// latter keeps its signature for caches that override it. A slot is
+// keyed by the cache key pointer, which is unique to the store in
+// flight. If they are all taken, the compute time is dropped and the
+// entry is treated as cheap to recompute.
+#define PENDING_COMPUTE_TIME_SLOTS 64
+
+struct PendingComputeTime {
+    const uint8_t *volatile cache_key;
+    int64_t compute_time;
+};
+
+WEAK PendingComputeTime pending_compute_times[PENDING_COMPUTE_TIME_SLOTS];
+
+WEAK __attribute((always_inline)) uint32_t pending_compute_time_slot(const uint8_t *cache_key) {
+    return (uint32_t)(((uintptr_t)cache_key >> 4) * 0x9E3779B1u) % PENDING_COMPUTE_TIME_SLOTS;
+}
+
+WEAK PendingComputeTime *stash_compute_time(const uint8_t *cache_key, int64_t compute_time) {
+    uint32_t first = pending_compute_time_slot(cache_key);
+    for (uint32_t i = 0; i < PENDING_COMPUTE_TIME_SLOTS; i++) {
+        PendingComputeTime *slot = &pending_compute_times[(first + i) % PENDING_COMPUTE_TIME_SLOTS];
+        if (__sync_bool_compare_and_swap(&slot->cache_key, (const uint8_t *)NULL, cache_key)) {
+            slot->compute_time = compute_time;
+            return slot;
         }
-        buf->host += header_bytes();
-        CacheBlockHeader *header = get_pointer_to_header(buf->host);
-        header->hash = h;
-        header->entry = NULL;
     }
+    return NULL;
+}
 
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+WEAK int64_t stashed_compute_time(const uint8_t *cache_key) {
+    uint32_t first = pending_compute_time_slot(cache_key);
+    for (uint32_t i = 0; i < PENDING_COMPUTE_TIME_SLOTS; i++) {
+        PendingComputeTime *slot = &pending_compute_times[(first + i) % PENDING_COMPUTE_TIME_SLOTS];
+        if (slot->cache_key == cache_key) {
+            return slot->compute_time;
+        }
+    }
+    return 0;
+}
 
-    return 1;
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK void halide_memoization_cache_set_size(int64_t size) {
+    if (size == 0) {
+        size = kDefaultCacheSize;
+    }
+
+    ScopedMutexLock lock(&memoization_lock);
+    {
+        ScopedMutexLock size_lock(&cache_size_lock);
+        max_cache_size = size;
+    }
+    prune_cache(NULL, 0);
 }
 
-WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache_key, int32_t size,
-                                        halide_buffer_t *computed_bounds,
-                                        int32_t tuple_count, halide_buffer_t **tuple_buffers) {
-    debug(user_context) << "halide_memoization_cache_store\n";
+WEAK int halide_memoization_cache_set_geometry(int num_shards, int initial_buckets) {
+    if (num_shards <= 0) {
+        num_shards = kDefaultCacheShards;
+    }
+    if (num_shards > MAX_CACHE_SHARDS) {
+        num_shards = MAX_CACHE_SHARDS;
+    }
+    if (initial_buckets <= 0) {
+        initial_buckets = kDefaultInitialBuckets;
+    }
+    // Round up to a power of two, so buckets can be found by masking.
+    uint32_t buckets = 1;
+    while ((int)buckets < initial_buckets && buckets < (1U << 30)) {
+        buckets *= 2;
+    }
 
-    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
+    ScopedMutexLock lock(&memoization_lock);
+    flush_cache();
+    num_cache_shards = num_shards;
+    initial_cache_buckets = buckets;
+    return 0;
+}
+
+WEAK int halide_memoization_cache_set_eviction_policy(halide_memoization_cache_eviction_policy_t policy) {
+    if (policy != halide_memoization_cache_evict_lru &&
+        policy != halide_memoization_cache_evict_greedy_dual_size) {
+        return halide_error_code_generic_error;
+    }
 
-    uint32_t index = h % kHashTableSize;
+    ScopedMutexLock lock(&memoization_lock);
+    if (policy != cache_eviction_policy) {
+        // Priorities aren't kept up to date under LRU, so start afresh.
+        {
+            ScopedMutexLock size_lock(&cache_size_lock);
+            cache_inflation = 0;
+        }
+        for (int s = 0; s < num_cache_shards; s++) {
+            CacheShard *shard = &cache_shards[s];
+            ScopedMutexLock shard_lock(&shard->lock);
+            for (CacheEntry *e = shard->least_recently_used; e != NULL; e = e->more_recent) {
+                update_priority_already_locked(e);
+            }
+            heap_rebuild_already_locked(shard);
+        }
+        cache_eviction_policy = policy;
+    }
+    return 0;
+}
 
+WEAK int halide_memoization_cache_set_persistent_file(void *user_context, const char *path, int64_t max_bytes) {
     ScopedMutexLock lock(&memoization_lock);
+    close_persistent_tier(user_context);
+    if (path == NULL) {
+        return 0;
+    }
+    if (max_bytes <= 0 || (uint64_t)max_bytes != (size_t)max_bytes) {
+        return halide_error_code_generic_error;
+    }
+    return open_persistent_tier(user_context, path, (size_t)max_bytes);
+}
+
+WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
+                                         halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    start_cache_clock(user_context);
+    uint32_t h = cache_key_hash(cache_key, size);
+    CacheShard *shard = shard_for_hash(h);
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
+    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
 
     debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
@@ -436,91 +1347,110 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
+    {
+        ScopedShardLock lock(user_context, shard);
+
+        CacheEntry *entry = shard->buckets ? shard->buckets[bucket_for_hash(shard, h)] : NULL;
+        while (entry != NULL) {
+            if (entry->hash == h && entry->key_size == (size_t)size &&
+                keys_equal(entry->key, cache_key, size) &&
+                buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+                entry->tuple_count == (uint32_t)tuple_count) {
 
-            bool all_bounds_equal = true;
-            bool no_host_pointers_equal = true;
-            {
+                // Check all the tuple buffers have the same bounds (they should).
+                bool all_bounds_equal = true;
                 for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
                     all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-                    if (entry->buf[i].host == buf->host) {
-                        no_host_pointers_equal = false;
-                    }
                 }
-            }
-            if (all_bounds_equal) {
-                halide_assert(user_context, no_host_pointers_equal);
-                // This entry is still in use by the caller. Mark it as having no cache entry
-                // so halide_memoization_cache_release can free the buffer.
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
 
+                if (all_bounds_equal) {
+                    if (entry->heap_index != NOT_IN_HEAP) {
+                        heap_remove_already_locked(shard, entry);
+                    }
+                    if (!recently_used_already_locked(shard, entry)) {
+                        move_to_front_already_locked(shard, entry);
+                    }
+
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        halide_buffer_t *buf = tuple_buffers[i];
+                        *buf = entry->buf[i];
+                    }
+
+                    if (cache_eviction_policy == halide_memoization_cache_evict_greedy_dual_size) {
+                        update_priority_already_locked(entry);
+                    }
+
+                    entry->in_use_count += tuple_count;
+                    shard->hits++;
+                    shard->compute_time_saved += entry->compute_time;
+
+                    return 0;
                 }
-                return 0;
             }
+            entry = entry->next;
         }
-        entry = entry->next;
-    }
 
-    uint64_t added_size = 0;
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            added_size += buf->size_in_bytes();
-        }
+        shard->misses++;
     }
-    current_cache_size += added_size;
-    prune_cache();
 
-    CacheEntry *new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
-    bool inited = false;
-    if (new_entry) {
-        inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers);
-    }
-    if (!inited) {
-        current_cache_size -= added_size;
+    // Allocate the buffers for the caller to compute into without
+    // holding the lock.
+    for (int32_t i = 0; i < tuple_count; i++) {
+        halide_buffer_t *buf = tuple_buffers[i];
 
-        // This entry is still in use by the caller. Mark it as having no cache entry
-        // so halide_memoization_cache_release can free the buffer.
-        for (int32_t i = 0; i < tuple_count; i++) {
-            get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+        buf->host = ((uint8_t *)halide_malloc(user_context, buf->size_in_bytes() + header_bytes()));
+        if (buf->host == NULL) {
+            for (int32_t j = i; j > 0; j--) {
+                halide_free(user_context, get_pointer_to_header(tuple_buffers[j - 1]->host));
+                tuple_buffers[j - 1]->host = NULL;
+            }
+            return -1;
         }
+        buf->host += header_bytes();
+        CacheBlockHeader *header = get_pointer_to_header(buf->host);
+        header->hash = h;
+        header->entry = NULL;
+    }
 
-        if (new_entry) {
-            halide_free(user_context, new_entry);
+    // On a hit in the persistent tier, the buffers are now filled in.
+    // Promote the result to memory, where the caller will release it
+    // as if this were an ordinary hit.
+    int64_t compute_time = 0;
+    if (persistent_tier.header != NULL &&
+        persistent_tier_lookup(user_context, cache_key, size, computed_bounds,
+                               tuple_count, tuple_buffers, &compute_time)) {
+        {
+            ScopedShardLock lock(user_context, shard);
+            shard->persistent_hits++;
+            shard->compute_time_saved += compute_time;
         }
+        store_entry(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers,
+                    compute_time, false);
         return 0;
     }
 
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != NULL) {
-        most_recently_used->more_recent = new_entry;
-    }
-    most_recently_used = new_entry;
-    if (least_recently_used == NULL) {
-        least_recently_used = new_entry;
-    }
-    cache_entries[index] = new_entry;
+    return 1;
+}
 
-    new_entry->in_use_count = tuple_count;
+WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache_key, int32_t size,
+                                        halide_buffer_t *computed_bounds,
+                                        int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    return store_entry(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers,
+                       stashed_compute_time(cache_key), true);
+}
 
-    for (int32_t i = 0; i < tuple_count; i++) {
-        get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
+WEAK int halide_memoization_cache_store_with_cost(void *user_context, const uint8_t *cache_key, int32_t size,
+                                                  halide_buffer_t *computed_bounds,
+                                                  int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                                                  int64_t compute_time) {
+    PendingComputeTime *slot = stash_compute_time(cache_key, compute_time);
+    int result = halide_memoization_cache_store(user_context, cache_key, size, computed_bounds,
+                                                tuple_count, tuple_buffers);
+    if (slot != NULL) {
+        __sync_synchronize();
+        slot->cache_key = NULL;
     }
-
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
-    debug(user_context) << "Exiting halide_memoization_cache_store\n";
-
-    return 0;
+    return result;
 }
 
 WEAK void halide_memoization_cache_release(void *user_context, void *host) {
@@ -531,33 +1461,52 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == NULL) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
+        CacheShard *shard = shard_for_hash(header->hash);
+        ScopedShardLock lock(user_context, shard);
 
         halide_assert(user_context, entry->in_use_count > 0);
         entry->in_use_count--;
+        if (entry->in_use_count == 0) {
+            heap_push_already_locked(shard, entry);
+        }
 #if CACHE_DEBUGGING
-        validate_cache();
+        validate_shard(shard);
 #endif
     }
 
     debug(user_context) << "Exited halide_memoization_cache_release.\n";
 }
 
+WEAK int halide_memoization_cache_get_stats(void *user_context, struct halide_memoization_cache_stats_t *stats) {
+    if (stats == NULL) {
+        return halide_error_code_generic_error;
+    }
+    memset(stats, 0, sizeof(*stats));
+    for (int s = 0; s < num_cache_shards; s++) {
+        CacheShard *shard = &cache_shards[s];
+        // Don't count waiting for the lock here as lock wait time.
+        ScopedMutexLock lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->entries += shard->num_entries;
+        stats->lock_wait_time += shard->lock_wait_time;
+        stats->compute_time_saved += shard->compute_time_saved;
+        stats->persistent_hits += shard->persistent_hits;
+    }
+    {
+        ScopedMutexLock lock(&cache_size_lock);
+        stats->bytes = current_cache_size;
+        stats->max_bytes = max_cache_size;
+    }
+    stats->shards = num_cache_shards;
+    return 0;
+}
+
 WEAK void halide_memoization_cache_cleanup() {
     debug(NULL) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = NULL;
-        while (entry != NULL) {
-            CacheEntry *next = entry->next;
-            entry->destroy();
-            halide_free(NULL, entry);
-            entry = next;
-        }
-    }
-    current_cache_size = 0;
-    most_recently_used = NULL;
-    least_recently_used = NULL;
+    ScopedMutexLock lock(&memoization_lock);
+    flush_cache();
 }
 
 namespace {
@@ -0,0 +1,18 @@
+#include "HalideRuntime.h"
+
+// Used on Linux targets for which the runtime doesn't know the
+// perf_event_open syscall number.
+
+extern "C" {
+
+WEAK bool halide_host_start_perf_counters() {
+    return false;
+}
+
+WEAK void halide_host_read_perf_counters(uint64_t *values) {
+    for (int i = 0; i < HOST_PERF_COUNTERS; i++) {
+        values[i] = 0;
+    }
+}
+
+}
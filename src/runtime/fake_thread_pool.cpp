@@ -25,6 +25,9 @@ namespace Halide { namespace Runtime { namespace Internal {
 WEAK halide_do_task_t custom_do_task = halide_default_do_task;
 WEAK halide_do_par_for_t custom_do_par_for = halide_default_do_par_for;
 
+// halide_spawn_thread below only reports an error.
+WEAK bool halide_can_spawn_threads = false;
+
 }}} // namespace Halide::Runtime::Internal
 
 extern "C" {
@@ -51,6 +54,32 @@ WEAK int halide_set_num_threads(int n) {
     return 1;
 }
 
+WEAK int halide_set_numa_aware_thread_pool(int enable) {
+    return 0;
+}
+
+WEAK void halide_init_huge_page_malloc() {
+}
+
+WEAK bool halide_set_huge_page_malloc(bool huge_pages, bool prefault) {
+    return false;
+}
+
+WEAK int halide_set_thread_pool_qos(void *user_context, int priority, int max_threads) {
+    return 0;
+}
+
+WEAK void halide_clear_thread_pool_qos(void *user_context) {
+}
+
+WEAK int halide_thread_pool_qos_stats(int priority, halide_thread_pool_qos_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    return 0;
+}
+
+WEAK void halide_reset_thread_pool_qos_stats() {
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
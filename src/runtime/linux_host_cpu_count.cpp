@@ -3,9 +3,275 @@
 extern "C" {
 
 extern long sysconf(int);
+extern int sched_getcpu();
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+extern int munmap(void *addr, size_t length);
+extern int madvise(void *addr, size_t length, int advice);
+extern size_t fread(void *ptr, size_t size, size_t n, void *file);
 
 WEAK int halide_host_cpu_count() {
     return sysconf(84);
 }
 
 }
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Large enough for the 1024-bit cpu_set_t used by glibc.
+#define MAX_NUMA_CPUS 1024
+#define MAX_NUMA_NODES 64
+
+// Allocations at least this large are placed on the allocating
+// thread's node when NUMA-local allocation is on. Smaller ones are
+// left to malloc, whose per-thread arenas already keep them local.
+#define NUMA_LOCAL_MALLOC_THRESHOLD (256 * 1024)
+
+// The size of a transparent huge page on x86 and arm64 Linux.
+// Allocations at least this large are given huge pages and prefaulted
+// when those are turned on.
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+
+struct numa_topology_t {
+    bool initialized;
+    int16_t cpu_node[MAX_NUMA_CPUS];
+};
+
+WEAK numa_topology_t numa_topology;
+
+// Parse a sysfs list such as "0-3,8-11\n", setting values[i] = value
+// for every i it names.
+WEAK void parse_sysfs_list(const char *str, int16_t *values, int max_values, int16_t value) {
+    while (*str) {
+        if (*str < '0' || *str > '9') {
+            str++;
+            continue;
+        }
+        int first = atoi(str);
+        while (*str >= '0' && *str <= '9') str++;
+        int last = first;
+        if (*str == '-') {
+            str++;
+            last = atoi(str);
+            while (*str >= '0' && *str <= '9') str++;
+        }
+        for (int i = first; i <= last && i < max_values; i++) {
+            values[i] = value;
+        }
+    }
+}
+
+WEAK bool read_sysfs_file(const char *path, char *buf, size_t size) {
+    void *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    size_t n = fread(buf, 1, size - 1, f);
+    fclose(f);
+    buf[n] = 0;
+    return true;
+}
+
+WEAK void init_numa_topology() {
+    if (numa_topology.initialized) {
+        return;
+    }
+    for (int i = 0; i < MAX_NUMA_CPUS; i++) {
+        numa_topology.cpu_node[i] = 0;
+    }
+
+    char buf[1024];
+    int16_t node_online[MAX_NUMA_NODES] = {0};
+    if (read_sysfs_file("/sys/devices/system/node/online", buf, sizeof(buf))) {
+        parse_sysfs_list(buf, node_online, MAX_NUMA_NODES, 1);
+    }
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        if (!node_online[node]) {
+            continue;
+        }
+        char path[64];
+        char *dst = halide_string_to_string(path, path + sizeof(path), "/sys/devices/system/node/node");
+        dst = halide_int64_to_string(dst, path + sizeof(path), node, 1);
+        halide_string_to_string(dst, path + sizeof(path), "/cpulist");
+        if (read_sysfs_file(path, buf, sizeof(buf))) {
+            parse_sysfs_list(buf, numa_topology.cpu_node, MAX_NUMA_CPUS, node);
+        }
+    }
+    numa_topology.initialized = true;
+}
+
+// Large allocations can be placed on the allocating thread's node (for
+// the NUMA-aware thread pool), given huge pages, or prefaulted. All of
+// these need the memory mapped directly rather than taken from malloc,
+// so while any is on, halide_malloc is replaced by host_large_malloc.
+WEAK halide_malloc_t host_chained_malloc = NULL;
+WEAK halide_free_t host_chained_free = NULL;
+WEAK bool host_numa_local_malloc = false;
+WEAK bool host_huge_page_malloc = false;
+WEAK bool host_prefault_malloc = false;
+
+struct prefault_closure_t {
+    char *start;
+    size_t bytes;
+    size_t page_size;
+};
+
+// Touch the pages of one huge page's worth of a new allocation.
+WEAK int prefault_task(void *user_context, int idx, uint8_t *closure) {
+    prefault_closure_t *c = (prefault_closure_t *)closure;
+    size_t begin = (size_t)idx * HUGE_PAGE_BYTES;
+    size_t end = begin + HUGE_PAGE_BYTES;
+    if (end > c->bytes) {
+        end = c->bytes;
+    }
+    for (size_t i = begin; i < end; i += c->page_size) {
+        ((volatile char *)c->start)[i] = 0;
+    }
+    return 0;
+}
+
+// Large blocks are mapped fresh. The word before the returned pointer
+// holds the mapping address with the low bit set, which distinguishes
+// these blocks from those of halide_default_malloc (which stores an
+// aligned pointer there), and the word before that holds its size.
+WEAK void *host_large_malloc(void *user_context, size_t x) {
+    bool numa_local = host_numa_local_malloc && x >= NUMA_LOCAL_MALLOC_THRESHOLD;
+    bool huge_pages = host_huge_page_malloc && x >= HUGE_PAGE_BYTES;
+    bool prefault = host_prefault_malloc && x >= HUGE_PAGE_BYTES;
+    if (!(numa_local || huge_pages || prefault)) {
+        return host_chained_malloc(user_context, x);
+    }
+    const size_t alignment = halide_malloc_alignment();
+    const size_t page_size = sysconf(30);
+    // A huge-page block starts on a 2MB boundary, with its header in
+    // the small page before it.
+    size_t header = huge_pages ? page_size : alignment;
+    size_t slack = huge_pages ? HUGE_PAGE_BYTES : 0;
+    size_t bytes = (x + header + slack + page_size - 1) & ~(page_size - 1);
+    // A private mapping of /dev/zero is anonymous memory, and avoids
+    // depending on the per-architecture value of MAP_ANONYMOUS. The
+    // mapping outlives the file, so it is closed straight away.
+    void *zero = fopen("/dev/zero", "r");
+    if (!zero) {
+        return host_chained_malloc(user_context, x);
+    }
+    const int prot_read_write = 3, map_private = 2;
+    void *base = mmap(NULL, bytes, prot_read_write, map_private, fileno(zero), 0);
+    fclose(zero);
+    if (base == (void *)-1) {
+        return host_chained_malloc(user_context, x);
+    }
+    char *ptr = (char *)base + header;
+    if (huge_pages) {
+        ptr = (char *)(((uintptr_t)ptr + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+        const int madv_hugepage = 14;
+        madvise(base, bytes, madv_hugepage);
+    }
+    if (numa_local) {
+        // The kernel's first-touch policy puts every page on the node
+        // of the thread that touches it, so this thread must do it.
+        for (size_t i = 0; i < bytes; i += page_size) {
+            ((volatile char *)base)[i] = 0;
+        }
+    } else if (prefault) {
+        prefault_closure_t closure = {ptr, x, page_size};
+        int chunks = (int)((x + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES);
+        halide_do_par_for(user_context, prefault_task, 0, chunks, (uint8_t *)&closure);
+    }
+    ((uintptr_t *)ptr)[-1] = (uintptr_t)base | 1;
+    ((size_t *)ptr)[-2] = bytes;
+    return ptr;
+}
+
+WEAK void host_large_free(void *user_context, void *ptr) {
+    uintptr_t tag = ((uintptr_t *)ptr)[-1];
+    if (tag & 1) {
+        munmap((void *)(tag & ~(uintptr_t)1), ((size_t *)ptr)[-2]);
+    } else {
+        host_chained_free(user_context, ptr);
+    }
+}
+
+// Install or remove host_large_malloc to match the settings. Returns
+// false if it is needed but halide_malloc has been replaced by the
+// user. Removing it leaves alone any allocator the user has installed
+// since.
+WEAK bool update_host_large_malloc() {
+    if (host_numa_local_malloc || host_huge_page_malloc || host_prefault_malloc) {
+        if (host_chained_malloc != NULL) {
+            return true;
+        }
+        halide_malloc_t old_malloc = halide_set_custom_malloc(host_large_malloc);
+        if (old_malloc != halide_default_malloc) {
+            // Don't second-guess a user-provided allocator.
+            halide_set_custom_malloc(old_malloc);
+            return false;
+        }
+        host_chained_malloc = old_malloc;
+        // The free hook stays installed for good, as blocks handed
+        // out while this was enabled may be freed after it is not.
+        if (host_chained_free == NULL) {
+            host_chained_free = halide_set_custom_free(host_large_free);
+        }
+    } else if (host_chained_malloc != NULL) {
+        halide_malloc_t current = halide_set_custom_malloc(host_chained_malloc);
+        if (current == host_large_malloc) {
+            host_chained_malloc = NULL;
+        } else {
+            // The user's allocator may chain to host_large_malloc,
+            // which now just passes everything through.
+            halide_set_custom_malloc(current);
+        }
+    }
+    return true;
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK int halide_host_cpu_numa_node(int cpu) {
+    init_numa_topology();
+    if (cpu < 0 || cpu >= MAX_NUMA_CPUS) {
+        return 0;
+    }
+    return numa_topology.cpu_node[cpu];
+}
+
+WEAK int halide_host_current_numa_node() {
+    return halide_host_cpu_numa_node(sched_getcpu());
+}
+
+WEAK bool halide_host_pin_thread_to_cpu(int cpu) {
+    if (cpu < 0 || cpu >= MAX_NUMA_CPUS) {
+        return false;
+    }
+    uint64_t mask[MAX_NUMA_CPUS / 64] = {0};
+    mask[cpu / 64] = (uint64_t)1 << (cpu % 64);
+    // A pid of zero means the calling thread.
+    return sched_setaffinity(0, sizeof(mask), mask) == 0;
+}
+
+WEAK bool halide_host_set_numa_local_malloc(bool enable) {
+    host_numa_local_malloc = enable;
+    if (!update_host_large_malloc()) {
+        host_numa_local_malloc = false;
+        return false;
+    }
+    return true;
+}
+
+WEAK bool halide_host_set_huge_page_malloc(bool huge_pages, bool prefault) {
+    host_huge_page_malloc = huge_pages;
+    host_prefault_malloc = prefault;
+    if (!update_host_large_malloc()) {
+        host_huge_page_malloc = false;
+        host_prefault_malloc = false;
+        return false;
+    }
+    return true;
+}
+
+}
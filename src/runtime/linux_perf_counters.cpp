@@ -0,0 +1,90 @@
+#include "HalideRuntime.h"
+
+extern "C" {
+
+extern ssize_t read(int fd, void *buf, size_t count);
+extern int syscall(int num, ...);
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The syscall number for perf_event_open varies across platforms, and
+// the runtime is compiled for a generic target, so this module is only
+// used for x86:
+// -- i386 is 336
+// -- x64 is 298
+#ifdef BITS_64
+#define SYS_PERF_EVENT_OPEN 298
+#else
+#define SYS_PERF_EVENT_OPEN 336
+#endif
+
+// The prefix of struct perf_event_attr that every kernel accepts
+// (PERF_ATTR_SIZE_VER0).
+struct perf_event_attr_t {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+
+// File descriptors for the profiler's hardware counters, or -1 for
+// those that could not be opened.
+WEAK int perf_counter_fds[HOST_PERF_COUNTERS] = {-1, -1, -1, -1};
+
+}}} // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK bool halide_host_start_perf_counters() {
+    // PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    // PERF_COUNT_HW_CACHE_MISSES (which is the last-level cache) and
+    // PERF_COUNT_HW_BRANCH_MISSES.
+    const uint64_t configs[HOST_PERF_COUNTERS] = {0, 1, 3, 5};
+    bool any = false;
+    for (int i = 0; i < HOST_PERF_COUNTERS; i++) {
+        if (perf_counter_fds[i] >= 0) {
+            any = true;
+            continue;
+        }
+        perf_event_attr_t attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = 0;  // PERF_TYPE_HARDWARE
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        // Set inherit, so the counts include threads this one creates
+        // from now on, and exclude_kernel and exclude_hv, which lets
+        // unprivileged processes open the counters under the default
+        // perf_event_paranoid setting.
+        attr.flags = (1 << 1) | (1 << 5) | (1 << 6);
+        const int pid_self = 0, any_cpu = -1, no_group = -1, fd_cloexec = 8;
+        int fd = syscall(SYS_PERF_EVENT_OPEN, &attr, pid_self, any_cpu, no_group, fd_cloexec);
+        if (fd >= 0) {
+            perf_counter_fds[i] = fd;
+            any = true;
+        }
+    }
+    return any;
+}
+
+WEAK void halide_host_read_perf_counters(uint64_t *values) {
+    for (int i = 0; i < HOST_PERF_COUNTERS; i++) {
+        uint64_t value = 0;
+        if (perf_counter_fds[i] < 0 ||
+            read(perf_counter_fds[i], &value, sizeof(value)) != sizeof(value)) {
+            value = 0;
+        }
+        values[i] = value;
+    }
+}
+
+}
@@ -50,6 +50,11 @@ WEAK halide_free_t halide_set_custom_free(halide_free_t user_free) {
 }
 
 WEAK void *halide_malloc(void *user_context, size_t x) {
+    // Only allocations of 2MB or more are affected by the huge page
+    // settings.
+    if (x >= 2 * 1024 * 1024) {
+        halide_init_huge_page_malloc();
+    }
     return custom_malloc(user_context, x);
 }
 
@@ -2,6 +2,8 @@
 #include "printer.h"
 #include "scoped_mutex_lock.h"
 
+extern "C" int fflush(void *);
+
 // Note: The profiler thread may out-live any valid user_context, or
 // be used across many different user_contexts, so nothing it calls
 // can depend on the user context.
@@ -16,6 +18,138 @@ WEAK halide_profiler_state *halide_profiler_get_state() {
 
 namespace Halide { namespace Runtime { namespace Internal {
 
+// Whether a pipeline compiled with the profile_counters feature has
+// asked for hardware counters, and whether any could be opened. The
+// sampling thread bills the change in the counters since its last
+// sample to the current Func, just as it does with time. Guarded by
+// the profiler state's lock.
+WEAK bool profiler_counters_requested = false;
+WEAK bool profiler_counters_available = false;
+WEAK uint64_t profiler_counters_last[HOST_PERF_COUNTERS];
+
+// In timeline mode, each thread slot records what its thread does in a
+// ring buffer. Only the thread holding a slot writes to its ring, so
+// recording takes no locks. The rings are written out as Chrome trace
+// events (which Perfetto also reads) whenever the profiler state is
+// reset, which includes at shutdown, while the Func names they refer to
+// are still valid. If a ring fills up between resets, the oldest events
+// are lost.
+//
+// Func changes happen at every produce and consume node, including
+// those in inner loops, so they are stamped with the time the sampling
+// thread last woke up rather than by reading the clock. Their times
+// are therefore only as precise as the sampling interval. Tasks and
+// device copies read the clock.
+#define TIMELINE_RING_EVENTS 16384
+
+enum {
+    // A thread starts computing a Func, or waits on other threads
+    // if the id is halide_profiler_outside_of_halide.
+    timeline_func,
+    // A pipeline call or parallel task starts or ends on a thread.
+    timeline_task_begin,
+    timeline_task_end,
+    // A copy between host and device starts or ends.
+    timeline_copy_begin,
+    timeline_copy_end
+};
+
+struct TimelineEvent {
+    uint64_t time;
+    // A global constant string, for events other than timeline_func.
+    const char *name;
+    int kind;
+    int func;
+};
+
+struct TimelineRing {
+    uint64_t count;
+    // The time of the latest event, which keeps the events in order
+    // when a Func change is stamped with an older sample time.
+    uint64_t last_time;
+    TimelineEvent events[TIMELINE_RING_EVENTS];
+};
+
+WEAK bool timeline_enabled = false;
+WEAK void *timeline_file = NULL;
+WEAK TimelineRing *timeline_rings[halide_profiler_max_threads];
+
+// Updated by the sampling thread every time it wakes up.
+WEAK volatile uint64_t timeline_sample_time = 0;
+
+WEAK void timeline_record(halide_profiler_state *s, halide_profiler_thread_stats *thread,
+                          int kind, int func, const char *name, uint64_t time) {
+    if (!thread) {
+        return;
+    }
+    TimelineRing *ring = timeline_rings[thread - s->threads];
+    if (!ring) {
+        return;
+    }
+    if (time < ring->last_time) {
+        time = ring->last_time;
+    }
+    ring->last_time = time;
+    TimelineEvent *e = ring->events + (ring->count % TIMELINE_RING_EVENTS);
+    e->time = time;
+    e->name = name;
+    e->kind = kind;
+    e->func = func;
+    ring->count++;
+}
+
+WEAK halide_profiler_pipeline_stats *find_pipeline(halide_profiler_state *s, int func_id);
+
+// Write out and clear every ring. Must be called with the profiler state
+// locked and no pipelines running.
+WEAK void timeline_flush_unlocked(halide_profiler_state *s) {
+    if (!timeline_file) {
+        return;
+    }
+    char line_buf[1024];
+    Printer<StringStreamPrinter, sizeof(line_buf)> sstr(NULL, line_buf);
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        TimelineRing *ring = timeline_rings[i];
+        if (!ring || !ring->count) {
+            continue;
+        }
+        uint64_t first = 0;
+        if (ring->count > TIMELINE_RING_EVENTS) {
+            first = ring->count - TIMELINE_RING_EVENTS;
+        }
+        // Whether a Func (or a wait) is open on this thread, so that
+        // starting another or ending the task closes it first.
+        bool func_open = false;
+        for (uint64_t j = first; j < ring->count; j++) {
+            const TimelineEvent *e = ring->events + (j % TIMELINE_RING_EVENTS);
+            // Chrome trace timestamps are in microseconds.
+            uint64_t us = e->time / 1000;
+            sstr.clear();
+            if (func_open && (e->kind == timeline_func || e->kind == timeline_task_end)) {
+                sstr << "{\"ph\":\"E\",\"ts\":" << us << ",\"pid\":0,\"tid\":" << i << "},\n";
+                func_open = false;
+            }
+            const char *name = e->name;
+            const char *phase = "B";
+            if (e->kind == timeline_func) {
+                name = "wait";
+                if (e->func >= 0) {
+                    halide_profiler_pipeline_stats *p = find_pipeline(s, e->func);
+                    name = p ? p->funcs[e->func - p->first_func_id].name : "unknown";
+                }
+                func_open = true;
+            } else if (e->kind == timeline_task_end || e->kind == timeline_copy_end) {
+                phase = "E";
+            }
+            sstr << "{\"name\":\"" << name << "\",\"ph\":\"" << phase
+                 << "\",\"ts\":" << us << ",\"pid\":0,\"tid\":" << i << "},\n";
+            fwrite(sstr.str(), 1, sstr.size(), timeline_file);
+        }
+        ring->count = 0;
+    }
+    fflush(timeline_file);
+}
+
 WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipeline_name, int num_funcs, const uint64_t *func_names) {
     halide_profiler_state *s = halide_profiler_get_state();
 
@@ -45,6 +179,10 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
     p->num_allocs = 0;
     p->active_threads_numerator = 0;
     p->active_threads_denominator = 0;
+    p->cycles = 0;
+    p->instructions = 0;
+    p->llc_misses = 0;
+    p->branch_misses = 0;
     p->funcs = (halide_profiler_func_stats *)malloc(num_funcs * sizeof(halide_profiler_func_stats));
     if (!p->funcs) {
         free(p);
@@ -60,13 +198,17 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         p->funcs[i].stack_peak = 0;
         p->funcs[i].active_threads_numerator = 0;
         p->funcs[i].active_threads_denominator = 0;
+        p->funcs[i].cycles = 0;
+        p->funcs[i].instructions = 0;
+        p->funcs[i].llc_misses = 0;
+        p->funcs[i].branch_misses = 0;
     }
     s->first_free_id += num_funcs;
     s->pipelines = p;
     return p;
 }
 
-WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
+WEAK halide_profiler_pipeline_stats *find_pipeline(halide_profiler_state *s, int func_id) {
     halide_profiler_pipeline_stats *p_prev = NULL;
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
@@ -77,19 +219,119 @@ WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int ac
                 p->next = s->pipelines;
                 s->pipelines = p;
             }
-            halide_profiler_func_stats *f = p->funcs + func_id - p->first_func_id;
-            f->time += time;
-            f->active_threads_numerator += active_threads;
-            f->active_threads_denominator += 1;
-            p->time += time;
-            p->samples++;
-            p->active_threads_numerator += active_threads;
-            p->active_threads_denominator += 1;
-            return;
+            return p;
         }
         p_prev = p;
     }
-    // Someone must have called reset_state while a kernel was running. Do nothing.
+    // Someone must have called reset_state while a kernel was running.
+    return NULL;
+}
+
+WEAK void add_counters(halide_profiler_func_stats *f, const uint64_t *counters) {
+    f->cycles += counters[0];
+    f->instructions += counters[1];
+    f->llc_misses += counters[2];
+    f->branch_misses += counters[3];
+}
+
+WEAK void add_counters(halide_profiler_pipeline_stats *p, const uint64_t *counters) {
+    p->cycles += counters[0];
+    p->instructions += counters[1];
+    p->llc_misses += counters[2];
+    p->branch_misses += counters[3];
+}
+
+WEAK void bill_func(halide_profiler_pipeline_stats *p, int func_id, uint64_t time, int active_threads,
+                    const uint64_t *counters) {
+    halide_profiler_func_stats *f = p->funcs + func_id - p->first_func_id;
+    f->time += time;
+    f->active_threads_numerator += active_threads;
+    f->active_threads_denominator += 1;
+    if (counters) {
+        add_counters(f, counters);
+    }
+}
+
+WEAK void bill_pipeline(halide_profiler_pipeline_stats *p, uint64_t time, int active_threads,
+                        const uint64_t *counters) {
+    p->time += time;
+    p->samples++;
+    p->active_threads_numerator += active_threads;
+    p->active_threads_denominator += 1;
+    if (counters) {
+        add_counters(p, counters);
+    }
+}
+
+// Bill the time since the last sample, and the change in the hardware
+// counters if there are any, to what every thread slot is computing.
+// Each pipeline's time is split evenly between its busy threads, so
+// that a pipeline's time stays wall-clock time however many threads it
+// uses, and pipelines running at once are each billed in full. The
+// counters count the whole process, so they are split evenly between
+// all busy threads. Returns false if no slot is busy.
+WEAK bool bill_thread_slots(halide_profiler_state *s, uint64_t time, const uint64_t *counters) {
+    int funcs[halide_profiler_max_threads];
+    int busy = 0, used = 0;
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        volatile halide_profiler_thread_stats *thread = s->threads + i;
+        funcs[i] = halide_profiler_outside_of_halide;
+        if (thread->in_use) {
+            funcs[i] = thread->current_func;
+            used = i + 1;
+        }
+        if (funcs[i] >= 0) {
+            busy++;
+        }
+    }
+    if (busy == 0) {
+        return false;
+    }
+
+    uint64_t share[HOST_PERF_COUNTERS];
+    const uint64_t *thread_counters = NULL;
+    if (counters) {
+        for (int i = 0; i < HOST_PERF_COUNTERS; i++) {
+            share[i] = counters[i] / busy;
+        }
+        thread_counters = share;
+    }
+
+    // Slots are released in any order, so the slot indices say
+    // nothing about how many threads are busy. Bill the utilization
+    // histogram by the count instead.
+    s->threads_time += time;
+    s->threads[busy - 1].time += time;
+    for (int i = 0; i < used; i++) {
+        if (funcs[i] < 0) {
+            continue;
+        }
+        halide_profiler_pipeline_stats *p = find_pipeline(s, funcs[i]);
+        if (!p) {
+            continue;
+        }
+        // Count this pipeline's busy threads, and bill the pipeline
+        // itself on the first of them.
+        int threads = 0;
+        bool first = true;
+        for (int j = 0; j < used; j++) {
+            if (funcs[j] >= p->first_func_id && funcs[j] < p->first_func_id + p->num_funcs) {
+                threads++;
+                first = first && j >= i;
+            }
+        }
+        bill_func(p, funcs[i], time / threads, threads, thread_counters);
+        if (first) {
+            uint64_t pipeline_counters[HOST_PERF_COUNTERS];
+            if (thread_counters) {
+                for (int k = 0; k < HOST_PERF_COUNTERS; k++) {
+                    pipeline_counters[k] = thread_counters[k] * threads;
+                }
+            }
+            bill_pipeline(p, time, threads, thread_counters ? pipeline_counters : NULL);
+        }
+    }
+    return true;
 }
 
 WEAK void sampling_profiler_thread(void *) {
@@ -113,12 +355,31 @@ WEAK void sampling_profiler_thread(void *) {
                 active_threads = s->active_threads;
             }
             uint64_t t_now = halide_current_time_ns(NULL);
+            timeline_sample_time = t_now;
+            uint64_t counters[HOST_PERF_COUNTERS];
+            uint64_t *counter_deltas = NULL;
+            if (profiler_counters_available) {
+                halide_host_read_perf_counters(counters);
+                for (int i = 0; i < HOST_PERF_COUNTERS; i++) {
+                    uint64_t now = counters[i];
+                    counters[i] = now - profiler_counters_last[i];
+                    profiler_counters_last[i] = now;
+                }
+                counter_deltas = counters;
+            }
             if (func == halide_profiler_please_stop) {
                 break;
-            } else if (func >= 0) {
+            }
+            bool billed = !s->get_remote_profiler_state &&
+                bill_thread_slots(s, t_now - t, counter_deltas);
+            if (!billed && func >= 0) {
                 // Assume all time since I was last awake is due to
-                // the currently running func.
-                bill_func(s, func, t_now - t, active_threads);
+                // the most recently started func.
+                halide_profiler_pipeline_stats *p = find_pipeline(s, func);
+                if (p) {
+                    bill_func(p, func, t_now - t, active_threads, counter_deltas);
+                    bill_pipeline(p, t_now - t, active_threads, counter_deltas);
+                }
             }
             t = t_now;
 
@@ -194,6 +455,140 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
     return p->first_func_id;
 }
 
+// Called by pipelines compiled with the profile_counters feature just
+// after halide_profiler_pipeline_start. Counters are opened once, by the
+// first such pipeline, and count the thread that opened them and the
+// threads it creates afterwards, which normally includes the thread
+// pool. If they can't be opened the profiler carries on without them.
+WEAK int halide_profiler_start_counters(void *user_context) {
+    halide_profiler_state *s = halide_profiler_get_state();
+
+    ScopedMutexLock lock(&s->lock);
+
+    if (!profiler_counters_requested) {
+        profiler_counters_requested = true;
+        profiler_counters_available = halide_host_start_perf_counters();
+        if (profiler_counters_available) {
+            halide_host_read_perf_counters(profiler_counters_last);
+        } else {
+            halide_print(user_context, "Warning: hardware performance counters are unavailable; "
+                         "the profiler will report time and memory only.\n");
+        }
+    }
+    return 0;
+}
+
+// Called by pipelines compiled with the profile_timeline feature just
+// after halide_profiler_pipeline_start. The first call opens the file
+// named by the environment variable HL_PROFILER_TIMELINE, or
+// halide_timeline.json if it is unset, and starts recording. If the
+// file can't be opened the profiler carries on without a timeline.
+WEAK int halide_profiler_start_timeline(void *user_context) {
+    halide_profiler_state *s = halide_profiler_get_state();
+
+    ScopedMutexLock lock(&s->lock);
+
+    if (!timeline_enabled) {
+        const char *file_name = getenv("HL_PROFILER_TIMELINE");
+        if (!file_name || !*file_name) {
+            file_name = "halide_timeline.json";
+        }
+        timeline_file = fopen(file_name, "w");
+        if (!timeline_file) {
+            print(user_context) << "Warning: could not open " << file_name
+                                << "; the profiler will not record a timeline.\n";
+            return 0;
+        }
+        // The closing bracket of the event array is optional, so the
+        // file stays a valid trace while events are appended.
+        const char *header = "[\n";
+        fwrite(header, 1, strlen(header), timeline_file);
+        timeline_sample_time = halide_current_time_ns(user_context);
+        timeline_enabled = true;
+    }
+    return 0;
+}
+
+// The out-of-line version of halide_profiler_set_current_func used in
+// timeline mode, which also records the change on the thread's ring.
+WEAK int halide_profiler_timeline_set_current_func(void *state, int tok, int t, void *thread) {
+    halide_profiler_state *s = (halide_profiler_state *)state;
+    halide_profiler_thread_stats *ts = (halide_profiler_thread_stats *)thread;
+    s->current_func = tok + t;
+    if (ts) {
+        ts->current_func = tok + t;
+        timeline_record(s, ts, timeline_func, tok + t, NULL, timeline_sample_time);
+    }
+    return 0;
+}
+
+// Record the start (end = 0) or end (end = 1) of a copy between host
+// and device in timeline mode. name is the runtime function doing it.
+WEAK int halide_profiler_timeline_copy(void *thread, const char *name, int end) {
+    timeline_record(halide_profiler_get_state(), (halide_profiler_thread_stats *)thread,
+                    end ? timeline_copy_end : timeline_copy_begin, 0, name,
+                    halide_current_time_ns(NULL));
+    return 0;
+}
+
+// Claim a thread slot for a pipeline call (with a null owner) or for a
+// parallel task within one. Returns null if every slot is taken, in
+// which case the thread is only seen through the global current_func.
+WEAK void *halide_profiler_acquire_thread(void *state, void *owner) {
+    halide_profiler_state *s = (halide_profiler_state *)state;
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        halide_profiler_thread_stats *thread = s->threads + i;
+        if (!thread->in_use && __sync_bool_compare_and_swap(&thread->in_use, 0, 1)) {
+            // A released slot is always left outside of Halide, so the
+            // sampling thread can't see a stale Func here.
+            thread->owner = owner;
+            if (timeline_enabled) {
+                if (!timeline_rings[i]) {
+                    TimelineRing *ring = (TimelineRing *)malloc(sizeof(TimelineRing));
+                    if (ring) {
+                        ring->count = 0;
+                        ring->last_time = 0;
+                    }
+                    timeline_rings[i] = ring;
+                }
+                timeline_record(s, thread, timeline_task_begin, 0, owner ? "task" : "pipeline",
+                                halide_current_time_ns(NULL));
+            }
+            return thread;
+        }
+    }
+    return NULL;
+}
+
+// Release the slot of a parallel task that completed.
+WEAK int halide_profiler_release_thread(void *obj) {
+    halide_profiler_thread_stats *thread = (halide_profiler_thread_stats *)obj;
+    if (thread) {
+        if (timeline_enabled) {
+            timeline_record(halide_profiler_get_state(), thread, timeline_task_end, 0,
+                            thread->owner ? "task" : "pipeline", halide_current_time_ns(NULL));
+        }
+        thread->current_func = halide_profiler_outside_of_halide;
+        thread->owner = NULL;
+        __sync_lock_release(&thread->in_use);
+    }
+    return 0;
+}
+
+// Registered as a destructor by each pipeline call to release its slot
+// when it exits, along with the slots of any of its tasks that exited
+// early on an error. Those tasks have all finished by now.
+WEAK void halide_profiler_release_call_thread(void *user_context, void *obj) {
+    halide_profiler_thread_stats *thread = (halide_profiler_thread_stats *)obj;
+    halide_profiler_state *s = halide_profiler_get_state();
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        if (s->threads[i].in_use && s->threads[i].owner == thread) {
+            halide_profiler_release_thread(s->threads + i);
+        }
+    }
+    halide_profiler_release_thread(thread);
+}
+
 WEAK void halide_profiler_stack_peak_update(void *user_context,
                                             void *pipeline_state,
                                             uint64_t *f_values) {
@@ -306,6 +701,12 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
         }
         sstr << " heap allocations: " << p->num_allocs
              << "  peak heap usage: " << p->memory_peak << " bytes\n";
+        if (p->cycles) {
+            sstr << " cycles: " << p->cycles
+                 << "  instructions: " << p->instructions
+                 << "  llc misses: " << p->llc_misses
+                 << "  branch misses: " << p->branch_misses << "\n";
+        }
         halide_print(user_context, sstr.str());
 
         bool print_f_states = p->time || p->memory_total;
@@ -374,12 +775,44 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 if (fs->stack_peak > 0) {
                     sstr << " stack: " << fs->stack_peak;
                 }
+                if (fs->cycles) {
+                    // Instructions per cycle, and misses per thousand
+                    // instructions, which say more about whether a
+                    // Func is compute or memory bound than raw counts.
+                    float ipc = (float)fs->instructions / fs->cycles;
+                    float kilo_instructions = fs->instructions / 1000.0f + 1e-10f;
+                    sstr << " ipc: " << ipc;
+                    sstr.erase(4);
+                    sstr << " llc mpki: " << fs->llc_misses / kilo_instructions;
+                    sstr.erase(4);
+                    sstr << " br mpki: " << fs->branch_misses / kilo_instructions;
+                    sstr.erase(4);
+                }
                 sstr << "\n";
 
                 halide_print(user_context, sstr.str());
             }
         }
     }
+
+    // Break down the time spent in Halide code by exactly how many
+    // threads were busy, if there was ever more than one.
+    int threads_used = 0;
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        if (s->threads[i].time) {
+            threads_used = i + 1;
+        }
+    }
+    if (threads_used > 1 && s->threads_time) {
+        sstr.clear();
+        sstr << "thread utilization:";
+        for (int i = 0; i < threads_used; i++) {
+            int percent = (100 * s->threads[i].time) / s->threads_time;
+            sstr << " " << percent << "%";
+        }
+        sstr << "\n";
+        halide_print(user_context, sstr.str());
+    }
 }
 
 WEAK void halide_profiler_report(void *user_context) {
@@ -390,6 +823,7 @@ WEAK void halide_profiler_report(void *user_context) {
 
 
 WEAK void halide_profiler_reset_unlocked(halide_profiler_state *s) {
+    timeline_flush_unlocked(s);
     while (s->pipelines) {
         halide_profiler_pipeline_stats *p = s->pipelines;
         s->pipelines = (halide_profiler_pipeline_stats *)(p->next);
@@ -397,6 +831,11 @@ WEAK void halide_profiler_reset_unlocked(halide_profiler_state *s) {
         free(p);
     }
     s->first_free_id = 0;
+    // Slots may still be in use, so only clear their statistics.
+    s->threads_time = 0;
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        s->threads[i].time = 0;
+    }
 }
 
 WEAK void halide_profiler_reset() {
@@ -428,6 +867,15 @@ WEAK void halide_profiler_shutdown() {
     halide_profiler_report_unlocked(NULL, s);
 
     halide_profiler_reset_unlocked(s);
+
+    if (timeline_file) {
+        // End with a metadata event, so that the file is valid JSON.
+        const char *footer = "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"halide\"}}]\n";
+        fwrite(footer, 1, strlen(footer), timeline_file);
+        fclose(timeline_file);
+        timeline_file = NULL;
+        timeline_enabled = false;
+    }
 }
 
 namespace {
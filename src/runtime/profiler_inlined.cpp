@@ -2,12 +2,19 @@
 
 extern "C" {
 
-WEAK __attribute__((always_inline)) int halide_profiler_set_current_func(halide_profiler_state *state, int tok, int t) {
+WEAK __attribute__((always_inline)) int halide_profiler_set_current_func(halide_profiler_state *state, int tok, int t,
+                                                                         halide_profiler_thread_stats *thread) {
     // Use empty volatile asm blocks to prevent code motion. Otherwise
     // llvm reorders or elides the stores.
     volatile int *ptr = &(state->current_func);
     asm volatile ("":::);
     *ptr = tok + t;
+    if (thread) {
+        // The calling thread's own slot. This is null if no slot was
+        // free, and in code offloaded to other devices.
+        volatile int *thread_ptr = &(thread->current_func);
+        *thread_ptr = tok + t;
+    }
     asm volatile ("":::);
     return 0;
 }
@@ -20,4 +20,9 @@ inline WEAK __attribute__((always_inline)) __attribute__((used)) void pseudostac
     slot->ptr = NULL;
 }
 
+// Allocations packed into a slab are released along with the slab, so
+// this is their destructor.
+inline WEAK __attribute__((always_inline)) __attribute__((used)) void slab_nop_free(void *user_context, void *ptr) {
+}
+
 }
@@ -132,8 +132,47 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
                                         const char *pipeline_name,
                                         int num_funcs,
                                         const uint64_t *func_names);
+WEAK int halide_profiler_start_counters(void *user_context);
+WEAK int halide_profiler_start_timeline(void *user_context);
+WEAK int halide_profiler_timeline_set_current_func(void *state, int tok, int t, void *thread);
+WEAK int halide_profiler_timeline_copy(void *thread, const char *name, int end);
+WEAK void *halide_profiler_acquire_thread(void *state, void *owner);
+WEAK int halide_profiler_release_thread(void *thread);
+WEAK void halide_profiler_release_call_thread(void *user_context, void *thread);
 WEAK int halide_host_cpu_count();
 
+// Platform hooks for the thread pool's NUMA-aware mode. Platforms
+// without NUMA support report every cpu as being on node zero, fail to
+// pin threads, and decline to change the allocator. The same goes for
+// giving large allocations huge pages and prefaulting them.
+WEAK int halide_host_cpu_numa_node(int cpu);
+WEAK int halide_host_current_numa_node();
+WEAK bool halide_host_pin_thread_to_cpu(int cpu);
+WEAK bool halide_host_set_numa_local_malloc(bool enable);
+WEAK bool halide_host_set_huge_page_malloc(bool huge_pages, bool prefault);
+
+// Apply the defaults from HL_HUGE_PAGES and HL_PREFAULT, unless
+// halide_set_huge_page_malloc has already been called. halide_malloc
+// calls this before large allocations, which may well come before the
+// thread pool starts.
+WEAK void halide_init_huge_page_malloc();
+
+// Hardware performance counters for the profiler: cycles,
+// instructions, last-level cache misses and branch misses, in that
+// order. Once started, they count the calling thread and every thread
+// it creates afterwards. Counters that are unavailable read as zero,
+// and starting them returns false if none are available.
+#define HOST_PERF_COUNTERS 4
+WEAK bool halide_host_start_perf_counters();
+WEAK void halide_host_read_perf_counters(uint64_t *values);
+
+// Map the first size bytes of a file, creating it or growing it as
+// needed, so that changes are shared with other processes mapping the
+// same file. Returns NULL on failure, or on platforms that lack shared
+// file mappings.
+WEAK void *halide_map_shared_file(void *user_context, const char *path, size_t size);
+WEAK void halide_unmap_shared_file(void *user_context, void *addr, size_t size);
+
 WEAK int halide_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf,
                                        const struct halide_device_interface_t *device_interface);
 WEAK int halide_device_and_host_free(void *user_context, struct halide_buffer_t *buf);
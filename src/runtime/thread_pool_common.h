@@ -21,6 +21,14 @@ int gettid() {
 
 namespace Halide { namespace Runtime { namespace Internal {
 
+// Lets other runtime modules (e.g. tracing) know they can spawn
+// helper threads.
+WEAK bool halide_can_spawn_threads = true;
+
+// The number of workers that can own a slot in a work-stealing job. Any
+// further workers joining the job only steal single iterations.
+#define MAX_STEAL_SLOTS 64
+
 struct work {
     halide_parallel_task_t task;
 
@@ -41,6 +49,46 @@ struct work {
     // which condition variable is the owner sleeping on. NULL if it isn't sleeping.
     bool owner_is_sleeping;
 
+    // Simple parallel loops (no semaphores, no minimum thread
+    // requirement) are scheduled by work stealing. The unclaimed
+    // iterations of such a job live in steal_slots rather than in
+    // task.min/task.extent: each slot packs a half-open range of
+    // iteration offsets relative to task.min, with the beginning in
+    // the low 32 bits. A worker claims iterations from the front of its
+    // own slot and steals the back half of some other slot when its own
+    // runs dry, so the work queue mutex only needs to be taken to join
+    // and leave the job instead of once per iteration. task.extent
+    // stays non-zero until the job has been retired from the stack.
+    bool work_stealing;
+    // The number of slots handed out so far. Written under the work
+    // queue mutex, read by thieves without it.
+    int steal_slots_assigned;
+    uint64_t steal_slots[MAX_STEAL_SLOTS];
+    // The NUMA node of the worker that owns each slot. Thieves try
+    // slots on their own node first, which splits a loop's range
+    // into contiguous pieces per node. All zero unless the thread
+    // pool is NUMA-aware.
+    int8_t steal_slot_node[MAX_STEAL_SLOTS];
+
+    // The index in work_queue.qos_tags of the tag governing this job,
+    // or -1 if it is untagged.
+    int qos;
+    // When the job last started waiting for a thread, if any calls
+    // are tagged. Used to raise the priority of starved jobs.
+    int64_t waiting_since;
+    // Whether any thread has started working on the job yet.
+    bool started;
+
+    void init_work_stealing() {
+        work_stealing = !task.serial && task.num_semaphores == 0 && task.min_threads == 0;
+        steal_slots_assigned = 0;
+        if (work_stealing) {
+            // Every iteration starts out in the first slot. Whoever
+            // joins first takes it, everyone else steals from there.
+            steal_slots[0] = (uint64_t)task.extent << 32;
+        }
+    }
+
     bool make_runnable() {
         for (; next_semaphore < task.num_semaphores; next_semaphore++) {
             if (!halide_default_semaphore_try_acquire(task.semaphores[next_semaphore].semaphore,
@@ -88,6 +136,39 @@ WEAK int default_desired_num_threads() {
     return desired_num_threads;
 }
 
+WEAK bool default_numa_aware() {
+    char *numa_str = getenv("HL_NUMA_AWARE");
+    return numa_str && atoi(numa_str) != 0;
+}
+
+WEAK int default_huge_page_setting() {
+    char *huge_pages_str = getenv("HL_HUGE_PAGES");
+    char *prefault_str = getenv("HL_PREFAULT");
+    return 1 + ((huge_pages_str && atoi(huge_pages_str) != 0) ? 1 : 0) +
+        ((prefault_str && atoi(prefault_str) != 0) ? 2 : 0);
+}
+
+// A priority class and thread limit set by halide_set_thread_pool_qos.
+struct qos_tag_t {
+    void *user_context;
+    int priority;
+    int max_threads;
+    // The number of threads currently working on plain parallel loops
+    // under this tag, for enforcing max_threads.
+    int active_workers;
+    // The number of jobs in flight that refer to this tag. A cleared
+    // tag can't be reused until this drops to zero.
+    int jobs;
+    // Whether the tag is set, i.e. hasn't been cleared.
+    bool in_use;
+};
+
+#define MAX_QOS_TAGS 64
+
+// A job that has been waiting for this long without getting a thread
+// is treated as one priority class higher, and so on.
+#define QOS_AGING_NS 5000000
+
 // The work queue and thread pool is weak, so one big work queue is shared by all halide functions
 struct work_queue_t {
     // all fields are protected by this mutex.
@@ -96,6 +177,21 @@ struct work_queue_t {
     // The desired number threads doing work (HL_NUM_THREADS).
     int desired_threads_working;
 
+    // Whether the thread pool should be NUMA-aware (HL_NUMA_AWARE): 0
+    // if not yet decided, otherwise 1 for no and 2 for yes.
+    int numa_aware_setting;
+
+    // Whether large allocations get huge pages (HL_HUGE_PAGES) and are
+    // prefaulted (HL_PREFAULT): 0 if not yet decided, otherwise 1 plus
+    // 1 for huge pages plus 2 for prefaulting.
+    int huge_page_setting;
+
+    // Tags set by halide_set_thread_pool_qos, and counters for each
+    // priority class. These survive thread pool shutdown.
+    qos_tag_t qos_tags[MAX_QOS_TAGS];
+    int qos_tags_in_use;
+    halide_thread_pool_qos_stats_t qos_stats[halide_thread_pool_priority_count];
+
     // All fields after this must be zero in the initial state. See assert_zeroed
     // Field serves both to mark the offset in struct and as layout padding.
     int zero_marker;
@@ -126,6 +222,11 @@ struct work_queue_t {
     // Keep track of threads so they can be joined at shutdown
     halide_thread *threads[MAX_THREADS];
 
+    // Whether workers are pinned to cores, parallel loops are split by
+    // NUMA node, and large allocations are node-local. Read without
+    // the lock by workers, who only use it as a scheduling hint.
+    bool numa_aware;
+
     // Global flags indicating the threadpool should shut down, and
     // whether the thread pool has been initialized.
     bool shutdown, initialized;
@@ -190,6 +291,184 @@ WEAK void dump_job_state() {
 #define dump_job_state()
 #endif
 
+__attribute__((always_inline)) uint32_t range_begin(uint64_t r) {
+    return (uint32_t)r;
+}
+
+__attribute__((always_inline)) uint32_t range_end(uint64_t r) {
+    return (uint32_t)(r >> 32);
+}
+
+__attribute__((always_inline)) uint64_t make_range(uint32_t begin, uint32_t end) {
+    return (uint64_t)begin | ((uint64_t)end << 32);
+}
+
+// Claim the first iteration of a slot. Returns false if the slot is empty.
+WEAK bool claim_from_slot(uint64_t *slot, uint32_t *iter) {
+    uint64_t old_range;
+    Synchronization::atomic_load_acquire(slot, &old_range);
+    while (range_begin(old_range) < range_end(old_range)) {
+        uint64_t new_range = make_range(range_begin(old_range) + 1, range_end(old_range));
+        if (Synchronization::atomic_cas_weak_relacq_relaxed(slot, &old_range, &new_range)) {
+            *iter = range_begin(old_range);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Steal from the back of the given slot. A worker that owns a slot
+// takes half of the victim's remaining range, runs the first of those
+// iterations itself and publishes the rest in its own (empty) slot
+// where it can in turn be stolen. A worker without a slot takes a
+// single iteration. Returns false if the victim's slot is empty.
+WEAK bool steal_from_slot(work *job, int victim, int my_slot, uint32_t *iter) {
+    uint64_t *slot = job->steal_slots + victim;
+    uint64_t old_range;
+    Synchronization::atomic_load_acquire(slot, &old_range);
+    while (range_begin(old_range) < range_end(old_range)) {
+        uint32_t remaining = range_end(old_range) - range_begin(old_range);
+        uint32_t stolen = my_slot < 0 ? 1 : (remaining + 1) / 2;
+        uint32_t split = range_end(old_range) - stolen;
+        uint64_t new_range = make_range(range_begin(old_range), split);
+        if (Synchronization::atomic_cas_weak_relacq_relaxed(slot, &old_range, &new_range)) {
+            *iter = split;
+            if (stolen > 1) {
+                // Our own slot is empty, and thieves never write
+                // to an empty slot, so a plain store suffices.
+                uint64_t rest = make_range(split + 1, split + stolen);
+                Synchronization::atomic_store_release(job->steal_slots + my_slot, &rest);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Steal from some other slot, starting the search at a random
+// victim. If my_node is non-negative, slots owned by workers on that
+// NUMA node are tried first. Returns false if every slot is empty.
+WEAK bool steal_work(work *job, int my_slot, int my_node, uint32_t *rng_state, uint32_t *iter) {
+    int num_slots;
+    Synchronization::atomic_load_acquire(&job->steal_slots_assigned, &num_slots);
+    if (num_slots == 0) {
+        return false;
+    }
+
+    // xorshift32
+    uint32_t r = *rng_state;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    *rng_state = r;
+
+    int start = (int)(r % (uint32_t)num_slots);
+    for (int pass = (my_node < 0) ? 1 : 0; pass < 2; pass++) {
+        for (int i = 0; i < num_slots; i++) {
+            int victim = start + i;
+            if (victim >= num_slots) {
+                victim -= num_slots;
+            }
+            if (victim == my_slot ||
+                (pass == 0 && job->steal_slot_node[victim] != my_node)) {
+                continue;
+            }
+            if (steal_from_slot(job, victim, my_slot, iter)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+WEAK bool work_stealing_job_has_work(work *job) {
+    for (int i = 0; i < job->steal_slots_assigned; i++) {
+        uint64_t range;
+        Synchronization::atomic_load_acquire(job->steal_slots + i, &range);
+        if (range_begin(range) < range_end(range)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Run iterations of a work-stealing job until there are none left or
+// the job fails. If this thread is the owner of some other job, it
+// also returns as soon as that job completes, so that it is not held
+// up helping out elsewhere. Called without the work queue lock held.
+WEAK int run_work_stealing_job(work *job, int my_slot, int my_node, work *owned_job) {
+    uint32_t rng_state = 0x9e3779b9u * (uint32_t)(my_slot + 2);
+    int result = 0;
+    while (result == 0) {
+        int exit_status;
+        Synchronization::atomic_load_relaxed(&job->exit_status, &exit_status);
+        if (exit_status != 0) {
+            break;
+        }
+
+        if (owned_job && owned_job != job) {
+            // Unsynchronized peek. The owner rechecks under the lock.
+            int owned_extent, owned_workers;
+            Synchronization::atomic_load_relaxed(&owned_job->task.extent, &owned_extent);
+            Synchronization::atomic_load_relaxed(&owned_job->active_workers, &owned_workers);
+            if (owned_extent == 0 && owned_workers == 0) {
+                break;
+            }
+        }
+
+        uint32_t iter;
+        if ((my_slot < 0 || !claim_from_slot(job->steal_slots + my_slot, &iter)) &&
+            !steal_work(job, my_slot, my_node, &rng_state, &iter)) {
+            break;
+        }
+
+        int idx = job->task.min + (int)iter;
+        if (job->task_fn) {
+            result = halide_do_task(job->user_context, job->task_fn, idx, job->task.closure);
+        } else {
+            result = halide_do_loop_task(job->user_context, job->task.fn, idx, 1,
+                                         job->task.closure, job);
+        }
+    }
+    return result;
+}
+
+WEAK void remove_job_already_locked(work *job) {
+    work **prev_ptr = &work_queue.jobs;
+    while (*prev_ptr != job) {
+        prev_ptr = &((*prev_ptr)->next_job);
+    }
+    *prev_ptr = job->next_job;
+}
+
+WEAK int64_t qos_now() {
+    int64_t now = halide_current_time_ns(NULL);
+    return now < 0 ? 0 : now;
+}
+
+WEAK int qos_priority(work *job, int64_t now) {
+    int priority = job->qos >= 0 ?
+        work_queue.qos_tags[job->qos].priority : (int)halide_thread_pool_priority_normal;
+    if (!job->started || job->work_stealing) {
+        int64_t waited = now - job->waiting_since;
+        if (waited > 0) {
+            priority += (int)(waited / QOS_AGING_NS);
+        }
+    }
+    return priority;
+}
+
+// Whether taking on this job would exceed its tag's thread limit. Only
+// plain parallel loops are limited, as they can always be finished by
+// their owner. Owners joining their own job don't count.
+WEAK bool qos_over_quota(work *job, work *owned_job) {
+    if (job->qos < 0 || !job->work_stealing || job == owned_job) {
+        return false;
+    }
+    const qos_tag_t &tag = work_queue.qos_tags[job->qos];
+    return tag.max_threads > 0 && tag.active_workers >= tag.max_threads;
+}
+
 WEAK void worker_thread(void *);
 
 WEAK void worker_thread_already_locked(work *owned_job) {
@@ -220,6 +499,14 @@ WEAK void worker_thread_already_locked(work *owned_job) {
 
         dump_job_state();
 
+        // If any calls are tagged with a priority class, we look at
+        // every job and take the highest priority runnable one.
+        bool use_qos = work_queue.qos_tags_in_use > 0;
+        int64_t now = use_qos ? qos_now() : 0;
+        work *best_job = NULL;
+        work **best_prev_ptr = NULL;
+        int best_priority = -1;
+
         // Find a job to run, prefering things near the top of the stack.
         while (job) {
             print_job(job, "", "Considering job ");
@@ -256,17 +543,37 @@ WEAK void worker_thread_already_locked(work *owned_job) {
             if (!can_add_worker) {
                 log_message("Cannot add worker to job " << job->task.name);
             }              
+            bool within_quota = !use_qos || !qos_over_quota(job, owned_job);
+            if (!within_quota) {
+                log_message("Job " << job->task.name << " is at its thread limit.");
+            }
               
-            if (enough_threads && can_use_this_thread_stack && can_add_worker) {
-                if (job->make_runnable()) {
-                    break;
-                } else {
-                     log_message("Cannot acquire semaphores for " << job->task.name);
+            if (enough_threads && can_use_this_thread_stack && can_add_worker && within_quota) {
+                int priority = use_qos ? qos_priority(job, now) : 0;
+                if (use_qos && job->task.num_semaphores == 0) {
+                    if (priority > best_priority) {
+                        best_job = job;
+                        best_prev_ptr = prev_ptr;
+                        best_priority = priority;
+                    }
+                } else if (priority > best_priority) {
+                    // Acquiring the semaphores commits us to running
+                    // the job, so don't bother unless it's the best
+                    // candidate so far.
+                    if (job->make_runnable()) {
+                        best_job = job;
+                        best_prev_ptr = prev_ptr;
+                        break;
+                    } else {
+                         log_message("Cannot acquire semaphores for " << job->task.name);
+                    }
                 }
             }
             prev_ptr = &(job->next_job);
             job = job->next_job;
         }
+        job = best_job;
+        prev_ptr = best_prev_ptr;
 
         if (!job) {
             // There is no runnable job. Go to sleep.
@@ -298,6 +605,24 @@ WEAK void worker_thread_already_locked(work *owned_job) {
         // though there are no outstanding tasks for it.
         job->active_workers++;
 
+        int64_t qos_start = 0;
+        if (job->qos >= 0) {
+            qos_start = qos_now();
+            halide_thread_pool_qos_stats_t &stats =
+                work_queue.qos_stats[work_queue.qos_tags[job->qos].priority];
+            if (!job->started) {
+                uint64_t wait = qos_start - job->waiting_since;
+                stats.jobs++;
+                stats.queue_wait_time += wait;
+                stats.max_queue_wait_time = max(stats.max_queue_wait_time, wait);
+            }
+            if (job->work_stealing && job != owned_job) {
+                work_queue.qos_tags[job->qos].active_workers++;
+            }
+        }
+        job->started = true;
+        job->waiting_since = now;
+
         if (job->parent_job == NULL) {
             work_queue.threads_reserved += job->task.min_threads;
             log_message("Reserved " << job->task.min_threads << " on work queue for " << job->task.name << " giving " << work_queue.threads_reserved << " of " << work_queue.threads_created + 1);
@@ -308,7 +633,42 @@ WEAK void worker_thread_already_locked(work *owned_job) {
 
         int result = 0;
 
-        if (job->task.serial) {
+        if (job->work_stealing) {
+            int my_slot = -1;
+            int my_node = work_queue.numa_aware ? halide_host_current_numa_node() : -1;
+            if (job->steal_slots_assigned < MAX_STEAL_SLOTS) {
+                my_slot = job->steal_slots_assigned;
+                if (my_slot != 0) {
+                    job->steal_slots[my_slot] = 0;
+                }
+                job->steal_slot_node[my_slot] = (int8_t)(my_node < 0 ? 0 : my_node);
+                int assigned = my_slot + 1;
+                Synchronization::atomic_store_release(&job->steal_slots_assigned, &assigned);
+            }
+
+            // Release the lock and work on the job until its iterations
+            // run out.
+            halide_mutex_unlock(&work_queue.mutex);
+            result = run_work_stealing_job(job, my_slot, my_node, owned_job);
+            halide_mutex_lock(&work_queue.mutex);
+
+            // Retire the job from the stack once nothing is left to
+            // claim. Iterations a thief has taken but not yet published
+            // belong to a worker that is still active, and that worker
+            // will check again on its way out.
+            if (job->task.extent != 0) {
+                if (result != 0 || job->exit_status != 0 || !work_stealing_job_has_work(job)) {
+                    remove_job_already_locked(job);
+                    job->task.extent = 0;
+                } else if (owned_job && owned_job != job) {
+                    // We're leaving early to return to our own job, and
+                    // may have left iterations behind in our slot. Make
+                    // sure someone comes to pick them up.
+                    halide_cond_broadcast(&work_queue.wake_a_team);
+                    halide_cond_broadcast(&work_queue.wake_owners);
+                }
+            }
+        } else if (job->task.serial) {
             // Remove it from the stack while we work on it
             *prev_ptr = job->next_job;
 
@@ -345,7 +705,7 @@ WEAK void worker_thread_already_locked(work *owned_job) {
             }
         } else {
             // Claim a task from it.
-            work myjob = *job;
+            int idx = job->task.min;
             job->task.min++;
             job->task.extent--;
 
@@ -357,13 +717,12 @@ WEAK void worker_thread_already_locked(work *owned_job) {
 
             // Release the lock and do the task.
             halide_mutex_unlock(&work_queue.mutex);
-            if (myjob.task_fn) {
-                result = halide_do_task(myjob.user_context, myjob.task_fn,
-                                        myjob.task.min, myjob.task.closure);
+            if (job->task_fn) {
+                result = halide_do_task(job->user_context, job->task_fn,
+                                        idx, job->task.closure);
             } else {
-                result = halide_do_loop_task(myjob.user_context, myjob.task.fn,
-                                             myjob.task.min, 1,
-                                             myjob.task.closure, job);
+                result = halide_do_loop_task(job->user_context, job->task.fn,
+                                             idx, 1, job->task.closure, job);
             }
             halide_mutex_lock(&work_queue.mutex);
         }
@@ -372,6 +731,23 @@ WEAK void worker_thread_already_locked(work *owned_job) {
             log_message("Saw thread pool saw error from task: " << result);
         }
 
+        if (job->qos >= 0) {
+            work_queue.qos_stats[work_queue.qos_tags[job->qos].priority].execution_time +=
+                qos_now() - qos_start;
+            if (job->work_stealing && job != owned_job) {
+                qos_tag_t &tag = work_queue.qos_tags[job->qos];
+                if (tag.active_workers-- == tag.max_threads && job->task.extent != 0) {
+                    // Workers may have gone to sleep because this job
+                    // was at its thread limit.
+                    halide_cond_broadcast(&work_queue.wake_a_team);
+                }
+            }
+        }
+        if (use_qos) {
+            // Anything left over starts waiting again.
+            job->waiting_since = qos_now();
+        }
+
         bool wake_owners = false;
  
         // If this task failed, set the exit status on the job.
@@ -415,6 +791,57 @@ WEAK void worker_thread(void *arg) {
     halide_mutex_unlock(&work_queue.mutex);
 }
 
+// Entry point for worker threads in a NUMA-aware pool. The closure is
+// the cpu to pin to.
+WEAK void numa_worker_thread(void *arg) {
+    halide_host_pin_thread_to_cpu((int)(intptr_t)arg);
+    worker_thread(NULL);
+}
+
+// Choose a cpu for the given worker thread. Cpus are handed out in
+// order of NUMA node, so that the pool fills one node before moving on
+// to the next. The first cpu is left for the thread that calls into
+// the pool.
+WEAK int numa_cpu_for_worker(int worker) {
+    int cpus = halide_host_cpu_count();
+    if (cpus < 1) {
+        return -1;
+    }
+    int target = (worker + 1) % cpus;
+    for (int node = 0; ; node++) {
+        bool more_nodes = false;
+        for (int cpu = 0; cpu < cpus; cpu++) {
+            int cpu_node = halide_host_cpu_numa_node(cpu);
+            if (cpu_node == node) {
+                if (target-- == 0) {
+                    return cpu;
+                }
+            } else if (cpu_node > node) {
+                more_nodes = true;
+            }
+        }
+        if (!more_nodes) {
+            return -1;
+        }
+    }
+}
+
+WEAK void update_numa_aware_already_locked() {
+    if (!work_queue.numa_aware_setting) {
+        work_queue.numa_aware_setting = default_numa_aware() ? 2 : 1;
+    }
+    work_queue.numa_aware = (work_queue.numa_aware_setting == 2);
+    halide_host_set_numa_local_malloc(work_queue.numa_aware);
+}
+
+WEAK void update_huge_pages_already_locked() {
+    if (!work_queue.huge_page_setting) {
+        work_queue.huge_page_setting = default_huge_page_setting();
+    }
+    int setting = work_queue.huge_page_setting - 1;
+    halide_host_set_huge_page_malloc((setting & 1) != 0, (setting & 2) != 0);
+}
+
 WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_parent) {
     if (!work_queue.initialized) {
         work_queue.assert_zeroed();
@@ -426,6 +853,8 @@ WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_paren
             work_queue.desired_threads_working = default_desired_num_threads();
         }
         work_queue.desired_threads_working = clamp_num_threads(work_queue.desired_threads_working);
+        update_numa_aware_already_locked();
+        update_huge_pages_already_locked();
         work_queue.initialized = true;
     }
 
@@ -485,8 +914,14 @@ WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_paren
             // We might need to make some new threads, if work_queue.desired_threads_working has
             // increased, or if there aren't enough threads to complete this new task.
             work_queue.a_team_size++;
-            work_queue.threads[work_queue.threads_created++] =
-                halide_spawn_thread(worker_thread, NULL);
+            int cpu = work_queue.numa_aware ? numa_cpu_for_worker(work_queue.threads_created) : -1;
+            if (cpu >= 0) {
+                work_queue.threads[work_queue.threads_created++] =
+                    halide_spawn_thread(numa_worker_thread, (void *)(intptr_t)cpu);
+            } else {
+                work_queue.threads[work_queue.threads_created++] =
+                    halide_spawn_thread(worker_thread, NULL);
+            }
         }
         log_message("enqueue_work_already_locked top level job " << jobs[0].task.name << " with min_threads " << min_threads << " work_queue.threads_created " << work_queue.threads_created << " work_queue.threads_reserved " << work_queue.threads_reserved);
         if (job_has_acquires || job_may_block) {
@@ -501,6 +936,32 @@ WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_paren
         }
     }
 
+    // Tag the jobs for quality of service. Nested jobs inherit the tag
+    // of their parent, everything else is looked up by user context.
+    int qos = -1;
+    if (work_queue.qos_tags_in_use > 0) {
+        if (task_parent != NULL) {
+            qos = task_parent->qos;
+        } else {
+            for (int i = 0; i < MAX_QOS_TAGS; i++) {
+                if (work_queue.qos_tags[i].in_use &&
+                    work_queue.qos_tags[i].user_context == jobs[0].user_context) {
+                    qos = i;
+                    break;
+                }
+            }
+        }
+    }
+    int64_t now = work_queue.qos_tags_in_use > 0 ? qos_now() : 0;
+    for (int i = 0; i < num_jobs; i++) {
+        jobs[i].qos = qos;
+        jobs[i].waiting_since = now;
+        jobs[i].started = false;
+    }
+    if (qos >= 0) {
+        work_queue.qos_tags[qos].jobs += num_jobs;
+    }
+
     // Push the jobs onto the stack.
     for (int i = num_jobs - 1; i >= 0; i--) {
         // We could bubble it downwards based on some heuristics, but
@@ -543,6 +1004,13 @@ WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_paren
     }
 }
 
+// Called by the owner once its jobs are complete.
+WEAK void release_qos_already_locked(int num_jobs, work *jobs) {
+    if (jobs[0].qos >= 0) {
+        work_queue.qos_tags[jobs[0].qos].jobs -= num_jobs;
+    }
+}
+
 WEAK halide_do_task_t custom_do_task = halide_default_do_task;
 WEAK halide_do_loop_task_t custom_do_loop_task = halide_default_do_loop_task;
 WEAK halide_do_par_for_t custom_do_par_for = halide_default_do_par_for;
@@ -600,9 +1068,11 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
     job.siblings = &job; // guarantees no other job points to the same siblings.
     job.sibling_count = 0;
     job.parent_job = NULL;
+    job.init_work_stealing();
     halide_mutex_lock(&work_queue.mutex);
     enqueue_work_already_locked(1, &job, NULL);
     worker_thread_already_locked(&job);
+    release_qos_already_locked(1, &job);
     halide_mutex_unlock(&work_queue.mutex);
     return job.exit_status;
 }
@@ -626,6 +1096,7 @@ WEAK int halide_default_do_parallel_tasks(void *user_context, int num_tasks,
         jobs[i].next_semaphore = 0;
         jobs[i].owner_is_sleeping = false;
         jobs[i].parent_job = (work *)task_parent;
+        jobs[i].init_work_stealing();
     }
 
     if (num_tasks == 0) {
@@ -643,6 +1114,7 @@ WEAK int halide_default_do_parallel_tasks(void *user_context, int num_tasks,
             exit_status = jobs[i].exit_status;
         }
     }
+    release_qos_already_locked(num_tasks, jobs);
     halide_mutex_unlock(&work_queue.mutex);
     return exit_status;
 }
@@ -664,6 +1136,106 @@ WEAK int halide_set_num_threads(int n) {
     return old;
 }
 
+WEAK int halide_set_numa_aware_thread_pool(int enable) {
+    halide_mutex_lock(&work_queue.mutex);
+    int old = work_queue.numa_aware_setting ?
+        (work_queue.numa_aware_setting == 2) : default_numa_aware();
+    work_queue.numa_aware_setting = enable ? 2 : 1;
+    if (work_queue.initialized) {
+        update_numa_aware_already_locked();
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    return old;
+}
+
+WEAK void halide_init_huge_page_malloc() {
+    if (work_queue.huge_page_setting) {
+        return;
+    }
+    halide_mutex_lock(&work_queue.mutex);
+    if (!work_queue.huge_page_setting) {
+        update_huge_pages_already_locked();
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+}
+
+WEAK bool halide_set_huge_page_malloc(bool huge_pages, bool prefault) {
+    halide_mutex_lock(&work_queue.mutex);
+    work_queue.huge_page_setting = 1 + (huge_pages ? 1 : 0) + (prefault ? 2 : 0);
+    bool result = halide_host_set_huge_page_malloc(huge_pages, prefault);
+    halide_mutex_unlock(&work_queue.mutex);
+    return result;
+}
+
+WEAK int halide_set_thread_pool_qos(void *user_context, int priority, int max_threads) {
+    if (priority < 0) {
+        priority = 0;
+    } else if (priority >= halide_thread_pool_priority_count) {
+        priority = halide_thread_pool_priority_count - 1;
+    }
+    halide_start_clock(user_context);
+    halide_mutex_lock(&work_queue.mutex);
+    int free_tag = -1;
+    int tag = -1;
+    for (int i = 0; i < MAX_QOS_TAGS; i++) {
+        if (work_queue.qos_tags[i].in_use) {
+            if (work_queue.qos_tags[i].user_context == user_context) {
+                tag = i;
+                break;
+            }
+        } else if (free_tag < 0 && work_queue.qos_tags[i].jobs == 0) {
+            free_tag = i;
+        }
+    }
+    if (tag < 0) {
+        if (free_tag < 0) {
+            halide_mutex_unlock(&work_queue.mutex);
+            halide_error(user_context, "halide_set_thread_pool_qos: too many tagged user contexts.\n");
+            return halide_error_code_generic_error;
+        }
+        tag = free_tag;
+        work_queue.qos_tags[tag].active_workers = 0;
+        work_queue.qos_tags[tag].jobs = 0;
+        work_queue.qos_tags[tag].in_use = true;
+        work_queue.qos_tags_in_use++;
+    }
+    work_queue.qos_tags[tag].user_context = user_context;
+    work_queue.qos_tags[tag].priority = priority;
+    work_queue.qos_tags[tag].max_threads = max_threads < 0 ? 0 : max_threads;
+    halide_mutex_unlock(&work_queue.mutex);
+    return halide_error_code_success;
+}
+
+WEAK void halide_clear_thread_pool_qos(void *user_context) {
+    halide_mutex_lock(&work_queue.mutex);
+    for (int i = 0; i < MAX_QOS_TAGS; i++) {
+        qos_tag_t &tag = work_queue.qos_tags[i];
+        if (tag.in_use && tag.user_context == user_context) {
+            // Jobs in flight keep referring to the tag, so it can't be
+            // reused until they are done. See release_qos_already_locked.
+            tag.in_use = false;
+            work_queue.qos_tags_in_use--;
+        }
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+}
+
+WEAK int halide_thread_pool_qos_stats(int priority, halide_thread_pool_qos_stats_t *stats) {
+    if (priority < 0 || priority >= halide_thread_pool_priority_count) {
+        return halide_error_code_generic_error;
+    }
+    halide_mutex_lock(&work_queue.mutex);
+    *stats = work_queue.qos_stats[priority];
+    halide_mutex_unlock(&work_queue.mutex);
+    return halide_error_code_success;
+}
+
+WEAK void halide_reset_thread_pool_qos_stats() {
+    halide_mutex_lock(&work_queue.mutex);
+    memset(work_queue.qos_stats, 0, sizeof(work_queue.qos_stats));
+    halide_mutex_unlock(&work_queue.mutex);
+}
+
 WEAK void halide_shutdown_thread_pool() {
     if (work_queue.initialized) {
         // Wake everyone up and tell them the party's over and it's time
@@ -68,87 +68,362 @@ public:
     SharedExclusiveSpinLock() : lock(0) {}
 };
 
-const static int buffer_size = 1024 * 1024;
-
-class TraceBuffer {
+// Threads write packets into one of several stripes, picked by hashing
+// the address of the thread's stack (there is no thread-local storage
+// in the runtime), so that they rarely contend for a cursor. When a
+// stripe fills up, every stripe is retired at once and handed to a
+// background thread to write out, while the threads carry on writing
+// into a second set of stripes. Retiring all the stripes together
+// keeps the packets in the file close to the order they were traced
+// in.
+const static int trace_stripe_bits = 4;
+const static int trace_stripes = 1 << trace_stripe_bits;
+const static int stripe_size = 128 * 1024;
+
+struct TraceStripe {
     SharedExclusiveSpinLock lock;
     uint32_t cursor, overage;
-    uint8_t buf[buffer_size];
-
-    // Attempt to atomically acquire space in the buffer to write a
-    // packet. Returns NULL if the buffer was full.
-    __attribute__((always_inline)) halide_trace_packet_t *try_acquire_packet(void *user_context, uint32_t size) {
-        lock.acquire_shared();
-        halide_assert(user_context, size <= buffer_size);
-        uint32_t my_cursor = __sync_fetch_and_add(&cursor, size);
-        if (my_cursor + size > sizeof(buf)) {
+    uint8_t *buf;
+    // Keep stripes on separate cache lines.
+    uint8_t padding[64 - sizeof(SharedExclusiveSpinLock) - 2 * sizeof(uint32_t) - sizeof(uint8_t *)];
+};
+
+WEAK uint8_t *trace_put_varint(uint8_t *dst, uint32_t x) {
+    while (x >= 0x80) {
+        *dst++ = (uint8_t)(x | 0x80);
+        x >>= 7;
+    }
+    *dst++ = (uint8_t)x;
+    return dst;
+}
+
+WEAK uint8_t *trace_put_delta(uint8_t *dst, int32_t a, int32_t b) {
+    // Zig-zag encode the difference, so that small negative
+    // differences are also small.
+    int32_t d = (int32_t)((uint32_t)a - (uint32_t)b);
+    return trace_put_varint(dst, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+}
+
+// Delta code the packets in a stripe, in the format described in
+// HalideRuntime.h. The result is never more than one and a half times
+// the size of the input.
+WEAK uint8_t *trace_delta_code(const uint8_t *src, uint32_t bytes, uint8_t *dst) {
+    const halide_trace_packet_t *prev = NULL;
+    int32_t prev_id = 0;
+    for (uint32_t offset = 0; offset < bytes;) {
+        const halide_trace_packet_t *p = (const halide_trace_packet_t *)(src + offset);
+        dst = trace_put_delta(dst, p->id, prev_id);
+        *dst++ = p->type.code;
+        *dst++ = p->type.bits;
+        dst = trace_put_varint(dst, p->type.lanes);
+        dst = trace_put_varint(dst, (uint32_t)p->event);
+        dst = trace_put_delta(dst, p->id, p->parent_id);
+        dst = trace_put_varint(dst, (uint32_t)p->value_index);
+        dst = trace_put_varint(dst, (uint32_t)p->dimensions);
+        const int *coords = p->coordinates();
+        const int *prev_coords = (prev && prev->dimensions == p->dimensions) ? prev->coordinates() : NULL;
+        for (int i = 0; i < p->dimensions; i++) {
+            dst = trace_put_delta(dst, coords[i], prev_coords ? prev_coords[i] : 0);
+        }
+        uint32_t value_bytes = p->type.lanes * p->type.bytes();
+        memcpy(dst, p->value(), value_bytes);
+        dst += value_bytes;
+        if (prev && strcmp(prev->func(), p->func()) == 0) {
+            dst = trace_put_varint(dst, 0);
+        } else {
+            uint32_t name_bytes = strlen(p->func());
+            dst = trace_put_varint(dst, name_bytes + 1);
+            memcpy(dst, p->func(), name_bytes);
+            dst += name_bytes;
+        }
+        uint32_t trace_tag_bytes = strlen(p->trace_tag());
+        dst = trace_put_varint(dst, trace_tag_bytes);
+        memcpy(dst, p->trace_tag(), trace_tag_bytes);
+        dst += trace_tag_bytes;
+        prev = p;
+        prev_id = p->id;
+        offset += p->size;
+    }
+    return dst;
+}
+
+WEAK void trace_flusher_main(void *);
+
+// Defined by the thread pool module. False when threads can't be
+// spawned, in which case stripes are written out synchronously.
+extern bool halide_can_spawn_threads;
+
+class TraceBuffer {
+    TraceStripe stripes[trace_stripes];
+
+    // Two sets of storage for the stripes. Threads write packets into
+    // the active one while the flusher writes out the other.
+    uint8_t *storage[2];
+    int active;
+
+    // Incremented every time the stripes are retired.
+    volatile uint32_t generation;
+
+    // Whether the inactive storage holds packets not yet written out,
+    // and how many bytes of them there are in each stripe.
+    bool retired;
+    uint32_t retired_bytes[trace_stripes];
+    int retired_fd;
+
+    // Space to delta code a stripe into, if compressing.
+    uint8_t *scratch;
+
+    halide_mutex mutex;
+    halide_cond cond;
+    halide_thread *flusher;
+    bool shutting_down;
+
+    __attribute__((always_inline)) TraceStripe *stripe_for_this_thread() {
+        int on_stack;
+        uint32_t h = (uint32_t)((uintptr_t)&on_stack >> 20);
+        h *= 0x9E3779B1u;
+        return &stripes[h >> (32 - trace_stripe_bits)];
+    }
+
+    // Attempt to atomically acquire space in a stripe to write a
+    // packet. Returns NULL if the stripe was full.
+    __attribute__((always_inline)) halide_trace_packet_t *try_acquire_packet(void *user_context, TraceStripe *stripe, uint32_t size) {
+        stripe->lock.acquire_shared();
+        halide_assert(user_context, size <= stripe_size);
+        uint32_t my_cursor = __sync_fetch_and_add(&stripe->cursor, size);
+        if (my_cursor + size > stripe_size) {
             // Don't try to back it out: instead, just allow this request to fail
             // (along with all subsequent requests) and record the 'overage'
-            // that was added and should be ignored; then, in the next flush,
-            // remove the overage.
-            __sync_fetch_and_add(&overage, size);
-            lock.release_shared();
+            // that was added and should be ignored; then, when the stripe is
+            // retired, remove the overage.
+            __sync_fetch_and_add(&stripe->overage, size);
+            stripe->lock.release_shared();
             return NULL;
         } else {
-            return (halide_trace_packet_t *)(buf + my_cursor);
+            return (halide_trace_packet_t *)(stripe->buf + my_cursor);
+        }
+    }
+
+    // Write out the retired stripes, one block each.
+    void write_retired(void *user_context) {
+        for (int i = 0; i < trace_stripes; i++) {
+            uint32_t bytes = retired_bytes[i];
+            if (!bytes) {
+                continue;
+            }
+            const uint8_t *packets = storage[1 - active] + i * stripe_size;
+            halide_trace_block_t block;
+            block.magic = halide_trace_block_magic;
+            block.flags = 0;
+            if (scratch) {
+                uint8_t *end = trace_delta_code(packets, bytes, scratch);
+                block.flags |= halide_trace_block_delta_coded;
+                bytes = (uint32_t)(end - scratch);
+                // Keep blocks aligned to four bytes.
+                while (bytes & 3) {
+                    scratch[bytes++] = 0;
+                }
+                block.size = (uint32_t)(end - scratch);
+                packets = scratch;
+            } else {
+                block.size = bytes;
+            }
+            bool success = (sizeof(block) == (size_t)write(retired_fd, &block, sizeof(block)) &&
+                            bytes == (uint32_t)write(retired_fd, packets, bytes));
+            halide_assert(user_context, success && "Could not write to trace file");
+        }
+    }
+
+    // Swap the active storage for the retired storage, once the
+    // flusher has finished with it. Does nothing if the stripes have
+    // been retired since the caller saw the given generation. Must be
+    // called with the mutex held.
+    void retire_already_locked(void *user_context, int fd, uint32_t seen_generation) {
+        while (seen_generation == generation && retired) {
+            if (flusher) {
+                halide_cond_wait(&cond, &mutex);
+            } else {
+                write_retired(user_context);
+                retired = false;
+            }
+        }
+        if (seen_generation != generation) {
+            return;
+        }
+
+        // Wait for all writers to finish with their packets, stall
+        // any new writers, and point each stripe at the new storage.
+        uint8_t *next = storage[1 - active];
+        for (int i = 0; i < trace_stripes; i++) {
+            TraceStripe *stripe = &stripes[i];
+            stripe->lock.acquire_exclusive();
+            retired_bytes[i] = stripe->cursor - stripe->overage;
+            stripe->cursor = 0;
+            stripe->overage = 0;
+            stripe->buf = next + i * stripe_size;
+            stripe->lock.release_exclusive();
+        }
+        active = 1 - active;
+        retired = true;
+        retired_fd = fd;
+        generation++;
+
+        if (flusher) {
+            halide_cond_broadcast(&cond);
+        } else {
+            write_retired(user_context);
+            retired = false;
         }
     }
 
 public:
 
-    // Wait for all writers to finish with their packets, stall any
-    // new writers, and flush the buffer to the fd.
-    __attribute__((always_inline)) void flush(void *user_context, int fd) {
-        lock.acquire_exclusive();
-        bool success = true;
-        if (cursor) {
-            cursor -= overage;
-            success = (cursor == (uint32_t)write(fd, buf, cursor));
-            cursor = 0;
-            overage = 0;
+    // Allocate the storage and start the flusher, if threads are
+    // available. The file starts with a block marking the start of a
+    // stream of packets.
+    __attribute__((always_inline)) bool init(void *user_context, int fd) {
+        storage[0] = (uint8_t *)malloc(2 * trace_stripes * stripe_size);
+        if (!storage[0]) {
+            return false;
+        }
+        storage[1] = storage[0] + trace_stripes * stripe_size;
+        for (int i = 0; i < trace_stripes; i++) {
+            stripes[i].buf = storage[0] + i * stripe_size;
         }
-        lock.release_exclusive();
+        const char *compress = getenv("HL_TRACE_COMPRESS");
+        if (compress && atoi(compress)) {
+            scratch = (uint8_t *)malloc(stripe_size + stripe_size / 2 + 4);
+        }
+
+        halide_trace_block_t block;
+        block.magic = halide_trace_block_magic;
+        block.flags = halide_trace_block_stream_start;
+        block.size = 0;
+        bool success = (sizeof(block) == (size_t)write(fd, &block, sizeof(block)));
         halide_assert(user_context, success && "Could not write to trace file");
+
+        retired_fd = fd;
+        if (halide_can_spawn_threads) {
+            flusher = halide_spawn_thread(trace_flusher_main, this);
+        }
+        return true;
     }
 
-    // Acquire and return a packet's worth of space in the trace
-    // buffer, flushing the trace buffer to the given fd to make space
-    // if necessary. The region acquired is protected from other
-    // threads writing or reading to it, so it must be released before
-    // a flush can occur.
-    __attribute__((always_inline)) halide_trace_packet_t *acquire_packet(void *user_context, int fd, uint32_t size) {
+    // Write out everything traced so far, and wait for it to reach
+    // the fd.
+    __attribute__((always_inline)) void flush(void *user_context, int fd) {
+        halide_mutex_lock(&mutex);
+        retire_already_locked(user_context, fd, generation);
+        while (retired) {
+            halide_cond_wait(&cond, &mutex);
+        }
+        halide_mutex_unlock(&mutex);
+    }
+
+    // Acquire and return a packet's worth of space in this thread's
+    // stripe, retiring the stripes to make space if necessary. The
+    // region acquired is protected from being retired, so it must be
+    // released before a flush can occur.
+    __attribute__((always_inline)) halide_trace_packet_t *acquire_packet(void *user_context, int fd, uint32_t size, TraceStripe **stripe) {
+        *stripe = stripe_for_this_thread();
         halide_trace_packet_t *packet = NULL;
-        while (!(packet = try_acquire_packet(user_context, size))) {
-            // Couldn't acquire space to write a packet. Flush and try again.
-            flush(user_context, fd);
+        while (true) {
+            uint32_t seen_generation = generation;
+            if ((packet = try_acquire_packet(user_context, *stripe, size))) {
+                return packet;
+            }
+            // Couldn't acquire space to write a packet. Retire the
+            // stripes and try again.
+            halide_mutex_lock(&mutex);
+            retire_already_locked(user_context, fd, seen_generation);
+            halide_mutex_unlock(&mutex);
         }
-        return packet;
     }
 
     // Release a packet, allowing it to be written out with flush
-    __attribute__((always_inline)) void release_packet(halide_trace_packet_t *) {
+    __attribute__((always_inline)) void release_packet(TraceStripe *stripe, halide_trace_packet_t *) {
         // Need a memory barrier to guarantee all the writes are done.
         __sync_synchronize();
-        lock.release_shared();
+        stripe->lock.release_shared();
     }
 
-    TraceBuffer() : cursor(0), overage(0) {}
+    // Runs on the flusher thread, writing out retired stripes as they
+    // come in.
+    void flusher_loop() {
+        halide_mutex_lock(&mutex);
+        while (true) {
+            if (retired) {
+                halide_mutex_unlock(&mutex);
+                write_retired(NULL);
+                halide_mutex_lock(&mutex);
+                retired = false;
+                halide_cond_broadcast(&cond);
+            } else if (shutting_down) {
+                break;
+            } else {
+                halide_cond_wait(&cond, &mutex);
+            }
+        }
+        halide_mutex_unlock(&mutex);
+    }
+
+    // Write out everything, stop the flusher, and free the storage.
+    __attribute__((always_inline)) void shutdown(void *user_context) {
+        flush(user_context, retired_fd);
+        if (flusher) {
+            halide_mutex_lock(&mutex);
+            shutting_down = true;
+            halide_cond_broadcast(&cond);
+            halide_mutex_unlock(&mutex);
+            halide_join_thread(flusher);
+            flusher = NULL;
+        }
+        free(storage[0]);
+        if (scratch) {
+            free(scratch);
+        }
+    }
 };
 
+WEAK void trace_flusher_main(void *arg) {
+    ((TraceBuffer *)arg)->flusher_loop();
+}
+
 WEAK TraceBuffer *halide_trace_buffer = NULL;
 WEAK int halide_trace_file = -1; // -1 indicates uninitialized
 WEAK int halide_trace_file_lock = 0;
 WEAK bool halide_trace_file_initialized = false;
 WEAK void *halide_trace_file_internally_opened = NULL;
 
+// Packet ids start again from one with each stream, which is what
+// readers of the trace file expect after a stream start block.
+WEAK int32_t halide_trace_next_id = 1;
+
+// Set up the trace buffer the first time a binary trace is written.
+WEAK TraceBuffer *trace_buffer_for_fd(void *user_context, int fd) {
+    if (halide_trace_buffer) {
+        return halide_trace_buffer;
+    }
+    ScopedSpinLock lock(&halide_trace_file_lock);
+    if (!halide_trace_buffer) {
+        // The buffer is not constructed; every field starts out zero.
+        TraceBuffer *buffer = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+        halide_assert(user_context, buffer && "Could not allocate trace buffer");
+        memset(buffer, 0, sizeof(TraceBuffer));
+        bool success = buffer->init(user_context, fd);
+        halide_assert(user_context, success && "Could not allocate trace buffer");
+        __sync_synchronize();
+        halide_trace_buffer = buffer;
+    }
+    return halide_trace_buffer;
+}
+
 }}}
 
 extern "C" {
 
 WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t *e) {
-    static int32_t ids = 1;
-
-    int32_t my_id = __sync_fetch_and_add(&ids, 1);
+    int32_t my_id = __sync_fetch_and_add(&halide_trace_next_id, 1);
 
     // If we're dumping to a file, use a binary format
     int fd = halide_get_trace_file(user_context);
@@ -163,7 +438,9 @@ WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t
         uint32_t total_size = (total_size_without_padding + 3) & ~3;
 
         // Claim some space to write to in the trace buffer
-        halide_trace_packet_t *packet = halide_trace_buffer->acquire_packet(user_context, fd, total_size);
+        TraceBuffer *trace_buffer = trace_buffer_for_fd(user_context, fd);
+        TraceStripe *stripe;
+        halide_trace_packet_t *packet = trace_buffer->acquire_packet(user_context, fd, total_size, &stripe);
 
         if (total_size > 4096) {
             print(NULL) << total_size << "\n";
@@ -187,12 +464,12 @@ WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t
         memcpy((void *)packet->trace_tag(), e->trace_tag ? e->trace_tag : "", trace_tag_bytes);
 
         // Release it
-        halide_trace_buffer->release_packet(packet);
+        trace_buffer->release_packet(stripe, packet);
 
         // We should also flush the trace buffer if we hit an event
         // that might be the end of the trace.
         if (e->event == halide_trace_end_pipeline) {
-            halide_trace_buffer->flush(user_context, fd);
+            trace_buffer->flush(user_context, fd);
         }
 
     } else {
@@ -335,9 +612,6 @@ WEAK int halide_get_trace_file(void *user_context) {
             halide_assert(user_context, file && "Failed to open trace file\n");
             halide_set_trace_file(fileno(file));
             halide_trace_file_internally_opened = file;
-            if (!halide_trace_buffer) {
-                halide_trace_buffer = (TraceBuffer *)malloc(sizeof(TraceBuffer));
-            }
         } else {
             halide_set_trace_file(0);
         }
@@ -350,14 +624,17 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event_t *e) {
 }
 
 WEAK int halide_shutdown_trace() {
+    if (halide_trace_buffer) {
+        halide_trace_buffer->shutdown(NULL);
+        free(halide_trace_buffer);
+        halide_trace_buffer = NULL;
+        halide_trace_next_id = 1;
+    }
     if (halide_trace_file_internally_opened) {
         int ret = fclose(halide_trace_file_internally_opened);
         halide_trace_file = 0;
         halide_trace_file_initialized = false;
         halide_trace_file_internally_opened = NULL;
-        if (halide_trace_buffer) {
-            free(halide_trace_buffer);
-        }
         return ret;
     } else {
         return 0;
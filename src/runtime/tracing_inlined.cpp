@@ -0,0 +1,21 @@
+#include "HalideRuntime.h"
+
+extern "C" {
+
+// Decide whether to trace a load or store filtered with
+// Func::trace_every or Func::trace_first. The counter holds the number
+// of such events seen so far in this run of the pipeline. Returns
+// nonzero for the first of every `every` events, up to `limit` events.
+WEAK __attribute__((always_inline)) int halide_trace_sample(int32_t *counter, int32_t every, int32_t limit) {
+    uint32_t *c = (uint32_t *)counter;
+    uint32_t lim = limit > 0 ? (uint32_t)limit : 0;
+    // Once past the limit, stop incrementing the counter, so that
+    // threads don't fight over its cache line.
+    if (*(volatile uint32_t *)c >= lim) {
+        return 0;
+    }
+    uint32_t n = __sync_fetch_and_add(c, 1);
+    return n < lim && (every <= 1 || n % (uint32_t)every == 0);
+}
+
+}
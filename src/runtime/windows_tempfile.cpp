@@ -43,4 +43,13 @@ WEAK int halide_create_temp_file(void *user_context, const char *prefix, const c
     return 0;
 }
 
+// The memoization cache's persistent tier is not yet supported on
+// Windows.
+WEAK void *halide_map_shared_file(void *user_context, const char *path, size_t size) {
+    return NULL;
+}
+
+WEAK void halide_unmap_shared_file(void *user_context, void *addr, size_t size) {
+}
+
 }  // extern "C"
@@ -0,0 +1,95 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// A cost model that counts how often it's consulted, and otherwise
+// defers to the default one.
+class CountingCostModel : public AutoScheduleCostModel {
+    std::shared_ptr<AutoScheduleCostModel> model = default_auto_schedule_cost_model();
+
+public:
+    int evaluations = 0;
+
+    double evaluate(const std::vector<AutoScheduleStageFeatures> &stages,
+                    const MachineParams &params) override {
+        evaluations++;
+        return model->evaluate(stages, params);
+    }
+};
+
+Func make_pipeline(Buffer<float> input) {
+    Var x("x"), y("y");
+
+    Func in_b = BoundaryConditions::repeat_edge(input);
+
+    Func blur_x("blur_x"), blur_y("blur_y"), sharpen("sharpen"), hist("hist"), out("out");
+    blur_x(x, y) = (in_b(x - 1, y) + in_b(x, y) * 2 + in_b(x + 1, y)) / 4;
+    blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) * 2 + blur_x(x, y + 1)) / 4;
+    sharpen(x, y) = 2 * in_b(x, y) - blur_y(x, y);
+
+    RDom r(0, 16);
+    hist(x, y) = 0.0f;
+    hist(x, y) += sharpen(x, y) * r;
+
+    out(x, y) = hist(x, y) + sqrt(abs(sharpen(x, y)));
+
+    out.estimate(x, 0, input.width()).estimate(y, 0, input.height());
+    return out;
+}
+
+int main(int argc, char **argv) {
+    const int W = 1536, H = 2560;
+    Buffer<float> input(W, H);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = rand() & 0xfff;
+        }
+    }
+
+    Target target = get_jit_target_from_environment();
+
+    // The default auto-scheduler.
+    Pipeline p1(make_pipeline(input));
+    p1.auto_schedule(target);
+    p1.compile_jit(target);
+    Buffer<float> out1(W, H);
+    double t1 = benchmark(3, 3, [&]() { p1.realize(out1); });
+
+    // The beam search auto-scheduler.
+    auto model = std::make_shared<CountingCostModel>();
+    BeamSearchOptions options;
+    options.cost_model = model;
+    Pipeline::set_custom_auto_scheduler(beam_search_auto_scheduler(options));
+    Pipeline p2(make_pipeline(input));
+    std::string schedule = p2.auto_schedule(target);
+    Pipeline::set_custom_auto_scheduler(nullptr);
+    printf("%s\n", schedule.c_str());
+
+    if (model->evaluations == 0) {
+        printf("The custom cost model was never consulted\n");
+        return -1;
+    }
+
+    p2.compile_jit(target);
+    Buffer<float> out2(W, H);
+    double t2 = benchmark(3, 3, [&]() { p2.realize(out2); });
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            float a = out1(x, y), b = out2(x, y);
+            if (std::abs(a - b) > 1e-3f * std::max(1.0f, std::abs(a))) {
+                printf("out(%d, %d) = %f with the beam search schedule instead of %f\n",
+                       x, y, b, a);
+                return -1;
+            }
+        }
+    }
+
+    printf("Default auto-scheduler: %f ms\n", t1 * 1e3);
+    printf("Beam search auto-scheduler: %f ms\n", t2 * 1e3);
+
+    printf("Success!\n");
+    return 0;
+}
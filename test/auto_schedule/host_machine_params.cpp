@@ -0,0 +1,75 @@
+#include "Halide.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    MachineParams host = MachineParams::host();
+    printf("Host MachineParams: %s\n", host.to_string().c_str());
+
+    if (host.parallelism < 1 || host.last_level_cache_size == 0 || host.balance < 1) {
+        printf("Implausible host MachineParams\n");
+        return -1;
+    }
+
+    if (host.l1_cache_size != 0 &&
+        !(host.l1_cache_size < host.l2_cache_size &&
+          host.l2_cache_size < host.last_level_cache_size)) {
+        printf("Cache sizes should increase with each level\n");
+        return -1;
+    }
+
+    // The string form should round-trip, and "host" should give the
+    // same parameters.
+    for (const std::string &s : {host.to_string(), std::string("host")}) {
+        MachineParams p(s);
+        if (p.to_string() != host.to_string()) {
+            printf("Parsing \"%s\" gave %s instead of %s\n",
+                   s.c_str(), p.to_string().c_str(), host.to_string().c_str());
+            return -1;
+        }
+    }
+
+    // The three-field form from before the cache levels were added
+    // should still parse, with the extra levels unknown.
+    MachineParams old("8,8388608,40");
+    if (old.l1_cache_size != 0 || old.l2_cache_size != 0 ||
+        old.to_string() != "8,8388608,40") {
+        printf("Parsing three-field MachineParams gave %s\n", old.to_string().c_str());
+        return -1;
+    }
+
+    const int W = 1024, H = 1024;
+    Buffer<float> input(W + 2, H + 2);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = rand() & 0xfff;
+        }
+    }
+
+    Var x("x"), y("y");
+    Func blur_x("blur_x"), blur_y("blur_y");
+    blur_x(x, y) = (input(x, y) + input(x + 1, y) + input(x + 2, y)) / 3;
+    blur_y(x, y) = (blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2)) / 3;
+    blur_y.estimate(x, 0, W).estimate(y, 0, H);
+
+    Target target = get_jit_target_from_environment();
+    Pipeline p(blur_y);
+    p.auto_schedule(target, host);
+    Buffer<float> out = p.realize(W, H, target);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            float bx0 = (input(x, y) + input(x + 1, y) + input(x + 2, y)) / 3;
+            float bx1 = (input(x, y + 1) + input(x + 1, y + 1) + input(x + 2, y + 1)) / 3;
+            float bx2 = (input(x, y + 2) + input(x + 1, y + 2) + input(x + 2, y + 2)) / 3;
+            float correct = (bx0 + bx1 + bx2) / 3;
+            if (std::abs(out(x, y) - correct) > 1e-3f) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "Halide.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int N = 1 << 20;
+    Buffer<float> input(N);
+    for (int i = 0; i < N; i++) {
+        input(i) = (rand() % 1024) / 1024.0f;
+    }
+
+    Target target = get_jit_target_from_environment();
+
+    {
+        // A full reduction has no pure dimensions to parallelize over, so
+        // it should be rfactored.
+        Func sum("sum");
+        RDom r(0, N);
+        sum() = 0.0f;
+        sum() += input(r);
+
+        Pipeline p(sum);
+        std::string schedule = p.auto_schedule(target);
+        if (schedule.find("rfactor") == std::string::npos ||
+            schedule.find("parallel") == std::string::npos) {
+            printf("Expected a parallel rfactor of sum:\n%s\n", schedule.c_str());
+            return -1;
+        }
+
+        Buffer<float> out = p.realize(target);
+        double correct = 0;
+        for (int i = 0; i < N; i++) {
+            correct += input(i);
+        }
+        if (std::abs(out() - correct) > 1e-3 * correct) {
+            printf("sum = %f instead of %f\n", out(), correct);
+            return -1;
+        }
+    }
+
+    {
+        // A histogram scatters, so it can't be vectorized, but it can still
+        // be rfactored and parallelized.
+        Func hist("hist");
+        Var x("x");
+        RDom r(0, N);
+        hist(x) = 0;
+        hist(clamp(cast<int>(input(r) * 16), 0, 15)) += 1;
+        hist.estimate(x, 0, 16);
+
+        Pipeline p(hist);
+        std::string schedule = p.auto_schedule(target);
+        if (schedule.find("rfactor") == std::string::npos) {
+            printf("Expected an rfactor of hist:\n%s\n", schedule.c_str());
+            return -1;
+        }
+
+        Buffer<int> out = p.realize(16, target);
+        int correct[16] = {0};
+        for (int i = 0; i < N; i++) {
+            correct[std::min(std::max((int)(input(i) * 16), 0), 15)]++;
+        }
+        for (int i = 0; i < 16; i++) {
+            if (out(i) != correct[i]) {
+                printf("hist(%d) = %d instead of %d\n", i, out(i), correct[i]);
+                return -1;
+            }
+        }
+    }
+
+    {
+        // A reduction with plenty of parallelism in its pure dimensions
+        // should be left alone.
+        Func rows("rows");
+        Var x("x"), y("y");
+        RDom r(0, 1024);
+        rows(y) = 0.0f;
+        rows(y) += input(r + y * 1024);
+        rows.estimate(y, 0, 1024);
+
+        Pipeline p(rows);
+        std::string schedule = p.auto_schedule(target);
+        if (schedule.find("rfactor") != std::string::npos) {
+            printf("Unexpected rfactor of rows:\n%s\n", schedule.c_str());
+            return -1;
+        }
+        Buffer<float> out = p.realize(1024, target);
+        for (int y = 0; y < 1024; y++) {
+            float correct = 0;
+            for (int i = 0; i < 1024; i++) {
+                correct += input(i + y * 1024);
+            }
+            if (std::abs(out(y) - correct) > 1e-3f * correct) {
+                printf("rows(%d) = %f instead of %f\n", y, out(y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "Halide.h"
+
+using namespace Halide;
+
+// Build a chain of 3x3 blurs, which the auto-scheduler should compute in
+// sliding windows within the tiles of the output. If 'root' is true, all
+// the stages are computed at root instead.
+Func make_chain(Buffer<float> input, int stages, bool root = false) {
+    Var x("x"), y("y");
+
+    Func f = BoundaryConditions::repeat_edge(input);
+    for (int i = 0; i < stages; i++) {
+        Func g("stage_" + std::to_string(i));
+        Expr sum = 0.0f;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                sum += f(x + dx, y + dy);
+            }
+        }
+        g(x, y) = sum / 9;
+        if (root) {
+            g.compute_root();
+        }
+        f = g;
+    }
+    f.estimate(x, 0, input.width()).estimate(y, 0, input.height());
+    return f;
+}
+
+int check(const std::string &name, Buffer<float> out, Buffer<float> correct) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (std::abs(out(x, y) - correct(x, y)) > 1e-3f) {
+                printf("%s: out(%d, %d) = %f instead of %f\n",
+                       name.c_str(), x, y, out(x, y), correct(x, y));
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const int W = 1536, H = 2048, stages = 6;
+    Buffer<float> input(W, H);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = rand() & 0xfff;
+        }
+    }
+
+    Target target = get_jit_target_from_environment();
+
+    // Everything at root, to compare against.
+    Func reference = make_chain(input, stages, true);
+    Buffer<float> correct = reference.realize(W, H, target);
+
+    {
+        Pipeline p(make_chain(input, stages));
+        std::string schedule = p.auto_schedule(target);
+        if (schedule.find("store_at") == std::string::npos) {
+            printf("Expected some stages to slide:\n%s\n", schedule.c_str());
+            return -1;
+        }
+        Buffer<float> out = p.realize(W, H, target);
+        if (check("sliding", out, correct)) {
+            return -1;
+        }
+    }
+
+    {
+        // With more cores than tiles, the sliding stages should still
+        // slide, and also run asynchronously.
+        Pipeline p(make_chain(input, stages));
+        std::string schedule = p.auto_schedule(target, MachineParams(100000, 16 * 1024 * 1024, 40));
+        if (schedule.find("store_at") == std::string::npos ||
+            schedule.find("async") == std::string::npos) {
+            printf("Expected the stages to slide asynchronously:\n%s\n", schedule.c_str());
+            return -1;
+        }
+        Buffer<float> out = p.realize(W, H, target);
+        if (check("async", out, correct)) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <atomic>
+
+using namespace Halide;
+
+// Check that the arena_alloc target feature serves repeated scratch
+// allocations from a few large blocks, and gives them all back.
+
+std::atomic<int> malloc_count;
+std::atomic<int> free_count;
+
+void *my_malloc(void *user_context, size_t x) {
+    malloc_count++;
+    void *orig = malloc(x+64);
+    void *ptr = (void *)((((size_t)orig + 64) >> 6) << 6);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free_count++;
+    free(((void**)ptr)[-1]);
+}
+
+bool error_occurred = false;
+void my_error_handler(void *user_context, const char *) {
+    error_occurred = true;
+}
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment().with_feature(Target::ArenaAlloc);
+
+    {
+        Func f, g;
+        Var x, y;
+
+        // g is allocated and freed once per row of f, with a size that
+        // depends on the output width, so it lives on the heap.
+        g(x, y) = x * y;
+        f(x, y) = g(x, y) + g(x + 1, y);
+        g.compute_at(f, y);
+        f.parallel(y);
+
+        f.set_custom_allocator(my_malloc, my_free);
+
+        malloc_count = 0;
+        free_count = 0;
+
+        const int rows = 256;
+        Buffer<int> im = f.realize(1000, rows, t);
+
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < 1000; x++) {
+                int correct = x * y + (x + 1) * y;
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+
+        printf("%d mallocs, %d frees for %d allocations\n",
+               (int)malloc_count, (int)free_count, rows);
+
+        if (malloc_count != free_count) {
+            printf("Arena leaked memory\n");
+            return -1;
+        }
+
+        // Without the arena there would be one malloc per row.
+        if (malloc_count >= rows / 4) {
+            printf("Arena did not recycle allocations\n");
+            return -1;
+        }
+    }
+
+    {
+        // An assertion failure partway through the pipeline must
+        // still free everything the arena allocated.
+        Func f, g, h;
+        Var x;
+
+        f(x) = x;
+        f.compute_root();
+        g(x) = f(x) + 1;
+        g.compute_root();
+        h(x) = g(x) + 1;
+
+        int g_size = 100000;
+        g.bound(x, 0, g_size);
+
+        h.set_custom_allocator(my_malloc, my_free);
+        h.set_error_handler(my_error_handler);
+
+        malloc_count = 0;
+        free_count = 0;
+
+        Buffer<int> im = h.realize(g_size + 100, t);
+
+        if (!error_occurred || malloc_count != free_count) {
+            printf("Arena leaked memory on error: %d mallocs, %d frees\n",
+                   (int)malloc_count, (int)free_count);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "Halide.h"
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+// Check that HL_COMPILE_TIME_REPORT records the lowering passes and
+// LLVM phases of each JIT compilation, one JSON object per line.
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Test skipped on windows due to use of setenv\n");
+#else
+    std::string report_file = Internal::get_test_tmp_dir() + "compile_time_report.json";
+    Internal::ensure_no_file_exists(report_file);
+    setenv("HL_COMPILE_TIME_REPORT", report_file.c_str(), 1);
+    // A pipeline loaded from the JIT cache isn't lowered at all.
+    set_jit_cache_directory("");
+
+    Func f("f");
+    Var x("x");
+    f(x) = x * 2;
+    f.vectorize(x, 8);
+    f.compile_jit();
+
+    // A second compilation is appended to the report.
+    Func g("g");
+    g(x) = x * 3;
+    g.compile_jit();
+
+    Internal::assert_file_exists(report_file);
+    std::ifstream in(report_file);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string report = contents.str();
+
+    const char *expected[] = {
+        "\"pass\": \"schedule_functions\"",
+        "\"pass\": \"vectorize_loops\"",
+        "\"pass\": \"optimize_module\"",
+        "\"pass\": \"mcjit_codegen\"",
+        "\"pipeline\": \"f\"",
+        "\"pipeline\": \"g\"",
+        "\"process_peak_rss_bytes\""};
+    for (const char *e : expected) {
+        if (report.find(e) == std::string::npos) {
+            printf("Did not find %s in the compile time report:\n%s\n", e, report.c_str());
+            return -1;
+        }
+    }
+
+    // Each line is a single pass.
+    std::istringstream lines(report);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.empty() || line.front() != '{' || line.back() != '}' ||
+            line.find("\"pass\": ") == std::string::npos) {
+            printf("Unexpected line in the compile time report: %s\n", line.c_str());
+            return -1;
+        }
+    }
+#endif
+
+    printf("Success!\n");
+    return 0;
+}
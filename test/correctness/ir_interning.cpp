@@ -0,0 +1,74 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Check that with HL_INTERN_IR set, equal Exprs share a node, and
+// that pipelines still compile and run correctly.
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Test skipped on windows due to use of setenv\n");
+#else
+    setenv("HL_INTERN_IR", "1", 1);
+    if (!ir_interning_enabled()) {
+        // Some Expr was made before main ran.
+        printf("Test skipped because IR interning could not be enabled\n");
+        printf("Success!\n");
+        return 0;
+    }
+
+    Var x("x"), y("y");
+
+    {
+        Expr a = (x + 3) * y;
+        Expr b = (x + 3) * y;
+        if (!a.same_as(b)) {
+            printf("Equal Exprs were not interned to the same node\n");
+            return -1;
+        }
+        Expr c = (x + 4) * y;
+        if (a.same_as(c) || equal(a, c) || !equal(a, b)) {
+            printf("Unequal Exprs were interned to the same node\n");
+            return -1;
+        }
+        // Positive and negative zero compare equal but are distinct
+        // constants.
+        Expr p = cast<float>(x) + 0.0f;
+        Expr n = cast<float>(x) + (-0.0f);
+        if (p.same_as(n) || !equal(p, n)) {
+            printf("Signed zeros were not kept apart\n");
+            return -1;
+        }
+        // Impure calls are never shared.
+        Expr r1 = random_float();
+        Expr r2 = random_float();
+        if (r1.same_as(r2)) {
+            printf("Impure calls were interned to the same node\n");
+            return -1;
+        }
+    }
+
+    {
+        Func f("f"), g("g");
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) * 2 + f(x + 1, y);
+        g.vectorize(x, 8).parallel(y);
+        Buffer<int> out = g.realize(32, 32);
+        for (int j = 0; j < out.height(); j++) {
+            for (int i = 0; i < out.width(); i++) {
+                int correct = (i + j) * 2 + (i + 1 + j);
+                if (out(i, j) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", i, j, out(i, j), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+#endif
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+using namespace Halide;
+
+// Check that a pipeline JIT compiled a second time with the same
+// algorithm and schedule is loaded from the JIT cache, and that
+// changing either one misses the cache.
+
+Func make_pipeline(Param<float> &scale, float offset, bool vectorize) {
+    Var x("x"), y("y");
+    Func f("f"), g("g");
+    f(x, y) = x * scale + y;
+    g(x, y) = f(x, y) + f(x + 1, y) + offset;
+    f.compute_root();
+    if (vectorize) {
+        g.vectorize(x, 4);
+    }
+    return g;
+}
+
+bool check(const Buffer<float> &im, float scale, float offset) {
+    for (int y = 0; y < im.height(); y++) {
+        for (int x = 0; x < im.width(); x++) {
+            float correct = (x * scale + y) + ((x + 1) * scale + y) + offset;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %f instead of %f\n", x, y, im(x, y), correct);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool check_stats(uint64_t hits, uint64_t misses) {
+    JITCacheStats stats = get_jit_cache_stats();
+    if (stats.hits != hits || stats.misses != misses) {
+        printf("%d hits and %d misses instead of %d and %d\n",
+               (int)stats.hits, (int)stats.misses, (int)hits, (int)misses);
+        return false;
+    }
+    return true;
+}
+
+// A temporary cache directory, deleted along with the entries in it
+// when the test exits.
+struct TemporaryCacheDirectory {
+    const std::string dir = Internal::dir_make_temp();
+
+    ~TemporaryCacheDirectory() {
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &data);
+        if (h != INVALID_HANDLE_VALUE) {
+            do {
+                std::string name = data.cFileName;
+                if (name != "." && name != "..") {
+                    Internal::file_unlink(dir + "\\" + name);
+                }
+            } while (FindNextFileA(h, &data));
+            FindClose(h);
+        }
+#else
+        if (DIR *d = opendir(dir.c_str())) {
+            while (dirent *entry = readdir(d)) {
+                std::string name = entry->d_name;
+                if (name != "." && name != "..") {
+                    Internal::file_unlink(dir + "/" + name);
+                }
+            }
+            closedir(d);
+        }
+#endif
+        Internal::dir_rmdir(dir);
+    }
+};
+
+int main(int argc, char **argv) {
+    TemporaryCacheDirectory cache;
+    set_jit_cache_directory(cache.dir);
+    reset_jit_cache_stats();
+
+    // The Params must be the same object, or at least have the same
+    // name, for two pipelines to be the same.
+    Param<float> scale("scale");
+
+    scale.set(2.0f);
+    Buffer<float> im = make_pipeline(scale, 0.5f, true).realize(32, 8);
+    if (!check(im, 2.0f, 0.5f) || !check_stats(0, 1)) {
+        return -1;
+    }
+
+    // The same pipeline, built again from scratch, with a different
+    // value for the Param.
+    scale.set(3.0f);
+    im = make_pipeline(scale, 0.5f, true).realize(32, 8);
+    if (!check(im, 3.0f, 0.5f) || !check_stats(1, 1)) {
+        return -1;
+    }
+
+    // A different constant is a different algorithm, even when it
+    // only differs past the precision IR printing normally uses.
+    im = make_pipeline(scale, 0.5000001f, true).realize(32, 8);
+    if (!check(im, 3.0f, 0.5000001f) || !check_stats(1, 2)) {
+        return -1;
+    }
+
+    // A different schedule.
+    im = make_pipeline(scale, 0.5f, false).realize(32, 8);
+    if (!check(im, 3.0f, 0.5f) || !check_stats(1, 3)) {
+        return -1;
+    }
+
+    set_jit_cache_directory("");
+    im = make_pipeline(scale, 0.5f, true).realize(32, 8);
+    if (!check(im, 3.0f, 0.5f) || !check_stats(1, 3) ||
+        get_jit_cache_stats().uncacheable != 1) {
+        printf("Pipeline was cached with the cache disabled\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
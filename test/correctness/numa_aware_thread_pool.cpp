@@ -0,0 +1,40 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Turn on the NUMA-aware thread pool before the runtime starts it.
+    char env[] = "HL_NUMA_AWARE=1";
+    putenv(env);
+
+    Var x, y, z;
+    Func f, g;
+
+    // g is large enough per row of f to be served from node-local
+    // memory, and is allocated and freed inside the parallel loop.
+    g(x, y) = x * y + 1;
+    f(x, y, z) = g(x, y) + g(x + 1, y) + z;
+
+    f.parallel(z);
+    g.compute_at(f, z);
+
+    Buffer<int> im = f.realize(1024, 128, 32);
+
+    for (int z = 0; z < 32; z++) {
+        for (int y = 0; y < 128; y++) {
+            for (int x = 0; x < 1024; x++) {
+                int correct = x * y + 1 + (x + 1) * y + 1 + z;
+                if (im(x, y, z) != correct) {
+                    printf("im(%d, %d, %d) = %d instead of %d\n",
+                           x, y, z, im(x, y, z), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace Halide;
+
+// Check that the profile_counters feature attributes hardware counters
+// to Funcs in the profiler report, or says why it can't.
+
+bool counters_reported = false;
+bool counters_unavailable = false;
+float expensive_ipc = -1;
+
+void my_print(void *, const char *msg) {
+    if (strstr(msg, "cycles:") && strstr(msg, "instructions:")) {
+        counters_reported = true;
+    }
+    if (strstr(msg, "performance counters are unavailable")) {
+        counters_unavailable = true;
+    }
+    const char *ipc = strstr(msg, " ipc: ");
+    if (strstr(msg, "expensive") && ipc) {
+        sscanf(ipc, " ipc: %f", &expensive_ipc);
+    }
+}
+
+int main(int argc, char **argv) {
+    Func cheap("cheap"), expensive("expensive"), out("out");
+    Var x, y;
+
+    cheap(x, y) = cast<float>(x + y);
+    Expr e = cheap(x, y);
+    for (int i = 0; i < 100; i++) {
+        e = sin(e);
+    }
+    expensive(x, y) = e;
+    out(x, y) = expensive(x, y) + cheap(x, y);
+
+    cheap.compute_root();
+    expensive.compute_root().parallel(y);
+
+    out.set_custom_print(&my_print);
+
+    Target t = get_jit_target_from_environment()
+        .with_feature(Target::Profile)
+        .with_feature(Target::ProfileCounters);
+    Buffer<float> im = out.realize(1000, 1000, t);
+
+    if (counters_unavailable || !counters_reported) {
+        // Counters may be missing or read as zero, e.g. in a VM.
+        printf("Hardware counters unavailable; profiler degraded gracefully\n");
+    } else if (expensive_ipc <= 0) {
+        printf("Hardware counters were not attributed to Funcs\n");
+        return -1;
+    } else {
+        printf("IPC of expensive: %f\n", expensive_ipc);
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Halide;
+
+// Check that the profiler follows each thread separately, by running
+// two expensive Funcs at once, one in a parallel loop and one as an
+// async producer. Each should get a good share of the time, and the
+// report should break down utilization by thread.
+
+int producer_percentage = -1, consumer_percentage = -1;
+bool utilization_reported = false;
+
+void my_print(void *, const char *msg) {
+    float ms;
+    int percentage;
+    if (sscanf(msg, " producer: %fms (%d", &ms, &percentage) == 2) {
+        producer_percentage = percentage;
+    }
+    if (sscanf(msg, " consumer: %fms (%d", &ms, &percentage) == 2) {
+        consumer_percentage = percentage;
+    }
+    if (strstr(msg, "thread utilization:")) {
+        utilization_reported = true;
+    }
+}
+
+Expr expensive(Expr e) {
+    for (int i = 0; i < 100; i++) {
+        e = sin(e);
+    }
+    return e;
+}
+
+int main(int argc, char **argv) {
+    // Make sure there is more than one thread, even on a single core.
+    char env[] = "HL_NUM_THREADS=4";
+    putenv(env);
+
+    Func producer("producer"), consumer("consumer");
+    Var x, y;
+
+    producer(x, y) = expensive(cast<float>(x + y));
+    consumer(x, y) = expensive(producer(x, y));
+
+    producer.compute_at(consumer, y).async();
+    consumer.parallel(y, 8);
+
+    consumer.set_custom_print(&my_print);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    Buffer<float> im = consumer.realize(2000, 256, t);
+
+    printf("producer: %d%%, consumer: %d%%\n", producer_percentage, consumer_percentage);
+
+    // Both Funcs do the same amount of work.
+    if (producer_percentage < 25 || consumer_percentage < 25) {
+        printf("Time was not split between the two Funcs\n");
+        return -1;
+    }
+
+    if (!utilization_reported) {
+        printf("No breakdown of utilization by thread\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
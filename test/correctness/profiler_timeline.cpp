@@ -0,0 +1,77 @@
+#include "Halide.h"
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+// Check that the profile_timeline feature writes a Chrome trace with
+// events for Funcs and parallel tasks on more than one thread.
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Test skipped on windows due to use of setenv\n");
+#else
+    std::string trace_file = Internal::get_test_tmp_dir() + "profiler_timeline.json";
+    Internal::ensure_no_file_exists(trace_file);
+    setenv("HL_PROFILER_TIMELINE", trace_file.c_str(), 1);
+    setenv("HL_NUM_THREADS", "4", 1);
+
+    Func producer("producer"), consumer("consumer");
+    Var x, y;
+
+    producer(x, y) = x + y;
+    consumer(x, y) = producer(x, y) + producer(x + 1, y);
+
+    producer.compute_at(consumer, y).async();
+    consumer.parallel(y, 4);
+
+    Target t = get_jit_target_from_environment()
+        .with_feature(Target::Profile)
+        .with_feature(Target::ProfileTimeline);
+    Buffer<int> im = consumer.realize(1000, 64, t);
+
+    // The events are written when the JIT resets the profiler after
+    // the realization.
+    std::ifstream f(trace_file);
+    if (!f.is_open()) {
+        printf("Timeline %s was not written\n", trace_file.c_str());
+        return -1;
+    }
+    std::stringstream contents;
+    contents << f.rdbuf();
+    std::string trace = contents.str();
+
+    if (trace.compare(0, 2, "[\n") != 0) {
+        printf("Timeline is not a Chrome trace array\n");
+        return -1;
+    }
+
+    for (const char *name : {"producer", "consumer", "pipeline", "task"}) {
+        std::string event = std::string("{\"name\":\"") + name + "\",\"ph\":\"B\"";
+        if (trace.find(event) == std::string::npos) {
+            printf("No begin event for %s in the timeline\n", name);
+            return -1;
+        }
+    }
+
+    // Collect the threads that began an event.
+    std::set<int> threads;
+    size_t pos = 0;
+    while ((pos = trace.find("\"tid\":", pos)) != std::string::npos) {
+        pos += 6;
+        threads.insert(atoi(trace.c_str() + pos));
+    }
+    if (threads.size() < 2) {
+        printf("Expected events on more than one thread\n");
+        return -1;
+    }
+#endif
+
+    printf("Success!\n");
+    return 0;
+}
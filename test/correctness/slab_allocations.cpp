@@ -0,0 +1,178 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <atomic>
+
+using namespace Halide;
+
+// Check that with the slab_alloc target feature, intermediates with
+// constant sizes are packed into a single slab, reusing memory across
+// non-overlapping lifetimes.
+
+std::atomic<int> malloc_count;
+std::atomic<int> free_count;
+
+void *my_malloc(void *user_context, size_t x) {
+    malloc_count++;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free_count++;
+    free(((void**)ptr)[-1]);
+}
+
+bool error_occurred = false;
+void my_error(void *user_context, const char *msg) {
+    error_occurred = true;
+}
+
+int main(int argc, char **argv) {
+    const int size = 10000;
+    Target target = get_jit_target_from_environment().with_feature(Target::SlabAlloc);
+
+    {
+        // A chain of root-level stages, each of which is only needed
+        // until the next one is computed.
+        Var x;
+        std::vector<Func> chain(5);
+        chain[0](x) = x;
+        for (size_t i = 1; i < chain.size(); i++) {
+            chain[i](x) = chain[i - 1](x) + chain[i - 1](x + 1);
+        }
+        for (size_t i = 0; i < chain.size() - 1; i++) {
+            chain[i].compute_root();
+        }
+        Func out = chain.back();
+        out.bound(x, 0, size);
+
+        Module m = out.compile_to_module({}, "slab_chain", target);
+        int64_t slab_bytes = m.functions()[0].slab_bytes;
+        const int64_t intermediate_bytes = size * sizeof(int);
+        printf("Slab for %d intermediates is %lld bytes\n",
+               (int)chain.size() - 1, (long long)slab_bytes);
+        // No more than two of the intermediates are ever live at once.
+        if (slab_bytes < 2 * intermediate_bytes ||
+            slab_bytes >= 3 * intermediate_bytes) {
+            printf("Unexpected slab size\n");
+            return -1;
+        }
+
+        out.set_custom_allocator(my_malloc, my_free);
+        malloc_count = 0;
+        free_count = 0;
+        Buffer<int> result = out.realize(size, target);
+
+        if (malloc_count != 1 || free_count != 1) {
+            printf("Expected one malloc and free, got %d and %d\n",
+                   (int)malloc_count, (int)free_count);
+            return -1;
+        }
+
+        // Each stage sums adjacent values of the previous one, so
+        // chain[k](x) = sum over i of C(k, i) * (x + i).
+        for (int x = 0; x < size; x++) {
+            int correct = 16 * x + 32;
+            if (result(x) != correct) {
+                printf("result(%d) = %d instead of %d\n", x, result(x), correct);
+                return -1;
+            }
+        }
+    }
+
+    {
+        // Intermediates computed per row of a parallel loop get a
+        // slab per task instead.
+        Var x, y;
+        Func f, g, h;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) * 2;
+        h(x, y) = g(x, y) + g(x + 1, y);
+        f.compute_at(h, y);
+        g.compute_at(h, y);
+        h.bound(x, 0, size).parallel(y);
+
+        Module m = h.compile_to_module({}, "slab_tasks", target);
+        int64_t task_slab_bytes = m.functions()[0].task_slab_bytes;
+        if (task_slab_bytes == 0) {
+            printf("Expected a slab per task\n");
+            return -1;
+        }
+
+        Buffer<int> result = h.realize(size, 16, target);
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < size; x++) {
+                int correct = (x + y) * 2 + (x + 1 + y) * 2;
+                if (result(x, y) != correct) {
+                    printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    {
+        // Slabs for tasks of a parallel loop nested inside another
+        // one are accounted for too.
+        Var x, y, xo, xi;
+        Func f, g, h;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) * 2;
+        h(x, y) = g(x, y) + g(x + 1, y);
+        f.compute_at(h, xo);
+        g.compute_at(h, xo);
+        h.bound(x, 0, size).split(x, xo, xi, size / 4).parallel(y).parallel(xo);
+
+        Module m = h.compile_to_module({}, "slab_nested_tasks", target);
+        int64_t task_slab_bytes = m.functions()[0].task_slab_bytes;
+        if (task_slab_bytes == 0) {
+            printf("Expected a slab per task of the inner parallel loop\n");
+            return -1;
+        }
+
+        Buffer<int> result = h.realize(size, 16, target);
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < size; x++) {
+                int correct = (x + y) * 2 + (x + 1 + y) * 2;
+                if (result(x, y) != correct) {
+                    printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    {
+        // A call that fails the checks on its inputs returns before
+        // the slab is allocated.
+        Buffer<int> small_input(10);
+        ImageParam input(Int(32), 1);
+        Var x;
+        Func f, g, h;
+        f(x) = input(x) + 1;
+        g(x) = f(x) * 2;
+        h(x) = g(x) + g(x + 1);
+        f.compute_root();
+        g.compute_root();
+        h.bound(x, 0, size);
+
+        input.set(small_input);
+        h.set_custom_allocator(my_malloc, my_free);
+        h.set_error_handler(my_error);
+        malloc_count = 0;
+        h.realize(size, target);
+        if (!error_occurred) {
+            printf("There should have been an out-of-bounds error\n");
+            return -1;
+        }
+        if (malloc_count != 0) {
+            printf("Allocated %d times before failing the input checks\n", (int)malloc_count);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
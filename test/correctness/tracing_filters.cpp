@@ -0,0 +1,124 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+using namespace Halide;
+
+// Check that trace_region, trace_every and trace_first only let
+// through the loads and stores they should.
+
+// The trace callback is called from the parallel loops below, so the
+// counters are atomic.
+std::atomic<int> boxed_stores, boxed_outside;
+std::atomic<int> sampled_loads, sampled_vector_stores;
+std::atomic<int> realizations;
+
+int my_trace(void *user_context, const halide_trace_event_t *e) {
+    if (e->event == halide_trace_begin_realization) {
+        realizations++;
+    }
+    if (e->event == halide_trace_store && !strcmp(e->func, "boxed")) {
+        boxed_stores++;
+        int x = e->coordinates[0], y = e->coordinates[1];
+        if (x < 10 || x >= 15 || y < 3 || y >= 5) {
+            boxed_outside++;
+        }
+    }
+    if (e->event == halide_trace_load && !strcmp(e->func, "sampled")) {
+        sampled_loads++;
+    }
+    if (e->event == halide_trace_store && !strcmp(e->func, "vectorized")) {
+        sampled_vector_stores++;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    boxed_stores = 0;
+    boxed_outside = 0;
+    sampled_loads = 0;
+    sampled_vector_stores = 0;
+    realizations = 0;
+
+    Var x("x"), y("y");
+
+    {
+        // Only the stores in a 5x2 box are traced, and the box can
+        // move without recompiling.
+        Param<int> box_x;
+        Func boxed("boxed");
+        boxed(x, y) = x + y;
+        boxed.trace_stores()
+            .trace_region(x, box_x, 5)
+            .trace_region(y, 3, 2);
+        boxed.set_custom_trace(&my_trace);
+
+        box_x.set(10);
+        boxed.realize(32, 8);
+        if (boxed_stores != 10 || boxed_outside != 0) {
+            printf("Traced %d stores, %d outside the box, instead of 10 and 0\n",
+                   (int)boxed_stores, (int)boxed_outside);
+            return -1;
+        }
+
+        box_x.set(30);
+        boxed_stores = 0;
+        boxed_outside = 0;
+        boxed.realize(32, 8);
+        // Only x = 30 and x = 31 are inside the box, and they are
+        // outside of the range the first check expects.
+        if (boxed_stores != 4 || boxed_outside != 4) {
+            printf("Traced %d stores after moving the box instead of 4\n", (int)boxed_stores);
+            return -1;
+        }
+    }
+
+    {
+        // Every third load, up to 30 loads considered, gives 10 traced
+        // loads, even from a parallel loop.
+        Func sampled("sampled"), consumer("consumer");
+        sampled(x, y) = x * y;
+        consumer(x, y) = sampled(x, y) + 1;
+        sampled.compute_root().trace_loads().trace_every(3).trace_first(30);
+        consumer.parallel(y);
+        consumer.set_custom_trace(&my_trace);
+
+        realizations = 0;
+        consumer.realize(16, 16);
+        if (sampled_loads != 10) {
+            printf("Traced %d loads instead of 10\n", (int)sampled_loads);
+            return -1;
+        }
+        // Other events are never filtered.
+        if (realizations == 0) {
+            printf("Realizations were filtered out\n");
+            return -1;
+        }
+
+        // The counters start again in each run of the pipeline.
+        sampled_loads = 0;
+        consumer.realize(16, 16);
+        if (sampled_loads != 10) {
+            printf("Traced %d loads on the second run instead of 10\n", (int)sampled_loads);
+            return -1;
+        }
+    }
+
+    {
+        // A vector of stores counts as one event.
+        Func vectorized("vectorized");
+        vectorized(x, y) = x - y;
+        vectorized.vectorize(x, 8).trace_stores().trace_every(2);
+        vectorized.set_custom_trace(&my_trace);
+        vectorized.realize(64, 4);
+        // 32 vectors of stores, every other one traced.
+        if (sampled_vector_stores != 16) {
+            printf("Traced %d vectors of stores instead of 16\n", (int)sampled_vector_stores);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
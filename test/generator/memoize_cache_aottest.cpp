@@ -0,0 +1,153 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "memoize_cache.h"
+
+using namespace Halide::Runtime;
+
+const int num_keys = 64;
+
+int check(int key) {
+    Buffer<float> out(64, 64);
+    int ret = memoize_cache(key, out);
+    if (ret) {
+        printf("Non zero exit code: %d\n", ret);
+        return ret;
+    }
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            float correct = sqrtf((float)(x * y + key));
+            if (fabs(out(x, y) - correct) > 1e-5f) {
+                printf("key %d: out(%d, %d) = %f instead of %f\n", key, x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // Few buckets, so the shards have to grow.
+    if (halide_memoization_cache_set_geometry(4, 1) != 0) {
+        printf("halide_memoization_cache_set_geometry failed\n");
+        return -1;
+    }
+
+    // Fill the cache, then look every key up again from several threads.
+    for (int key = 0; key < num_keys; key++) {
+        if (check(key)) return -1;
+    }
+    std::vector<std::thread> threads;
+    std::vector<int> results(8);
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&results, t]() {
+            for (int i = 0; i < 100 && !results[t]; i++) {
+                results[t] = check((i * 7 + t) % num_keys);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    for (int r : results) {
+        if (r) return -1;
+    }
+
+    halide_memoization_cache_stats_t stats;
+    if (halide_memoization_cache_get_stats(nullptr, &stats) != 0) {
+        printf("halide_memoization_cache_get_stats failed\n");
+        return -1;
+    }
+    printf("hits %llu, misses %llu, evictions %llu, entries %llu, bytes %lld, lock wait %lld ns\n",
+           (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+           (unsigned long long)stats.evictions, (unsigned long long)stats.entries,
+           (long long)stats.bytes, (long long)stats.lock_wait_time);
+
+    // Each entry is 64x64 floats, so the default 1MB cache holds all of them.
+    if (stats.shards != 4 ||
+        stats.misses != num_keys ||
+        stats.hits != 8 * 100 ||
+        stats.evictions != 0 ||
+        stats.entries != num_keys ||
+        stats.bytes != num_keys * 64 * 64 * (int64_t)sizeof(float)) {
+        printf("Unexpected cache statistics\n");
+        return -1;
+    }
+
+    // Shrinking the cache evicts down to the new size.
+    halide_memoization_cache_set_size(num_keys * 64 * 64 * sizeof(float) / 2);
+    halide_memoization_cache_get_stats(nullptr, &stats);
+    if (stats.evictions != num_keys / 2 || stats.entries != num_keys / 2) {
+        printf("Expected %d evictions, got %llu\n", num_keys / 2, (unsigned long long)stats.evictions);
+        return -1;
+    }
+
+    // Cost-aware eviction is selectable, and keeps the cache within
+    // its size just the same.
+    if (halide_memoization_cache_set_eviction_policy(halide_memoization_cache_evict_greedy_dual_size) != 0 ||
+        halide_memoization_cache_set_eviction_policy((halide_memoization_cache_eviction_policy_t)17) == 0) {
+        printf("halide_memoization_cache_set_eviction_policy failed\n");
+        return -1;
+    }
+    for (int key = 0; key < num_keys; key++) {
+        if (check(key)) return -1;
+    }
+    halide_memoization_cache_get_stats(nullptr, &stats);
+    if (stats.bytes > stats.max_bytes) {
+        printf("Cache holds %lld bytes, more than its size of %lld\n",
+               (long long)stats.bytes, (long long)stats.max_bytes);
+        return -1;
+    }
+    halide_memoization_cache_set_eviction_policy(halide_memoization_cache_evict_lru);
+
+    // Flushing resets the counters.
+    halide_memoization_cache_cleanup();
+    halide_memoization_cache_get_stats(nullptr, &stats);
+    if (stats.hits || stats.misses || stats.entries || stats.bytes) {
+        printf("Statistics not reset by halide_memoization_cache_cleanup\n");
+        return -1;
+    }
+
+#ifndef _WIN32
+    // Results written through to a persistent file survive flushing
+    // the in-memory cache (as they would a restart).
+    char path[] = "/tmp/memoize_cache_aottest_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("mkstemp failed\n");
+        return -1;
+    }
+    close(fd);
+    if (halide_memoization_cache_set_persistent_file(nullptr, path, 4 * 1024 * 1024) != 0) {
+        printf("halide_memoization_cache_set_persistent_file failed\n");
+        return -1;
+    }
+    for (int key = 0; key < num_keys; key++) {
+        if (check(key)) return -1;
+    }
+    halide_memoization_cache_cleanup();
+    for (int key = 0; key < num_keys; key++) {
+        if (check(key)) return -1;
+    }
+    halide_memoization_cache_get_stats(nullptr, &stats);
+    if (stats.persistent_hits != num_keys) {
+        printf("Expected %d hits in the persistent file, got %llu\n",
+               num_keys, (unsigned long long)stats.persistent_hits);
+        return -1;
+    }
+    halide_memoization_cache_set_persistent_file(nullptr, nullptr, 0);
+    remove(path);
+#endif
+
+    printf("Success!\n");
+    return 0;
+}
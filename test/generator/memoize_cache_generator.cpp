@@ -0,0 +1,29 @@
+#include "Halide.h"
+
+namespace {
+
+class MemoizeCache : public Halide::Generator<MemoizeCache> {
+public:
+    Input<int> key{"key"};
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        // One cache entry per value of key.
+        Func f;
+        f(x, y) = sqrt(cast<float>(x * y + key));
+        f.compute_root().memoize();
+
+        output(x, y) = f(x, y);
+    }
+
+    void schedule() {
+        output.bound(x, 0, 64).bound(y, 0, 64);
+    }
+
+private:
+    Var x, y;
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(MemoizeCache, memoize_cache)
@@ -0,0 +1,36 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "split_compile.h"
+#include "split_compile_with_offset_42.h"
+
+using namespace Halide::Runtime;
+
+const int kSize = 32;
+
+// Both libraries are compiled from the same Generator, with their
+// modules split into several objects. Linking them into one program
+// checks that the split didn't make their local symbols global.
+int main(int argc, char **argv) {
+    Buffer<int32_t> input(kSize), output(kSize);
+
+    input.for_each_element([&](int x) {
+        input(x) = x;
+    });
+
+    split_compile(input, output);
+    input.for_each_element([=](int x) {
+        assert(output(x) == (x & 15) * (x & 15));
+    });
+
+    split_compile_with_offset_42(input, output);
+    input.for_each_element([=](int x) {
+        assert(output(x) == (x & 15) * (x & 15) + 42);
+    });
+
+    printf("Success!\n");
+    return 0;
+}
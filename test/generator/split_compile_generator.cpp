@@ -0,0 +1,27 @@
+#include "Halide.h"
+
+namespace {
+
+class SplitCompile : public Halide::Generator<SplitCompile> {
+public:
+    GeneratorParam<int32_t> offset{ "offset", 0 };
+    Input<Buffer<int32_t>>  input{ "input", 1 };
+    Output<Buffer<int32_t>> output{ "output", 1 };
+
+    void generate() {
+        // The table is embedded in each library as a local constant,
+        // which must stay local when the module is split.
+        Buffer<int32_t> table(16, "table");
+        for (int i = 0; i < 16; i++) {
+            table(i) = i * i;
+        }
+
+        Var x;
+        output(x) = table(input(x) & 15) + offset;
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(SplitCompile, split_compile)
+HALIDE_REGISTER_GENERATOR_ALIAS(split_compile_with_offset_42, split_compile, { { "offset", "42" }})
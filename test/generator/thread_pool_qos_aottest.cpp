@@ -0,0 +1,83 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <thread>
+
+#include "thread_pool_qos.h"
+
+using namespace Halide::Runtime;
+
+// Each tenant is identified to the thread pool by its user context.
+int batch_tenant, latency_tenant;
+
+int run(void *user_context, int iterations) {
+    Buffer<float> out(256, 256);
+    for (int i = 0; i < iterations; i++) {
+        int ret = thread_pool_qos(user_context, out);
+        if (ret) {
+            printf("Non zero exit code: %d\n", ret);
+            return ret;
+        }
+    }
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            float correct = sqrtf(sqrtf((float)(x * y)));
+            if (fabs(out(x, y) - correct) > 1e-5f) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    halide_set_num_threads(8);
+
+    // The batch tenant may only use two threads for its parallel
+    // loops, and yields to the latency-sensitive one.
+    if (halide_set_thread_pool_qos(&batch_tenant, halide_thread_pool_priority_low, 2) != 0 ||
+        halide_set_thread_pool_qos(&latency_tenant, halide_thread_pool_priority_high, 0) != 0) {
+        printf("halide_set_thread_pool_qos failed\n");
+        return -1;
+    }
+    halide_reset_thread_pool_qos_stats();
+
+    int batch_result = 0, latency_result = 0;
+    std::thread batch([&]() { batch_result = run(&batch_tenant, 200); });
+    std::thread latency([&]() { latency_result = run(&latency_tenant, 200); });
+    batch.join();
+    latency.join();
+    if (batch_result || latency_result) {
+        return -1;
+    }
+
+    halide_thread_pool_qos_stats_t low, normal, high;
+    halide_thread_pool_qos_stats(halide_thread_pool_priority_low, &low);
+    halide_thread_pool_qos_stats(halide_thread_pool_priority_normal, &normal);
+    halide_thread_pool_qos_stats(halide_thread_pool_priority_high, &high);
+
+    printf("low:  %llu jobs, mean queue wait %f us, max queue wait %f us, execution %f ms\n",
+           (unsigned long long)low.jobs, low.queue_wait_time / (1e3 * low.jobs),
+           low.max_queue_wait_time / 1e3, low.execution_time / 1e6);
+    printf("high: %llu jobs, mean queue wait %f us, max queue wait %f us, execution %f ms\n",
+           (unsigned long long)high.jobs, high.queue_wait_time / (1e3 * high.jobs),
+           high.max_queue_wait_time / 1e3, high.execution_time / 1e6);
+
+    if (low.jobs == 0 || high.jobs == 0 || low.execution_time == 0 || high.execution_time == 0) {
+        printf("Tagged calls were not counted\n");
+        return -1;
+    }
+    if (normal.jobs != 0) {
+        printf("Untagged calls should not be counted\n");
+        return -1;
+    }
+
+    halide_clear_thread_pool_qos(&batch_tenant);
+    halide_clear_thread_pool_qos(&latency_tenant);
+
+    printf("Success!\n");
+    return 0;
+}
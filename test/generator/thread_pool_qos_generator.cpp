@@ -0,0 +1,21 @@
+#include "Halide.h"
+
+namespace {
+
+class ThreadPoolQoS : public Halide::Generator<ThreadPoolQoS> {
+public:
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        // Fine-grained nested parallelism, so that calls from different
+        // tenants compete for the thread pool.
+        Var x, y;
+
+        output(x, y) = sqrt(sqrt(cast<float>(x * y)));
+        output.parallel(y).parallel(x, 16);
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(ThreadPoolQoS, thread_pool_qos)
@@ -0,0 +1,77 @@
+#include "Halide.h"
+#include <stdio.h>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// A naive transpose between two large intermediates touches a new page
+// of its input on every iteration, so it is bound by TLB misses. Check
+// that giving those intermediates huge pages, and prefaulting them from
+// the thread pool, doesn't make things worse.
+
+void set_huge_page_malloc(bool huge_pages, bool prefault) {
+    // The setting lives in the runtime, so call it from a pipeline.
+    Func set;
+    set() = Internal::Call::make(Bool(), "halide_set_huge_page_malloc",
+                                 {Expr(huge_pages), Expr(prefault)},
+                                 Internal::Call::Extern);
+    Buffer<bool> honored = set.realize();
+    if (!honored()) {
+        printf("halide_set_huge_page_malloc(%d, %d) was not honored\n",
+               huge_pages, prefault);
+    }
+}
+
+int main(int argc, char **argv) {
+    const int size = 4096;
+
+    Func input, transposed, output;
+    Var x, y;
+
+    input(x, y) = cast<float>(x + y);
+    transposed(x, y) = input(y, x);
+    output(x, y) = transposed(x, y) * 2.0f;
+
+    // Each intermediate is 64MB.
+    input.compute_root().parallel(y).vectorize(x, 8);
+    transposed.compute_root().parallel(y, 16);
+    output.parallel(y).vectorize(x, 8);
+    output.bound(x, 0, size).bound(y, 0, size);
+
+    output.compile_jit();
+
+    Buffer<float> out(size, size);
+
+    const char *names[] = {"small pages", "huge pages", "huge pages with prefaulting"};
+    double t[3];
+    for (int i = 0; i < 3; i++) {
+        set_huge_page_malloc(i >= 1, i >= 2);
+        output.realize(out);
+        t[i] = benchmark(3, 3, [&]() {
+            output.realize(out);
+        });
+        printf("Time using %s: %f ms\n", names[i], t[i] * 1e3);
+    }
+    set_huge_page_malloc(false, false);
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            float correct = (x + y) * 2.0f;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // Without transparent huge pages in the kernel the madvise is a
+    // no-op, so only check for a slowdown beyond noise.
+    if (t[1] > t[0] * 1.25) {
+        printf("Huge pages were slower than small pages!\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -1,11 +1,70 @@
 #include "Halide.h"
 
+#include <chrono>
 #include <cstdio>
 #include "halide_benchmark.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
 using namespace Halide;
 using namespace Halide::Tools;
 
+// A temporary cache directory, deleted along with the entries in it
+// when the test exits.
+struct TemporaryCacheDirectory {
+    const std::string dir = Internal::dir_make_temp();
+
+    ~TemporaryCacheDirectory() {
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &data);
+        if (h != INVALID_HANDLE_VALUE) {
+            do {
+                std::string name = data.cFileName;
+                if (name != "." && name != "..") {
+                    Internal::file_unlink(dir + "\\" + name);
+                }
+            } while (FindNextFileA(h, &data));
+            FindClose(h);
+        }
+#else
+        if (DIR *d = opendir(dir.c_str())) {
+            while (dirent *entry = readdir(d)) {
+                std::string name = entry->d_name;
+                if (name != "." && name != "..") {
+                    Internal::file_unlink(dir + "/" + name);
+                }
+            }
+            closedir(d);
+        }
+#endif
+        Internal::dir_rmdir(dir);
+    }
+};
+
+// Time the first JIT compilation in a fresh process, which includes
+// building and compiling the shared runtime. The pipeline calls into
+// the runtime's thread pool and math functions, so that its result
+// depends on the runtime working. The names are fixed, as they are
+// part of the JIT cache key.
+double first_jit_compilation(const std::string &cache_dir, Buffer<float> &result) {
+    set_jit_cache_directory(cache_dir);
+    Internal::JITSharedRuntime::release_all();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    Var x("x");
+    Func f("jit_stress_f");
+    f(x) = pow(x * 0.01f, 1.5f) + x;
+    f.parallel(x, 64);
+    result = f.realize(1024);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
 int main(int argc, char **argv) {
     Var x;
 
@@ -26,6 +85,35 @@ int main(int argc, char **argv) {
 
     printf("%g ms per jit compilation\n", t * 1e3);
 
+    // The shared runtime can be loaded from the JIT cache instead.
+    TemporaryCacheDirectory temp;
+    const std::string &cache_dir = temp.dir;
+    Buffer<float> fresh, populated, loaded;
+    double uncached = first_jit_compilation("", fresh);
+    // Populate the cache.
+    first_jit_compilation(cache_dir, populated);
+    reset_jit_cache_stats();
+    double cached = first_jit_compilation(cache_dir, loaded);
+
+    printf("%g ms for the first jit compilation, %g ms with the shared runtime cached on disk\n",
+           uncached * 1e3, cached * 1e3);
+
+    JITCacheStats stats = get_jit_cache_stats();
+    if (stats.runtime_hits == 0 || stats.hits == 0) {
+        printf("The shared runtime and pipeline were not loaded from the JIT cache\n");
+        return -1;
+    }
+
+    // The pipeline and runtime loaded from the cache must compute the
+    // same results as the freshly compiled ones.
+    for (int x = 0; x < fresh.width(); x++) {
+        if (populated(x) != fresh(x) || loaded(x) != fresh(x)) {
+            printf("result(%d) = %f when populating the cache and %f when loaded from it, instead of %f\n",
+                   x, populated(x), loaded(x), fresh(x));
+            return -1;
+        }
+    }
+
     printf("Success!\n");
     return 0;
 }
@@ -0,0 +1,65 @@
+#include "Halide.h"
+#include <cstdio>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// Compares eviction policies for the memoization cache on a mixed
+// workload: small results that are expensive to compute and are
+// reused, interleaved with large results that are cheap to compute
+// and are not. LRU lets the large results push the small ones out;
+// GreedyDual-Size keeps the small ones because they save more time
+// per byte.
+int main(int argc, char **argv) {
+    Param<int> expensive_key, cheap_key;
+    Var x, y;
+
+    Func expensive, cheap, output;
+    RDom r(0, 500);
+    expensive(x, y) = sum(sin(cast<float>(x + y + r + expensive_key)));
+    cheap(x, y) = cast<float>(x + y + cheap_key);
+    output(x, y) = cheap(x, y) + expensive(x % 32, y % 32);
+
+    expensive.compute_root().memoize();
+    cheap.compute_root().memoize();
+    output.compile_jit();
+
+    // Room for three of the 256KB cheap results, plus a few of the
+    // 4KB expensive ones.
+    Internal::JITSharedRuntime::memoization_cache_set_size(800 * 1024);
+
+    Buffer<float> out(256, 256);
+    auto workload = [&]() {
+        for (int i = 0; i < 64; i++) {
+            expensive_key.set(i % 8);
+            cheap_key.set(i);
+            output.realize(out);
+        }
+    };
+
+    double lru_time = 0, gds_time = 0;
+    for (int policy : {halide_memoization_cache_evict_lru,
+                       halide_memoization_cache_evict_greedy_dual_size}) {
+        Internal::JITSharedRuntime::memoization_cache_set_eviction_policy(policy);
+        double t = benchmark(3, 1, workload);
+        if (policy == halide_memoization_cache_evict_lru) {
+            lru_time = t;
+        } else {
+            gds_time = t;
+        }
+    }
+
+    printf("LRU: %f ms, GreedyDual-Size: %f ms\n", lru_time * 1e3, gds_time * 1e3);
+
+    if (gds_time > lru_time) {
+        printf("GreedyDual-Size should beat LRU on this workload\n");
+        return -1;
+    }
+
+    Internal::JITSharedRuntime::memoization_cache_set_eviction_policy(halide_memoization_cache_evict_lru);
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    printf("Success!\n");
+    return 0;
+}
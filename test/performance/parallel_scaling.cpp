@@ -0,0 +1,67 @@
+#include "Halide.h"
+#include <cstdio>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// Measures how the thread pool scales with thread count on
+// fine-grained parallel loops, where each task is a single short row,
+// and on nested parallel loops.
+int main(int argc, char **argv) {
+    Var x, y, z;
+
+    // Fine-grained: many tiny tasks.
+    Func fine;
+    fine(x, y) = sqrt(cast<float>(x * y));
+    fine.parallel(y);
+
+    // Nested: parallel loops inside a parallel loop.
+    Func nested;
+    nested(x, y, z) = sqrt(cast<float>(x * y + z));
+    nested.parallel(z).parallel(y);
+
+    Pipeline p_fine(fine), p_nested(nested);
+
+    double fine_serial_time = 0, nested_serial_time = 0;
+    for (int t = 1; t <= 64; t *= 2) {
+        std::ostringstream ss;
+        ss << "HL_NUM_THREADS=" << t;
+        std::string str = ss.str();
+        char buf[32] = {0};
+        memcpy(buf, str.c_str(), str.size());
+        putenv(buf);
+        p_fine.invalidate_cache();
+        p_nested.invalidate_cache();
+        Halide::Internal::JITSharedRuntime::release_all();
+
+        p_fine.compile_jit();
+        p_nested.compile_jit();
+
+        Buffer<float> fine_out(16, 100000);
+        Buffer<float> nested_out(16, 64, 64);
+
+        double fine_time = benchmark([&]() { p_fine.realize(fine_out); });
+        double nested_time = benchmark([&]() { p_nested.realize(nested_out); });
+
+        if (t == 1) {
+            fine_serial_time = fine_time;
+            nested_serial_time = nested_time;
+        }
+
+        printf("%2d threads: fine-grained %f ms (speedup %f), nested %f ms (speedup %f)\n",
+               t,
+               fine_time * 1e3, fine_serial_time / fine_time,
+               nested_time * 1e3, nested_serial_time / nested_time);
+
+        // Adding threads should never make things dramatically worse,
+        // even when there are more threads than cores.
+        if (fine_time > fine_serial_time * 4 || nested_time > nested_serial_time * 4) {
+            printf("Unacceptable slowdown with %d threads\n", t);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// Measure how long it takes to compile a heavily unrolled and
+// vectorized kernel, most of which is spent in CSE.
+
+int main(int argc, char **argv) {
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y"), xi("xi"), yi("yi");
+
+    // A stencil with lots of shared subexpressions between
+    // neighbouring outputs.
+    Func blur_x("blur_x"), blur_y("blur_y");
+    Expr sum_x = 0.0f;
+    for (int i = -4; i <= 4; i++) {
+        sum_x += input(x + i, y) * (1.0f + i * i);
+    }
+    blur_x(x, y) = sum_x;
+    Expr sum_y = 0.0f;
+    for (int i = -4; i <= 4; i++) {
+        sum_y += blur_x(x, y + i) * (1.0f + i * i);
+    }
+    blur_y(x, y) = sqrt(sum_y);
+
+    blur_y.tile(x, y, xi, yi, 32, 8)
+        .vectorize(xi, 8)
+        .unroll(xi)
+        .unroll(yi);
+    blur_x.compute_at(blur_y, x)
+        .vectorize(x, 8)
+        .unroll(x)
+        .unroll(y);
+
+    double t = benchmark(1, 1, [&]() {
+        blur_y.compile_to_module(blur_y.infer_arguments());
+    });
+    printf("Compiling the unrolled kernel took %f s\n", t);
+
+    // Also time CSE directly on a large expression.
+    Expr e = input(x, y);
+    for (int i = 0; i < 2000; i++) {
+        e = e * e + (e + i) / 3;
+    }
+    t = benchmark(1, 1, [&]() {
+        Internal::common_subexpression_elimination(e);
+    });
+    printf("CSE of a 2000-level expression took %f s\n", t);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,535 @@
+// autotune: find the fastest variant of a Generator by compiling and
+// benchmarking many candidate schedules.
+//
+// Build it with any C++11 compiler, e.g.:
+//
+//     c++ -std=c++11 -O2 tools/autotune.cpp -lpthread -o autotune
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define popen _popen
+#define pclose _pclose
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+void usage(const char *argv0) {
+    const std::string usage = R"USAGE(
+Usage: $NAME$ --generator=PATH --name=GENERATOR_NAME
+              --rungen_main=PATH [flags] [-- RUNGEN_ARGS...]
+
+$NAME$ compiles many variants of a Generator, benchmarks each with RunGen,
+and reports the fastest. Each variant sets a different combination of
+GeneratorParams, which can be user-defined schedule knobs, or the knobs
+of the auto-scheduler.
+
+Variants are compiled in parallel, and then benchmarked one at a time on
+an otherwise idle machine. Every result is appended to a database as soon
+as it's measured, so an interrupted run can be resumed, and re-running
+with more knobs only compiles and benchmarks the new variants. Results
+are keyed on the Generator executable, the target, the machine and the
+GeneratorParams, so rebuilding the Generator or moving to new hardware
+re-tunes everything.
+
+Flags:
+
+    --generator=PATH
+        The Generator executable (built with GenGen.cpp).
+
+    --name=GENERATOR_NAME
+        The name of the Generator to tune (passed as -g).
+
+    --target=TARGET [default = host]
+        The target to compile for.
+
+    --knob=PARAM=VALUE,VALUE,...
+        A GeneratorParam to tune, and the values to try. May be repeated;
+        every combination of values is tried.
+
+    --auto_schedule
+        Also try auto-scheduling the Generator, across a range of
+        machine_params (parallelism, last level cache size and balance).
+
+    --rungen_main=PATH
+        RunGenMain.o, or RunGenMain.cpp (in which case pass the include
+        paths it needs in --cxx_flags).
+
+    --cxx=COMMAND [default = $CXX, or c++]
+        The compiler used to build the RunGen executable of each variant.
+
+    --cxx_flags=FLAGS
+        Extra flags for building the RunGen executables, e.g. include
+        paths, -ldl -lpthread, and image libraries.
+
+    --jobs=NUM [default = number of cores]
+        How many variants to compile at once.
+
+    --work_dir=PATH [default = autotune]
+        Where to build the variants.
+
+    --db=PATH [default = WORK_DIR/results.tsv]
+        The database of results.
+
+    --machine=NAME [default = host name and number of cores]
+        A name for the machine, used to key the results.
+
+    --retry_failed
+        Retry variants that failed to compile or run in a previous run.
+
+Any arguments after -- are passed to RunGen. The default is:
+
+    --default_input_buffers=random:0:estimate_then_auto
+    --default_input_scalars=estimate --quiet
+
+)USAGE";
+
+    std::string basename = argv0;
+    size_t slash = basename.find_last_of("/\\");
+    if (slash != std::string::npos) {
+        basename = basename.substr(slash + 1);
+    }
+    std::string text = usage;
+    size_t pos;
+    while ((pos = text.find("$NAME$")) != std::string::npos) {
+        text.replace(pos, 6, basename);
+    }
+    std::cout << text;
+}
+
+[[noreturn]] void fail(const std::string &msg) {
+    std::cerr << "Error: " << msg << "\n";
+    exit(1);
+}
+
+std::vector<std::string> split_string(const std::string &s, char delim) {
+    std::vector<std::string> result;
+    std::string item;
+    std::istringstream in(s);
+    while (std::getline(in, item, delim)) {
+        result.push_back(item);
+    }
+    return result;
+}
+
+bool file_exists(const std::string &path) {
+    struct stat s;
+    return stat(path.c_str(), &s) == 0;
+}
+
+void make_dir(const std::string &path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// Quote a string for the shell.
+std::string quote(const std::string &s) {
+    std::string result = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            result += "'\\''";
+        } else {
+            result += c;
+        }
+    }
+    return result + "'";
+}
+
+// Run a shell command, sending its output to a log file. Returns
+// whether it succeeded.
+bool run(const std::string &command, const std::string &log) {
+    {
+        std::ofstream f(log, std::ios::app);
+        f << "$ " << command << "\n";
+    }
+    return system((command + " >> " + quote(log) + " 2>&1").c_str()) == 0;
+}
+
+// Run a shell command and capture its output.
+bool run_and_capture(const std::string &command, std::string &output) {
+    FILE *p = popen((command + " 2>&1").c_str(), "r");
+    if (!p) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), p)) > 0) {
+        output.append(buf, n);
+    }
+    return pclose(p) == 0;
+}
+
+uint64_t fnv1a(const std::string &s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : s) {
+        h = (h ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    return h;
+}
+
+std::string default_machine_name() {
+    char host[256] = "unknown";
+#ifndef _WIN32
+    gethostname(host, sizeof(host) - 1);
+#endif
+    return std::string(host) + "-" + std::to_string(std::thread::hardware_concurrency());
+}
+
+// Identifies a build of the Generator, so that results from an older
+// build aren't reused.
+std::string generator_version(const std::string &path) {
+    struct stat s;
+    if (stat(path.c_str(), &s) != 0) {
+        fail("Generator " + path + " not found");
+    }
+    return path + "@" + std::to_string((long long)s.st_size) + "@" + std::to_string((long long)s.st_mtime);
+}
+
+struct Options {
+    std::string generator, name, target = "host";
+    std::vector<std::pair<std::string, std::vector<std::string>>> knobs;
+    bool auto_schedule = false;
+    std::string rungen_main, cxx, cxx_flags;
+    int jobs = 0;
+    std::string work_dir = "autotune", db, machine;
+    bool retry_failed = false;
+    std::vector<std::string> rungen_args;
+};
+
+Options parse_options(int argc, char **argv) {
+    Options o;
+    const char *cxx = getenv("CXX");
+    o.cxx = cxx ? cxx : "c++";
+    o.jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    int i = 1;
+    for (; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--") {
+            i++;
+            break;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            fail("Unknown argument: " + arg);
+        }
+        size_t eq = arg.find('=');
+        std::string flag = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (flag == "help") {
+            usage(argv[0]);
+            exit(0);
+        } else if (flag == "generator") {
+            o.generator = value;
+        } else if (flag == "name") {
+            o.name = value;
+        } else if (flag == "target") {
+            o.target = value;
+        } else if (flag == "knob") {
+            size_t knob_eq = value.find('=');
+            if (knob_eq == std::string::npos) {
+                fail("Expected --knob=PARAM=VALUE,VALUE,..., got " + arg);
+            }
+            o.knobs.emplace_back(value.substr(0, knob_eq), split_string(value.substr(knob_eq + 1), ','));
+        } else if (flag == "auto_schedule") {
+            o.auto_schedule = true;
+        } else if (flag == "rungen_main") {
+            o.rungen_main = value;
+        } else if (flag == "cxx") {
+            o.cxx = value;
+        } else if (flag == "cxx_flags") {
+            o.cxx_flags = value;
+        } else if (flag == "jobs") {
+            o.jobs = std::max(1, atoi(value.c_str()));
+        } else if (flag == "work_dir") {
+            o.work_dir = value;
+        } else if (flag == "db") {
+            o.db = value;
+        } else if (flag == "machine") {
+            o.machine = value;
+        } else if (flag == "retry_failed") {
+            o.retry_failed = true;
+        } else {
+            fail("Unknown flag: " + arg);
+        }
+    }
+    for (; i < argc; i++) {
+        o.rungen_args.push_back(argv[i]);
+    }
+
+    if (o.generator.empty() || o.name.empty() || o.rungen_main.empty()) {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (o.db.empty()) {
+        o.db = o.work_dir + "/results.tsv";
+    }
+    if (o.machine.empty()) {
+        o.machine = default_machine_name();
+    }
+    if (o.rungen_args.empty()) {
+        o.rungen_args = {"--default_input_buffers=random:0:estimate_then_auto",
+                         "--default_input_scalars=estimate",
+                         "--quiet"};
+    }
+    return o;
+}
+
+struct Candidate {
+    // The GeneratorParams to set.
+    std::vector<std::pair<std::string, std::string>> params;
+    // Identifies the candidate in the database.
+    std::string key;
+    // Where it's built.
+    std::string dir;
+    bool built = false;
+};
+
+std::string params_string(const Candidate &c) {
+    std::string s;
+    for (const auto &p : c.params) {
+        if (!s.empty()) {
+            s += " ";
+        }
+        s += p.first + "=" + p.second;
+    }
+    return s;
+}
+
+std::vector<Candidate> enumerate_candidates(const Options &o) {
+    // Every combination of the user's knobs.
+    std::vector<std::vector<std::pair<std::string, std::string>>> combos = {{}};
+    for (const auto &knob : o.knobs) {
+        std::vector<std::vector<std::pair<std::string, std::string>>> next;
+        for (const auto &combo : combos) {
+            for (const std::string &value : knob.second) {
+                next.push_back(combo);
+                next.back().emplace_back(knob.first, value);
+            }
+        }
+        combos.swap(next);
+    }
+
+    std::vector<Candidate> result;
+    for (const auto &combo : combos) {
+        Candidate c;
+        c.params = combo;
+        result.push_back(c);
+    }
+
+    // The auto-scheduler's knobs are the machine parameters it's
+    // told to schedule for.
+    if (o.auto_schedule) {
+        int cores = std::max(1u, std::thread::hardware_concurrency());
+        for (int parallelism : {cores, 2 * cores}) {
+            for (const char *cache : {"262144", "1048576", "8388608", "33554432"}) {
+                for (const char *balance : {"10", "40", "160"}) {
+                    for (const auto &combo : combos) {
+                        Candidate c;
+                        c.params = combo;
+                        c.params.emplace_back("auto_schedule", "true");
+                        c.params.emplace_back("machine_params",
+                                              std::to_string(parallelism) + "," + cache + "," + balance);
+                        result.push_back(c);
+                    }
+                }
+            }
+        }
+    }
+
+    std::string version = generator_version(o.generator);
+    for (Candidate &c : result) {
+        c.key = version + "\t" + o.name + "\t" + o.target + "\t" + o.machine + "\t" + params_string(c);
+        char id[32];
+        snprintf(id, sizeof(id), "%016llx", (unsigned long long)fnv1a(c.key));
+        c.dir = o.work_dir + "/" + id;
+    }
+    return result;
+}
+
+// The database is a text file with one line per result, holding the
+// fields of the key, the status ("ok", "compile_failed" or
+// "run_failed") and the time in seconds per iteration. Later lines
+// override earlier ones.
+struct Database {
+    struct Result {
+        std::string status;
+        double seconds = 0;
+    };
+    std::map<std::string, Result> results;
+    std::ofstream out;
+    std::mutex mutex;
+
+    explicit Database(const std::string &path) {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t last = line.rfind('\t');
+            if (last == std::string::npos) {
+                continue;
+            }
+            size_t status = line.rfind('\t', last - 1);
+            if (status == std::string::npos) {
+                continue;
+            }
+            Result r;
+            r.status = line.substr(status + 1, last - status - 1);
+            r.seconds = atof(line.c_str() + last + 1);
+            results[line.substr(0, status)] = r;
+        }
+        out.open(path, std::ios::app);
+        if (!out) {
+            fail("Can't open " + path);
+        }
+    }
+
+    void record(const std::string &key, const std::string &status, double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << key << "\t" << status << "\t" << seconds << "\n";
+        out.flush();
+        Result &r = results[key];
+        r.status = status;
+        r.seconds = seconds;
+    }
+};
+
+bool build(const Options &o, Candidate &c) {
+    make_dir(c.dir);
+    std::string log = c.dir + "/build.log";
+    std::ostringstream gen;
+    gen << quote(o.generator) << " -g " << quote(o.name) << " -f autotuned"
+        << " -o " << quote(c.dir) << " -e static_library,registration"
+        << " target=" << quote(o.target);
+    for (const auto &p : c.params) {
+        gen << " " << quote(p.first + "=" + p.second);
+    }
+    if (!run(gen.str(), log)) {
+        return false;
+    }
+
+    std::ostringstream link;
+    link << o.cxx << " -std=c++11 -O2 " << quote(o.rungen_main)
+         << " " << quote(c.dir + "/autotuned.registration.cpp")
+         << " " << quote(c.dir + "/autotuned.a")
+         << " " << o.cxx_flags
+         << " -o " << quote(c.dir + "/autotuned.rungen");
+    return run(link.str(), log);
+}
+
+// Benchmark a candidate with RunGen. Returns the best time per
+// iteration in seconds, or a negative number on failure.
+double benchmark(const Options &o, const Candidate &c) {
+    std::ostringstream cmd;
+    cmd << quote(c.dir + "/autotuned.rungen") << " --benchmarks=all";
+    for (const std::string &a : o.rungen_args) {
+        cmd << " " << quote(a);
+    }
+    std::string output;
+    bool ok = run_and_capture(cmd.str(), output);
+    {
+        std::ofstream f(c.dir + "/benchmark.log");
+        f << "$ " << cmd.str() << "\n" << output;
+    }
+    const std::string marker = "produces best case of ";
+    size_t pos = output.find(marker);
+    if (!ok || pos == std::string::npos) {
+        return -1;
+    }
+    return atof(output.c_str() + pos + marker.size());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options o = parse_options(argc, argv);
+    make_dir(o.work_dir);
+    if (!file_exists(o.work_dir)) {
+        fail("Can't create " + o.work_dir);
+    }
+
+    std::vector<Candidate> candidates = enumerate_candidates(o);
+    Database db(o.db);
+
+    std::vector<Candidate *> pending;
+    for (Candidate &c : candidates) {
+        auto it = db.results.find(c.key);
+        if (it == db.results.end() || (o.retry_failed && it->second.status != "ok")) {
+            pending.push_back(&c);
+        }
+    }
+    std::cout << candidates.size() << " candidates, " << (candidates.size() - pending.size())
+              << " already in " << o.db << "\n";
+
+    // Compile the pending candidates in parallel.
+    std::atomic<size_t> next(0);
+    std::mutex print_mutex;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < o.jobs; i++) {
+        workers.emplace_back([&]() {
+            size_t j;
+            while ((j = next++) < pending.size()) {
+                Candidate &c = *pending[j];
+                c.built = build(o, c);
+                if (!c.built) {
+                    db.record(c.key, "compile_failed", 0);
+                }
+                std::lock_guard<std::mutex> lock(print_mutex);
+                std::cout << (c.built ? "Built " : "Failed to build ") << c.dir
+                          << " (" << params_string(c) << ")\n";
+            }
+        });
+    }
+    for (std::thread &t : workers) {
+        t.join();
+    }
+
+    // Benchmark them one at a time, so they don't compete for the machine.
+    for (Candidate *c : pending) {
+        if (!c->built) {
+            continue;
+        }
+        double t = benchmark(o, *c);
+        if (t < 0) {
+            db.record(c->key, "run_failed", 0);
+            std::cout << "Failed to run " << c->dir << " (" << params_string(*c) << ")\n";
+        } else {
+            db.record(c->key, "ok", t);
+            std::cout << t * 1e3 << " ms: " << params_string(*c) << "\n";
+        }
+    }
+
+    // Report the best of all candidates, including earlier runs.
+    const Candidate *best = nullptr;
+    double best_time = 0;
+    for (const Candidate &c : candidates) {
+        auto it = db.results.find(c.key);
+        if (it != db.results.end() && it->second.status == "ok" &&
+            (!best || it->second.seconds < best_time)) {
+            best = &c;
+            best_time = it->second.seconds;
+        }
+    }
+    if (!best) {
+        std::cout << "No candidate ran successfully; see the logs in " << o.work_dir << "\n";
+        return 1;
+    }
+    std::cout << "Best: " << best_time * 1e3 << " ms: " << params_string(*best) << "\n";
+    return 0;
+}
@@ -332,9 +332,10 @@ int main(int argc, char * const *argv) {
 
     printf("[INFO] First pass...\n");
 
+    PacketReader first_pass(file_desc);
     for (;;) {
         Packet p;
-        if (!p.read_from_filedesc(file_desc)) {
+        if (!first_pass.read(&p)) {
             printf("[INFO] Finished pass 1 after %d packets.\n", packet_count);
             break;
         }
@@ -366,9 +367,10 @@ int main(int argc, char * const *argv) {
         pair.second.allocate();
     }
 
+    PacketReader second_pass(file_desc);
     for (;;) {
         Packet p;
-        if (!p.read_from_filedesc(file_desc)) {
+        if (!second_pass.read(&p)) {
             printf("[INFO] Finished pass 2 after %d packets.\n", packet_count);
             if (file_desc != nullptr) {
                 fclose(file_desc);
@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 
 namespace Halide {
 namespace Internal {
@@ -44,6 +45,220 @@ bool Packet::read(void *d, size_t size, FILE *fdesc) {
     return true;
 }
 
+namespace {
+
+void bad_trace(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(-1);
+}
+
+}  // namespace
+
+bool PacketReader::read(Packet *p) {
+    // Don't hold on to an unbounded number of packets waiting for one
+    // that never arrives, e.g. because the trace was cut short.
+    const size_t max_pending_bytes = 256 * 1024 * 1024;
+
+    while (true) {
+        if (!pending.empty()) {
+            auto it = pending.begin();
+            if (it->first == next_id || draining || eof || pending_bytes > max_pending_bytes) {
+                const std::vector<uint8_t> &packet = it->second;
+                memcpy((void *)p, packet.data(), packet.size());
+                next_id = it->first + 1;
+                pending_bytes -= packet.size();
+                pending.erase(it);
+                return true;
+            }
+        } else if (!bare.empty()) {
+            memcpy((void *)p, bare.data(), bare.size());
+            bare.clear();
+            draining = false;
+            next_id = p->id + 1;
+            return true;
+        } else if (draining) {
+            // A new stream is starting.
+            draining = false;
+            next_id = 1;
+        } else if (eof) {
+            return false;
+        }
+        if (!draining && !eof && !read_more()) {
+            eof = true;
+        }
+    }
+}
+
+bool PacketReader::read_or_eof(void *d, size_t size) {
+    size_t s = fread(d, 1, size, fdesc);
+    if (s != size) {
+        if (ferror(fdesc) || !feof(fdesc)) {
+            perror("Failed during read");
+            exit(-1);
+        }
+        if (s) {
+            bad_trace("Unexpected EOF mid-packet");
+        }
+        return false;
+    }
+    return true;
+}
+
+bool PacketReader::read_more() {
+    uint32_t first_word;
+    if (!read_or_eof(&first_word, sizeof(first_word))) {
+        return false;
+    }
+
+    if (first_word != halide_trace_block_magic) {
+        // A bare packet, as written by older runtimes.
+        uint32_t size = first_word;
+        if (size < sizeof(halide_trace_packet_t) || size > sizeof(Packet)) {
+            fprintf(stderr, "Bad packet size in trace stream (%d)\n", (int)size);
+            exit(-1);
+        }
+        bare.resize(size);
+        memcpy(bare.data(), &first_word, sizeof(first_word));
+        if (!read_or_eof(bare.data() + sizeof(first_word), size - sizeof(first_word))) {
+            bad_trace("Unexpected EOF mid-packet");
+        }
+        draining = true;
+        return true;
+    }
+
+    halide_trace_block_t block;
+    block.magic = first_word;
+    uint32_t rest[2];
+    if (!read_or_eof(rest, sizeof(rest))) {
+        bad_trace("Unexpected EOF mid-block");
+    }
+    block.flags = rest[0];
+    block.size = rest[1];
+
+    std::vector<uint8_t> data((block.size + 3) & ~3);
+    if (!read_or_eof(data.data(), data.size())) {
+        bad_trace("Unexpected EOF mid-block");
+    }
+
+    if (block.flags & halide_trace_block_stream_start) {
+        draining = true;
+    }
+
+    if (block.flags & halide_trace_block_delta_coded) {
+        decode_delta_coded(data.data(), data.data() + block.size);
+    } else {
+        uint32_t offset = 0;
+        while (offset < block.size) {
+            uint32_t size;
+            memcpy(&size, data.data() + offset, sizeof(size));
+            if (size < sizeof(halide_trace_packet_t) || size > block.size - offset) {
+                fprintf(stderr, "Bad packet size in trace stream (%d)\n", (int)size);
+                exit(-1);
+            }
+            add_pending(std::vector<uint8_t>(data.begin() + offset, data.begin() + offset + size));
+            offset += size;
+        }
+    }
+    return true;
+}
+
+void PacketReader::decode_delta_coded(const uint8_t *src, const uint8_t *end) {
+    auto get_bytes = [&](size_t n) {
+        if ((size_t)(end - src) < n) {
+            bad_trace("Truncated packet in delta-coded trace block");
+        }
+        const uint8_t *result = src;
+        src += n;
+        return result;
+    };
+    auto get_varint = [&]() {
+        uint32_t x = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t b = *get_bytes(1);
+            x |= (uint32_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return x;
+            }
+        }
+        bad_trace("Bad varint in delta-coded trace block");
+        return x;
+    };
+    // Undo the zig-zag coding of the difference from base.
+    auto get_delta = [&](int32_t base) {
+        uint32_t z = get_varint();
+        return (int32_t)((uint32_t)base + ((z >> 1) ^ (0u - (z & 1))));
+    };
+
+    int32_t prev_id = 0;
+    std::vector<int32_t> coords, prev_coords;
+    std::string name, prev_name;
+    bool first = true;
+    while (src < end) {
+        halide_trace_packet_t header;
+        header.id = get_delta(prev_id);
+        header.type.code = (halide_type_code_t)*get_bytes(1);
+        header.type.bits = *get_bytes(1);
+        header.type.lanes = (uint16_t)get_varint();
+        header.event = (halide_trace_event_code_t)get_varint();
+        header.parent_id = (int32_t)((uint32_t)header.id - (uint32_t)get_delta(0));
+        header.value_index = (int32_t)get_varint();
+        header.dimensions = (int32_t)get_varint();
+
+        bool same_dims = !first && (int32_t)prev_coords.size() == header.dimensions;
+        coords.resize(header.dimensions);
+        for (int32_t i = 0; i < header.dimensions; i++) {
+            coords[i] = get_delta(same_dims ? prev_coords[i] : 0);
+        }
+
+        size_t value_bytes = header.type.lanes * header.type.bytes();
+        const uint8_t *value = get_bytes(value_bytes);
+
+        uint32_t name_bytes = get_varint();
+        if (name_bytes) {
+            const uint8_t *n = get_bytes(name_bytes - 1);
+            name.assign((const char *)n, name_bytes - 1);
+        } else if (first) {
+            bad_trace("Missing func name in delta-coded trace block");
+        } else {
+            name = prev_name;
+        }
+
+        uint32_t trace_tag_bytes = get_varint();
+        const uint8_t *trace_tag = get_bytes(trace_tag_bytes);
+
+        // Lay the packet out as the runtime does.
+        size_t size = (sizeof(halide_trace_packet_t) + coords.size() * sizeof(int32_t) +
+                       value_bytes + name.size() + 1 + trace_tag_bytes + 1 + 3) & ~3;
+        std::vector<uint8_t> packet(size, 0);
+        halide_trace_packet_t *p = (halide_trace_packet_t *)packet.data();
+        header.size = (uint32_t)size;
+        memcpy((void *)p, &header, sizeof(header));
+        memcpy(p->coordinates(), coords.data(), coords.size() * sizeof(int32_t));
+        memcpy(p->value(), value, value_bytes);
+        memcpy(p->func(), name.c_str(), name.size() + 1);
+        memcpy(p->trace_tag(), trace_tag, trace_tag_bytes);
+        add_pending(std::move(packet));
+
+        prev_id = header.id;
+        prev_coords.swap(coords);
+        prev_name.swap(name);
+        first = false;
+    }
+}
+
+void PacketReader::add_pending(std::vector<uint8_t> packet) {
+    if (packet.size() > sizeof(Packet)) {
+        fprintf(stderr, "Payload larger than %d bytes in trace stream (%d)\n",
+                (int)(sizeof(Packet) - sizeof(halide_trace_packet_t)),
+                (int)(packet.size() - sizeof(halide_trace_packet_t)));
+        abort();
+    }
+    int32_t id = ((const halide_trace_packet_t *)packet.data())->id;
+    std::vector<uint8_t> &slot = pending[id];
+    pending_bytes += packet.size() - slot.size();
+    slot = std::move(packet);
+}
+
 void bad_type_error(halide_type_t type) {
     fprintf(stderr, "Can't convert packet with type: %d bits: %d\n", type.code, type.bits);
     exit(-1);
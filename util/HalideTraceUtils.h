@@ -4,6 +4,8 @@
 #include "HalideRuntime.h"
 #include <stdio.h>
 #include <cstring>
+#include <map>
+#include <vector>
 
 namespace Halide {
 namespace Internal {
@@ -94,6 +96,48 @@ private:
     bool read(void *d, size_t size, FILE *fdesc);
 };
 
+// Reads the packets in a binary trace. The runtime writes packets in
+// blocks, which may be delta coded and are not in order relative to
+// each other, so this decodes the blocks and returns the packets in
+// order of id.
+class PacketReader {
+public:
+    explicit PacketReader(FILE *fdesc) : fdesc(fdesc) {}
+
+    // Grab the next packet. Returns false when the end is reached.
+    bool read(Packet *p);
+
+private:
+    // Read the next block or bare packet from the file. Returns false
+    // at the end of the file.
+    bool read_more();
+
+    // Do a blocking read, failing if only part of the data is there.
+    bool read_or_eof(void *d, size_t size);
+
+    void decode_delta_coded(const uint8_t *src, const uint8_t *end);
+    void add_pending(std::vector<uint8_t> packet);
+
+    FILE *fdesc;
+
+    // Packets read but not yet returned, by id.
+    std::map<int32_t, std::vector<uint8_t>> pending;
+    size_t pending_bytes = 0;
+
+    // The id of the next packet to return.
+    int32_t next_id = 1;
+
+    // A bare packet, to be returned once the pending packets are.
+    std::vector<uint8_t> bare;
+
+    // Set when everything pending must be returned before reading
+    // more, because a new stream is starting or a bare packet was
+    // read.
+    bool draining = false;
+
+    bool eof = false;
+};
+
 }
 }
 